@@ -0,0 +1,86 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_BATCHED_UNIFORM_RANDOM_H_
+#define LYRA_CODEC_BATCHED_UNIFORM_RANDOM_H_
+
+#if defined __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <random>
+
+namespace chromemedia {
+namespace codec {
+
+// Writes |num_values| floats to |values|, the same ones and in the same order
+// as |num_values| calls to std::uniform_real_distribution<float>()(*gen), and
+// leaves |gen| in the same state as those calls would.
+// With AVX2, blocks of 8 values take one call to |gen|, and the 7 values which
+// follow are computed at once by jumping ahead from it.
+inline void DrawUniformFloats(std::minstd_rand* gen, int num_values,
+                              float* values) {
+  int i = 0;
+#if defined __AVX2__
+  static_assert(std::minstd_rand::modulus == 0x7fffffff,
+                "The reduction below relies on a Mersenne prime modulus.");
+  // The multiplier to the power of 0 to 7, modulo the modulus, which take the
+  // state to the 0th to 7th next one.
+  const __m256i powers_low =
+      _mm256_setr_epi64x(1, 48271, 182605794, 1291394886);
+  const __m256i powers_high =
+      _mm256_setr_epi64x(1914720637, 2078669041, 407355683, 1105902161);
+  const __m256i modulus = _mm256_set1_epi64x(std::minstd_rand::modulus);
+  // Takes the 32 bit lanes which hold the states in the order of the powers,
+  // after the high ones are shifted into the odd lanes of the low ones.
+  const __m256i interleaved_order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  // std::generate_canonical() divides by the range of the generator rounded to
+  // a float, which is 2^31, and returns the largest float below 1 instead of 1.
+  const __m256 inv_range = _mm256_set1_ps(1.0f / 2147483648.0f);
+  const __m256 below_one = _mm256_set1_ps(0.99999994f);
+  const __m256i min_value = _mm256_set1_epi32(std::minstd_rand::min());
+  // Reduces products of two states, which are below 2^62, modulo 2^31 - 1.
+  auto reduce = [&modulus](__m256i product) {
+    product = _mm256_add_epi64(_mm256_and_si256(product, modulus),
+                               _mm256_srli_epi64(product, 31));
+    // A remainder of 0 cannot occur, so neither can the modulus itself.
+    return _mm256_add_epi64(_mm256_and_si256(product, modulus),
+                            _mm256_srli_epi64(product, 31));
+  };
+  for (; i + 8 <= num_values; i += 8) {
+    const __m256i state = _mm256_set1_epi64x((*gen)());
+    const __m256i states_low = reduce(_mm256_mul_epu32(state, powers_low));
+    const __m256i states_high = reduce(_mm256_mul_epu32(state, powers_high));
+    // Each state fits in the low 32 bits of its 64 bit lane.
+    __m256i states = _mm256_or_si256(states_low,
+                                     _mm256_slli_epi64(states_high, 32));
+    states = _mm256_permutevar8x32_epi32(states, interleaved_order);
+    gen->seed(_mm256_extract_epi32(states, 7));
+    __m256 uniform = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_sub_epi32(states, min_value)), inv_range);
+    _mm256_storeu_ps(values + i, _mm256_min_ps(uniform, below_one));
+  }
+#endif  // __AVX2__
+  std::uniform_real_distribution<float> dist;
+  for (; i < num_values; ++i) {
+    values[i] = dist(*gen);
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_BATCHED_UNIFORM_RANDOM_H_
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "batched_uniform_random.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(BatchedUniformRandomTest, MatchesUniformRealDistribution) {
+  std::minstd_rand batched_gen(17);
+  std::minstd_rand gen(17);
+  std::uniform_real_distribution<float> dist;
+  // Covers partial, single and several blocks, one after the other.
+  for (const int num_values : {0, 1, 7, 8, 9, 16, 100}) {
+    std::vector<float> values(num_values);
+    DrawUniformFloats(&batched_gen, num_values, values.data());
+    for (int i = 0; i < num_values; ++i) {
+      EXPECT_EQ(values[i], dist(gen)) << "Value " << i << " of " << num_values;
+    }
+    EXPECT_EQ(batched_gen, gen);
+  }
+}
+
+TEST(BatchedUniformRandomTest, StaysBelowOne) {
+  // The state before the largest one, which would map to one if it were not
+  // replaced by the largest float below one.
+  std::minstd_rand gen(247665088);
+  std::minstd_rand expected_gen = gen;
+  ASSERT_EQ(expected_gen(), std::minstd_rand::max());
+
+  std::vector<float> values(8);
+  DrawUniformFloats(&gen, values.size(), values.data());
+  EXPECT_LT(values[0], 1.0f);
+  for (const float value : values) {
+    EXPECT_GE(value, 0.0f);
+    EXPECT_LT(value, 1.0f);
+  }
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
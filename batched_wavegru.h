@@ -0,0 +1,506 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_BATCHED_WAVEGRU_H_
+#define LYRA_CODEC_BATCHED_WAVEGRU_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "batched_uniform_random.h"
+#include "causal_convolutional_conditioning.h"
+#include "dsp_util.h"
+#include "lyra_types.h"
+#include "lyra_wavegru.h"
+#include "model_store.h"
+#include "project_and_sample.h"
+#include "sparse_matmul/sparse_matmul.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Runs the sampling loop of LyraWavegru for many independent streams at once
+// on the calling thread. The states of the streams are stacked as the columns
+// of one matrix per layer, so that every weight block is loaded once per step
+// for all of them. The gates take the AR inputs with the same dense weights
+// and kernel as LyraWavegru, and each stream is sampled by the sampling code
+// of ProjectAndSample. Each stream keeps its own conditioning, generator and
+// samples, and produces the same samples as a single threaded LyraWavegru,
+// whichever streams it is batched with.
+//
+// Streams may join and leave between calls to Sample(), which callers are
+// expected to make once per packet. To use more cores, run one instance per
+// core; the weights are shared through the ModelStore.
+template <typename WeightTypeKind>
+class BatchedWavegru {
+ public:
+  using Types = WavegruTypes<WeightTypeKind>;
+  using ArRhsType = typename Types::ArRhsType;
+  using GruWeightType = typename Types::GruWeightType;
+  using GruStateType = typename Types::GruStateType;
+  using GruRhsType = typename Types::GruRhsType;
+  using DiskWeightType = typename Types::DiskWeightType;
+
+  using SampleTypes = ProjectAndSampleTypes<WeightTypeKind>;
+  using ProjWeightType = typename SampleTypes::ProjWeightType;
+  using ProjRhsType = typename SampleTypes::ProjRhsType;
+  using ProjMatMulOutType = typename SampleTypes::ProjMatMulOutType;
+  using MixWeightType = typename SampleTypes::MixWeightType;
+  using MeanWeightType = typename SampleTypes::MeanWeightType;
+  using ScaleWeightType = typename SampleTypes::ScaleWeightType;
+  using MixMatMulOutType =
+      typename csrblocksparse::TypeOfProduct<MixWeightType,
+                                             ProjMatMulOutType>::type;
+  using MeanMatMulOutType =
+      typename csrblocksparse::TypeOfProduct<MeanWeightType,
+                                             ProjMatMulOutType>::type;
+  using ScaleMatMulOutType =
+      typename csrblocksparse::TypeOfProduct<ScaleWeightType,
+                                             ProjMatMulOutType>::type;
+
+  using GruGatesType =
+      csrblocksparse::GruGates<GruStateType, GruRhsType, ArRhsType>;
+  using ConditioningType =
+      CausalConvolutionalConditioning<ConditioningTypes<WeightTypeKind>>;
+  using ProjectAndSampleType = ProjectAndSample<SampleTypes>;
+
+  // Returns a nullptr on failure. The weights and biases are shared with all
+  // other users of |model_store|, including single stream LyraWavegru
+  // instances.
+  static std::unique_ptr<BatchedWavegru<WeightTypeKind>> Create(
+      int max_num_streams, std::shared_ptr<ModelStore> model_store,
+      const std::string& prefix) {
+    if (max_num_streams < 1) {
+      std::cerr << "Maximum number of streams must be positive, got "
+                << max_num_streams << "." << std::endl;
+      return nullptr;
+    }
+    std::shared_ptr<const ArToGatesWeightsType> ar_to_gates_weights;
+    std::shared_ptr<const GruLayerType> gru_layer;
+    std::shared_ptr<const ProjLayerType> proj_layer;
+    std::shared_ptr<const MixLayerType> mix_layer;
+    std::shared_ptr<const MeanLayerType> mean_layer;
+    std::shared_ptr<const ScaleLayerType> scale_layer;
+    model_store->RunConcurrently({
+        [&]() {
+          ar_to_gates_weights =
+              LyraWavegru<WeightTypeKind>::GetArToGatesWeights(
+                  model_store.get(), prefix + "_ar_to_gates_");
+        },
+        [&]() {
+          gru_layer = model_store->GetSparseLayer<
+              GruWeightType, GruStateType, DiskWeightType>(
+              prefix + "_gru_layer_", /*num_threads=*/1);
+        },
+        [&]() {
+          proj_layer = model_store->GetSparseLayer<
+              ProjWeightType, ProjRhsType, DiskWeightType>(prefix + "_proj_",
+                                                           /*num_threads=*/1);
+        },
+        [&]() {
+          mix_layer = model_store->GetLogitLayer<
+              MixWeightType, ProjMatMulOutType, DiskWeightType>(
+              prefix + "_mix_", /*num_threads=*/1);
+        },
+        [&]() {
+          mean_layer = model_store->GetLogitLayer<
+              MeanWeightType, ProjMatMulOutType, DiskWeightType>(
+              prefix + "_means_", /*num_threads=*/1);
+        },
+        [&]() {
+          scale_layer = model_store->GetLogitLayer<
+              ScaleWeightType, ProjMatMulOutType, DiskWeightType>(
+              prefix + "_scales_", /*num_threads=*/1);
+        },
+    });
+    if (ar_to_gates_weights == nullptr || gru_layer == nullptr ||
+        proj_layer == nullptr || mix_layer == nullptr ||
+        mean_layer == nullptr || scale_layer == nullptr) {
+      std::cerr << "Could not load the layers of " << prefix << "."
+                << std::endl;
+      return nullptr;
+    }
+    if (gru_layer->cols() != kNumGruHiddens ||
+        gru_layer->rows() != 3 * kNumGruHiddens ||
+        proj_layer->cols() != kNumGruHiddens ||
+        mix_layer->cols() != proj_layer->rows() ||
+        mean_layer->cols() != proj_layer->rows() ||
+        scale_layer->cols() != proj_layer->rows()) {
+      std::cerr << "Unexpected layer dimensions for " << prefix << "."
+                << std::endl;
+      return nullptr;
+    }
+    return absl::WrapUnique(new BatchedWavegru<WeightTypeKind>(
+        max_num_streams, std::move(ar_to_gates_weights), std::move(gru_layer),
+        std::move(proj_layer), std::move(mix_layer), std::move(mean_layer),
+        std::move(scale_layer)));
+  }
+
+  // Adds a stream in the same initial state as a new LyraWavegru, which reads
+  // its conditioning from |conditioning|. Returns the id of the stream, which
+  // stays valid until it is removed, or -1 if the batch is full.
+  int AddStream(ConditioningType* conditioning) {
+    if (num_streams() == max_num_streams_) {
+      std::cerr << "Cannot add more than " << max_num_streams_ << " streams."
+                << std::endl;
+      return -1;
+    }
+    const int stream_id = std::distance(
+        streams_.begin(),
+        std::find_if(streams_.begin(), streams_.end(),
+                     [](const Stream& stream) { return stream.column < 0; }));
+    const int column = num_streams();
+    Stream& stream = streams_[stream_id];
+    stream.column = column;
+    stream.conditioning = conditioning;
+    stream.conditioning_start = 0;
+    stream.gen = std::minstd_rand();
+    // Discard the first 10 samples to get the generator into a good state for
+    // sampling, as LyraWavegru does.
+    stream.gen.discard(10);
+    std::fill(ColumnData(&ar_input_, column),
+              ColumnData(&ar_input_, column) + ar_input_.rows(),
+              static_cast<ArRhsType>(0.f));
+    std::fill(ColumnData(&gru_state_, column),
+              ColumnData(&gru_state_, column) + gru_state_.rows(),
+              static_cast<GruStateType>(0.f));
+    stream_of_column_.push_back(stream_id);
+    return stream_id;
+  }
+
+  // Removes the stream with |stream_id|. The last column takes the place of
+  // the removed one, so that the active columns stay contiguous. Returns
+  // false if there is no such stream.
+  bool RemoveStream(int stream_id) {
+    if (!IsActive(stream_id)) {
+      std::cerr << "No stream with id " << stream_id << "." << std::endl;
+      return false;
+    }
+    const int column = streams_[stream_id].column;
+    const int last_column = num_streams() - 1;
+    if (column != last_column) {
+      std::copy(ColumnData(&ar_input_, last_column),
+                ColumnData(&ar_input_, last_column) + ar_input_.rows(),
+                ColumnData(&ar_input_, column));
+      std::copy(ColumnData(&gru_state_, last_column),
+                ColumnData(&gru_state_, last_column) + gru_state_.rows(),
+                ColumnData(&gru_state_, column));
+      const int moved_stream_id = stream_of_column_[last_column];
+      streams_[moved_stream_id].column = column;
+      stream_of_column_[column] = moved_stream_id;
+    }
+    stream_of_column_.pop_back();
+    streams_[stream_id] = Stream();
+    return true;
+  }
+
+  // Restarts reading the conditioning of |stream_id| from its first step,
+  // after its conditioning has been computed for a new packet.
+  void ResetConditioningStart(int stream_id) {
+    if (!IsActive(stream_id)) {
+      std::cerr << "No stream with id " << stream_id << "." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    streams_[stream_id].conditioning_start = 0;
+  }
+
+  // Generates up to |num_samples| samples for every stream in lockstep, at
+  // most as many as the stream with the least conditioning left has. Returns
+  // the number of samples generated per stream, which are available from
+  // split_band_samples() until the next call.
+  int Sample(int num_samples) {
+    if (num_samples % kNumSplitBands != 0 || num_samples < 0) {
+      std::cerr << "Number of samples must be a non-negative multiple of "
+                << kNumSplitBands << ", got " << num_samples << "."
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    const int num_columns = num_streams();
+    for (const int stream_id : stream_of_column_) {
+      const Stream& stream = streams_[stream_id];
+      num_samples =
+          std::min(num_samples, stream.conditioning->num_samples() -
+                                    stream.conditioning_start);
+    }
+    for (const int stream_id : stream_of_column_) {
+      for (auto& band : streams_[stream_id].split_band_samples) {
+        band.resize(num_samples / kNumSplitBands);
+      }
+    }
+    if (num_columns == 0) return 0;
+
+    auto gru_state = ActiveColumns(&gru_state_, kNumGruHiddens);
+    auto gru_gates = ActiveColumns(&gru_gates_, 3 * kNumGruHiddens);
+    auto proj_out = ActiveColumns(&proj_out_, proj_layer_->rows());
+    auto mixes = ActiveColumns(&mixes_, mixes_.rows());
+    auto means = ActiveColumns(&means_, means_.rows());
+    auto scales = ActiveColumns(&scales_, scales_.rows());
+    const float* ar_01_weights = ar_to_gates_weights_->data();
+    const float* ar_23_weights = ar_01_weights + 6 * kNumGruHiddens;
+    for (int s = 0; s < num_samples; s += kNumSplitBands) {
+      // Pass the states of all streams through the GRU layer. The gates of
+      // each stream add its conditioning and its AR samples times their dense
+      // weights themselves.
+      gru_layer_->SpMM_bias(gru_state, &gru_gates);
+      for (int column = 0; column < num_columns; ++column) {
+        const Stream& stream = streams_[stream_of_column_[column]];
+        ArRhsType* sample_at_sminus1 = ColumnData(&ar_input_, column);
+        gru_gates_kernel_.template GruWithARInput<
+            csrblocksparse::ARInputsMode::k4ARInputs>(
+            0, kNumGruHiddens, /*state_size=*/kNumGruHiddens,
+            /*gru_recurrent_ptr=*/ColumnData(&gru_gates_, column),
+            /*input_ptr=*/
+            stream.conditioning->AtStep(stream.conditioning_start + s).data(),
+            /*gru_state_ptr=*/ColumnData(&gru_state_, column),
+            &sample_at_sminus1[0], &sample_at_sminus1[1], ar_01_weights,
+            /*num_replicas=*/1, /*replica_stride=*/0, &sample_at_sminus1[2],
+            ar_23_weights);
+      }
+
+      // Project and compute the mixture of logistics of all streams.
+      proj_layer_->SpMM_bias(gru_state, &proj_out, /*relu=*/true);
+      mix_layer_->SpMM_bias(proj_out, &mixes);
+      mean_layer_->SpMM_bias(proj_out, &means);
+      scale_layer_->SpMM_bias(proj_out, &scales);
+
+      // Sample each stream with its own generator, and loop back the samples
+      // as its AR inputs of the next step.
+      for (int column = 0; column < num_columns; ++column) {
+        Stream& stream = streams_[stream_of_column_[column]];
+        SampleColumn(column, &stream.gen);
+        ArRhsType* sample_at_sminus1 = ColumnData(&ar_input_, column);
+        for (int i = 0; i < kNumSplitBands; ++i) {
+          sample_at_sminus1[i] =
+              static_cast<ArRhsType>(SampleToFloat(sample_at_s_[i]));
+          stream.split_band_samples[i][s / kNumSplitBands] = sample_at_s_[i];
+        }
+      }
+    }
+    for (const int stream_id : stream_of_column_) {
+      streams_[stream_id].conditioning_start += num_samples;
+    }
+    return num_samples;
+  }
+
+  // The samples of |stream_id| generated by the last call to Sample(), one
+  // vector per band.
+  const std::vector<std::vector<int16_t>>& split_band_samples(
+      int stream_id) const {
+    return streams_[stream_id].split_band_samples;
+  }
+
+  bool IsActive(int stream_id) const {
+    return stream_id >= 0 && stream_id < max_num_streams_ &&
+           streams_[stream_id].column >= 0;
+  }
+
+  int num_streams() const { return stream_of_column_.size(); }
+
+  int max_num_streams() const { return max_num_streams_; }
+
+  int num_gru_hiddens() const { return kNumGruHiddens; }
+
+  int num_split_bands() const { return kNumSplitBands; }
+
+ private:
+  static constexpr int kNumGruHiddens = 1024;
+  static constexpr int kNumSplitBands = 4;
+  // Columns start on this many elements, so that every column is as aligned
+  // as the first one.
+  static constexpr int kColumnAlignment = 16;
+  // As the defaults of ProjectAndSample.
+  static constexpr float kProbabilityOffset = 1e-5f;
+  static constexpr float kTemperature = 1.f;
+
+  using ArToGatesWeightsType = csrblocksparse::CacheAlignedVector<float>;
+  using GruLayerType =
+      csrblocksparse::SparseLinearLayer<GruWeightType, GruStateType>;
+  using ProjLayerType =
+      csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType>;
+  using MixLayerType =
+      csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType>;
+  using MeanLayerType =
+      csrblocksparse::SparseLinearLayer<MeanWeightType, ProjMatMulOutType>;
+  using ScaleLayerType =
+      csrblocksparse::SparseLinearLayer<ScaleWeightType, ProjMatMulOutType>;
+
+  struct Stream {
+    // Column of the stream in the state matrices, or -1 if the id is free.
+    int column = -1;
+    ConditioningType* conditioning = nullptr;
+    int conditioning_start = 0;
+    std::minstd_rand gen;
+    std::vector<std::vector<int16_t>> split_band_samples =
+        std::vector<std::vector<int16_t>>(kNumSplitBands);
+  };
+
+  BatchedWavegru() = delete;
+
+  BatchedWavegru(
+      int max_num_streams,
+      std::shared_ptr<const ArToGatesWeightsType> ar_to_gates_weights,
+      std::shared_ptr<const GruLayerType> gru_layer,
+      std::shared_ptr<const ProjLayerType> proj_layer,
+      std::shared_ptr<const MixLayerType> mix_layer,
+      std::shared_ptr<const MeanLayerType> mean_layer,
+      std::shared_ptr<const ScaleLayerType> scale_layer)
+      : max_num_streams_(max_num_streams),
+        ar_to_gates_weights_(std::move(ar_to_gates_weights)),
+        gru_layer_(std::move(gru_layer)),
+        proj_layer_(std::move(proj_layer)),
+        mix_layer_(std::move(mix_layer)),
+        mean_layer_(std::move(mean_layer)),
+        scale_layer_(std::move(scale_layer)),
+        streams_(max_num_streams),
+        uniforms_(2 * kNumSplitBands),
+        mixture_indices_(kNumSplitBands),
+        sample_at_s_(kNumSplitBands) {
+    stream_of_column_.reserve(max_num_streams_);
+    // Working space for activations, one column per stream.
+    ar_input_ = Columns<ArRhsType>(kNumSplitBands);
+    gru_state_ = Columns<GruStateType>(kNumGruHiddens);
+    gru_gates_ = Columns<GruRhsType>(3 * kNumGruHiddens);
+    proj_out_ = Columns<ProjMatMulOutType>(proj_layer_->rows());
+
+    // As in ProjectAndSample, the mixture outputs are padded to the SIMD
+    // width, and the padding of the mixes is set to a value that does not
+    // disturb the softmax.
+    int output_bins = mix_layer_->rows();
+#ifdef __AVX2__
+    output_bins = ((output_bins + kSIMDWidth - 1) / kSIMDWidth) * kSIMDWidth;
+#endif  // __AVX2__
+    mixes_ = csrblocksparse::FatCacheAlignedVector<MixMatMulOutType>(
+        output_bins, max_num_streams_);
+    std::fill(mixes_.data(), mixes_.data() + mixes_.size(),
+              static_cast<MixMatMulOutType>(
+                  std::numeric_limits<float>::lowest()));
+    means_ = csrblocksparse::FatCacheAlignedVector<MeanMatMulOutType>(
+        output_bins, max_num_streams_);
+    means_.FillZero();
+    scales_ = csrblocksparse::FatCacheAlignedVector<ScaleMatMulOutType>(
+        output_bins, max_num_streams_);
+    scales_.FillZero();
+    mix_logits_ = csrblocksparse::CacheAlignedVector<float>(output_bins);
+    mixture_exps_ = csrblocksparse::CacheAlignedVector<float>(output_bins);
+  }
+
+  // Returns a matrix with room for |rows| rows of every stream.
+  template <typename T>
+  csrblocksparse::FatCacheAlignedVector<T> Columns(int rows) const {
+    csrblocksparse::FatCacheAlignedVector<T> columns(
+        ((rows + kColumnAlignment - 1) / kColumnAlignment) * kColumnAlignment,
+        max_num_streams_);
+    columns.FillZero();
+    return columns;
+  }
+
+  // Returns a view of the first |rows| rows of the columns of the active
+  // streams in |columns|.
+  template <typename T>
+  csrblocksparse::MutableVectorView<T> ActiveColumns(
+      csrblocksparse::FatCacheAlignedVector<T>* columns, int rows) const {
+    return csrblocksparse::MutableVectorView<T>(
+        columns->data(), rows, num_streams(), columns->col_stride());
+  }
+
+  template <typename T>
+  static T* ColumnData(csrblocksparse::FatCacheAlignedVector<T>* columns,
+                       int column) {
+    return columns->data() + column * columns->col_stride();
+  }
+
+  // Samples the mixture of logistics in |column| into |sample_at_s_| as
+  // ProjectAndSample does for a single stream on a single thread: the random
+  // numbers of all bands are drawn at once, the mixtures first.
+  void SampleColumn(int column, std::minstd_rand* gen) {
+    const MixMatMulOutType* mixes = ColumnData(&mixes_, column);
+    const int mixtures_per_sample = mixes_.rows() / kNumSplitBands;
+    DrawUniformFloats(gen, 2 * kNumSplitBands, uniforms_.data());
+    for (int i = 0; i < kNumSplitBands; ++i) {
+      const int begin = i * mixtures_per_sample;
+      const int end = begin + mixtures_per_sample;
+      float max_value = std::numeric_limits<float>::lowest();
+      for (int j = begin; j < end; ++j) {
+        mix_logits_[j] = static_cast<float>(mixes[j]);
+        max_value = std::max(max_value, mix_logits_[j]);
+      }
+      mixture_indices_[i] = ProjectAndSampleType::SampleMixture(
+          mix_logits_.data(), begin, end, max_value, kTemperature,
+          uniforms_[i], mixture_exps_.data());
+    }
+    ProjectAndSampleType::SampleLogistics(
+        kNumSplitBands, uniforms_.data() + kNumSplitBands,
+        mixture_indices_.data(), ColumnData(&means_, column),
+        ColumnData(&scales_, column), kProbabilityOffset,
+        sample_at_s_.data());
+  }
+
+  // The range [-32768, 32767] is mapped to floating point by x / 32768.0f
+  // resulting in a range of [-1.f, 1.f).
+  static float SampleToFloat(int sample) {
+    return static_cast<float>(sample) / 32768.0f;
+  }
+
+  // Maximum possible width of a SIMD register in floats.
+  static constexpr int kSIMDWidth = 16;
+
+  const int max_num_streams_;
+
+  // Weights, shared with all other users of the model store. The AR inputs
+  // to the gates are dense, see LyraWavegru::GetArToGatesWeights().
+  std::shared_ptr<const ArToGatesWeightsType> ar_to_gates_weights_;
+  std::shared_ptr<const GruLayerType> gru_layer_;
+  std::shared_ptr<const ProjLayerType> proj_layer_;
+  std::shared_ptr<const MixLayerType> mix_layer_;
+  std::shared_ptr<const MeanLayerType> mean_layer_;
+  std::shared_ptr<const ScaleLayerType> scale_layer_;
+  GruGatesType gru_gates_kernel_;
+
+  // Streams by id, and the id of the stream in each active column.
+  std::vector<Stream> streams_;
+  std::vector<int> stream_of_column_;
+
+  // Buffers, with one column per stream.
+  csrblocksparse::FatCacheAlignedVector<ArRhsType> ar_input_;
+  csrblocksparse::FatCacheAlignedVector<GruStateType> gru_state_;
+  csrblocksparse::FatCacheAlignedVector<GruRhsType> gru_gates_;
+  csrblocksparse::FatCacheAlignedVector<ProjMatMulOutType> proj_out_;
+  csrblocksparse::FatCacheAlignedVector<MixMatMulOutType> mixes_;
+  csrblocksparse::FatCacheAlignedVector<MeanMatMulOutType> means_;
+  csrblocksparse::FatCacheAlignedVector<ScaleMatMulOutType> scales_;
+
+  // Scratch space for sampling one stream at a time.
+  csrblocksparse::CacheAlignedVector<float> mix_logits_;
+  csrblocksparse::CacheAlignedVector<float> mixture_exps_;
+  std::vector<float> uniforms_;
+  std::vector<int> mixture_indices_;
+  std::vector<int> sample_at_s_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_BATCHED_WAVEGRU_H_
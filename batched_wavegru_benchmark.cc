@@ -0,0 +1,90 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of sampling one packet for a range of batch sizes
+// on a single thread. The items per second reported are samples of all
+// streams together, so the gain of batching is their ratio to the single
+// stream case.
+
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "batched_wavegru.h"
+#include "benchmark/benchmark.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "model_store.h"
+#include "sparse_matmul/sparse_matmul.h"
+
+namespace {
+
+constexpr int kNumCondHiddens = 512;
+constexpr int kNumGruHiddens = 1024;
+constexpr char kModelPrefix[] = "lyra_16khz";
+
+#ifdef USE_FIXED16
+using ComputeType = csrblocksparse::fixed16_type;
+#else
+using ComputeType = float;
+#endif  // USE_FIXED16
+
+using BatchedWavegruType = chromemedia::codec::BatchedWavegru<ComputeType>;
+
+// |state.range(0)| is the number of streams.
+void BM_BatchedWavegruSample(benchmark::State& state) {
+  const int num_streams = state.range(0);
+  auto model_store = chromemedia::codec::ModelStore::Create(
+      ghc::filesystem::current_path() / "wavegru");
+  auto batched_wavegru =
+      BatchedWavegruType::Create(num_streams, model_store, kModelPrefix);
+  // All streams read the same conditioning, which does not change the work.
+  BatchedWavegruType::ConditioningType conditioning(
+      chromemedia::codec::kNumFeatures, kNumCondHiddens, kNumGruHiddens,
+      chromemedia::codec::GetNumSamplesPerHop(
+          chromemedia::codec::kInternalSampleRateHz),
+      chromemedia::codec::kNumFramesPerPacket, /*num_threads=*/1,
+      /*silence_value=*/0.0f, model_store, kModelPrefix);
+  csrblocksparse::FatCacheAlignedVector<float> input(
+      chromemedia::codec::kNumFeatures, 1);
+  input.FillRandom();
+  conditioning.Precompute(input, 1);
+  std::vector<int> stream_ids;
+  for (int i = 0; i < num_streams; ++i) {
+    stream_ids.push_back(batched_wavegru->AddStream(&conditioning));
+  }
+  const int num_samples = conditioning.num_samples();
+  for (auto _ : state) {
+    for (const int stream_id : stream_ids) {
+      batched_wavegru->ResetConditioningStart(stream_id);
+    }
+    benchmark::DoNotOptimize(batched_wavegru->Sample(num_samples));
+  }
+  state.SetItemsProcessed(state.iterations() * num_streams * num_samples);
+}
+
+}  // namespace
+
+BENCHMARK(BM_BatchedWavegruSample)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(5)
+    ->Arg(8)
+    ->Arg(10)
+    ->Arg(16)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_MAIN();
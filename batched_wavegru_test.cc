@@ -0,0 +1,237 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "batched_wavegru.h"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Placeholder for get runfiles header.
+#include "absl/memory/memory.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_wavegru.h"
+#include "model_store.h"
+#include "sparse_matmul/sparse_matmul.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+#ifdef USE_FIXED16
+using ComputeType = csrblocksparse::fixed16_type;
+#elif USE_BFLOAT16
+using ComputeType = csrblocksparse::bfloat16;
+#else
+using ComputeType = float;
+#endif  // USE_FIXED16
+
+using BatchedWavegruType = BatchedWavegru<ComputeType>;
+using ConditioningType = BatchedWavegruType::ConditioningType;
+
+static constexpr int kNumCondHiddens = 512;
+static constexpr char kModelPrefix[] = "lyra_16khz";
+
+// The split band samples of one stream, packet after packet.
+using StreamSamples = std::vector<std::vector<std::vector<int16_t>>>;
+
+class BatchedWavegruTest : public testing::Test {
+ protected:
+  BatchedWavegruTest()
+      : model_store_(
+            ModelStore::Create(ghc::filesystem::current_path() / "wavegru")) {}
+
+  std::unique_ptr<ConditioningType> CreateConditioning() {
+    return absl::make_unique<ConditioningType>(
+        kNumFeatures, kNumCondHiddens, /*num_gru_hiddens=*/1024,
+        GetNumSamplesPerHop(kInternalSampleRateHz), kNumFramesPerPacket,
+        /*num_threads=*/1, /*silence_value=*/0.0f, model_store_, kModelPrefix);
+  }
+
+  // Distinct, reproducible features for each |stream| and |packet|.
+  static csrblocksparse::FatCacheAlignedVector<float> Features(int stream,
+                                                               int packet) {
+    std::minstd_rand gen(1 + 100 * stream + packet);
+    std::uniform_real_distribution<float> dist(-2.f, 2.f);
+    csrblocksparse::FatCacheAlignedVector<float> features(kNumFeatures, 1);
+    for (int i = 0; i < kNumFeatures; ++i) {
+      features[i] = dist(gen);
+    }
+    return features;
+  }
+
+  // Decodes |num_packets| packets of |stream| in a batch of its own.
+  StreamSamples DecodeAlone(int stream, int first_packet, int num_packets) {
+    auto batched_wavegru =
+        BatchedWavegruType::Create(1, model_store_, kModelPrefix);
+    auto conditioning = CreateConditioning();
+    const int stream_id = batched_wavegru->AddStream(conditioning.get());
+    StreamSamples samples;
+    for (int packet = first_packet; packet < first_packet + num_packets;
+         ++packet) {
+      conditioning->Precompute(Features(stream, packet), 1);
+      batched_wavegru->ResetConditioningStart(stream_id);
+      batched_wavegru->Sample(conditioning->num_samples());
+      samples.push_back(batched_wavegru->split_band_samples(stream_id));
+    }
+    return samples;
+  }
+
+  std::shared_ptr<ModelStore> model_store_;
+};
+
+TEST_F(BatchedWavegruTest, CreateFailsWithoutStreams) {
+  EXPECT_EQ(BatchedWavegruType::Create(0, model_store_, kModelPrefix),
+            nullptr);
+}
+
+TEST_F(BatchedWavegruTest, AddAndRemoveStreams) {
+  auto batched_wavegru =
+      BatchedWavegruType::Create(2, model_store_, kModelPrefix);
+  ASSERT_NE(batched_wavegru, nullptr);
+  auto conditioning = CreateConditioning();
+
+  const int first_id = batched_wavegru->AddStream(conditioning.get());
+  const int second_id = batched_wavegru->AddStream(conditioning.get());
+  EXPECT_NE(first_id, second_id);
+  EXPECT_EQ(batched_wavegru->num_streams(), 2);
+  EXPECT_EQ(batched_wavegru->AddStream(conditioning.get()), -1);
+
+  EXPECT_TRUE(batched_wavegru->RemoveStream(first_id));
+  EXPECT_FALSE(batched_wavegru->RemoveStream(first_id));
+  EXPECT_FALSE(batched_wavegru->IsActive(first_id));
+  EXPECT_TRUE(batched_wavegru->IsActive(second_id));
+  EXPECT_EQ(batched_wavegru->num_streams(), 1);
+
+  // The id of a removed stream is given to the next one.
+  EXPECT_EQ(batched_wavegru->AddStream(conditioning.get()), first_id);
+}
+
+TEST_F(BatchedWavegruTest, SampleWithoutStreams) {
+  auto batched_wavegru =
+      BatchedWavegruType::Create(1, model_store_, kModelPrefix);
+  ASSERT_NE(batched_wavegru, nullptr);
+  EXPECT_EQ(batched_wavegru->Sample(8), 0);
+}
+
+TEST_F(BatchedWavegruTest, SamplesDoNotDependOnTheBatch) {
+  // More than five streams, to go through both the five column and the
+  // single column kernels of the sparse matrix multiplications.
+  const int kNumStreams = 6;
+  const int kNumPackets = 2;
+  auto batched_wavegru =
+      BatchedWavegruType::Create(kNumStreams, model_store_, kModelPrefix);
+  ASSERT_NE(batched_wavegru, nullptr);
+  std::vector<std::unique_ptr<ConditioningType>> conditionings;
+  std::vector<int> stream_ids;
+  for (int stream = 0; stream < kNumStreams; ++stream) {
+    conditionings.push_back(CreateConditioning());
+    stream_ids.push_back(
+        batched_wavegru->AddStream(conditionings.back().get()));
+  }
+
+  std::vector<StreamSamples> batched_samples(kNumStreams);
+  for (int packet = 0; packet < kNumPackets; ++packet) {
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      conditionings[stream]->Precompute(Features(stream, packet), 1);
+      batched_wavegru->ResetConditioningStart(stream_ids[stream]);
+    }
+    const int num_samples = conditionings[0]->num_samples();
+    ASSERT_EQ(batched_wavegru->Sample(num_samples), num_samples);
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      batched_samples[stream].push_back(
+          batched_wavegru->split_band_samples(stream_ids[stream]));
+    }
+  }
+
+  for (int stream = 0; stream < kNumStreams; ++stream) {
+    EXPECT_EQ(batched_samples[stream], DecodeAlone(stream, 0, kNumPackets))
+        << "Stream " << stream;
+  }
+  // Distinct features give distinct samples.
+  EXPECT_NE(batched_samples[0], batched_samples[1]);
+}
+
+TEST_F(BatchedWavegruTest, MatchesLyraWavegru) {
+  const int kNumPackets = 3;
+  auto lyra_wavegru =
+      LyraWavegru<ComputeType>::Create(1, model_store_, kModelPrefix);
+  ASSERT_NE(lyra_wavegru, nullptr);
+  auto conditioning = CreateConditioning();
+
+  StreamSamples expected_samples;
+  for (int packet = 0; packet < kNumPackets; ++packet) {
+    conditioning->Precompute(Features(0, packet), 1);
+    lyra_wavegru->ResetConditioningStart();
+    const int num_samples = conditioning->num_samples();
+    const int num_split_bands = lyra_wavegru->num_split_bands();
+    std::vector<std::vector<int16_t>> split_band_samples(
+        num_split_bands, std::vector<int16_t>(num_samples / num_split_bands));
+    ASSERT_EQ(lyra_wavegru->SampleThreaded(0, conditioning.get(),
+                                           &split_band_samples, num_samples),
+              num_samples);
+    expected_samples.push_back(split_band_samples);
+  }
+
+  EXPECT_EQ(DecodeAlone(0, 0, kNumPackets), expected_samples);
+}
+
+TEST_F(BatchedWavegruTest, StreamsJoinAndLeaveAtPacketBoundaries) {
+  auto batched_wavegru = BatchedWavegruType::Create(3, model_store_,
+                                                    kModelPrefix);
+  ASSERT_NE(batched_wavegru, nullptr);
+  std::vector<std::unique_ptr<ConditioningType>> conditionings;
+  for (int stream = 0; stream < 3; ++stream) {
+    conditionings.push_back(CreateConditioning());
+  }
+  std::vector<int> stream_ids(3, -1);
+  std::vector<StreamSamples> batched_samples(3);
+  auto decode_packet = [&](int packet) {
+    for (int stream = 0; stream < 3; ++stream) {
+      if (stream_ids[stream] < 0) continue;
+      conditionings[stream]->Precompute(Features(stream, packet), 1);
+      batched_wavegru->ResetConditioningStart(stream_ids[stream]);
+    }
+    batched_wavegru->Sample(conditionings[0]->num_samples());
+    for (int stream = 0; stream < 3; ++stream) {
+      if (stream_ids[stream] < 0) continue;
+      batched_samples[stream].push_back(
+          batched_wavegru->split_band_samples(stream_ids[stream]));
+    }
+  };
+
+  // Streams 0 and 1 decode packet 0, stream 2 joins for packet 1, and stream
+  // 0, which is in the first column, leaves before packet 2.
+  stream_ids[0] = batched_wavegru->AddStream(conditionings[0].get());
+  stream_ids[1] = batched_wavegru->AddStream(conditionings[1].get());
+  decode_packet(0);
+  stream_ids[2] = batched_wavegru->AddStream(conditionings[2].get());
+  decode_packet(1);
+  ASSERT_TRUE(batched_wavegru->RemoveStream(stream_ids[0]));
+  stream_ids[0] = -1;
+  decode_packet(2);
+
+  EXPECT_EQ(batched_samples[0], DecodeAlone(0, 0, 2));
+  EXPECT_EQ(batched_samples[1], DecodeAlone(1, 0, 3));
+  EXPECT_EQ(batched_samples[2], DecodeAlone(2, 1, 2));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
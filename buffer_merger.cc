@@ -30,14 +30,22 @@
 namespace chromemedia {
 namespace codec {
 
-std::unique_ptr<BufferMerger> BufferMerger::Create(int num_bands) {
-  auto merge_filter = MergeFilter::Create(num_bands);
+std::unique_ptr<BufferMerger> BufferMerger::Create(int num_bands,
+                                                   int max_num_samples) {
+  // At most |num_bands - 1| more samples than requested are generated.
+  const int max_num_samples_to_generate = max_num_samples + num_bands - 1;
+  auto merge_filter =
+      MergeFilter::Create(num_bands, max_num_samples_to_generate);
   if (merge_filter == nullptr) {
-    fprintf(stderr, "Failed to create merge filter with %d bands.\n", num_bands);
+    fprintf(stderr, "Failed to create merge filter with %d bands.\n",
+            num_bands);
     return nullptr;
   }
 
-  return absl::WrapUnique(new BufferMerger(std::move(merge_filter)));
+  auto buffer_merger =
+      absl::WrapUnique(new BufferMerger(std::move(merge_filter)));
+  buffer_merger->merged_samples_.reserve(max_num_samples_to_generate);
+  return buffer_merger;
 }
 
 BufferMerger::BufferMerger(std::unique_ptr<MergeFilterInterface> merge_filter)
@@ -61,63 +69,76 @@ std::vector<int16_t> BufferMerger::BufferAndMerge(
     const std::function<const std::vector<std::vector<int16_t>>&(int)>&
         sample_generator,
     int num_samples) {
-  int num_samples_to_generate = GetNumSamplesToGenerate(num_samples);
+  std::vector<int16_t> samples(num_samples);
+  BufferAndMerge(sample_generator, absl::MakeSpan(samples));
+  return samples;
+}
+
+void BufferMerger::BufferAndMerge(
+    absl::FunctionRef<const std::vector<std::vector<int16_t>>&(int)>
+        sample_generator,
+    absl::Span<int16_t> samples) {
+  int num_samples_to_generate = GetNumSamplesToGenerate(samples.size());
 
   // 1. If we have any leftover samples from last time we must use them.
-  std::vector<int16_t> samples(num_samples);
-  const int num_leftover_used = UseLeftoverSamples(num_samples, &samples);
+  const int num_leftover_used = UseLeftoverSamples(samples);
 
   // 2. Generate samples using |sample_generator|.
   const std::vector<std::vector<int16_t>>& new_split_samples =
       sample_generator(num_samples_to_generate);
 
   // 3. Merge the buffer of split samples if needed to produce new samples.
-  const std::vector<int16_t> new_samples = MergeSamples(new_split_samples);
-  if (new_samples.size() != num_samples_to_generate) {
-    fprintf(stderr, "Failed to generate %d samples.\n",
-            num_samples_to_generate);
-    exit(EXIT_FAILURE);
-  }
+  const absl::Span<const int16_t> new_samples =
+      MergeSamples(new_split_samples, num_samples_to_generate);
 
   // 4. Copy the new samples to output and the leftover buffers.
-  CopyNewSamples(new_samples, num_samples, num_leftover_used, &samples);
-  return samples;
+  CopyNewSamples(new_samples, num_leftover_used, samples);
 }
 
-int BufferMerger::UseLeftoverSamples(int num_samples,
-                                     std::vector<int16_t>* samples) {
-  const int num_leftover_used =
-      std::min(static_cast<int>(leftover_samples_.size()), num_samples);
+int BufferMerger::UseLeftoverSamples(absl::Span<int16_t> samples) {
+  const int num_leftover_used = std::min(leftover_samples_.size(),
+                                         samples.size());
   std::move(leftover_samples_.begin(),
-            leftover_samples_.begin() + num_leftover_used, samples->begin());
+            leftover_samples_.begin() + num_leftover_used, samples.begin());
   std::move(leftover_samples_.begin() + num_leftover_used,
             leftover_samples_.end(), leftover_samples_.begin());
   leftover_samples_.resize(leftover_samples_.size() - num_leftover_used);
   return num_leftover_used;
 }
 
-std::vector<int16_t> BufferMerger::MergeSamples(
-    const std::vector<std::vector<int16_t>>& new_split_samples) {
+absl::Span<const int16_t> BufferMerger::MergeSamples(
+    const std::vector<std::vector<int16_t>>& new_split_samples,
+    int num_samples_to_generate) {
+  absl::Span<const int16_t> new_samples;
   // If there is only one band, no need to merge.
   if (num_bands_ == 1) {
-    return new_split_samples.at(0);
+    new_samples = absl::MakeConstSpan(new_split_samples.at(0));
+  } else {
+    // Otherwise merge the split samples.
+    merged_samples_.resize(num_samples_to_generate);
+    merge_filter_->Merge(new_split_samples, absl::MakeSpan(merged_samples_));
+    new_samples = absl::MakeConstSpan(merged_samples_);
+  }
+  if (new_samples.size() != num_samples_to_generate) {
+    fprintf(stderr, "Failed to generate %d samples.\n",
+            num_samples_to_generate);
+    exit(EXIT_FAILURE);
   }
-  // Otherwise merge the split samples.
-  return merge_filter_->Merge(new_split_samples);
+  return new_samples;
 }
 
-void BufferMerger::CopyNewSamples(const std::vector<int16_t>& new_samples,
-                                  int num_samples, int num_leftover_used,
-                                  std::vector<int16_t>* samples) {
+void BufferMerger::CopyNewSamples(absl::Span<const int16_t> new_samples,
+                                  int num_leftover_used,
+                                  absl::Span<int16_t> samples) {
   // Copy the needed samples to the destination, which already has some
   // leftover samples from the last run.
-  const int num_samples_to_copy = num_samples - num_leftover_used;
+  const int num_samples_to_copy = samples.size() - num_leftover_used;
   if (new_samples.size() < num_samples_to_copy) {
     fprintf(stderr, "Failed to generate %d samples.\n", num_samples_to_copy);
     exit(EXIT_FAILURE);
   }
   std::copy(new_samples.begin(), new_samples.begin() + num_samples_to_copy,
-            samples->begin() + num_leftover_used);
+            samples.begin() + num_leftover_used);
 
   // Store the rest in the |leftover_samples_|.
   leftover_samples_.insert(leftover_samples_.end(),
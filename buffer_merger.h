@@ -22,6 +22,8 @@
 #include <memory>
 #include <vector>
 
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
 #include "filter_banks_interface.h"
 
 namespace chromemedia {
@@ -32,7 +34,10 @@ namespace codec {
 // time domain samples in multiples of |num_bands|.
 class BufferMerger {
  public:
-  static std::unique_ptr<BufferMerger> Create(int num_bands);
+  // The buffers are allocated for requests of up to |max_num_samples| and grow
+  // on longer ones.
+  static std::unique_ptr<BufferMerger> Create(int num_bands,
+                                              int max_num_samples = 0);
 
   // Buffer the newly generated split samples and merge them to produce
   // |num_samples| samples.
@@ -41,6 +46,13 @@ class BufferMerger {
           sample_generator,
       int num_samples);
 
+  // Same as above, but writes the samples into |samples|, without allocating
+  // once the buffers are large enough.
+  void BufferAndMerge(
+      absl::FunctionRef<const std::vector<std::vector<int16_t>>&(int)>
+          sample_generator,
+      absl::Span<int16_t> samples);
+
   void Reset() { leftover_samples_.clear(); }
 
  private:
@@ -52,20 +64,23 @@ class BufferMerger {
   // bands.
   int GetNumSamplesToGenerate(int num_samples) const;
 
-  // Use at most |num_samples| from |leftover_samples_| to fill the beginning
-  // of |samples|.
-  int UseLeftoverSamples(int num_samples, std::vector<int16_t>* samples);
+  // Use at most |samples.size()| from |leftover_samples_| to fill the
+  // beginning of |samples|.
+  int UseLeftoverSamples(absl::Span<int16_t> samples);
 
-  std::vector<int16_t> MergeSamples(
-      const std::vector<std::vector<int16_t>>& new_split_samples);
+  absl::Span<const int16_t> MergeSamples(
+      const std::vector<std::vector<int16_t>>& new_split_samples,
+      int num_samples_to_generate);
 
-  void CopyNewSamples(const std::vector<int16_t>& new_samples, int num_samples,
-                      int num_leftover_used, std::vector<int16_t>* samples);
+  void CopyNewSamples(absl::Span<const int16_t> new_samples,
+                      int num_leftover_used, absl::Span<int16_t> samples);
 
   std::unique_ptr<MergeFilterInterface> merge_filter_;
   const int num_bands_;
   // Buffer of (at most |num_bands_ - 1|) leftover samples from the last run.
   std::vector<int16_t> leftover_samples_;
+  // The merged samples of the last run.
+  std::vector<int16_t> merged_samples_;
   friend class BufferMergerPeer;
 };
 
@@ -17,8 +17,11 @@
 #ifndef LYRA_CODEC_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
 #define LYRA_CODEC_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
 
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_format.h"
@@ -26,6 +29,7 @@
 #include "dsp_util.h"
 #include "layer_wrappers_lib.h"
 #include "lyra_types.h"
+#include "model_store.h"
 #include "sparse_matmul/sparse_matmul.h"
 
 namespace chromemedia {
@@ -97,38 +101,10 @@ class CausalConvolutionalConditioning {
                                   int num_frames_per_packet, int num_threads,
                                   float silence_value, const std::string& path,
                                   const std::string& prefix)
-      : feature_depth_(feature_depth),
-        num_hiddens_(num_hiddens),
-        num_cond_hiddens_(num_cond_hiddens),
-        num_samples_per_hop_(num_samples_per_hop),
-        num_frames_per_packet_(num_frames_per_packet),
-        num_threads_(num_threads),
-        path_(path),
-        prefix_(prefix),
-        num_precomputed_frames_(0) {
-    // Crash ok.
-    if (num_threads_ > num_cond_hiddens) {
-      std::cerr << "Number of threads must be <= the number of hidden layers "
-                   "but were "
-                << num_threads_ << " and " << num_cond_hiddens_ << std::endl;
-      exit(EXIT_FAILURE);
-    }
-    if (num_threads_ <= 0) {
-      std::cerr << "Number of threads must be > 0." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-    if (num_samples_per_hop_ <= 0) {
-      std::cerr << "Number of samples per hop must be > 0." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-    if (num_frames_per_packet_ <= 0) {
-      std::cerr << "Number of frames per packet must be > 0." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-    CreateLayers();
-    PrepareOutput();
-    WarmUp(silence_value);
-  }
+      : CausalConvolutionalConditioning(
+            feature_depth, num_cond_hiddens, num_hiddens, num_samples_per_hop,
+            num_frames_per_packet, num_threads, silence_value,
+            ModelStore::Create(path), prefix) {}
 
   CausalConvolutionalConditioning(int feature_depth, int num_cond_hiddens,
                                   int num_hiddens, int num_samples_per_hop,
@@ -136,16 +112,32 @@ class CausalConvolutionalConditioning {
                                   float silence_value,
                                   const WavegruBufferInterface& wavegru_buffer,
                                   const std::string& prefix)
+      : CausalConvolutionalConditioning(
+            feature_depth, num_cond_hiddens, num_hiddens, num_samples_per_hop,
+            num_frames_per_packet, num_threads, silence_value,
+            ModelStore::Create(wavegru_buffer), prefix) {
+    model_store_->ReleaseWavegruBuffer();
+  }
+
+  // The weights and biases of all layers are shared with all other users of
+  // |model_store|.
+  CausalConvolutionalConditioning(int feature_depth, int num_cond_hiddens,
+                                  int num_hiddens, int num_samples_per_hop,
+                                  int num_frames_per_packet, int num_threads,
+                                  float silence_value,
+                                  std::shared_ptr<ModelStore> model_store,
+                                  const std::string& prefix)
       : feature_depth_(feature_depth),
         num_hiddens_(num_hiddens),
         num_cond_hiddens_(num_cond_hiddens),
         num_samples_per_hop_(num_samples_per_hop),
         num_frames_per_packet_(num_frames_per_packet),
         num_threads_(num_threads),
-        path_("unused-path"),
+        model_store_(std::move(model_store)),
         prefix_(prefix),
-        num_precomputed_frames_(0) {
-
+        num_precomputed_frames_(0),
+        next_num_precomputed_frames_(0),
+        current_(0) {
     // Crash ok.
     if (num_threads_ > num_cond_hiddens) {
       std::cerr << "Number of threads must be <= the number of hidden layers "
@@ -165,14 +157,17 @@ class CausalConvolutionalConditioning {
       std::cerr << "Number of frames per packet must be > 0." << std::endl;
       exit(EXIT_FAILURE);
     }
-    CreateLayers(wavegru_buffer);
+    CreateLayers();
     PrepareOutput();
     WarmUp(silence_value);
+    thread_pool_ =
+        absl::make_unique<csrblocksparse::BarrierThreadPool>(num_threads_);
   }
 
   ~CausalConvolutionalConditioning() {}
 
   // Return the conditioning vector corresponding to |step| in sample domain.
+  // Safe to call while PrecomputeNext() runs on another thread.
   absl::Span<OutputType> AtStep(int step) {
     const int samples_per_cond_output =
         num_samples_per_hop_ / kCondUpsamplingRatio;
@@ -181,12 +176,24 @@ class CausalConvolutionalConditioning {
         samples_per_cond_output;
     const int num_output_elements = 3 * num_hiddens_;
     return absl::Span<OutputType>(
-        conditioning_.data() + conditioning_column * num_output_elements,
+        conditioning_[current_].data() +
+            conditioning_column * num_output_elements,
         num_output_elements);
   }
 
   void Precompute(const csrblocksparse::FatCacheAlignedVector<float>& input,
                   int num_threads) {
+    PrecomputeNext(input, num_threads);
+    UseNext();
+  }
+
+  // Computes the conditioning of |input| into a second buffer, leaving the
+  // one read by AtStep() and num_samples() untouched until UseNext() is
+  // called. This lets the conditioning of the next frame be computed on
+  // another thread while the current one is sampled. At most one call may be
+  // made between calls to UseNext().
+  void PrecomputeNext(const csrblocksparse::FatCacheAlignedVector<float>& input,
+                      int num_threads) {
     if (input.cols() != kCondInputNumTimesteps) {
       std::cerr << "Input must have " << kCondInputNumTimesteps << " columns."
                 << std::endl;
@@ -199,10 +206,17 @@ class CausalConvolutionalConditioning {
     }
     InsertNewInput(input);
 
-    auto f = [this](csrblocksparse::SpinBarrier* barrier, int tid) {
+    // The threads are reused across calls, rather than created per frame.
+    thread_pool_->Run([this](csrblocksparse::SpinBarrier* barrier, int tid) {
       ComputeFunction(barrier, tid);
-    };
-    csrblocksparse::LaunchOnThreadsWithBarrier(num_threads_, f);
+    });
+  }
+
+  // Makes the conditioning computed by the last PrecomputeNext() the one read
+  // by AtStep() and num_samples().
+  void UseNext() {
+    current_ = 1 - current_;
+    num_precomputed_frames_ = next_num_precomputed_frames_;
   }
 
   int num_samples() const {
@@ -223,7 +237,7 @@ class CausalConvolutionalConditioning {
 
   static LayerParams Conv1DParams(int feature_depth, int num_cond_hiddens,
                                   int num_threads,
-                                  const std::string& model_path,
+                                  const LayerParams::Source& from,
                                   const std::string& prefix) {
     return LayerParams{.num_input_channels = feature_depth,
                        .num_filters = num_cond_hiddens,
@@ -236,11 +250,7 @@ class CausalConvolutionalConditioning {
                        .type = LayerType::kConv1D,
                        .num_threads = num_threads,
                        .per_column_barrier = false,
-                       .from =
-                           LayerParams::FromDisk{
-                               .path = model_path,
-                               .zipped = true,
-                           },
+                       .from = from,
                        .prefix = prefix + "_conv1d_"};
   }
 
@@ -249,7 +259,7 @@ class CausalConvolutionalConditioning {
   // have skip connections.
   static LayerParams DilatedParams(int num_cond_hiddens, int level,
                                    int num_threads,
-                                   const std::string& model_path,
+                                   const LayerParams::Source& from,
                                    const std::string& prefix) {
     return LayerParams{
         .num_input_channels = num_cond_hiddens,
@@ -263,7 +273,7 @@ class CausalConvolutionalConditioning {
         .type = LayerType::kDilated,
         .num_threads = num_threads,
         .per_column_barrier = false,
-        .from = LayerParams::FromDisk{.path = model_path, .zipped = true},
+        .from = from,
         .prefix = prefix + absl::StrFormat("_conditioning_stack_%d_", level)};
   }
 
@@ -274,7 +284,7 @@ class CausalConvolutionalConditioning {
   // They also have Relu activations after the multiplication.
   static LayerParams TransposeParams(int num_cond_hiddens, int level,
                                      int num_threads,
-                                     const std::string& model_path,
+                                     const LayerParams::Source& from,
                                      const std::string& prefix) {
     return LayerParams{
         .num_input_channels = num_cond_hiddens,
@@ -288,11 +298,7 @@ class CausalConvolutionalConditioning {
         .type = LayerType::kTranspose,
         .num_threads = num_threads,
         .per_column_barrier = false,
-        .from =
-            LayerParams::FromDisk{
-                .path = model_path,
-                .zipped = true,
-            },
+        .from = from,
         .prefix = prefix + absl::StrFormat("_transpose_%d_", level)};
   }
 
@@ -300,7 +306,7 @@ class CausalConvolutionalConditioning {
   // |num_hiddens_| and to |3 * num_hiddens_| rows successively.
   static LayerParams ConvCondParams(int num_cond_hiddens, int num_hiddens,
                                     int num_threads,
-                                    const std::string& model_path,
+                                    const LayerParams::Source& from,
                                     const std::string& prefix) {
     return LayerParams{.num_input_channels = num_cond_hiddens,
                        .num_filters = num_hiddens,
@@ -313,16 +319,12 @@ class CausalConvolutionalConditioning {
                        .type = LayerType::kConv1D,
                        .num_threads = num_threads,
                        .per_column_barrier = false,
-                       .from =
-                           LayerParams::FromDisk{
-                               .path = model_path,
-                               .zipped = true,
-                           },
+                       .from = from,
                        .prefix = prefix + "_conv_cond_"};
   }
 
   static LayerParams ConvToGatesParams(int num_hiddens, int num_threads,
-                                       const std::string& model_path,
+                                       const LayerParams::Source& from,
                                        const std::string& prefix) {
     return LayerParams{.num_input_channels = num_hiddens,
                        .num_filters = 3 * num_hiddens,
@@ -335,166 +337,98 @@ class CausalConvolutionalConditioning {
                        .type = LayerType::kConv1D,
                        .num_threads = num_threads,
                        .per_column_barrier = false,
-                       .from =
-                           LayerParams::FromDisk{
-                               .path = model_path,
-                               .zipped = true,
-                           },
+                       .from = from,
                        .prefix = prefix + "_conv_to_gates_"};
   }
 
   void CreateLayers() {
+    const LayerParams::Source from =
+        LayerParams::FromModelStore{.model_store = model_store_};
     // TODO(b/161822329): Put these layers in a container.
     const LayerParams conv1d_params = Conv1DParams(
-        feature_depth_, num_cond_hiddens_, num_threads_, path_, prefix_);
-    conv1d_layer_ = Conv1DLayerType::Create(conv1d_params);
-    if (conv1d_layer_ == nullptr) {
-      std::cerr << "Failed to create conv1d layer." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        feature_depth_, num_cond_hiddens_, num_threads_, from, prefix_);
     const LayerParams dilated_params_0 =
-        DilatedParams(num_cond_hiddens_, 0, num_threads_, path_, prefix_);
-    dilated_conv_layer_0_ = CondStack0LayerType::Create(dilated_params_0);
-    if (dilated_conv_layer_0_ == nullptr) {
-      std::cerr << "Failed to create dilated conv layer 0." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        DilatedParams(num_cond_hiddens_, 0, num_threads_, from, prefix_);
     const LayerParams dilated_params_1 =
-        DilatedParams(num_cond_hiddens_, 1, num_threads_, path_, prefix_);
-    dilated_conv_layer_1_ = CondStack1LayerType::Create(dilated_params_1);
-    if (dilated_conv_layer_1_ == nullptr) {
-      std::cerr << "Failed to create dilated conv layer 1." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        DilatedParams(num_cond_hiddens_, 1, num_threads_, from, prefix_);
     const LayerParams dilated_params_2 =
-        DilatedParams(num_cond_hiddens_, 2, num_threads_, path_, prefix_);
-    dilated_conv_layer_2_ = CondStack2LayerType::Create(dilated_params_2);
-    if (dilated_conv_layer_2_ == nullptr) {
-      std::cerr << "Failed to create dilated conv layer 2." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        DilatedParams(num_cond_hiddens_, 2, num_threads_, from, prefix_);
     const LayerParams transpose_params_0 =
-        TransposeParams(num_cond_hiddens_, 0, num_threads_, path_, prefix_);
-    transpose_conv_layer_0_ = Transpose0LayerType::Create(transpose_params_0);
-    if (transpose_conv_layer_0_ == nullptr) {
-      std::cerr << "Failed to create transpose conv layer 0." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        TransposeParams(num_cond_hiddens_, 0, num_threads_, from, prefix_);
     const LayerParams transpose_params_1 =
-        TransposeParams(num_cond_hiddens_, 1, num_threads_, path_, prefix_);
-    transpose_conv_layer_1_ = Transpose1LayerType::Create(transpose_params_1);
-    if (transpose_conv_layer_1_ == nullptr) {
-      std::cerr << "Failed to create transpose conv layer 1." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        TransposeParams(num_cond_hiddens_, 1, num_threads_, from, prefix_);
     const LayerParams transpose_params_2 =
-        TransposeParams(num_cond_hiddens_, 2, num_threads_, path_, prefix_);
-    transpose_conv_layer_2_ = Transpose2LayerType::Create(transpose_params_2);
-    if (transpose_conv_layer_2_ == nullptr) {
-      std::cerr << "Failed to create transpose conv layer 2." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        TransposeParams(num_cond_hiddens_, 2, num_threads_, from, prefix_);
     const LayerParams conv_cond_params = ConvCondParams(
-        num_cond_hiddens_, num_hiddens_, num_threads_, path_, prefix_);
-    conv_cond_layer_ = ConvCondLayerType::Create(conv_cond_params);
-    if (conv_cond_layer_ == nullptr) {
-      std::cerr << "Failed to create conv_cond layer." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
+        num_cond_hiddens_, num_hiddens_, num_threads_, from, prefix_);
     const LayerParams conv_to_gates_params =
-        ConvToGatesParams(num_hiddens_, num_threads_, path_, prefix_);
-    conv_to_gates_layer_ = ConvToGatesLayerType::Create(conv_to_gates_params);
-    if (conv_to_gates_layer_ == nullptr) {
-      std::cerr << "Failed to create conv_to_gates layer." << std::endl;
-      exit(EXIT_FAILURE);
-    }
-  }
+        ConvToGatesParams(num_hiddens_, num_threads_, from, prefix_);
+
+    // Failures are reported after all layers are loaded, in a fixed order.
+    model_store_->RunConcurrently({
+        [&]() { conv1d_layer_ = Conv1DLayerType::Create(conv1d_params); },
+        [&]() {
+          dilated_conv_layer_0_ = CondStack0LayerType::Create(dilated_params_0);
+        },
+        [&]() {
+          dilated_conv_layer_1_ = CondStack1LayerType::Create(dilated_params_1);
+        },
+        [&]() {
+          dilated_conv_layer_2_ = CondStack2LayerType::Create(dilated_params_2);
+        },
+        [&]() {
+          transpose_conv_layer_0_ =
+              Transpose0LayerType::Create(transpose_params_0);
+        },
+        [&]() {
+          transpose_conv_layer_1_ =
+              Transpose1LayerType::Create(transpose_params_1);
+        },
+        [&]() {
+          transpose_conv_layer_2_ =
+              Transpose2LayerType::Create(transpose_params_2);
+        },
+        [&]() {
+          conv_cond_layer_ = ConvCondLayerType::Create(conv_cond_params);
+        },
+        [&]() {
+          conv_to_gates_layer_ =
+              ConvToGatesLayerType::Create(conv_to_gates_params);
+        },
+    });
 
-  void CreateLayers(const WavegruBufferInterface& wavegru_buffer) {
-    // TODO(b/161822329): Put these layers in a container.
-    const LayerParams conv1d_params = Conv1DParams(
-        feature_depth_, num_cond_hiddens_, num_threads_, path_, prefix_);
-    conv1d_layer_ = Conv1DLayerType::Create(conv1d_params, wavegru_buffer);
     if (conv1d_layer_ == nullptr) {
       std::cerr << "Failed to create conv1d layer." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams dilated_params_0 =
-        DilatedParams(num_cond_hiddens_, 0, num_threads_, path_, prefix_);
-    dilated_conv_layer_0_ =
-        CondStack0LayerType::Create(dilated_params_0, wavegru_buffer);
     if (dilated_conv_layer_0_ == nullptr) {
       std::cerr << "Failed to create dilated conv layer 0." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams dilated_params_1 =
-        DilatedParams(num_cond_hiddens_, 1, num_threads_, path_, prefix_);
-    dilated_conv_layer_1_ =
-        CondStack1LayerType::Create(dilated_params_1, wavegru_buffer);
     if (dilated_conv_layer_1_ == nullptr) {
       std::cerr << "Failed to create dilated conv layer 1." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams dilated_params_2 =
-        DilatedParams(num_cond_hiddens_, 2, num_threads_, path_, prefix_);
-    dilated_conv_layer_2_ =
-        CondStack2LayerType::Create(dilated_params_2, wavegru_buffer);
     if (dilated_conv_layer_2_ == nullptr) {
       std::cerr << "Failed to create dilated conv layer 2." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams transpose_params_0 =
-        TransposeParams(num_cond_hiddens_, 0, num_threads_, path_, prefix_);
-    transpose_conv_layer_0_ =
-        Transpose0LayerType::Create(transpose_params_0, wavegru_buffer);
     if (transpose_conv_layer_0_ == nullptr) {
       std::cerr << "Failed to create transpose conv layer 0." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams transpose_params_1 =
-        TransposeParams(num_cond_hiddens_, 1, num_threads_, path_, prefix_);
-    transpose_conv_layer_1_ =
-        Transpose1LayerType::Create(transpose_params_1, wavegru_buffer);
     if (transpose_conv_layer_1_ == nullptr) {
       std::cerr << "Failed to create transpose conv layer 1." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams transpose_params_2 =
-        TransposeParams(num_cond_hiddens_, 2, num_threads_, path_, prefix_);
-    transpose_conv_layer_2_ =
-        Transpose2LayerType::Create(transpose_params_2, wavegru_buffer);
     if (transpose_conv_layer_2_ == nullptr) {
       std::cerr << "Failed to create transpose conv layer 2." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams conv_cond_params = ConvCondParams(
-        num_cond_hiddens_, num_hiddens_, num_threads_, path_, prefix_);
-    conv_cond_layer_ =
-        ConvCondLayerType::Create(conv_cond_params, wavegru_buffer);
     if (conv_cond_layer_ == nullptr) {
       std::cerr << "Failed to create conv_cond layer." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    const LayerParams conv_to_gates_params =
-        ConvToGatesParams(num_hiddens_, num_threads_, path_, prefix_);
-    conv_to_gates_layer_ =
-        ConvToGatesLayerType::Create(conv_to_gates_params, wavegru_buffer);
     if (conv_to_gates_layer_ == nullptr) {
       std::cerr << "Failed to create conv_to_gates layer." << std::endl;
       exit(EXIT_FAILURE);
@@ -508,10 +442,12 @@ class CausalConvolutionalConditioning {
         csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType>(
             3 * num_hiddens_, kCondUpsamplingRatio);
     conv_to_gates_out_.FillZero();
-    conditioning_ = csrblocksparse::FatCacheAlignedVector<OutputType>(
-        conv_to_gates_out_.rows(),
-        num_frames_per_packet_ * conv_to_gates_out_.cols());
-    conditioning_.FillZero();
+    for (auto& conditioning : conditioning_) {
+      conditioning = csrblocksparse::FatCacheAlignedVector<OutputType>(
+          conv_to_gates_out_.rows(),
+          num_frames_per_packet_ * conv_to_gates_out_.cols());
+      conditioning.FillZero();
+    }
   }
 
   void WarmUp(float silence_value) {
@@ -531,15 +467,12 @@ class CausalConvolutionalConditioning {
 
   void InsertNewInput(
       const csrblocksparse::FatCacheAlignedVector<float>& input) {
-    // This conversion might not always be necessary, will
-    // optimize to copy if RhsType == InputType.
-    const csrblocksparse::FatCacheAlignedVector<InputType> input_rhs_type(
-        input);
-
-    // Copy the values of |input| to the input buffer of the first layer.
-    std::copy(input_rhs_type.data(),
-              input_rhs_type.data() + input_rhs_type.size(),
-              conv1d_layer_->InputViewToUpdate().data());
+    // Convert the values of |input| straight into the input buffer of the
+    // first layer, so that no temporary is allocated per frame.
+    InputType* layer_input = conv1d_layer_->InputViewToUpdate().data();
+    for (int i = 0; i < input.size(); ++i) {
+      layer_input[i] = static_cast<InputType>(input.data()[i]);
+    }
   }
 
   void RunLayers(csrblocksparse::SpinBarrier* spin_barrier, int tid) {
@@ -579,23 +512,24 @@ class CausalConvolutionalConditioning {
             &conv_to_gates_out_));
   }
 
+  // Writes the frames kept from the current buffer followed by the new frame
+  // to the other buffer, which only reads the current one.
   void CopyToOutput(csrblocksparse::SpinBarrier* spin_barrier, int tid) {
     // Convert the output to the input type  of the GRU gate in lyra_wavegru.h.
     if (tid == 0) {
-      // Shift the content of |conditioning_| if necessary.
-      if (num_precomputed_frames_ == num_frames_per_packet_) {
-        std::copy(conditioning_.data() + conv_to_gates_out_.size(),
-                  conditioning_.data() + conditioning_.size(),
-                  conditioning_.data());
-      }
-
-      num_precomputed_frames_ =
-          std::min(num_precomputed_frames_ + 1, num_frames_per_packet_);
-      auto destination_start =
-          conditioning_.data() +
-          (num_precomputed_frames_ - 1) * conv_to_gates_out_.size();
-      CastVector(0, conv_to_gates_out_.size(), conv_to_gates_out_.data(),
-                 destination_start);
+      const auto& current = conditioning_[current_];
+      auto& next = conditioning_[1 - current_];
+      // Drop the oldest frame if the current buffer is full.
+      const int num_kept_frames =
+          std::min(num_precomputed_frames_, num_frames_per_packet_ - 1);
+      const int frame_size = conv_to_gates_out_.size();
+      std::copy(current.data() +
+                    (num_precomputed_frames_ - num_kept_frames) * frame_size,
+                current.data() + num_precomputed_frames_ * frame_size,
+                next.data());
+      next_num_precomputed_frames_ = num_kept_frames + 1;
+      CastVector(0, frame_size, conv_to_gates_out_.data(),
+                 next.data() + num_kept_frames * frame_size);
     }
     spin_barrier->barrier();
   }
@@ -611,10 +545,13 @@ class CausalConvolutionalConditioning {
   const int num_samples_per_hop_;
   const int num_frames_per_packet_;
   const int num_threads_;
-  const std::string path_;
+  // Owns the weights and biases of the layers.
+  const std::shared_ptr<ModelStore> model_store_;
   const std::string prefix_;
 
+  // Number of frames in the current and the other buffer of |conditioning_|.
   int num_precomputed_frames_;
+  int next_num_precomputed_frames_;
 
   std::unique_ptr<Conv1DLayerType> conv1d_layer_;
   std::unique_ptr<CondStack0LayerType> dilated_conv_layer_0_;
@@ -632,8 +569,15 @@ class CausalConvolutionalConditioning {
   csrblocksparse::FatCacheAlignedVector<ConvCondOutputType> conv_cond_out_;
   csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType> conv_to_gates_out_;
 
-  // Stores |num_frames_per_packet_| frames worth of conditioning output.
-  csrblocksparse::FatCacheAlignedVector<OutputType> conditioning_;
+  // Each stores |num_frames_per_packet_| frames worth of conditioning output.
+  // AtStep() reads the one at |current_| while the other one is written.
+  std::array<csrblocksparse::FatCacheAlignedVector<OutputType>, 2>
+      conditioning_;
+  int current_;
+
+  // Runs ComputeFunction() on |num_threads_| threads for every frame. Declared
+  // last so that its threads are joined before anything they use is freed.
+  std::unique_ptr<csrblocksparse::BarrierThreadPool> thread_pool_;
 
   template <typename WeightTypeKindPeer>
   friend class CausalConvolutionalConditioningPeer;
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the latency of computing the conditioning of one frame with a range
+// of conditioning threads. Also measures the per frame cost of dispatching the
+// work to those threads, both by creating them on every call as
+// LaunchOnThreadsWithBarrier() does and by waking the parked threads of a
+// BarrierThreadPool, which Precompute() uses.
+
+#include "benchmark/benchmark.h"
+#include "causal_convolutional_conditioning.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_types.h"
+#include "model_store.h"
+#include "sparse_matmul/sparse_matmul.h"
+
+namespace {
+
+constexpr int kNumCondHiddens = 512;
+constexpr int kNumGruHiddens = 1024;
+
+#ifdef USE_FIXED16
+using ComputeType = csrblocksparse::fixed16_type;
+#else
+using ComputeType = float;
+#endif  // USE_FIXED16
+
+// |state.range(0)| is the number of conditioning threads.
+void BM_Precompute(benchmark::State& state) {
+  const int num_threads = state.range(0);
+  chromemedia::codec::CausalConvolutionalConditioning<
+      chromemedia::codec::ConditioningTypes<ComputeType>>
+      conditioning(chromemedia::codec::kNumFeatures, kNumCondHiddens,
+                   kNumGruHiddens,
+                   chromemedia::codec::GetNumSamplesPerHop(
+                       chromemedia::codec::kInternalSampleRateHz),
+                   chromemedia::codec::kNumFramesPerPacket, num_threads,
+                   /*silence_value=*/0.0f,
+                   chromemedia::codec::ModelStore::Create(
+                       ghc::filesystem::current_path() / "wavegru"),
+                   "lyra_16khz");
+  csrblocksparse::FatCacheAlignedVector<float> input(
+      chromemedia::codec::kNumFeatures, 1);
+  input.FillRandom();
+  for (auto _ : state) {
+    conditioning.Precompute(input, num_threads);
+  }
+}
+
+// Does no work, so that only the cost of getting it onto the threads, which is
+// paid once per frame, is measured.
+void DoNothing(csrblocksparse::SpinBarrier* barrier, int tid) {}
+
+// |state.range(0)| is the number of threads.
+void BM_LaunchOnThreadsWithBarrier(benchmark::State& state) {
+  for (auto _ : state) {
+    csrblocksparse::LaunchOnThreadsWithBarrier(state.range(0), DoNothing);
+  }
+}
+
+// |state.range(0)| is the number of threads.
+void BM_BarrierThreadPool(benchmark::State& state) {
+  csrblocksparse::BarrierThreadPool pool(state.range(0));
+  for (auto _ : state) {
+    pool.Run(DoNothing);
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_Precompute)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+BENCHMARK(BM_LaunchOnThreadsWithBarrier)->Arg(2)->Arg(4)->UseRealTime();
+BENCHMARK(BM_BarrierThreadPool)->Arg(2)->Arg(4)->UseRealTime();
+BENCHMARK_MAIN();
@@ -45,7 +45,8 @@ class CausalConvolutionalConditioningPeer {
                                   const std::string& model_path,
                                   const std::string& prefix) {
     return ConditioningType::Conv1DParams(feature_depth, num_cond_hiddens,
-                                          num_threads, model_path, prefix);
+                                          num_threads, FromDisk(model_path),
+                                          prefix);
   }
 
   static LayerParams DilatedParams(int num_cond_hiddens, int level,
@@ -53,30 +54,35 @@ class CausalConvolutionalConditioningPeer {
                                    const std::string& model_path,
                                    const std::string& prefix) {
     return ConditioningType::DilatedParams(num_cond_hiddens, level, num_threads,
-                                           model_path, prefix);
+                                           FromDisk(model_path), prefix);
   }
 
   static LayerParams TransposeParams(int num_cond_hiddens, int level,
                                      int num_threads,
                                      const std::string& model_path,
                                      const std::string& prefix) {
-    return ConditioningType::TransposeParams(num_cond_hiddens, level,
-                                             num_threads, model_path, prefix);
+    return ConditioningType::TransposeParams(
+        num_cond_hiddens, level, num_threads, FromDisk(model_path), prefix);
   }
 
   static LayerParams ConvCondParams(int num_cond_hiddens, int num_hiddens,
                                     int num_threads,
                                     const std::string& model_path,
                                     const std::string& prefix) {
-    return ConditioningType::ConvCondParams(num_cond_hiddens, num_hiddens,
-                                            num_threads, model_path, prefix);
+    return ConditioningType::ConvCondParams(
+        num_cond_hiddens, num_hiddens, num_threads, FromDisk(model_path),
+        prefix);
   }
 
   static LayerParams ConvToGatesParams(int num_hiddens, int num_threads,
                                        const std::string& model_path,
                                        const std::string& prefix) {
     return ConditioningType::ConvToGatesParams(num_hiddens, num_threads,
-                                               model_path, prefix);
+                                               FromDisk(model_path), prefix);
+  }
+
+  static LayerParams::Source FromDisk(const std::string& model_path) {
+    return LayerParams::FromDisk{.path = model_path, .zipped = true};
   }
 
   CausalConvolutionalConditioningPeer(int feature_depth, int num_cond_hiddens,
@@ -264,6 +270,60 @@ TYPED_TEST(CausalConvolutionalConditioningTest,
   }
 }
 
+TYPED_TEST(CausalConvolutionalConditioningTest,
+           PrecomputeNextTakesEffectOnUseNext) {
+  using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
+      TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6>>;
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const std::vector<std::vector<float>> kFeatures = {{0.0f, 0.0f, 0.0f},
+                                                     {1.0f, 1.0f, 1.0f},
+                                                     {0.0f, 0.0f, 0.0f}};
+  ConditioningType pipelined(kFeatures.at(0).size(), kNumCondHiddens,
+                             kNumHiddens, kNumSamplesPerHop,
+                             kNumFramesPerPacket, 1, 0.0f,
+                             this->testdata_dir_.string(), "lyra");
+  ConditioningType reference(kFeatures.at(0).size(), kNumCondHiddens,
+                             kNumHiddens, kNumSamplesPerHop,
+                             kNumFramesPerPacket, 1, 0.0f,
+                             this->testdata_dir_.string(), "lyra");
+  auto output_at = [](ConditioningType* conditioning, int step) {
+    auto output = conditioning->AtStep(step);
+    std::vector<float> result;
+    for (const auto value : output) {
+      result.push_back(static_cast<float>(value));
+    }
+    return result;
+  };
+
+  csrblocksparse::FatCacheAlignedVector<float> input(kFeatures.at(0).size(), 1);
+  for (int i = 0; i < kFeatures.size(); ++i) {
+    std::copy(kFeatures.at(i).begin(), kFeatures.at(i).end(), input.data());
+    const int num_samples = pipelined.num_samples();
+    std::vector<std::vector<float>> outputs;
+    for (int j = 0; j < kCondUpsamplingRatio; ++j) {
+      outputs.push_back(output_at(&pipelined, j * kNumSamplesPerCondOutput));
+    }
+
+    // The conditioning in use is untouched until UseNext() is called.
+    pipelined.PrecomputeNext(input, 1);
+    EXPECT_EQ(pipelined.num_samples(), num_samples);
+    for (int j = 0; j < kCondUpsamplingRatio; ++j) {
+      EXPECT_EQ(output_at(&pipelined, j * kNumSamplesPerCondOutput),
+                outputs[j]);
+    }
+
+    pipelined.UseNext();
+    reference.Precompute(input, 1);
+    EXPECT_EQ(pipelined.num_samples(), reference.num_samples());
+    for (int j = 0; j < kCondUpsamplingRatio; ++j) {
+      EXPECT_EQ(output_at(&pipelined, j * kNumSamplesPerCondOutput),
+                output_at(&reference, j * kNumSamplesPerCondOutput));
+    }
+  }
+}
+
 TYPED_TEST(CausalConvolutionalConditioningTest,
            MultipleFramesPerPacketYieldsSameResult) {
   using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
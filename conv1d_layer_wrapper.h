@@ -150,7 +150,8 @@ class Conv1DLayerWrapper
   explicit Conv1DLayerWrapper(
       int num_input_channels, int output_rows, int length,
       int input_buffer_rows, int stride, bool relu, bool per_column_barrier,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+      std::shared_ptr<
+          const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
           layer)
       : Super(num_input_channels, output_rows, length, input_buffer_rows,
               length, relu, per_column_barrier, std::move(layer)),
@@ -23,6 +23,7 @@
 #include "decoder_main_lib.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_decoder_options.h"
 
 ABSL_FLAG(std::string, encoded_path, "",
           "Complete path to the file containing the encoded features.");
@@ -42,6 +43,15 @@ ABSL_FLAG(
     "Path to directory containing model weights and quant files. For mobile "
     "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
     "the path relative to the binary.");
+ABSL_FLAG(int, num_threads, 1,
+          "Number of threads the sampling of each hop is split across, "
+          "including the calling thread.");
+ABSL_FLAG(int, num_conditioning_threads, 1,
+          "Number of threads the conditioning of each packet is computed "
+          "with, including the calling thread.");
+ABSL_FLAG(bool, length_prefixed, false,
+          "Whether each packet of the encoded file is preceded by its size, as "
+          "encoder_main writes them with --enable_dtx.");
 
 int main(int argc, char** argv) {
   absl::SetProgramUsageMessage(argv[0]);
@@ -53,6 +63,11 @@ int main(int argc, char** argv) {
   const int sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
   const float packet_loss_rate = absl::GetFlag(FLAGS_packet_loss_rate);
   const float average_burst_length = absl::GetFlag(FLAGS_average_burst_length);
+  chromemedia::codec::LyraDecoderOptions options;
+  options.num_threads = absl::GetFlag(FLAGS_num_threads);
+  options.num_conditioning_threads =
+      absl::GetFlag(FLAGS_num_conditioning_threads);
+  const bool length_prefixed = absl::GetFlag(FLAGS_length_prefixed);
   const ghc::filesystem::path model_path =
       chromemedia::codec::GetCompleteArchitecturePath(
           absl::GetFlag(FLAGS_model_path));
@@ -80,7 +95,7 @@ int main(int argc, char** argv) {
 
   if (!chromemedia::codec::DecodeFile(encoded_path, output_path, sample_rate_hz,
                                       packet_loss_rate, average_burst_length,
-                                      model_path)) {
+                                      model_path, options, length_prefixed)) {
     LOG(ERROR) << "Could not decode " << encoded_path;
     return -1;
   }
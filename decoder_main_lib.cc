@@ -28,12 +28,16 @@
 #include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "gilbert_model.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
 #include "lyra_decoder.h"
+#include "lyra_decoder_options.h"
+#include "model_store.h"
+#include "packet_framing.h"
 #include "wav_util.h"
 
 namespace chromemedia {
@@ -51,7 +55,8 @@ int PacketSize(LyraDecoder* decoder) {
 
 bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
                     float packet_loss_rate, float average_burst_length,
-                    LyraDecoder* decoder, std::vector<int16_t>* decoded_audio) {
+                    LyraDecoder* decoder, std::vector<int16_t>* decoded_audio,
+                    bool length_prefixed) {
   auto gilbert_model =
       GilbertModel::Create(packet_loss_rate, average_burst_length);
   if (gilbert_model == nullptr) {
@@ -59,16 +64,20 @@ bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
     return false;
   }
 
-  const int packet_size = PacketSize(decoder);
+  const absl::optional<std::vector<absl::Span<const uint8_t>>> packets_or =
+      length_prefixed ? SplitFramedPackets(packet_stream)
+                      : absl::make_optional(SplitFixedSizePackets(
+                            packet_stream, PacketSize(decoder)));
+  if (!packets_or.has_value()) {
+    LOG(ERROR) << "Could not split the packet stream into packets.";
+    return false;
+  }
   const int num_samples_per_packet =
       kNumFramesPerPacket * GetNumSamplesPerHop(decoder->sample_rate_hz());
 
   const auto benchmark_start = absl::Now();
-  for (int encoded_index = 0; encoded_index < packet_stream.size();
-       encoded_index += packet_size) {
-    const absl::Span<const uint8_t> encoded_packet =
-        absl::MakeConstSpan(packet_stream.data() + encoded_index, packet_size);
-
+  for (const absl::Span<const uint8_t> encoded_packet : packets_or.value()) {
+    const int encoded_index = encoded_packet.data() - packet_stream.data();
     absl::optional<std::vector<int16_t>> decoded_or;
     if (gilbert_model->IsPacketReceived()) {
       if (!decoder->SetEncodedPacket(encoded_packet)) {
@@ -102,9 +111,10 @@ bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
 bool DecodeFile(const ghc::filesystem::path& encoded_path,
                 const ghc::filesystem::path& output_path, int sample_rate_hz,
                 float packet_loss_rate, float average_burst_length,
-                const ghc::filesystem::path& model_path) {
-  auto decoder =
-      LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate, model_path);
+                const ghc::filesystem::path& model_path,
+                const LyraDecoderOptions& options, bool length_prefixed) {
+  auto decoder = LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                     ModelStore::Create(model_path), options);
   if (decoder == nullptr) {
     LOG(ERROR) << "Could not create lyra decoder.";
     return false;
@@ -121,7 +131,10 @@ bool DecodeFile(const ghc::filesystem::path& encoded_path,
 
   const int packet_size = PacketSize(decoder.get());
 
-  const int stream_size_remainder = packet_stream_string.size() % packet_size;
+  // The size of length-prefixed packets varies, so their stream is checked
+  // when it is split.
+  const int stream_size_remainder =
+      length_prefixed ? 0 : packet_stream_string.size() % packet_size;
   if (stream_size_remainder != 0) {
     LOG(WARNING)
         << "Read " << packet_stream_string.size()
@@ -142,7 +155,7 @@ bool DecodeFile(const ghc::filesystem::path& encoded_path,
 
   std::vector<int16_t> decoded_audio;
   if (!DecodeFeatures(packet_stream, packet_loss_rate, average_burst_length,
-                      decoder.get(), &decoded_audio)) {
+                      decoder.get(), &decoded_audio, length_prefixed)) {
     LOG(ERROR) << "Unable to decode features for file " << encoded_path;
     return false;
   }
@@ -24,14 +24,18 @@
 #include "absl/strings/string_view.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_decoder.h"
+#include "lyra_decoder_options.h"
 
 namespace chromemedia {
 namespace codec {
 
-// Decodes a vector of bytes into wav data.
+// Decodes a vector of bytes into wav data. If |length_prefixed| the packets
+// are framed as by AppendFramedPacket(), which an encoder with DTX enabled
+// requires, otherwise they all have the packet size of the |decoder|.
 bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
                     float packet_loss_rate, float average_burst_length,
-                    LyraDecoder* decoder, std::vector<int16_t>* decoded_audio);
+                    LyraDecoder* decoder, std::vector<int16_t>* decoded_audio,
+                    bool length_prefixed = false);
 
 // Decodes an encoded features file into a wav file.
 // Uses the model and quant files located under |model_path|.
@@ -40,10 +44,14 @@ bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
 // |output_path| = "/tmp/lyra/file1_decoded.lyra"
 // Then successful decoding will write out the file
 // /tmp/lyra/encoded/file1_decoded.wav
+// The decoder is threaded as requested by |options|. The packets are framed as
+// for DecodeFeatures().
 bool DecodeFile(const ghc::filesystem::path& encoded_path,
                 const ghc::filesystem::path& output_path, int sample_rate_hz,
                 float packet_loss_rate, float average_burst_length,
-                const ghc::filesystem::path& model_path);
+                const ghc::filesystem::path& model_path,
+                const LyraDecoderOptions& options = LyraDecoderOptions(),
+                bool length_prefixed = false);
 
 }  // namespace codec
 }  // namespace chromemedia
@@ -14,11 +14,15 @@
 
 #include "decoder_main_lib.h"
 
+#include <cstdint>
 #include <cstdio>
+#include <fstream>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
 #include <tuple>
+#include <vector>
 
 // Placeholder for get runfiles header.
 #include "gmock/gmock.h"
@@ -27,9 +31,12 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "packet_framing.h"
 #include "wav_util.h"
 
 namespace chromemedia {
@@ -135,6 +142,44 @@ TEST_P(DecoderMainLibTest, TwoEncodedFramesWithPacketLoss) {
   EXPECT_EQ(NumSamplesInWavFile(output_filepath), expected_num_samples);
 }
 
+TEST_P(DecoderMainLibTest, LengthPrefixedPacketsWithEmptyPackets) {
+  std::ifstream encoded_stream(
+      (testdata_dir_ / "two_encoded_frames_16khz.lyra").string(),
+      std::ios_base::binary);
+  ASSERT_TRUE(encoded_stream.is_open());
+  const std::vector<uint8_t> encoded{std::istreambuf_iterator<char>(
+                                         encoded_stream),
+                                     std::istreambuf_iterator<char>()};
+  ASSERT_GE(encoded.size(), 2 * kPacketSize);
+  const auto first_packet = absl::MakeConstSpan(encoded).first(kPacketSize);
+  const auto second_packet =
+      absl::MakeConstSpan(encoded).subspan(kPacketSize, kPacketSize);
+
+  // Empty packets are sent by an encoder with DTX enabled during noise.
+  std::vector<uint8_t> packet_stream;
+  for (const auto& packet :
+       {first_packet, absl::Span<const uint8_t>(),
+        absl::Span<const uint8_t>(), second_packet,
+        absl::Span<const uint8_t>()}) {
+    ASSERT_TRUE(AppendFramedPacket(packet, &packet_stream));
+  }
+  auto decoder = LyraDecoder::Create(sample_rate_hz_, kNumChannels, kBitrate,
+                                     model_path_);
+  ASSERT_NE(decoder, nullptr);
+  std::vector<int16_t> decoded_audio;
+  EXPECT_TRUE(DecodeFeatures(packet_stream, /*packet_loss_rate=*/0.f,
+                             /*average_burst_length=*/1.f, decoder.get(),
+                             &decoded_audio, /*length_prefixed=*/true));
+  EXPECT_EQ(decoded_audio.size(), 5 * num_samples_in_packet_);
+
+  // A truncated packet is not decoded.
+  packet_stream.push_back(kPacketSize);
+  decoded_audio.clear();
+  EXPECT_FALSE(DecodeFeatures(packet_stream, /*packet_loss_rate=*/0.f,
+                              /*average_burst_length=*/1.f, decoder.get(),
+                              &decoded_audio, /*length_prefixed=*/true));
+}
+
 INSTANTIATE_TEST_SUITE_P(SampleRates, DecoderMainLibTest,
                          testing::ValuesIn(kSupportedSampleRates));
 
@@ -185,7 +185,8 @@ class DilatedConvolutionalLayerWrapper
 
   int PrepareForThreads(int num_threads) override {
     num_elements_per_thread_ = this->output_rows_ / num_threads;
-    return this->layer_->PrepareForThreads(num_threads);
+    return csrblocksparse::PrepareSharedLayerForThreads(num_threads,
+                                                        &this->layer_);
   }
 
  private:
@@ -194,7 +195,8 @@ class DilatedConvolutionalLayerWrapper
       int num_input_channels, int output_rows, int input_buffer_rows,
       int input_buffer_cols, bool relu, bool per_column_barrier,
       bool skip_connection, int num_threads,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+      std::shared_ptr<
+          const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
           layer)
       : Super(num_input_channels, output_rows, /*length=*/1, input_buffer_rows,
               input_buffer_cols, relu, per_column_barrier, std::move(layer)),
@@ -10,6 +10,7 @@
 #include "lyra_decoder.h"
 #include "lyra_encoder.h"
 #include "packet.h"
+#include "packet_framing.h"
 #include "packet_loss_handler_interface.h"
 #include "runfiles_util.h"
 #include "wav_util.h"
@@ -29,30 +30,30 @@ int PacketSize(LyraDecoder* decoder) {
 
 std::optional<std::vector<uint8_t>> EncodeWithEncoder(
     LyraEncoder* encoder, const std::vector<int16_t>& wav_data,
-    int sample_rate_hz) {
+    int sample_rate_hz, bool length_prefixed) {
   // Encode the wav data and store the encoded features in a vector.
   const auto benchmark_start = absl::Now();
+  // The last packet is padded with silence rather than dropped.
+  std::vector<std::vector<uint8_t>> packets;
+  if (!encoder->EncodeStream(wav_data, &packets) ||
+      !encoder->FlushStream(&packets)) {
+    std::cerr << "Unable to encode features of packet " << packets.size()
+              << ".";
+    return std::nullopt;
+  }
+
+  // Append the encoded audio frames to the encoded_features accumulator
+  // vector.
   std::vector<uint8_t> encoded_features;
-  int num_samples_per_packet =
-      kNumFramesPerPacket * sample_rate_hz / encoder->frame_rate();
-  // Iterate over the wav data until the end of the vector.
-  for (int wav_iterator = 0;
-       wav_iterator + num_samples_per_packet <= wav_data.size();
-       wav_iterator += num_samples_per_packet) {
-    // Move audio samples from the large in memory wav file frame by frame to
-    // the encoder.
-    auto encoded_or = encoder->Encode(absl::MakeConstSpan(
-        &wav_data.at(wav_iterator), num_samples_per_packet));
-    if (!encoded_or.has_value()) {
-      std::cerr << "Unable to encode features starting at samples at byte "
-                << wav_iterator << ".";
-      return std::nullopt;
+  for (const auto& packet : packets) {
+    if (length_prefixed) {
+      if (!AppendFramedPacket(packet, &encoded_features)) {
+        return std::nullopt;
+      }
+    } else {
+      encoded_features.insert(encoded_features.end(), packet.begin(),
+                              packet.end());
     }
-
-    // Append the encoded audio frames to the encoded_features accumulator
-    // vector.
-    encoded_features.insert(encoded_features.end(), encoded_or.value().begin(),
-                            encoded_or.value().end());
   }
   const auto elapsed = absl::Now() - benchmark_start;
   fprintf(stdout, "Encoding lapsed seconds %ld.\n",
@@ -66,7 +67,7 @@ std::optional<std::vector<uint8_t>> EncodeWithEncoder(
 
 std::optional<std::vector<int16_t>> DecodeWithDecoder(
     LyraDecoder* decoder, const std::vector<uint8_t>& encoded_features,
-    float packet_loss_rate, float average_burst_length) {
+    float packet_loss_rate, float average_burst_length, bool length_prefixed) {
   // Decode the encoded features and return the reconstructed audio.
   auto gilbert_model =
       GilbertModel::Create(packet_loss_rate, average_burst_length);
@@ -75,15 +76,21 @@ std::optional<std::vector<int16_t>> DecodeWithDecoder(
     return std::nullopt;
   }
 
-  const int packet_size = PacketSize(decoder);
+  const absl::optional<std::vector<absl::Span<const uint8_t>>> packets_or =
+      length_prefixed ? SplitFramedPackets(encoded_features)
+                      : absl::make_optional(SplitFixedSizePackets(
+                            encoded_features, PacketSize(decoder)));
+  if (!packets_or.has_value()) {
+    std::cerr << "Could not split the encoded features into packets."
+              << std::endl;
+    return std::nullopt;
+  }
   const int num_samples_per_packet =
       kNumFramesPerPacket * GetNumSamplesPerHop(decoder->sample_rate_hz());
   std::vector<int16_t> decoded_audio;
   const auto decode_benchmark_start = absl::Now();
-  for (int encoded_index = 0; encoded_index < encoded_features.size();
-       encoded_index += packet_size) {
-    const absl::Span<const uint8_t> encoded_packet = absl::MakeConstSpan(
-        encoded_features.data() + encoded_index, packet_size);
+  for (const absl::Span<const uint8_t> encoded_packet : packets_or.value()) {
+    const int encoded_index = encoded_packet.data() - encoded_features.data();
 
     absl::optional<std::vector<int16_t>> decoded_or;
     if (gilbert_model->IsPacketReceived()) {
@@ -122,9 +129,9 @@ std::optional<std::vector<int16_t>> DecodeWithDecoder(
 std::optional<std::vector<int16_t>> EncodeAndDecode(
     LyraEncoder* encoder, LyraDecoder* decoder,
     const std::vector<int16_t>& wav_data, int sample_rate_hz,
-    float packet_loss_rate, float average_burst_length) {
+    float packet_loss_rate, float average_burst_length, bool length_prefixed) {
   auto encoded_features_or =
-      EncodeWithEncoder(encoder, wav_data, sample_rate_hz);
+      EncodeWithEncoder(encoder, wav_data, sample_rate_hz, length_prefixed);
 
   if (!encoded_features_or.has_value()) {
     std::cerr << "Unable to encode features." << std::endl;
@@ -132,7 +139,8 @@ std::optional<std::vector<int16_t>> EncodeAndDecode(
   }
 
   return DecodeWithDecoder(decoder, encoded_features_or.value(),
-                           packet_loss_rate, average_burst_length);
+                           packet_loss_rate, average_burst_length,
+                           length_prefixed);
 }
 
 bool End2End(const std::string& input_filename,
@@ -181,7 +189,8 @@ bool End2End(const std::string& input_filename,
   auto output_or =
       EncodeAndDecode(encoder.get(), decoder.get(), data_to_encode,
                       /*sample_rate_hz=*/48000, /*packet_loss_rate=*/0.f,
-                      /*float_average_burst_length=*/1.f);
+                      /*float_average_burst_length=*/1.f,
+                      /*length_prefixed=*/true);
 
   if (!output_or.has_value()) {
     fprintf(stderr, "EncodeAndDecode failed. \n");
@@ -7,18 +7,22 @@
 namespace chromemedia {
 namespace codec {
 
+// If |length_prefixed| the packets are framed as by AppendFramedPacket(),
+// which an encoder with DTX enabled requires, since its packets may be empty.
 std::optional<std::vector<uint8_t>> EncodeWithEncoder(
     LyraEncoder* encoder, const std::vector<int16_t>& wav_data,
-    int sample_rate_hz);
+    int sample_rate_hz, bool length_prefixed = false);
 
 std::optional<std::vector<int16_t>> DecodeWithDecoder(
     LyraDecoder* decoder, const std::vector<uint8_t>& encoded_data,
-    float packet_loss_rate, float average_burst_length);
+    float packet_loss_rate, float average_burst_length,
+    bool length_prefixed = false);
 
 std::optional<std::vector<int16_t>> EncodeAndDecode(
     LyraEncoder* encoder, LyraDecoder* decoder,
     const std::vector<int16_t>& wav_data, int sample_rate_hz,
-    float packet_loss_rate, float average_burst_length);
+    float packet_loss_rate, float average_burst_length,
+    bool length_prefixed = false);
 
 bool End2End(const std::string& input_filename,
              const std::string& output_filename, const std::string& arg0);
@@ -35,8 +35,9 @@ ABSL_FLAG(bool, enable_preprocessing, false,
           "If enabled runs the input signal through the preprocessing "
           "module before encoding.");
 ABSL_FLAG(bool, enable_dtx, false,
-          "Enables discontinuous transmission (DTX). DTX does not send packets "
-          "when noise is detected.");
+          "Enables discontinuous transmission (DTX). DTX sends empty packets "
+          "when noise is detected. Each packet is then preceded by its size in "
+          "the output file, which decoder_main reads with --length_prefixed.");
 ABSL_FLAG(
     std::string, model_path, "wavegru",
     "Path to directory containing quantization files. For mobile "
@@ -34,6 +34,7 @@
 #include "lyra_config.h"
 #include "lyra_encoder.h"
 #include "no_op_preprocessor.h"
+#include "packet_framing.h"
 #include "wav_util.h"
 
 namespace chromemedia {
@@ -68,27 +69,27 @@ bool EncodeWav(const std::vector<int16_t>& wav_data, int num_channels,
         absl::MakeConstSpan(wav_data.data(), wav_data.size()), sample_rate_hz);
   }
 
-  const int num_samples_per_packet =
-      kNumFramesPerPacket * sample_rate_hz / encoder->frame_rate();
-  // Iterate over the wav data until the end of the vector.
-  for (int wav_iterator = 0;
-       wav_iterator + num_samples_per_packet <= processed_data.size();
-       wav_iterator += num_samples_per_packet) {
-    // Move audio samples from the large in memory wav file frame by frame to
-    // the encoder.
-    auto encoded_or = encoder->Encode(absl::MakeConstSpan(
-        &processed_data.at(wav_iterator), num_samples_per_packet));
-    if (!encoded_or.has_value()) {
-      LOG(ERROR) << "Unable to encode features starting at samples at byte "
-                 << wav_iterator << ".";
-      return false;
-    }
+  // The last packet is padded with silence rather than dropped.
+  std::vector<std::vector<uint8_t>> packets;
+  if (!encoder->EncodeStream(processed_data, &packets) ||
+      !encoder->FlushStream(&packets)) {
+    LOG(ERROR) << "Unable to encode features of packet " << packets.size()
+               << ".";
+    return false;
+  }
 
-    // Append the encoded audio frames to the encoded_features accumulator
-    // vector.
-    encoded_features->insert(encoded_features->end(),
-                             encoded_or.value().begin(),
-                             encoded_or.value().end());
+  // Append the encoded audio frames to the encoded_features accumulator
+  // vector.
+  for (const auto& packet : packets) {
+    if (enable_dtx) {
+      if (!AppendFramedPacket(packet, encoded_features)) {
+        LOG(ERROR) << "Unable to frame packet.";
+        return false;
+      }
+    } else {
+      encoded_features->insert(encoded_features->end(), packet.begin(),
+                               packet.end());
+    }
   }
   const auto elapsed = absl::Now() - benchmark_start;
   LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
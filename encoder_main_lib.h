@@ -28,7 +28,8 @@ namespace chromemedia {
 namespace codec {
 
 // Encodes a vector of wav_data into encoded_features.
-// Uses the quant files located under |model_path|.
+// Uses the quant files located under |model_path|. If |enable_dtx| the packets
+// are framed as by AppendFramedPacket(), since their size varies.
 bool EncodeWav(const std::vector<int16_t>& wav_data, int num_channels,
                int sample_rate_hz, bool enable_preprocessing, bool enable_dtx,
                const ghc::filesystem::path& model_path,
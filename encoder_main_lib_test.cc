@@ -14,8 +14,10 @@
 
 #include "encoder_main_lib.h"
 
+#include <cstdint>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
+#include <vector>
 
 // Placeholder for get runfiles header.
 #include "gmock/gmock.h"
@@ -26,6 +28,8 @@
 #include "absl/strings/string_view.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "packet_framing.h"
 
 namespace chromemedia {
 namespace codec {
@@ -83,6 +87,32 @@ TEST_F(EncoderMainLibTest, EncodeSingleWavFiles) {
   }
 }
 
+TEST_F(EncoderMainLibTest, EncodeWavWithDtxFramesPackets) {
+  const int kSampleRateHz = 16000;
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(kSampleRateHz);
+  const int kNumPackets = 100;
+  // Silence is noise, so that some packets are empty.
+  const std::vector<int16_t> wav_data(kNumPackets * num_samples_per_packet, 0);
+  std::vector<uint8_t> encoded_features;
+  ASSERT_TRUE(EncodeWav(wav_data, kNumChannels, kSampleRateHz,
+                        /*enable_preprocessing=*/false,
+                        /*enable_dtx=*/true, model_path_, &encoded_features));
+
+  const auto packets_or = SplitFramedPackets(encoded_features);
+  ASSERT_TRUE(packets_or.has_value());
+  ASSERT_EQ(packets_or->size(), kNumPackets);
+  int num_empty_packets = 0;
+  for (const auto& packet : packets_or.value()) {
+    if (packet.empty()) {
+      ++num_empty_packets;
+    } else {
+      EXPECT_EQ(packet.size(), kPacketSize);
+    }
+  }
+  EXPECT_GT(num_empty_packets, 0);
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
@@ -17,6 +17,7 @@
 #ifndef LYRA_CODEC_FEATURE_EXTRACTOR_INTERFACE_H_
 #define LYRA_CODEC_FEATURE_EXTRACTOR_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -36,6 +37,19 @@ class FeatureExtractorInterface {
   // Extracts features from the audio. On failure returns a nullopt.
   virtual absl::optional<std::vector<float>> Extract(
       const absl::Span<const int16_t> audio) = 0;
+
+  // Same as above, but writes the features to |features|, whose size must
+  // match their number. Returns false on failure. Implementations override
+  // this to extract features without allocating.
+  virtual bool Extract(const absl::Span<const int16_t> audio,
+                       absl::Span<float> features) {
+    const auto extracted = Extract(audio);
+    if (!extracted.has_value() || extracted->size() != features.size()) {
+      return false;
+    }
+    std::copy(extracted->begin(), extracted->end(), features.begin());
+    return true;
+  }
 };
 
 }  // namespace codec
@@ -14,6 +14,7 @@
 
 #include "filter_banks.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <utility>
@@ -88,16 +89,18 @@ std::vector<std::vector<int16_t>> SplitFilter::Split(
   return old_bands;
 }
 
-std::unique_ptr<MergeFilter> MergeFilter::Create(int num_bands) {
+std::unique_ptr<MergeFilter> MergeFilter::Create(int num_bands,
+                                                 int max_num_samples) {
   if (!IsPowerOfTwo(num_bands)) {
     std::cerr << "Number of bands has to be a power of 2, but was "
                << num_bands << ".";
     return nullptr;
   }
-  return absl::WrapUnique(new MergeFilter(num_bands));
+  return absl::WrapUnique(new MergeFilter(num_bands, max_num_samples));
 }
 
-MergeFilter::MergeFilter(int num_bands) : MergeFilterInterface(num_bands) {
+MergeFilter::MergeFilter(int num_bands, int max_num_samples)
+    : MergeFilterInterface(num_bands) {
   const int num_levels = IntLogTwo(num_bands);
   filters_per_level_.reserve(num_levels);
   for (int level = 0; level < num_levels; ++level) {
@@ -106,10 +109,13 @@ MergeFilter::MergeFilter(int num_bands) : MergeFilterInterface(num_bands) {
         std::vector<MergeQuadratureMirrorFilter<int16_t>>(num_bands >>
                                                           (level + 1)));
   }
+  for (auto& samples : level_samples_) {
+    samples.reserve(max_num_samples);
+  }
 }
 
-std::vector<int16_t> MergeFilter::Merge(
-    const std::vector<std::vector<int16_t>>& bands) {
+void MergeFilter::CheckBands(
+    const std::vector<std::vector<int16_t>>& bands) const {
   if (bands.size() != num_bands_) {
     std::cerr << "The number of bands has to be " << num_bands_ << ", but was "
     << bands.size() << ".";
@@ -124,20 +130,58 @@ std::vector<int16_t> MergeFilter::Merge(
      exit(EXIT_FAILURE);
     }
   }
-  std::vector<std::vector<int16_t>> old_bands(bands);
-  for (std::vector<MergeQuadratureMirrorFilter<int16_t>>& filters :
-       filters_per_level_) {
-    std::vector<std::vector<int16_t>> new_bands;
+}
+
+std::vector<int16_t> MergeFilter::Merge(
+    const std::vector<std::vector<int16_t>>& bands) {
+  CheckBands(bands);
+  std::vector<int16_t> signal(num_bands_ * bands.at(0).size());
+  Merge(bands, absl::MakeSpan(signal));
+  return signal;
+}
+
+void MergeFilter::Merge(const std::vector<std::vector<int16_t>>& bands,
+                        absl::Span<int16_t> signal) {
+  CheckBands(bands);
+  const int band_size = bands.at(0).size();
+  if (signal.size() != num_bands_ * band_size) {
+    std::cerr << "The signal has to have " << num_bands_ * band_size
+              << " samples, but had " << signal.size() << ".";
+    exit(EXIT_FAILURE);
+  }
+  // A single band is the signal itself.
+  if (filters_per_level_.empty()) {
+    std::copy(bands[0].begin(), bands[0].end(), signal.begin());
+    return;
+  }
+  // Each level merges pairs of the bands of the level before, which are laid
+  // out one after the other in |old_bands|, into bands twice as long.
+  absl::Span<const int16_t> old_bands;
+  for (int level = 0; level < filters_per_level_.size(); ++level) {
+    std::vector<MergeQuadratureMirrorFilter<int16_t>>& filters =
+        filters_per_level_[level];
+    const int old_band_size = band_size << level;
+    auto old_band = [&](int band) {
+      return level == 0 ? absl::MakeConstSpan(bands[band])
+                        : old_bands.subspan(band * old_band_size,
+                                            old_band_size);
+    };
+    absl::Span<int16_t> new_bands = signal;
+    if (level + 1 < filters_per_level_.size()) {
+      std::vector<int16_t>& samples = level_samples_[level % 2];
+      samples.resize(signal.size());
+      new_bands = absl::MakeSpan(samples);
+    }
     for (int filter = 0; filter < filters.size(); ++filter) {
       // Because of the mirroring characteristic of aliasing, odd bands are
       // reversed.
-      const Bands<int16_t> bands(old_bands.at(2 * filter + filter % 2),
-                                 old_bands.at(2 * filter + 1 - filter % 2));
-      new_bands.push_back(filters.at(filter).Merge(bands));
+      filters.at(filter).Merge(
+          old_band(2 * filter + filter % 2),
+          old_band(2 * filter + 1 - filter % 2),
+          new_bands.subspan(2 * filter * old_band_size, 2 * old_band_size));
     }
     old_bands = new_bands;
   }
-  return old_bands.at(0);
 }
 
 }  // namespace codec
@@ -17,6 +17,7 @@
 #ifndef LYRA_CODEC_FILTER_BANKS_H_
 #define LYRA_CODEC_FILTER_BANKS_H_
 
+#include <array>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -52,18 +53,30 @@ class SplitFilter {
 class MergeFilter : public MergeFilterInterface {
  public:
   // Create a MergeFilter. Return nullptr if num_bands isn't a power of 2.
-  static std::unique_ptr<MergeFilter> Create(int num_bands);
+  // The scratch space of the intermediate levels is allocated for signals of
+  // up to |max_num_samples| and grows on longer ones.
+  static std::unique_ptr<MergeFilter> Create(int num_bands,
+                                             int max_num_samples = 0);
 
   // Merge multiple bands sampled at sub-Nyquist into signal.
   // The size of the bands have to coincide.
   std::vector<int16_t> Merge(
       const std::vector<std::vector<int16_t>>& bands) override;
 
+  // Same as above, but writes the signal into |signal|, which has to be
+  // |num_bands| times as long as each band.
+  void Merge(const std::vector<std::vector<int16_t>>& bands,
+             absl::Span<int16_t> signal) override;
+
  private:
-  explicit MergeFilter(int num_bands);
+  MergeFilter(int num_bands, int max_num_samples);
+
+  void CheckBands(const std::vector<std::vector<int16_t>>& bands) const;
 
   std::vector<std::vector<MergeQuadratureMirrorFilter<int16_t>>>
       filters_per_level_;
+  // The bands of the intermediate levels, alternating between the two.
+  std::array<std::vector<int16_t>, 2> level_samples_;
 };
 
 }  // namespace codec
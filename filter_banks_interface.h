@@ -17,9 +17,14 @@
 #ifndef LYRA_CODEC_FILTER_BANKS_INTERFACE_H_
 #define LYRA_CODEC_FILTER_BANKS_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 
+#include "absl/types/span.h"
+
 namespace chromemedia {
 namespace codec {
 
@@ -33,6 +38,20 @@ class MergeFilterInterface {
   virtual std::vector<int16_t> Merge(
       const std::vector<std::vector<int16_t>>& bands) = 0;
 
+  // Same as above, but writes the signal into |signal|, which has to hold
+  // exactly the samples of all bands. Implementations override this to merge
+  // without allocating.
+  virtual void Merge(const std::vector<std::vector<int16_t>>& bands,
+                     absl::Span<int16_t> signal) {
+    const std::vector<int16_t> merged = Merge(bands);
+    if (merged.size() != signal.size()) {
+      fprintf(stderr, "Merged %d samples instead of %d.\n",
+              static_cast<int>(merged.size()), static_cast<int>(signal.size()));
+      exit(EXIT_FAILURE);
+    }
+    std::copy(merged.begin(), merged.end(), signal.begin());
+  }
+
   int num_bands() const { return num_bands_; }
 
  protected:
@@ -22,6 +22,7 @@
 #include <random>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "gtest/gtest.h"
 
 namespace chromemedia {
@@ -144,6 +145,42 @@ TEST(FilterBanksTest, Noise) {
   EXPECT_LT(kMinCorrelation, MaxCorrelation(merged_signal, merged_signal));
 }
 
+TEST(FilterBanksTest, MergeIntoSpanMatchesMerge) {
+  std::mt19937 generator;
+  std::uniform_int_distribution<> distribution(
+      std::numeric_limits<int16_t>().min(),
+      std::numeric_limits<int16_t>().max());
+  std::vector<std::vector<int16_t>> bands(
+      kNumBands, std::vector<int16_t>(kNumBandSamples));
+  for (std::vector<int16_t>& band : bands) {
+    for (int16_t& sample : band) {
+      sample = distribution(generator);
+    }
+  }
+  std::unique_ptr<MergeFilter> merge_filter = MergeFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, merge_filter);
+  const std::vector<int16_t> merged_signal = merge_filter->Merge(bands);
+
+  // Merging the two halves of the bands one after the other into a
+  // preallocated signal gives the same samples.
+  std::unique_ptr<MergeFilter> span_merge_filter =
+      MergeFilter::Create(kNumBands, kNumSignalSamples / 2);
+  ASSERT_NE(nullptr, span_merge_filter);
+  std::vector<int16_t> span_merged_signal(kNumSignalSamples);
+  for (int half = 0; half < 2; ++half) {
+    std::vector<std::vector<int16_t>> half_bands;
+    for (const std::vector<int16_t>& band : bands) {
+      half_bands.emplace_back(band.begin() + half * kNumBandSamples / 2,
+                              band.begin() + (half + 1) * kNumBandSamples / 2);
+    }
+    span_merge_filter->Merge(
+        half_bands, absl::MakeSpan(span_merged_signal)
+                        .subspan(half * kNumSignalSamples / 2,
+                                 kNumSignalSamples / 2));
+  }
+  EXPECT_EQ(merged_signal, span_merged_signal);
+}
+
 class FilterBanksSineTest : public testing::TestWithParam<int> {};
 
 TEST_P(FilterBanksSineTest, Sine) {
@@ -17,10 +17,12 @@
 #ifndef LYRA_CODEC_GENERATIVE_MODEL_INTERFACE_H_
 #define LYRA_CODEC_GENERATIVE_MODEL_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 
 namespace chromemedia {
 namespace codec {
@@ -40,6 +42,19 @@ class GenerativeModelInterface {
   virtual absl::optional<std::vector<int16_t>> GenerateSamples(
       int num_samples) = 0;
 
+  // Same as above, but writes the audio samples to the beginning of
+  // |samples|. Returns the number of samples written, which may be less than
+  // |samples.size()|, or -1 on failure. Implementations override this to
+  // generate samples without allocating.
+  virtual int GenerateSamples(absl::Span<int16_t> samples) {
+    const auto generated = GenerateSamples(static_cast<int>(samples.size()));
+    if (!generated.has_value() || generated->size() > samples.size()) {
+      return -1;
+    }
+    std::copy(generated->begin(), generated->end(), samples.begin());
+    return generated->size();
+  }
+
   // Clears any information about previous frames stored by the model.
   virtual void Reset() {}
 
@@ -1,11 +1,20 @@
 'use strict';
 
-import Module from './webassembly_codec_wrapper.js';
 import {HeapAudioBuffer} from "./audio_helper.js";
 
+// The number of decoder threads, set with the |threads| URL parameter. The
+// threaded build needs SharedArrayBuffer, which is only available to cross
+// origin isolated pages, so the single-threaded build is the fallback.
+const kNumThreads =
+    Number(new URLSearchParams(location.search).get('threads')) || 1;
+const kUseThreadedBuild = kNumThreads > 1 && self.crossOriginIsolated;
+
 // Initialize the lyra codec module.
 let codecModule;
-Module().then((module) => {
+import(kUseThreadedBuild ? './webassembly_codec_wrapper_threaded.js'
+                         : './webassembly_codec_wrapper.js').then((Module) => {
+    return Module.default({numThreads: kNumThreads});
+}).then((module) => {
     console.log("Initialized codec's wasmModule.");
     codecModule = module;
 }).catch(e => {
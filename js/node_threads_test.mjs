@@ -0,0 +1,118 @@
+/**
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Encodes and decodes a tone with the wasm codec under Node, where the threads
+// of the threaded build run as worker_threads. Run from the directory holding
+// the build output and the wavegru/ model directory:
+//
+//   node node_threads_test.mjs ./webassembly_codec_wrapper_threaded.js 4
+//
+// Exits with a non-zero status on failure.
+
+import {readFile} from 'fs/promises';
+import {pathToFileURL} from 'url';
+
+const kSampleRateHz = 16000;
+const kNumSamples = kSampleRateHz;
+
+/**
+ * Minimal XMLHttpRequest serving the model files from disk, as Node has no
+ * XMLHttpRequest for emscripten's fetch.
+ */
+class FileXMLHttpRequest {
+    open(method, url) {
+        this.url = url;
+        this.readyState = 1;
+    }
+
+    setRequestHeader() {}
+
+    overrideMimeType() {}
+
+    getAllResponseHeaders() {
+        return '';
+    }
+
+    send() {
+        const fileUrl = new URL(this.url, pathToFileURL(process.cwd() + '/'));
+        readFile(fileUrl).then((data) => {
+            this.response = data.buffer.slice(
+                data.byteOffset, data.byteOffset + data.byteLength);
+            this.readyState = 4;
+            this.status = 200;
+            this.statusText = 'OK';
+            if (this.onreadystatechange) this.onreadystatechange();
+            const event = {loaded: data.byteLength, total: data.byteLength};
+            if (this.onload) this.onload(event);
+        }, () => {
+            this.readyState = 4;
+            this.status = 404;
+            this.statusText = 'Not Found';
+            if (this.onerror) this.onerror({loaded: 0, total: 0});
+        });
+    }
+}
+globalThis.XMLHttpRequest = FileXMLHttpRequest;
+
+/**
+ * Resolves once the model has been downloaded and loaded.
+ */
+function waitUntilReady(module) {
+    return new Promise((resolve) => {
+        const poll = () => {
+            if (module.isCodecReady()) {
+                resolve();
+            } else {
+                setTimeout(poll, 10);
+            }
+        };
+        poll();
+    });
+}
+
+async function main() {
+    const modulePath = process.argv[2] || './webassembly_codec_wrapper_threaded.js';
+    const numThreads = Number(process.argv[3]) || 1;
+    const {default: Module} = await import(pathToFileURL(modulePath).href);
+    const module = await Module({numThreads: numThreads});
+    await waitUntilReady(module);
+    console.log(`Codec ready with ${module.numThreads()} threads.`);
+
+    const numBytes = kNumSamples * Float32Array.BYTES_PER_ELEMENT;
+    const input = module._malloc(numBytes);
+    const output = module._malloc(numBytes);
+    const inputData = module.HEAPF32.subarray(input >> 2, (input >> 2) + kNumSamples);
+    for (let i = 0; i < kNumSamples; ++i) {
+        inputData[i] = 0.5 * Math.sin(2 * Math.PI * 440 * i / kSampleRateHz);
+    }
+    const start = performance.now();
+    const success = module.encodeAndDecode(input, kNumSamples, kSampleRateHz, output);
+    const elapsedMs = performance.now() - start;
+    module._free(input);
+    module._free(output);
+    if (!success) {
+        console.error('Encoding and decoding failed.');
+        process.exit(1);
+    }
+    console.log(`Coded ${kNumSamples} samples in ${elapsedMs.toFixed(1)} ms.`);
+    // The runtime is kept alive for the worker pool, so exit explicitly.
+    process.exit(0);
+}
+
+main().catch((e) => {
+    console.error(e);
+    process.exit(1);
+});
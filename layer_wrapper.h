@@ -26,6 +26,7 @@
 
 #include "dsp_util.h"
 #include "layer_wrapper_interface.h"
+#include "model_store.h"
 #include "sparse_matmul/sparse_matmul.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
 
@@ -92,7 +93,8 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
     }
   }
 
-  static std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  static std::shared_ptr<
+      const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
   LoadAndCheckLayer(const WavegruBufferInterface& wavegru_buffer,
                     const std::string& prefix, const std::string& layer_prompt,
                     int expected_rows, int expected_cols, int num_threads) {
@@ -128,12 +130,48 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
     return layer;
   }
 
+  // Returns the layer shared through |model_store|, which is already prepared
+  // for |num_threads|.
+  static std::shared_ptr<
+      const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  LoadAndCheckLayer(ModelStore& model_store, const std::string& prefix,
+                    const std::string& layer_prompt, int expected_rows,
+                    int expected_cols, int num_threads) {
+    auto layer =
+        model_store.GetSparseLayer<WeightType, RhsType, DiskWeightType>(
+            prefix, num_threads);
+    if (layer == nullptr) {
+      fprintf(stderr, "Loading %s failed.\n", layer_prompt.c_str());
+      return nullptr;
+    }
+    fprintf(stdout, "%s Shape: [%d, %d]. Sparsity: %s\n", layer_prompt.c_str(),
+            layer->rows(), layer->cols(),
+            std::to_string(layer->sparsity()).c_str());
+
+    // Dimension checks for the shared layer.
+    if ((expected_rows > 0 && layer->rows() != expected_rows) ||
+        (expected_cols > 0 && layer->cols() != expected_cols)) {
+      fprintf(
+          stderr,
+          "Dimension mismatch for %s. expecting [%d, %d], but is [%d, %d].\n",
+          layer_prompt.c_str(), expected_rows, expected_cols, layer->rows(),
+          layer->cols());
+      return nullptr;
+    }
+    return layer;
+  }
+
   // Convenient method used in all subclass creation methods.
-  static std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
-  LoadAndCheckLayer(
-      const std::variant<LayerParams::FromDisk, LayerParams::FromConstant> from,
-      const std::string& prefix, const std::string& layer_prompt,
-      int expected_rows, int expected_cols, int num_threads) {
+  static std::shared_ptr<
+      const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  LoadAndCheckLayer(const LayerParams::Source& from,
+                    const std::string& prefix, const std::string& layer_prompt,
+                    int expected_rows, int expected_cols, int num_threads) {
+    if (std::holds_alternative<LayerParams::FromModelStore>(from)) {
+      return LoadAndCheckLayer(
+          *std::get<LayerParams::FromModelStore>(from).model_store, prefix,
+          layer_prompt, expected_rows, expected_cols, num_threads);
+    }
     auto layer = absl::make_unique<
         csrblocksparse::SparseLinearLayer<WeightType, RhsType>>();
     if (std::holds_alternative<LayerParams::FromDisk>(from)) {
@@ -185,7 +223,7 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
   virtual csrblocksparse::MutableVectorView<RhsType> InputViewToUpdate() = 0;
 
   virtual int PrepareForThreads(int num_threads) {
-    return layer_->PrepareForThreads(num_threads);
+    return csrblocksparse::PrepareSharedLayerForThreads(num_threads, &layer_);
   }
 
   virtual int bytes() { return layer_->bytes(); }
@@ -200,7 +238,8 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
       int num_input_channels, int output_rows, int length,
       int input_buffer_rows, int input_buffer_cols, bool relu,
       bool per_column_barrier,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+      std::shared_ptr<
+          const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
           layer)
       : num_input_channels_(num_input_channels),
         output_rows_(output_rows),
@@ -253,7 +292,9 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
   // multiplication is done.
   const bool per_column_barrier_;
 
-  std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  // The weights and biases, which may be shared with other LayerWrappers
+  // created from the same ModelStore.
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
       layer_;
   csrblocksparse::FatCacheAlignedVector<RhsType> input_buffer_;
 
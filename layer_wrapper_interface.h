@@ -17,6 +17,7 @@
 #ifndef LYRA_CODEC_LAYER_WRAPPER_INTERFACE_H_
 #define LYRA_CODEC_LAYER_WRAPPER_INTERFACE_H_
 
+#include <memory>
 #include <string>
 #include <variant>
 
@@ -25,6 +26,8 @@
 namespace chromemedia {
 namespace codec {
 
+class ModelStore;
+
 enum class LayerType { kConv1D, kDilated, kTranspose };
 
 // Parameters to construct a LayerWrapper object.
@@ -62,8 +65,8 @@ struct LayerParams {
   int num_threads = 1;
   bool per_column_barrier = false;
 
-  // Where the layer get its values. Either from disk or from/ a specified
-  // constant.
+  // Where the layer get its values. Either from disk, from a specified
+  // constant or from a ModelStore.
   struct FromDisk {
     // Path to load the weights and biases from disk.
     std::string path = "";
@@ -79,7 +82,13 @@ struct LayerParams {
     // Sparsity < 0.0 means to create a fully dense layer.
     float sparsity = -1.0f;
   };
-  std::variant<FromDisk, FromConstant> from = FromDisk();
+  struct FromModelStore {
+    // Store owning the weights and biases, which are shared with all other
+    // layers created from the same store.
+    std::shared_ptr<ModelStore> model_store;
+  };
+  using Source = std::variant<FromDisk, FromConstant, FromModelStore>;
+  Source from = FromDisk();
 
   std::string prefix = "";
 };
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <complex>
 #include <cstdint>
 #include <memory>
 #include <optional>
@@ -24,9 +25,10 @@
 
 #include "absl/memory/memory.h"
 #include "absl/types/span.h"
+#include "audio/dsp/kiss_fft.h"
 #include "audio/dsp/mfcc/mel_filterbank.h"
 #include "audio/dsp/number_util.h"
-#include "audio/dsp/spectrogram/spectrogram.h"
+#include "audio/dsp/window_functions.h"
 
 namespace chromemedia {
 namespace codec {
@@ -41,13 +43,19 @@ static constexpr double kUpperFreqLimitFactor = 0.495;
 }  // namespace
 
 LogMelSpectrogramExtractorImpl::LogMelSpectrogramExtractorImpl(
-    std::unique_ptr<audio_dsp::Spectrogram> spectrogram,
-    std::unique_ptr<audio_dsp::MelFilterbank> mel_filterbank,
-    int hop_length_samples)
-    : spectrogram_(std::move(spectrogram)),
-      mel_filterbank_(std::move(mel_filterbank)),
-      hop_length_samples_(hop_length_samples),
-      samples_(hop_length_samples, 0.0) {}
+    std::unique_ptr<audio_dsp::RealFFTTransformer> fft,
+    std::vector<float> window, std::vector<MelBand> mel_bands,
+    std::vector<float> mel_weights, int hop_length_samples)
+    : fft_(std::move(fft)),
+      fft_input_(fft_->GetSize(), 0.0f),
+      fft_output_(fft_->GetTransformedSize()),
+      magnitudes_(fft_->GetTransformedSize()),
+      window_(std::move(window)),
+      window_samples_(window_.size(), 0.0f),
+      window_start_(0),
+      mel_bands_(std::move(mel_bands)),
+      mel_weights_(std::move(mel_weights)),
+      hop_length_samples_(hop_length_samples) {}
 
 std::unique_ptr<LogMelSpectrogramExtractorImpl>
 LogMelSpectrogramExtractorImpl::Create(int sample_rate_hz, int num_mel_bins,
@@ -59,68 +67,132 @@ LogMelSpectrogramExtractorImpl::Create(int sample_rate_hz, int num_mel_bins,
                << hop_length_samples;
     return nullptr;
   }
-  auto spectrogram = absl::make_unique<audio_dsp::Spectrogram>();
-  if (!spectrogram->Initialize(window_length_samples, hop_length_samples)) {
+  if (hop_length_samples < 1 || window_length_samples < 2) {
     std::cerr << "Could not initialize spectrogram for feature extraction.";
     return nullptr;
   }
-  // To get a spectrogram for the first audio of hop length samples we first
-  // calculate the spectrogram of an empty window to fill the internal queue.
-  std::vector<std::vector<double>> unused_spectrogram_slices;
-  if (!spectrogram->ComputeSpectrogram(
-          std::vector<double>(window_length_samples, 0.0),
-          &unused_spectrogram_slices)) {
-    std::cerr << "Error calculating spectrogram of empty window.";
-    return nullptr;
-  }
 
   // Compute the next power of two for FFT size.
   const int kFftSize = static_cast<int>(
       audio_dsp::NextPowerOfTwo(static_cast<unsigned>(window_length_samples)));
   // Number of unique FFT bins.
   const int kFftBins = kFftSize / 2 + 1;
-  auto mel_filterbank = absl::make_unique<audio_dsp::MelFilterbank>();
-  if (!mel_filterbank->Initialize(kFftBins, sample_rate_hz, num_mel_bins,
-                                  kLowerFreqLimit,
-                                  GetUpperFreqLimit(sample_rate_hz))) {
+  audio_dsp::MelFilterbank mel_filterbank;
+  if (!mel_filterbank.Initialize(kFftBins, sample_rate_hz, num_mel_bins,
+                                 kLowerFreqLimit,
+                                 GetUpperFreqLimit(sample_rate_hz))) {
     std::cerr << "Could not initialize mel filterbank for feature extraction.";
     return nullptr;
   }
 
+  // The weights of the filterbank are recovered by filtering a unit spectrum
+  // at each FFT bin in turn. Each mel band only spans a short run of bins, so
+  // only the weights of that run are kept.
+  std::vector<std::vector<double>> bin_weights(kFftBins);
+  std::vector<double> unit_spectrum(kFftBins, 0.0);
+  for (int bin = 0; bin < kFftBins; ++bin) {
+    unit_spectrum[bin] = 1.0;
+    mel_filterbank.Compute(unit_spectrum, &bin_weights[bin]);
+    unit_spectrum[bin] = 0.0;
+  }
+  std::vector<MelBand> mel_bands;
+  std::vector<float> mel_weights;
+  for (int band = 0; band < num_mel_bins; ++band) {
+    int start_bin = 0;
+    int end_bin = 0;
+    for (int bin = 0; bin < kFftBins; ++bin) {
+      if (bin_weights[bin][band] != 0.0) {
+        if (start_bin == end_bin) {
+          start_bin = bin;
+        }
+        end_bin = bin + 1;
+      }
+    }
+    mel_bands.push_back({start_bin, end_bin - start_bin,
+                         static_cast<int>(mel_weights.size())});
+    for (int bin = start_bin; bin < end_bin; ++bin) {
+      mel_weights.push_back(static_cast<float>(bin_weights[bin][band]));
+    }
+  }
+
+  std::vector<float> window;
+  audio_dsp::HannWindow().GetPeriodicSamples(window_length_samples, &window);
+
   return absl::WrapUnique(new LogMelSpectrogramExtractorImpl(
-      std::move(spectrogram), std::move(mel_filterbank), hop_length_samples));
+      absl::make_unique<audio_dsp::RealFFTTransformer>(
+          kFftSize, /*normalization=*/false),
+      std::move(window), std::move(mel_bands), std::move(mel_weights),
+      hop_length_samples));
 }
 
 absl::optional<std::vector<float>> LogMelSpectrogramExtractorImpl::Extract(
     const absl::Span<const int16_t> audio) {
+  std::vector<float> mel_features(mel_bands_.size());
+  if (!Extract(audio, absl::MakeSpan(mel_features))) {
+    return absl::nullopt;
+  }
+  return mel_features;
+}
+
+bool LogMelSpectrogramExtractorImpl::Extract(
+    const absl::Span<const int16_t> audio, absl::Span<float> features) {
+  if (features.size() != mel_bands_.size()) {
+    std::cerr << "Features should have " << mel_bands_.size()
+              << " values but instead had " << features.size() << ".";
+    return false;
+  }
   if (audio.size() != hop_length_samples_) {
     std::cerr << "Audio frame should have " << hop_length_samples_
                << " samples but instead had " << audio.size() << ".";
-    return absl::nullopt;
+    return false;
   }
 
-  std::copy(audio.begin(), audio.end(), samples_.begin());
-
-  std::vector<std::vector<double>> spectrogram_slices;
-  if (!spectrogram_->ComputeSpectrogram(samples_, &spectrogram_slices)) {
-    std::cerr << "Could not compute spectrogram from audio.";
-    return absl::nullopt;
+  // The new audio replaces the oldest hop of samples in the ring, after which
+  // the oldest sample follows it.
+  const int window_length_samples = window_samples_.size();
+  const int num_samples_to_end =
+      std::min(hop_length_samples_, window_length_samples - window_start_);
+  std::copy(audio.begin(), audio.begin() + num_samples_to_end,
+            window_samples_.begin() + window_start_);
+  std::copy(audio.begin() + num_samples_to_end, audio.end(),
+            window_samples_.begin());
+  window_start_ = (window_start_ + hop_length_samples_) % window_length_samples;
+
+  // Window the samples from the oldest on. The rest of the FFT input is zero
+  // padding.
+  const int num_oldest_samples = window_length_samples - window_start_;
+  const float* oldest_samples = window_samples_.data() + window_start_;
+  for (int i = 0; i < num_oldest_samples; ++i) {
+    fft_input_[i] = oldest_samples[i] * window_[i];
   }
-  if (spectrogram_slices.size() != 1) {
-    std::cerr << "Spectrogram had unexpected number of output frames.";
-    return absl::nullopt;
+  for (int i = num_oldest_samples; i < window_length_samples; ++i) {
+    fft_input_[i] = window_samples_[i - num_oldest_samples] * window_[i];
+  }
+  fft_->ForwardTransform(fft_input_.data(), fft_output_.data());
+
+  // The mel filterbank weights the linear magnitudes of the spectrum.
+  const float* spectrum = reinterpret_cast<const float*>(fft_output_.data());
+  const int num_bins = magnitudes_.size();
+  for (int i = 0; i < num_bins; ++i) {
+    const float real = spectrum[2 * i];
+    const float imag = spectrum[2 * i + 1];
+    magnitudes_[i] = std::sqrt(real * real + imag * imag);
   }
 
-  std::vector<double> temp_features;
-  mel_filterbank_->Compute(spectrogram_slices.at(0), &temp_features);
-  std::vector<float> mel_features(temp_features.begin(), temp_features.end());
-  // Compute the log, but disallow values below the floor, then
-  // normalize the amplitude to avoid clipping in Wavenet.
-  for (auto& val : mel_features) {
-    val = std::log(std::max(val, kLogFloor)) / kNorm;
+  for (int band = 0; band < mel_bands_.size(); ++band) {
+    const MelBand& mel_band = mel_bands_[band];
+    const float* magnitudes = magnitudes_.data() + mel_band.start_bin;
+    const float* weights = mel_weights_.data() + mel_band.weights_offset;
+    float mel = 0.f;
+    for (int i = 0; i < mel_band.num_bins; ++i) {
+      mel += weights[i] * magnitudes[i];
+    }
+    // Compute the log, but disallow values below the floor, then
+    // normalize the amplitude to avoid clipping in Wavenet.
+    features[band] = std::log(std::max(mel, kLogFloor)) / kNorm;
   }
 
-  return mel_features;
+  return true;
 }
 
 double LogMelSpectrogramExtractorImpl::GetLowerFreqLimit() {
@@ -17,14 +17,14 @@
 #ifndef LYRA_CODEC_LOG_MEL_SPECTROGRAM_EXTRACTOR_IMPL_H_
 #define LYRA_CODEC_LOG_MEL_SPECTROGRAM_EXTRACTOR_IMPL_H_
 
+#include <complex>
 #include <cstdint>
 #include <memory>
 #include <vector>
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
-#include "audio/dsp/mfcc/mel_filterbank.h"
-#include "audio/dsp/spectrogram/spectrogram.h"
+#include "audio/dsp/kiss_fft.h"
 #include "feature_extractor_interface.h"
 
 namespace chromemedia {
@@ -43,9 +43,16 @@ class LogMelSpectrogramExtractorImpl : public FeatureExtractorInterface {
   // Extracts the mel features from the audio. On failure returns a nullopt.
   // The size of audio must match the value of hop_length_samples_.
   // This assumes that audio frames are passed in order.
+  // The features are computed in single precision and, apart from the returned
+  // vector, without allocating.
   absl::optional<std::vector<float>> Extract(
       const absl::Span<const int16_t> audio) override;
 
+  // Same as above, but writes the features to |features|, whose size must be
+  // the number of mel bins, without allocating at all.
+  bool Extract(const absl::Span<const int16_t> audio,
+               absl::Span<float> features) override;
+
   // Returns the lower frequency limit used to initialize the MelFilterbank
   // class.
   static double GetLowerFreqLimit();
@@ -62,16 +69,36 @@ class LogMelSpectrogramExtractorImpl : public FeatureExtractorInterface {
   static float GetSilenceValue();
 
  private:
+  // The mel weights of the contiguous run of FFT bins which a mel band spans.
+  struct MelBand {
+    int start_bin;
+    int num_bins;
+    // Index of the weight of |start_bin| in |mel_weights_|.
+    int weights_offset;
+  };
+
   LogMelSpectrogramExtractorImpl() = delete;
   LogMelSpectrogramExtractorImpl(
-      std::unique_ptr<audio_dsp::Spectrogram> spectrogram,
-      std::unique_ptr<audio_dsp::MelFilterbank> mel_filterbank,
-      int hop_length_samples);
+      std::unique_ptr<audio_dsp::RealFFTTransformer> fft,
+      std::vector<float> window, std::vector<MelBand> mel_bands,
+      std::vector<float> mel_weights, int hop_length_samples);
+
+  // Real FFT plan, zero-padded windowed input and its transform.
+  const std::unique_ptr<audio_dsp::RealFFTTransformer> fft_;
+  std::vector<float> fft_input_;
+  std::vector<std::complex<float>> fft_output_;
+  std::vector<float> magnitudes_;
+
+  // Periodic Hann window of the analysis window length.
+  const std::vector<float> window_;
+  // Ring buffer holding the last window length of samples, the oldest of which
+  // is at |window_start_|.
+  std::vector<float> window_samples_;
+  int window_start_;
 
-  const std::unique_ptr<audio_dsp::Spectrogram> spectrogram_;
-  const std::unique_ptr<const audio_dsp::MelFilterbank> mel_filterbank_;
+  const std::vector<MelBand> mel_bands_;
+  const std::vector<float> mel_weights_;
   const int hop_length_samples_;
-  std::vector<double> samples_;
 };
 
 }  // namespace codec
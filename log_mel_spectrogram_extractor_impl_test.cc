@@ -14,12 +14,18 @@
 
 #include "log_mel_spectrogram_extractor_impl.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <memory>
 #include <optional>
 #include <vector>
 
+#include "absl/random/random.h"
 #include "absl/types/span.h"
+#include "audio/dsp/mfcc/mel_filterbank.h"
+#include "audio/dsp/number_util.h"
+#include "audio/dsp/spectrogram/spectrogram.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -32,6 +38,7 @@ static constexpr int kNumMelBins = 10;
 static constexpr int kHopLengthSamples = 5;
 static constexpr int kWindowLengthSamples = 10;
 static constexpr int kNumOutputMelBins = 3;
+static constexpr double kLogFloor = 500.0;
 
 static constexpr int16_t kWavData[] = {7954,   10085, 8733,   10844,  29949,
                                        -549,   20833, 30345,  18086,  11375,
@@ -100,6 +107,60 @@ TEST_F(LogMelSpectrogramExtractorImplTest, FrameShorterThanExpected) {
   EXPECT_FALSE(features_or.has_value());
 }
 
+// Compares the features to those of a double precision spectrogram and mel
+// filterbank at the sizes Lyra uses.
+TEST(LogMelSpectrogramExtractorImplPrecisionTest, MatchesDoublePrecision) {
+  const int kSampleRateHz = 16000;
+  const int kNumLyraMelBins = 160;
+  const int kHopLength = 640;
+  const int kWindowLength = 1280;
+  auto feature_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kSampleRateHz, kNumLyraMelBins, kHopLength, kWindowLength);
+  ASSERT_NE(feature_extractor, nullptr);
+
+  audio_dsp::Spectrogram spectrogram;
+  ASSERT_TRUE(spectrogram.Initialize(kWindowLength, kHopLength));
+  std::vector<std::vector<double>> spectrogram_slices;
+  ASSERT_TRUE(spectrogram.ComputeSpectrogram(
+      std::vector<double>(kWindowLength, 0.0), &spectrogram_slices));
+  audio_dsp::MelFilterbank mel_filterbank;
+  ASSERT_TRUE(mel_filterbank.Initialize(
+      audio_dsp::NextPowerOfTwo(kWindowLength) / 2 + 1, kSampleRateHz,
+      kNumLyraMelBins, LogMelSpectrogramExtractorImpl::GetLowerFreqLimit(),
+      LogMelSpectrogramExtractorImpl::GetUpperFreqLimit(kSampleRateHz)));
+
+  absl::BitGen gen;
+  std::vector<int16_t> audio_frame(kHopLength);
+  for (int frame = 0; frame < 10; ++frame) {
+    // Alternates loud and quiet frames so that some bands are floored.
+    const int16_t amplitude = frame % 2 == 0 ? INT16_MAX : 4;
+    for (auto& sample : audio_frame) {
+      sample = absl::Uniform<int16_t>(absl::IntervalClosed, gen, -amplitude,
+                                      amplitude);
+    }
+
+    auto features_or =
+        feature_extractor->Extract(absl::MakeConstSpan(audio_frame));
+    ASSERT_TRUE(features_or.has_value());
+
+    ASSERT_TRUE(spectrogram.ComputeSpectrogram(
+        std::vector<double>(audio_frame.begin(), audio_frame.end()),
+        &spectrogram_slices));
+    ASSERT_EQ(spectrogram_slices.size(), 1);
+    std::vector<double> mel;
+    mel_filterbank.Compute(spectrogram_slices[0], &mel);
+    std::vector<float> expected_features(mel.size());
+    for (int i = 0; i < mel.size(); ++i) {
+      expected_features[i] =
+          std::log(std::max(mel[i], kLogFloor)) /
+          LogMelSpectrogramExtractorImpl::GetNormalizationFactor();
+    }
+    EXPECT_THAT(features_or.value(),
+                testing::Pointwise(testing::FloatNear(1e-5f),
+                                   expected_features));
+  }
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
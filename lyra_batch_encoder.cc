@@ -0,0 +1,322 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_batch_encoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "dsp_util.h"
+#include "lyra_components.h"
+#include "lyra_config.h"
+#include "model_store.h"
+#include "noise_estimator.h"
+#include "resampler.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<LyraBatchEncoder> LyraBatchEncoder::Create(
+    int num_streams, int sample_rate_hz, int num_channels, int bitrate,
+    bool enable_dtx, std::shared_ptr<ModelStore> model_store) {
+  if (num_streams <= 0) {
+    fprintf(stderr, "Error: The number of streams must be positive.\n");
+    return nullptr;
+  }
+  // The model configuration can only be checked when reading from disk.
+  absl::Status are_params_supported =
+      model_store->model_path().empty()
+          ? AreParamsSupported(sample_rate_hz, num_channels, bitrate)
+          : AreParamsSupported(sample_rate_hz, num_channels, bitrate,
+                               model_store->model_path());
+  if (!are_params_supported.ok()) {
+    std::cerr << "ERROR: " << are_params_supported << std::endl;
+    return nullptr;
+  }
+
+  const int internal_samples_per_hop =
+      GetNumSamplesPerHop(kInternalSampleRateHz);
+  std::vector<Stream> streams(num_streams);
+  for (Stream& stream : streams) {
+    if (kInternalSampleRateHz != sample_rate_hz) {
+      stream.resampler =
+          Resampler::Create(sample_rate_hz, kInternalSampleRateHz);
+      if (stream.resampler == nullptr) {
+        fprintf(stderr, "Error: Failed to create resampler.\n");
+        return nullptr;
+      }
+    }
+
+    stream.feature_extractor = CreateFeatureExtractor(
+        kInternalSampleRateHz, kNumFeatures, internal_samples_per_hop,
+        GetNumSamplesPerFrame(kInternalSampleRateHz));
+    if (stream.feature_extractor == nullptr) {
+      fprintf(stderr, "Error: Failed to create feature extractor.\n");
+      return nullptr;
+    }
+
+    stream.noise_estimator = NoiseEstimator::Create(
+        kNumFeatures,
+        static_cast<float>(internal_samples_per_hop) / kInternalSampleRateHz);
+    if (stream.noise_estimator == nullptr) {
+      fprintf(stderr, "Error: Failed to create noise estimator.\n");
+      return nullptr;
+    }
+
+    auto denoiser = CreateDenoiser(model_store->model_path());
+    if (!denoiser.ok()) {
+      fprintf(stderr, "Error: Failed to create denoiser.\n");
+      return nullptr;
+    }
+    stream.denoiser = std::move(denoiser.value());
+    if (stream.denoiser != nullptr && stream.denoiser->SamplesPerHop() != 0 &&
+        internal_samples_per_hop % stream.denoiser->SamplesPerHop() != 0) {
+      fprintf(stderr,
+              "Error: Denoiser hop size must divide the "
+              "encoder hop size.\n");
+      return nullptr;
+    }
+  }
+
+  // All streams share a single quantizer, which searches their features at
+  // once.
+  auto vector_quantizer = CreateQuantizer(
+      kNumFramesPerPacket * kNumExpectedOutputFeatures, kNumQuantizationBits,
+      model_store);
+  if (vector_quantizer == nullptr) {
+    fprintf(stderr, "Error: Failed to create vector quantizer.\n");
+    return nullptr;
+  }
+
+  // WrapUnique is used because of private c'tor.
+  return absl::WrapUnique(new LyraBatchEncoder(
+      std::move(streams), std::move(vector_quantizer), CreatePacket(),
+      sample_rate_hz, num_channels, bitrate, kNumFramesPerPacket,
+      enable_dtx));
+}
+
+LyraBatchEncoder::LyraBatchEncoder(
+    std::vector<Stream> streams,
+    std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
+    std::unique_ptr<PacketInterface> packet, int sample_rate_hz,
+    int num_channels, int bitrate, int num_frames_per_packet, bool enable_dtx)
+    : streams_(std::move(streams)),
+      vector_quantizer_(std::move(vector_quantizer)),
+      packet_(std::move(packet)),
+      sample_rate_hz_(sample_rate_hz),
+      num_channels_(num_channels),
+      bitrate_(bitrate),
+      num_frames_per_packet_(num_frames_per_packet),
+      enable_dtx_(enable_dtx),
+      batch_samples_(streams_.size(),
+                     num_frames_per_packet *
+                         GetNumSamplesPerHop(kInternalSampleRateHz)),
+      filtered_samples_(batch_samples_.rows(), batch_samples_.cols()),
+      stream_samples_(batch_samples_.cols() + 1),
+      batch_features_(streams_.size() * num_frames_per_packet * kNumFeatures),
+      quantized_bits_(streams_.size() * packet_->PacketSize()) {
+  quantized_streams_.reserve(streams_.size());
+  second_order_sections_filter_.Init(streams_.size(),
+                                     CreateHighPassFilterCoefficients());
+}
+
+bool LyraBatchEncoder::EncodeBatch(
+    absl::Span<const absl::Span<const int16_t>> audio,
+    std::vector<std::vector<uint8_t>>* packets) {
+  if (audio.size() != streams_.size()) {
+    fprintf(stderr,
+            "The number of streams of audio (%zu) does not match the "
+            "number of streams of the encoder (%zu).\n",
+            audio.size(), streams_.size());
+    return false;
+  }
+  for (int stream = 0; stream < streams_.size(); ++stream) {
+    if (!PrepareStreamAudio(stream, audio[stream])) {
+      return false;
+    }
+  }
+
+  // High-pass filter all streams at once before encoding.
+  second_order_sections_filter_.ProcessBlock(batch_samples_,
+                                             &filtered_samples_);
+
+  const int num_features_per_packet = num_frames_per_packet_ * kNumFeatures;
+  quantized_streams_.clear();
+  packets->resize(streams_.size());
+  for (int stream = 0; stream < streams_.size(); ++stream) {
+    // Features of packets which are not quantized are overwritten by the next
+    // stream.
+    const auto is_silent = ExtractStreamFeatures(
+        stream, absl::MakeSpan(batch_features_)
+                    .subspan(quantized_streams_.size() *
+                                 num_features_per_packet,
+                             num_features_per_packet));
+    if (!is_silent.has_value()) {
+      return false;
+    }
+    if (is_silent.value()) {
+      (*packets)[stream].clear();
+    } else {
+      quantized_streams_.push_back(stream);
+    }
+  }
+  if (quantized_streams_.empty()) {
+    return true;
+  }
+
+  const int num_quantized = quantized_streams_.size();
+  const int packet_size = packet_->PacketSize();
+  if (!vector_quantizer_->QuantizeBatchToBits(
+          absl::MakeConstSpan(batch_features_)
+              .subspan(0, num_quantized * num_features_per_packet),
+          num_quantized,
+          absl::MakeSpan(quantized_bits_)
+              .subspan(0, num_quantized * packet_size))) {
+    fprintf(stderr, "Vector quantization failed.\n");
+    return false;
+  }
+  for (int i = 0; i < num_quantized; ++i) {
+    std::vector<uint8_t>& packet = (*packets)[quantized_streams_[i]];
+    packet.resize(packet_size);
+    if (!packet_->PackQuantizedBits(
+            absl::MakeConstSpan(quantized_bits_)
+                .subspan(i * packet_size, packet_size),
+            absl::MakeSpan(packet))) {
+      fprintf(stderr, "Packing quantized features failed.\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LyraBatchEncoder::PrepareStreamAudio(int stream,
+                                          absl::Span<const int16_t> audio) {
+  const Stream& components = streams_[stream];
+  absl::Span<const int16_t> audio_for_encoding = audio;
+  if (components.resampler != nullptr) {
+    const int num_resampled = components.resampler->Resample(
+        audio, absl::MakeSpan(stream_samples_));
+    if (num_resampled < 0) {
+      fprintf(stderr, "Resampled audio of stream %d is too long.\n", stream);
+      return false;
+    }
+    audio_for_encoding =
+        absl::MakeConstSpan(stream_samples_).subspan(0, num_resampled);
+  }
+
+  const int num_samples = batch_samples_.cols();
+  if (audio_for_encoding.size() != num_samples) {
+    fprintf(stderr,
+            "The number of audio samples (%zu) of stream %d does not match "
+            "the number of frames per packet (%d) times the internal hop "
+            "size (%d).\n",
+            audio_for_encoding.size(), stream, num_frames_per_packet_,
+            GetNumSamplesPerHop(kInternalSampleRateHz));
+    return false;
+  }
+
+  if (components.denoiser != nullptr) {
+    // Default to the internal frame hop size.
+    const int samples_per_hop =
+        components.denoiser->SamplesPerHop() == 0
+            ? GetNumSamplesPerHop(kInternalSampleRateHz)
+            : components.denoiser->SamplesPerHop();
+    for (int t = 0; t < num_samples; t += samples_per_hop) {
+      auto denoised_frame = components.denoiser->Denoise(
+          audio_for_encoding.subspan(t, samples_per_hop));
+      if (!denoised_frame.ok() ||
+          denoised_frame.value().size() != samples_per_hop) {
+        fprintf(stderr, "Denoising failed.\n");
+        return false;
+      }
+      for (int i = 0; i < samples_per_hop; ++i) {
+        batch_samples_(stream, t + i) = denoised_frame.value()[i];
+      }
+    }
+    return true;
+  }
+
+  for (int t = 0; t < num_samples; ++t) {
+    batch_samples_(stream, t) = audio_for_encoding[t];
+  }
+  return true;
+}
+
+absl::optional<bool> LyraBatchEncoder::ExtractStreamFeatures(
+    int stream, absl::Span<float> features) {
+  const Stream& components = streams_[stream];
+  const int num_samples = filtered_samples_.cols();
+  for (int t = 0; t < num_samples; ++t) {
+    stream_samples_[t] = ClipToInt16(filtered_samples_(stream, t));
+  }
+
+  // A packet is silent only if all constituent frames are noise similar to
+  // the previous ones.
+  const int internal_samples_per_hop =
+      GetNumSamplesPerHop(kInternalSampleRateHz);
+  int num_similar_noise_frames = 0;
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    auto features_or = components.feature_extractor->Extract(
+        absl::MakeConstSpan(stream_samples_)
+            .subspan(internal_samples_per_hop * i, internal_samples_per_hop));
+    if (!features_or.has_value() ||
+        features_or.value().size() != kNumFeatures) {
+      fprintf(stderr, "Feature extraction from audio frame failed.\n");
+      return absl::nullopt;
+    }
+    const std::vector<float>& frame_features = features_or.value();
+
+    if (enable_dtx_) {
+      auto is_similar_noise =
+          components.noise_estimator->IsSimilarNoise(frame_features);
+      if (!is_similar_noise.has_value()) {
+        fprintf(stderr, "Unable to check noise estimation.\n");
+        return absl::nullopt;
+      }
+
+      if (is_similar_noise.value()) {
+        num_similar_noise_frames++;
+      } else if (!components.noise_estimator->Update(frame_features)) {
+        fprintf(stderr, "Unable to update noise estimator.\n");
+        return absl::nullopt;
+      }
+    }
+
+    std::copy(frame_features.begin(), frame_features.end(),
+              features.begin() + i * kNumFeatures);
+  }
+  return num_similar_noise_frames == num_frames_per_packet_;
+}
+
+int LyraBatchEncoder::num_streams() const { return streams_.size(); }
+
+int LyraBatchEncoder::sample_rate_hz() const { return sample_rate_hz_; }
+
+int LyraBatchEncoder::num_channels() const { return num_channels_; }
+
+int LyraBatchEncoder::bitrate() const { return bitrate_; }
+
+int LyraBatchEncoder::frame_rate() const { return kFrameRate; }
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_BATCH_ENCODER_H_
+#define LYRA_CODEC_LYRA_BATCH_ENCODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Eigen/Core"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "audio/linear_filters/biquad_filter.h"
+#include "denoiser_interface.h"
+#include "feature_extractor_interface.h"
+#include "model_store.h"
+#include "noise_estimator_interface.h"
+#include "packet_interface.h"
+#include "resampler_interface.h"
+#include "vector_quantizer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+/// Lyra encoder of many independent streams at once.
+///
+/// Each call encodes one packet of every stream, producing the same packets
+/// as a LyraEncoder per stream would. The high-pass filter runs over all
+/// streams at once, and the features of all streams are projected and
+/// searched in the codebooks as a single batch. The resampler, feature
+/// extractor and noise estimator keep separate state for each stream.
+class LyraBatchEncoder {
+ public:
+  /// Static method to create a LyraBatchEncoder.
+  ///
+  /// @param num_streams Number of streams encoded by each call. Must be
+  ///                    positive.
+  /// @param sample_rate_hz Desired sample rate in Hertz of all streams. The
+  ///                       supported sample rates are 8000, 16000, 32000 and
+  ///                       48000.
+  /// @param num_channels Desired number of channels. Currently only 1 is
+  ///                     supported.
+  /// @param bitrate Desired bit rate. Currently only 3000 is supported.
+  /// @param enable_dtx Set to true if discontinuous transmission should be
+  ///                   enabled.
+  /// @param model_store Store owning the model weights.
+  /// @return A unique_ptr to a LyraBatchEncoder if all desired params are
+  ///         supported. Else it returns a nullptr.
+  static std::unique_ptr<LyraBatchEncoder> Create(
+      int num_streams, int sample_rate_hz, int num_channels, int bitrate,
+      bool enable_dtx, std::shared_ptr<ModelStore> model_store);
+
+  /// Encodes a packet of each stream.
+  ///
+  /// @param audio Span of int16-formatted samples of each stream, in order.
+  ///              Each is assumed to contain 40ms of data at the sample rate
+  ///              chosen at Create time.
+  /// @param packets Resized to the number of streams and filled with the
+  ///                encoded packet of each stream. If DTX is enabled packets
+  ///                deemed to contain silence are empty.
+  /// @return True on success. Else the contents of |packets| are unspecified.
+  bool EncodeBatch(absl::Span<const absl::Span<const int16_t>> audio,
+                   std::vector<std::vector<uint8_t>>* packets);
+
+  /// Getter for the number of streams.
+  ///
+  /// @return Number of streams.
+  int num_streams() const;
+
+  /// Getter for the sample rate in Hertz.
+  ///
+  /// @return Sample rate in Hertz.
+  int sample_rate_hz() const;
+
+  /// Getter for the number of channels.
+  ///
+  /// @return Number of channels.
+  int num_channels() const;
+
+  /// Getter for the bitrate.
+  ///
+  /// @return Bitrate.
+  int bitrate() const;
+
+  /// Getter for the frame rate.
+  ///
+  /// @return Frame rate.
+  int frame_rate() const;
+
+ private:
+  // The components which keep the state of one stream.
+  struct Stream {
+    std::unique_ptr<ResamplerInterface> resampler;
+    std::unique_ptr<FeatureExtractorInterface> feature_extractor;
+    std::unique_ptr<NoiseEstimatorInterface> noise_estimator;
+    std::unique_ptr<DenoiserInterface> denoiser;
+  };
+
+  LyraBatchEncoder() = delete;
+  LyraBatchEncoder(std::vector<Stream> streams,
+                   std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
+                   std::unique_ptr<PacketInterface> packet, int sample_rate_hz,
+                   int num_channels, int bitrate, int num_frames_per_packet,
+                   bool enable_dtx);
+
+  // Resamples and denoises the audio of |stream| into its row of
+  // |batch_samples_|.
+  bool PrepareStreamAudio(int stream, absl::Span<const int16_t> audio);
+
+  // Extracts the features of |stream| from its row of |filtered_samples_|
+  // and updates its noise estimator. Returns a nullopt on failure, else
+  // whether all frames are noise similar to the previous ones.
+  absl::optional<bool> ExtractStreamFeatures(int stream,
+                                             absl::Span<float> features);
+
+  std::vector<Stream> streams_;
+  const std::unique_ptr<VectorQuantizerInterface> vector_quantizer_;
+  const std::unique_ptr<PacketInterface> packet_;
+  const int sample_rate_hz_;
+  const int num_channels_;
+  const int bitrate_;
+  const int num_frames_per_packet_;
+  const bool enable_dtx_;
+  // Filters the samples of all streams at once, one channel per stream.
+  linear_filters::BiquadFilterCascade<Eigen::ArrayXf>
+      second_order_sections_filter_;
+  // The samples of a packet of each stream at |kInternalSampleRateHz|, one
+  // row per stream, so that each column holds a sample of all streams.
+  Eigen::ArrayXXf batch_samples_;
+  Eigen::ArrayXXf filtered_samples_;
+  // Scratch space for the samples of a single stream. Resampling a packet may
+  // round up by a sample.
+  std::vector<int16_t> stream_samples_;
+  // The features of the packets to quantize, one after the other, and the
+  // stream each belongs to.
+  std::vector<float> batch_features_;
+  std::vector<int> quantized_streams_;
+  // The quantized features of the packets, packed as described in
+  // packed_bits.h, each in |packet_->PacketSize()| bytes.
+  std::vector<uint8_t> quantized_bits_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_BATCH_ENCODER_H_
@@ -0,0 +1,155 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_batch_encoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Placeholder for get runfiles header.
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_encoder.h"
+#include "model_store.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kNumStreams = 5;
+constexpr int kNumPackets = 6;
+
+class LyraBatchEncoderTest
+    : public testing::TestWithParam<testing::tuple<int, bool>> {
+ protected:
+  LyraBatchEncoderTest()
+      : sample_rate_hz_(std::get<0>(GetParam())),
+        enable_dtx_(std::get<1>(GetParam())),
+        num_samples_per_packet_(kNumFramesPerPacket *
+                                GetNumSamplesPerHop(sample_rate_hz_)),
+        model_store_(ModelStore::Create(ghc::filesystem::current_path() /
+                                        "wavegru")) {}
+
+  // Returns a packet of audio of |stream|, which is a tone of its own
+  // frequency and level, except for the last stream which is silent.
+  std::vector<int16_t> StreamAudio(int stream, int packet) const {
+    std::vector<int16_t> audio(num_samples_per_packet_, 0);
+    if (stream == kNumStreams - 1) {
+      return audio;
+    }
+    const float frequency_hz = 100.0f + 450.0f * stream;
+    for (int i = 0; i < audio.size(); ++i) {
+      const int t = packet * num_samples_per_packet_ + i;
+      audio[i] = static_cast<int16_t>(
+          (2000.0f + 3000.0f * stream) *
+          std::sin(2.0f * M_PI * frequency_hz * t / sample_rate_hz_));
+    }
+    return audio;
+  }
+
+  const int sample_rate_hz_;
+  const bool enable_dtx_;
+  const int num_samples_per_packet_;
+  std::shared_ptr<ModelStore> model_store_;
+};
+
+TEST_P(LyraBatchEncoderTest, MatchesEncoderPerStream) {
+  auto batch_encoder =
+      LyraBatchEncoder::Create(kNumStreams, sample_rate_hz_, kNumChannels,
+                               kBitrate, enable_dtx_, model_store_);
+  ASSERT_NE(batch_encoder, nullptr);
+  EXPECT_EQ(batch_encoder->num_streams(), kNumStreams);
+  std::vector<std::unique_ptr<LyraEncoder>> encoders;
+  for (int stream = 0; stream < kNumStreams; ++stream) {
+    encoders.push_back(LyraEncoder::Create(sample_rate_hz_, kNumChannels,
+                                           kBitrate, enable_dtx_,
+                                           model_store_));
+    ASSERT_NE(encoders.back(), nullptr);
+  }
+
+  std::vector<std::vector<uint8_t>> packets;
+  int num_empty_packets = 0;
+  for (int packet = 0; packet < kNumPackets; ++packet) {
+    std::vector<std::vector<int16_t>> audio;
+    std::vector<absl::Span<const int16_t>> audio_spans;
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      audio.push_back(StreamAudio(stream, packet));
+    }
+    for (const auto& stream_audio : audio) {
+      audio_spans.push_back(absl::MakeConstSpan(stream_audio));
+    }
+
+    ASSERT_TRUE(batch_encoder->EncodeBatch(audio_spans, &packets));
+
+    ASSERT_EQ(packets.size(), kNumStreams);
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      const auto expected_or = encoders[stream]->Encode(audio[stream]);
+      ASSERT_TRUE(expected_or.has_value());
+      EXPECT_EQ(packets[stream], expected_or.value())
+          << "stream " << stream << " packet " << packet;
+      num_empty_packets += packets[stream].empty();
+    }
+  }
+  // Only DTX sends the silent stream as empty packets.
+  if (enable_dtx_) {
+    EXPECT_GT(num_empty_packets, 0);
+  } else {
+    EXPECT_EQ(num_empty_packets, 0);
+  }
+}
+
+TEST_P(LyraBatchEncoderTest, InvalidAudioFails) {
+  auto batch_encoder =
+      LyraBatchEncoder::Create(kNumStreams, sample_rate_hz_, kNumChannels,
+                               kBitrate, enable_dtx_, model_store_);
+  ASSERT_NE(batch_encoder, nullptr);
+  const std::vector<int16_t> audio(num_samples_per_packet_);
+  const std::vector<int16_t> short_audio(num_samples_per_packet_ / 2);
+  std::vector<std::vector<uint8_t>> packets;
+
+  const std::vector<absl::Span<const int16_t>> too_few_streams(
+      kNumStreams - 1, absl::MakeConstSpan(audio));
+  EXPECT_FALSE(batch_encoder->EncodeBatch(too_few_streams, &packets));
+
+  std::vector<absl::Span<const int16_t>> one_short_stream(
+      kNumStreams, absl::MakeConstSpan(audio));
+  one_short_stream[2] = absl::MakeConstSpan(short_audio);
+  EXPECT_FALSE(batch_encoder->EncodeBatch(one_short_stream, &packets));
+}
+
+TEST_P(LyraBatchEncoderTest, InvalidParamsFail) {
+  EXPECT_EQ(LyraBatchEncoder::Create(0, sample_rate_hz_, kNumChannels,
+                                     kBitrate, enable_dtx_, model_store_),
+            nullptr);
+  EXPECT_EQ(LyraBatchEncoder::Create(kNumStreams, 0, kNumChannels, kBitrate,
+                                     enable_dtx_, model_store_),
+            nullptr);
+  EXPECT_EQ(LyraBatchEncoder::Create(kNumStreams, sample_rate_hz_, -3,
+                                     kBitrate, enable_dtx_, model_store_),
+            nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(SampleRatesAndDtx, LyraBatchEncoderTest,
+                         testing::Combine(testing::ValuesIn(
+                                              kSupportedSampleRates),
+                                          testing::Bool()));
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
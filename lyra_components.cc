@@ -16,13 +16,16 @@
 
 #include <cstdint>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "absl/memory/memory.h"
+#include "audio/linear_filters/biquad_filter_coefficients.h"
 #include "feature_extractor_interface.h"
 #include "generative_model_interface.h"
 #include "log_mel_spectrogram_extractor_impl.h"
+#include "model_store.h"
 #include "packet.h"
 #include "packet_interface.h"
 #include "vector_quantizer_impl.h"
@@ -55,6 +58,13 @@ std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
                                      wavegru_buffer);
 }
 
+std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
+    int num_output_features, int num_bits,
+    std::shared_ptr<ModelStore> model_store) {
+  return VectorQuantizerImpl::Create(num_output_features, num_bits,
+                                     std::move(model_store));
+}
+
 std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
     const Eigen::MatrixXf& transformation_matrix,
@@ -81,6 +91,16 @@ std::unique_ptr<GenerativeModelInterface> CreateGenerativeModel(
       LogMelSpectrogramExtractorImpl::GetSilenceValue(), wavegru_buffer);
 }
 
+std::unique_ptr<GenerativeModelInterface> CreateGenerativeModel(
+    int num_samples_per_hop, int num_output_features, int num_frames_per_packet,
+    std::shared_ptr<ModelStore> model_store,
+    const LyraDecoderOptions& options) {
+  return WavegruModelImpl::Create(
+      num_samples_per_hop, num_output_features, num_frames_per_packet,
+      LogMelSpectrogramExtractorImpl::GetSilenceValue(),
+      std::move(model_store), options);
+}
+
 std::unique_ptr<FeatureExtractorInterface> CreateFeatureExtractor(
     int sample_rate_hz, int num_features, int num_samples_per_hop,
     int num_samples_per_frame) {
@@ -92,6 +112,26 @@ std::unique_ptr<PacketInterface> CreatePacket() {
   return absl::make_unique<Packet<kNumQuantizedBits, kNumHeaderBits>>();
 }
 
+linear_filters::BiquadFilterCascadeCoefficients
+CreateHighPassFilterCoefficients() {
+  // This filter has a -60 dB response for frequencies below 60 Hz for 16 kHz
+  // sample rate or 30 Hz for 8 kHz sample rate. For sample rates of 32 kHz and
+  // 48 kHz, the audio is resampled to 16 kHz before filtering, so the cutoff
+  // will be 60 Hz too.
+  // TODO(b/143491858): Remove this filtering once we find a vector quantizer
+  // that is robust to DC.
+  return linear_filters::BiquadFilterCascadeCoefficients({
+      {{0.99860809, -1.99666786, 0.99860809}, {1.0, -1.99658432, 0.99729972}},
+      {{0.99597739, -1.99145467, 0.99597739}, {1.0, -1.99137134, 0.99203811}},
+      {{0.99353280, -1.98665193, 0.99353280}, {1.0, -1.98656881, 0.98714873}},
+      {{0.99137777, -1.98245157, 0.99137777}, {1.0, -1.98236863, 0.98283848}},
+      {{0.98960226, -1.97901469, 0.98960226}, {1.0, -1.97893189, 0.97928731}},
+      {{0.98827957, -1.97646836, 0.98827957}, {1.0, -1.97638567, 0.97664182}},
+      {{0.98746381, -1.97490392, 0.98746381}, {1.0, -1.9748213, 0.97501025}},
+      {{0.99357343, -0.99357343, 0.0}, {1.0, -0.98714687, 0.0}},
+  });
+}
+
 absl::StatusOr<std::unique_ptr<DenoiserInterface>> CreateDenoiser(
     const ghc::filesystem::path& model_path) {
   return nullptr;
@@ -23,10 +23,13 @@
 
 #include "Eigen/Core"
 #include "absl/status/statusor.h"
+#include "audio/linear_filters/biquad_filter_coefficients.h"
 #include "denoiser_interface.h"
 #include "feature_extractor_interface.h"
 #include "generative_model_interface.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_decoder_options.h"
+#include "model_store.h"
 #include "packet_interface.h"
 #include "vector_quantizer_interface.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
@@ -42,6 +45,10 @@ std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     int num_output_features, int num_bits,
     const WavegruBufferInterface& wavegru_buffer);
 
+std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
+    int num_output_features, int num_bits,
+    std::shared_ptr<ModelStore> model_store);
+
 std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
     const Eigen::MatrixXf& transformation_matrix,
@@ -56,6 +63,11 @@ std::unique_ptr<GenerativeModelInterface> CreateGenerativeModel(
     int num_samples_per_hop, int num_output_features, int num_frames_per_packet,
     const WavegruBufferInterface& wavegru_buffer);
 
+std::unique_ptr<GenerativeModelInterface> CreateGenerativeModel(
+    int num_samples_per_hop, int num_output_features, int num_frames_per_packet,
+    std::shared_ptr<ModelStore> model_store,
+    const LyraDecoderOptions& options = LyraDecoderOptions());
+
 std::unique_ptr<FeatureExtractorInterface> CreateFeatureExtractor(
     int sample_rate_hz, int num_features, int num_samples_per_hop,
     int num_samples_per_frame);
@@ -65,6 +77,11 @@ absl::StatusOr<std::unique_ptr<DenoiserInterface>> CreateDenoiser(
 
 std::unique_ptr<PacketInterface> CreatePacket();
 
+// The coefficients of the high-pass filter applied to the audio at
+// |kInternalSampleRateHz| before extracting its features.
+linear_filters::BiquadFilterCascadeCoefficients
+CreateHighPassFilterCoefficients();
+
 }  // namespace codec
 }  // namespace chromemedia
 
@@ -32,6 +32,10 @@
 #include "include/ghc/filesystem.hpp"
 #include "lyra_components.h"
 #include "lyra_config.h"
+#include "lyra_decoder_options.h"
+#include "model_store.h"
+#include "noise_estimator.h"
+#include "noise_estimator_interface.h"
 #include "packet_interface.h"
 #include "packet_loss_handler.h"
 #include "packet_loss_handler_interface.h"
@@ -45,75 +49,29 @@ namespace codec {
 std::unique_ptr<LyraDecoder> LyraDecoder::Create(
     int sample_rate_hz, int num_channels, int bitrate,
     const WavegruBufferInterface& wavegru_buffer) {
-  absl::Status are_params_supported =
-      AreParamsSupported(sample_rate_hz, num_channels, bitrate);
-  if (!are_params_supported.ok()) {
-    std::cerr << are_params_supported << std::endl;
-    return nullptr;
-  }
-
-  // The model is always set up for |kInternalSampleRateHz|.
-  auto model = CreateGenerativeModel(GetNumSamplesPerHop(kInternalSampleRateHz),
-                                     kNumExpectedOutputFeatures,
-                                     kNumFramesPerPacket, wavegru_buffer);
-  if (model == nullptr) {
-    std::cerr << "New model could not be instantiated." << std::endl;
-    return nullptr;
-  }
-
-  // The comfort noise generator is always set up for |kInternalSampleRateHz|.
-  auto comfort_noise_generator = ComfortNoiseGenerator::Create(
-      kInternalSampleRateHz, kNumExpectedOutputFeatures,
-      GetNumSamplesPerFrame(kInternalSampleRateHz),
-      GetNumSamplesPerHop(kInternalSampleRateHz));
-  if (comfort_noise_generator == nullptr) {
-    std::cerr << "Could not create Comfort Noise Generator." << std::endl;
-    return nullptr;
-  }
-
-  // Vector Quantizer is always set up for |kInternalSampleRateHz|.
-  auto vector_quantizer =
-      CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
-                      kNumQuantizationBits, wavegru_buffer);
-  if (vector_quantizer == nullptr) {
-    std::cerr << "Could not create Vector Quantizer.";
-    return nullptr;
-  }
-
-  auto packet = CreatePacket();
-
-  // The packet loss handler is always set up for |kInternalSampleRateHz|.
-  auto packet_loss_handler = PacketLossHandler::Create(
-      kInternalSampleRateHz, kNumExpectedOutputFeatures,
-      static_cast<float>(GetNumSamplesPerHop(kInternalSampleRateHz)) /
-          kInternalSampleRateHz);
-  if (packet_loss_handler == nullptr) {
-    std::cerr << "Could not create Packet Loss Handler.";
-    return nullptr;
-  }
-
-  // The resampler always resamples from |kInternalSampleRateHz| to the
-  // requested |sample_rate_hz|.
-  auto resampler = Resampler::Create(kInternalSampleRateHz, sample_rate_hz);
-  if (resampler == nullptr) {
-    std::cerr << "Could not create Resampler.";
-    return nullptr;
-  }
-
-  // WrapUnique is used because of private c'tor.
-  return absl::WrapUnique(new LyraDecoder(
-      std::move(model), std::move(comfort_noise_generator),
-      std::move(vector_quantizer), std::move(packet),
-      std::move(packet_loss_handler), std::move(resampler), sample_rate_hz,
-      num_channels, bitrate, kNumFramesPerPacket));
+  auto model_store = ModelStore::Create(wavegru_buffer);
+  auto decoder = Create(sample_rate_hz, num_channels, bitrate, model_store);
+  model_store->ReleaseWavegruBuffer();
+  return decoder;
 }
 
-
 std::unique_ptr<LyraDecoder> LyraDecoder::Create(
     int sample_rate_hz, int num_channels, int bitrate,
     const ghc::filesystem::path& model_path) {
+  return Create(sample_rate_hz, num_channels, bitrate,
+                ModelStore::Create(model_path));
+}
+
+std::unique_ptr<LyraDecoder> LyraDecoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate,
+    std::shared_ptr<ModelStore> model_store,
+    const LyraDecoderOptions& options) {
+  // The model configuration can only be checked when reading from disk.
   absl::Status are_params_supported =
-      AreParamsSupported(sample_rate_hz, num_channels, bitrate, model_path);
+      model_store->model_path().empty()
+          ? AreParamsSupported(sample_rate_hz, num_channels, bitrate)
+          : AreParamsSupported(sample_rate_hz, num_channels, bitrate,
+                               model_store->model_path());
   if (!are_params_supported.ok()) {
     std::cerr << are_params_supported << std::endl;
     return nullptr;
@@ -122,7 +80,8 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
   // The model is always set up for |kInternalSampleRateHz|.
   auto model = CreateGenerativeModel(GetNumSamplesPerHop(kInternalSampleRateHz),
                                      kNumExpectedOutputFeatures,
-                                     kNumFramesPerPacket, model_path);
+                                     kNumFramesPerPacket, model_store,
+                                     options);
   if (model == nullptr) {
     std::cerr << "New model could not be instantiated." << std::endl;
     return nullptr;
@@ -141,7 +100,7 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
   // Vector Quantizer is always set up for |kInternalSampleRateHz|.
   auto vector_quantizer =
       CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
-                      kNumQuantizationBits, model_path);
+                      kNumQuantizationBits, model_store);
   if (vector_quantizer == nullptr) {
     std::cerr << "Could not create Vector Quantizer.";
     return nullptr;
@@ -159,6 +118,18 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
     return nullptr;
   }
 
+  // Tracks the received features as the noise estimator of the encoder tracks
+  // the encoded ones, so that empty packets are decoded from the same noise.
+  std::unique_ptr<NoiseEstimatorInterface> noise_estimator =
+      NoiseEstimator::Create(
+          kNumFeatures,
+          static_cast<float>(GetNumSamplesPerHop(kInternalSampleRateHz)) /
+              kInternalSampleRateHz);
+  if (noise_estimator == nullptr) {
+    std::cerr << "Could not create Noise Estimator.";
+    return nullptr;
+  }
+
   // The resampler always resamples from |kInternalSampleRateHz| to the
   // requested |sample_rate_hz|.
   auto resampler = Resampler::Create(kInternalSampleRateHz, sample_rate_hz);
@@ -171,8 +142,9 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
   return absl::WrapUnique(new LyraDecoder(
       std::move(model), std::move(comfort_noise_generator),
       std::move(vector_quantizer), std::move(packet),
-      std::move(packet_loss_handler), std::move(resampler), sample_rate_hz,
-      num_channels, bitrate, kNumFramesPerPacket));
+      std::move(packet_loss_handler), std::move(noise_estimator),
+      std::move(resampler), sample_rate_hz, num_channels, bitrate,
+      kNumFramesPerPacket));
 }
 
 LyraDecoder::LyraDecoder(
@@ -181,6 +153,7 @@ LyraDecoder::LyraDecoder(
     std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
     std::unique_ptr<PacketInterface> packet,
     std::unique_ptr<PacketLossHandlerInterface> packet_loss_handler,
+    std::unique_ptr<NoiseEstimatorInterface> noise_estimator,
     std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
     int num_channels, int bitrate, int num_frames_per_packet)
     : generative_model_(std::move(generative_model)),
@@ -188,6 +161,7 @@ LyraDecoder::LyraDecoder(
       vector_quantizer_(std::move(vector_quantizer)),
       packet_(std::move(packet)),
       packet_loss_handler_(std::move(packet_loss_handler)),
+      noise_estimator_(std::move(noise_estimator)),
       resampler_(std::move(resampler)),
       sample_rate_hz_(sample_rate_hz),
       num_channels_(num_channels),
@@ -195,45 +169,99 @@ LyraDecoder::LyraDecoder(
       num_frames_per_packet_(num_frames_per_packet),
       internal_num_samples_available_(0),
       encoded_packet_set_(false),
-      prev_frame_was_comfort_noise_(false) {}
+      empty_packet_set_(false),
+      prev_frame_was_comfort_noise_(false),
+      prev_frame_was_empty_packet_(false),
+      internal_samples_(num_frames_per_packet *
+                        GetNumSamplesPerHop(kInternalSampleRateHz)),
+      resampled_samples_(GetMaxNumResampledSamples(
+          num_frames_per_packet * GetNumSamplesPerHop(sample_rate_hz))),
+      quantized_bits_(packet_->PacketSize()),
+      concatenated_features_(num_frames_per_packet * kNumFeatures),
+      features_(kNumFeatures),
+      transition_samples_(GetNumSamplesPerHop(kInternalSampleRateHz)) {}
 
 bool LyraDecoder::SetEncodedPacket(absl::Span<const uint8_t> encoded) {
+  if (encoded.empty()) {
+    return SetEmptyPacket();
+  }
   if (encoded.size() != kPacketSize) {
     std::cerr << "The number of bytes has to equal to " << kPacketSize
-              << ", but is " << encoded.size() << ".";
+              << " or 0, but is " << encoded.size() << ".";
     return false;
   }
 
-  const auto unpacked_or = packet_->UnpackPacket(encoded);
-  if (!unpacked_or.has_value()) {
+  if (!packet_->UnpackQuantizedBits(encoded,
+                                    absl::MakeSpan(quantized_bits_))) {
     std::cerr << "Couldn't read Lyra packet for decoding.";
     return false;
   }
 
-  std::vector<float> concatenated_features =
-      vector_quantizer_->DecodeToLossyFeatures(unpacked_or.value());
-  const int num_features =
-      concatenated_features.size() / num_frames_per_packet_;
+  if (!vector_quantizer_->DecodeBitsToLossyFeatures(
+          quantized_bits_, absl::MakeSpan(concatenated_features_))) {
+    std::cerr << "Couldn't decode the quantized features.";
+    return false;
+  }
+  const int num_features = features_.size();
   for (int i = 0; i < num_frames_per_packet_; ++i) {
-    const std::vector<float> features(
-        concatenated_features.begin() + num_features * i,
-        concatenated_features.begin() + num_features * (i + 1));
-    if (!packet_loss_handler_->SetReceivedFeatures(features)) {
+    std::copy(concatenated_features_.begin() + num_features * i,
+              concatenated_features_.begin() + num_features * (i + 1),
+              features_.begin());
+    if (!packet_loss_handler_->SetReceivedFeatures(features_)) {
       std::cerr << "Unable to update packet loss handler.";
       return false;
     }
 
-    generative_model_->AddFeatures(features);
+    // The encoder only updates its noise estimate with frames which are not
+    // similar to the noise.
+    const auto is_similar_noise = noise_estimator_->IsSimilarNoise(features_);
+    if (!is_similar_noise.has_value()) {
+      std::cerr << "Unable to check noise estimation.";
+      return false;
+    }
+    if (!is_similar_noise.value() && !noise_estimator_->Update(features_)) {
+      std::cerr << "Unable to update noise estimator.";
+      return false;
+    }
+
+    generative_model_->AddFeatures(features_);
   }
 
   internal_num_samples_available_ =
       num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
   encoded_packet_set_ = true;
+  empty_packet_set_ = false;
+  return true;
+}
+
+bool LyraDecoder::SetEmptyPacket() {
+  // Lost packets which follow are estimated from the noise.
+  const std::vector<float> noise_estimate = noise_estimator_->NoiseEstimate();
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    if (!packet_loss_handler_->SetReceivedFeatures(noise_estimate)) {
+      std::cerr << "Unable to update packet loss handler.";
+      return false;
+    }
+  }
+
+  internal_num_samples_available_ =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  encoded_packet_set_ = true;
+  empty_packet_set_ = true;
   return true;
 }
 
 absl::optional<std::vector<int16_t>> LyraDecoder::DecodeSamples(
     int num_samples) {
+  std::vector<int16_t> samples(num_samples);
+  if (!DecodeSamples(absl::MakeSpan(samples))) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+bool LyraDecoder::DecodeSamples(absl::Span<int16_t> samples) {
+  const int num_samples = samples.size();
   const int external_num_samples_available = ConvertNumSamplesBetweenSampleRate(
       internal_num_samples_available_, kInternalSampleRateHz, sample_rate_hz_);
   if (num_samples > external_num_samples_available) {
@@ -241,79 +269,192 @@ absl::optional<std::vector<int16_t>> LyraDecoder::DecodeSamples(
               << " samples for decoding but only "
               << external_num_samples_available
               << " remain in the current frame.";
-    return absl::nullopt;
+    return false;
   }
   if (!encoded_packet_set_) {
     std::cerr << "Requesting normal decoding without adding "
                  "an encoded packet.";
-    return absl::nullopt;
+    return false;
   }
   const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
       num_samples, sample_rate_hz_, kInternalSampleRateHz);
-  auto audio_or = generative_model_->GenerateSamples(internal_num_samples);
-  if (!audio_or.has_value()) {
-    std::cerr << "Couldn't generate audio samples.";
-    return absl::nullopt;
-  }
-  internal_num_samples_available_ -= audio_or->size();
-
-  // Comfort noise generator should only be run during a model transition, so
-  // perform this check beforehand.
-  if (prev_frame_was_comfort_noise_) {
-    auto estimated_features_or =
-        packet_loss_handler_->EstimateLostFeatures(internal_num_samples);
-    if (!estimated_features_or.has_value()) {
-      std::cerr << "Unable to estimate lost features.";
-      return absl::nullopt;
+  // Without resampling the model writes straight into |samples|.
+  absl::Span<int16_t> internal_samples =
+      sample_rate_hz_ == kInternalSampleRateHz
+          ? samples
+          : absl::MakeSpan(internal_samples_).subspan(0, internal_num_samples);
+  if (empty_packet_set_) {
+    internal_samples = internal_samples.subspan(0, internal_num_samples);
+    if (!RunComfortNoiseGeneratorForEmptyPacket(internal_samples)) {
+      std::cerr << "Couldn't generate comfort noise.";
+      return false;
+    }
+    internal_num_samples_available_ -= internal_num_samples;
+  } else {
+    const int num_generated = generative_model_->GenerateSamples(
+        internal_samples.subspan(0, internal_num_samples));
+    if (num_generated < 0) {
+      std::cerr << "Couldn't generate audio samples.";
+      return false;
     }
-    audio_or = RunComfortNoiseGeneratorWithNecessaryOverlap(
-        internal_num_samples, true, estimated_features_or.value(),
-        audio_or.value());
-    if (!audio_or.has_value()) return absl::nullopt;
+    internal_samples = internal_samples.subspan(0, num_generated);
+    internal_num_samples_available_ -= num_generated;
 
-    // Reset CNG when going back to generative model to avoid continuity issues.
-    comfort_noise_generator_->Reset();
+    // Comfort noise generator should only be run during a model transition, so
+    // perform this check beforehand.
+    if (prev_frame_was_comfort_noise_) {
+      // After an empty packet the comfort noise continues from the noise
+      // estimate, rather than from estimated features which would count as a
+      // lost packet.
+      auto features_or =
+          prev_frame_was_empty_packet_
+              ? absl::optional<std::vector<float>>(
+                    noise_estimator_->NoiseEstimate())
+              : packet_loss_handler_->EstimateLostFeatures(
+                    internal_num_samples);
+      if (!features_or.has_value()) {
+        std::cerr << "Unable to estimate lost features.";
+        return false;
+      }
+      const auto overlapped_or = RunComfortNoiseGeneratorWithNecessaryOverlap(
+          internal_num_samples, true, features_or.value(),
+          std::vector<int16_t>(internal_samples.begin(),
+                               internal_samples.end()));
+      if (!overlapped_or.has_value()) return false;
+      std::copy(overlapped_or->begin(), overlapped_or->end(),
+                internal_samples.begin());
+
+      // Reset CNG when going back to generative model to avoid continuity
+      // issues.
+      comfort_noise_generator_->Reset();
+    }
+    prev_frame_was_comfort_noise_ = false;
+    prev_frame_was_empty_packet_ = false;
   }
-  prev_frame_was_comfort_noise_ = false;
 
+  int num_decoded = internal_samples.size();
   if (sample_rate_hz_ != kInternalSampleRateHz) {
-    audio_or = resampler_->Resample(audio_or.value());
+    num_decoded = resampler_->Resample(internal_samples, samples);
   }
-  if (audio_or->size() != num_samples) {
+  if (num_decoded != num_samples) {
     std::cerr << "Generated audio samples have a different number of samples "
                  "than requested.";
     exit(EXIT_FAILURE);
   }
 
-  return audio_or;
+  return true;
 }
 
 absl::optional<std::vector<int16_t>> LyraDecoder::DecodePacketLoss(
     int num_samples) {
+  std::vector<int16_t> samples(num_samples);
+  if (!DecodePacketLoss(absl::MakeSpan(samples))) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+bool LyraDecoder::DecodePacketLoss(absl::Span<int16_t> samples) {
   const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
-      num_samples, sample_rate_hz_, kInternalSampleRateHz);
-  auto audio_or = RunGenerativeModelForPacketLoss(internal_num_samples);
+      samples.size(), sample_rate_hz_, kInternalSampleRateHz);
+  if (sample_rate_hz_ == kInternalSampleRateHz) {
+    if (!RunGenerativeModelForPacketLoss(samples)) {
+      std::cerr << "Couldn't generate audio samples.";
+      return false;
+    }
+    return true;
+  }
 
-  if (!audio_or.has_value()) {
+  // The buffers hold a packet, and only grow for longer requests.
+  if (internal_samples_.size() < internal_num_samples) {
+    internal_samples_.resize(internal_num_samples);
+  }
+  const int max_num_resampled_samples =
+      GetMaxNumResampledSamples(samples.size());
+  if (resampled_samples_.size() < max_num_resampled_samples) {
+    resampled_samples_.resize(max_num_resampled_samples);
+  }
+  const auto internal_samples =
+      absl::MakeSpan(internal_samples_).subspan(0, internal_num_samples);
+  if (!RunGenerativeModelForPacketLoss(internal_samples)) {
     std::cerr << "Couldn't generate audio samples.";
-    return absl::nullopt;
+    return false;
   }
-  if (sample_rate_hz_ != kInternalSampleRateHz) {
-    audio_or = resampler_->Resample(audio_or.value());
+  const int num_resampled = resampler_->Resample(
+      internal_samples, absl::MakeSpan(resampled_samples_));
+  if (num_resampled < 0) {
+    std::cerr << "Resampled audio samples do not fit in "
+              << resampled_samples_.size() << " samples.";
+    exit(EXIT_FAILURE);
   }
 
   // Possibly truncate some extra samples in the end.
-  audio_or->resize(num_samples);
-  return audio_or;
+  const int num_copied = std::min<int>(num_resampled, samples.size());
+  std::copy(resampled_samples_.begin(), resampled_samples_.begin() + num_copied,
+            samples.begin());
+  std::fill(samples.begin() + num_copied, samples.end(), 0);
+  return true;
 }
 
-absl::optional<std::vector<int16_t>>
-LyraDecoder::RunGenerativeModelForPacketLoss(int num_samples) {
+bool LyraDecoder::RunComfortNoiseGeneratorForEmptyPacket(
+    absl::Span<int16_t> samples) {
+  const int num_samples = samples.size();
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  const std::vector<float> noise_estimate = noise_estimator_->NoiseEstimate();
+  int num_samples_decoded = 0;
+  if (!prev_frame_was_comfort_noise_) {
+    // Transition from the generative model, which requires overlap.
+    const int num_overlapped_samples = std::min(num_samples, num_samples_per_hop);
+    const auto overlapped_samples = samples.subspan(0, num_overlapped_samples);
+    // The whole hop of features added is generated, and only the requested
+    // part is overlapped, so that the model holds no samples once the next
+    // packet is added.
+    generative_model_->AddFeatures(noise_estimate);
+    if (generative_model_->GenerateSamples(
+            absl::MakeSpan(transition_samples_)) != num_samples_per_hop) {
+      std::cerr << "Model could not be run on the noise estimate.";
+      return false;
+    }
+    const auto overlapped_or = RunComfortNoiseGeneratorWithNecessaryOverlap(
+        num_overlapped_samples, true, noise_estimate,
+        std::vector<int16_t>(
+            transition_samples_.begin(),
+            transition_samples_.begin() + num_overlapped_samples));
+    if (!overlapped_or.has_value()) return false;
+    std::copy(overlapped_or->begin(), overlapped_or->end(),
+              overlapped_samples.begin());
+    num_samples_decoded = num_overlapped_samples;
+  }
+  // The comfort noise generator generates at most a hop at a time.
+  while (num_samples_decoded < num_samples) {
+    const int num_samples_to_decode =
+        std::min(num_samples - num_samples_decoded, num_samples_per_hop);
+    const auto comfort_noise_or = RunComfortNoiseGeneratorWithNecessaryOverlap(
+        num_samples_to_decode, false, noise_estimate);
+    if (!comfort_noise_or.has_value()) return false;
+    std::copy(comfort_noise_or->begin(), comfort_noise_or->end(),
+              samples.begin() + num_samples_decoded);
+    num_samples_decoded += num_samples_to_decode;
+  }
+  prev_frame_was_comfort_noise_ = true;
+  prev_frame_was_empty_packet_ = true;
+  return true;
+}
+
+bool LyraDecoder::RunGenerativeModelForPacketLoss(
+    absl::Span<int16_t> samples) {
+  const int num_samples = samples.size();
+  if (empty_packet_set_) {
+    // The generative model has no features for the rest of an empty packet, so
+    // the lost packet is estimated from the start.
+    internal_num_samples_available_ = 0;
+    empty_packet_set_ = false;
+  }
   const auto estimated_features_or =
       packet_loss_handler_->EstimateLostFeatures(num_samples);
   if (!estimated_features_or.has_value()) {
     std::cerr << "Unable to estimate lost features.";
-    return absl::nullopt;
+    return false;
   }
 
   // Do not perform overlap if both previous and current frames were produced
@@ -322,19 +463,20 @@ LyraDecoder::RunGenerativeModelForPacketLoss(int num_samples) {
       packet_loss_handler_->is_comfort_noise();
   if (prev_frame_was_comfort_noise_ && current_frame_is_comfort_noise) {
     prev_frame_was_comfort_noise_ = true;
-    return RunComfortNoiseGeneratorWithNecessaryOverlap(
+    prev_frame_was_empty_packet_ = false;
+    const auto comfort_noise_or = RunComfortNoiseGeneratorWithNecessaryOverlap(
         num_samples, false, estimated_features_or.value());
+    if (!comfort_noise_or.has_value()) return false;
+    std::copy(comfort_noise_or->begin(), comfort_noise_or->end(),
+              samples.begin());
+    return true;
   }
 
-  std::vector<int16_t> result;
-  result.reserve(num_samples);
-
-  // Generate samples to fill |result| with desired number of samples. Add
-  // estimated features when the previous packet has been fully decoded.
-  int num_samples_to_decode;
-  while (result.size() < num_samples) {
-    const int remaining_num_samples =
-        num_samples - static_cast<int>(result.size());
+  // Generate samples to fill |samples|. Add estimated features when the
+  // previous packet has been fully decoded.
+  int num_samples_decoded = 0;
+  while (num_samples_decoded < num_samples) {
+    const int remaining_num_samples = num_samples - num_samples_decoded;
     if (internal_num_samples_available_ == 0) {
       // The previous sample generation used up the features added, add a new
       // one.
@@ -343,24 +485,24 @@ LyraDecoder::RunGenerativeModelForPacketLoss(int num_samples) {
           GetNumSamplesPerHop(kInternalSampleRateHz);
       encoded_packet_set_ = false;
     }
-    num_samples_to_decode =
+    const int num_samples_to_decode =
         std::min(remaining_num_samples, internal_num_samples_available_);
-    const auto audio_or =
-        generative_model_->GenerateSamples(num_samples_to_decode);
-    if (!audio_or.has_value()) {
+    const int num_generated = generative_model_->GenerateSamples(
+        samples.subspan(num_samples_decoded, num_samples_to_decode));
+    if (num_generated < 0) {
       std::cerr << "Model could not be run on features.";
-      return absl::nullopt;
+      return false;
     }
-    result.insert(result.end(), audio_or->begin(), audio_or->end());
+    num_samples_decoded += num_generated;
 
-    if (audio_or->size() > internal_num_samples_available_) {
+    if (num_generated > internal_num_samples_available_) {
       std::cerr << "Generated audio samples have a larger number of samples "
                    "than available.";
       exit(EXIT_FAILURE);
     }
-    internal_num_samples_available_ -= audio_or->size();
+    internal_num_samples_available_ -= num_generated;
   }
-  if (result.size() != num_samples) {
+  if (num_samples_decoded != num_samples) {
     std::cerr << "Generated audio samples have a different number of samples "
                  "than requested.";
     exit(EXIT_FAILURE);
@@ -368,13 +510,18 @@ LyraDecoder::RunGenerativeModelForPacketLoss(int num_samples) {
 
   // Implies a transition between models, which requires overlap.
   if (current_frame_is_comfort_noise) {
-    result = RunComfortNoiseGeneratorWithNecessaryOverlap(
-                 num_samples, true, estimated_features_or.value(), result)
-                 .value();
+    const auto overlapped = RunComfortNoiseGeneratorWithNecessaryOverlap(
+                                num_samples, true,
+                                estimated_features_or.value(),
+                                std::vector<int16_t>(samples.begin(),
+                                                     samples.end()))
+                                .value();
+    std::copy(overlapped.begin(), overlapped.end(), samples.begin());
   }
   prev_frame_was_comfort_noise_ = current_frame_is_comfort_noise;
+  prev_frame_was_empty_packet_ = false;
 
-  return result;
+  return true;
 }
 
 absl::optional<std::vector<int16_t>>
@@ -437,6 +584,15 @@ absl::optional<std::vector<int16_t>> LyraDecoder::OverlapFrames(
   return overlapped_frame;
 }
 
+int LyraDecoder::GetMaxNumResampledSamples(int num_samples) const {
+  // Requests are rounded up to whole samples at |kInternalSampleRateHz|, which
+  // may resample to up to one of those samples more than asked for.
+  return num_samples +
+         ConvertNumSamplesBetweenSampleRate(1, kInternalSampleRateHz,
+                                            sample_rate_hz_) +
+         1;
+}
+
 int LyraDecoder::sample_rate_hz() const { return sample_rate_hz_; }
 
 int LyraDecoder::num_channels() const { return num_channels_; }
@@ -446,7 +602,7 @@ int LyraDecoder::bitrate() const { return bitrate_; }
 int LyraDecoder::frame_rate() const { return kFrameRate; }
 
 bool LyraDecoder::is_comfort_noise() const {
-  return packet_loss_handler_->is_comfort_noise();
+  return empty_packet_set_ || packet_loss_handler_->is_comfort_noise();
 }
 
 }  // namespace codec
@@ -28,6 +28,9 @@
 #include "generative_model_interface.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_decoder_interface.h"
+#include "lyra_decoder_options.h"
+#include "model_store.h"
+#include "noise_estimator_interface.h"
 #include "packet_interface.h"
 #include "packet_loss_handler_interface.h"
 #include "resampler_interface.h"
@@ -59,16 +62,39 @@ class LyraDecoder : public LyraDecoderInterface {
       int sample_rate_hz, int num_channels, int bitrate,
       const ghc::filesystem::path& model_path);
 
+  /// Same as above, but the model weights are read from |wavegru_buffer|.
+  ///
+  /// @param wavegru_buffer Buffers of the model files. They are only read
+  ///                       during this call, so |wavegru_buffer| need not
+  ///                       outlive the returned decoder.
   static std::unique_ptr<LyraDecoder> Create(
-        int sample_rate_hz, int num_channels, int bitrate,
+      int sample_rate_hz, int num_channels, int bitrate,
       const WavegruBufferInterface& wavegru_buffer);
 
+  /// Same as above, but the model weights are shared with all other encoders
+  /// and decoders created from |model_store|. Only the per-stream state is
+  /// owned by the returned decoder.
+  ///
+  /// @param model_store Store owning the model weights.
+  /// @param options Threading of the generative model, see
+  ///                |LyraDecoderOptions|.
+  /// @return A unique_ptr to a |LyraDecoder| if all desired params and
+  ///         |options| are supported. Else it returns a nullptr.
+  static std::unique_ptr<LyraDecoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate,
+      std::shared_ptr<ModelStore> model_store,
+      const LyraDecoderOptions& options = LyraDecoderOptions());
+
   /// Parses a packet and prepares the decoder to decode samples from the
   /// payload.
   ///
   /// If estimated features were added by |DecodePacketLoss| but not fully
   /// decoded overwrites that estimated feature.
   ///
+  /// An empty packet, which an encoder with DTX enabled sends in place of a
+  /// packet of noise, is decoded into comfort noise shaped like the noise of
+  /// the previous packets, without running the generative model.
+  ///
   /// @param encoded Encoded packet as a span of bytes.
   /// @return True if the provided packet is a valid Lyra packet.
   bool SetEncodedPacket(absl::Span<const uint8_t> encoded) override;
@@ -83,6 +109,16 @@ class LyraDecoder : public LyraDecoderInterface {
   ///          remaining samples available. Else it returns nullopt.
   absl::optional<std::vector<int16_t>> DecodeSamples(int num_samples) override;
 
+  /// Same as above, but decodes |samples.size()| samples into |samples|.
+  ///
+  /// Does not allocate when decoding at any supported sample rate, unless
+  /// decoding an empty packet or transitioning from comfort noise, so it may
+  /// be called on a real time audio thread.
+  ///
+  /// @param samples Buffer to decode into.
+  /// @return True on success.
+  bool DecodeSamples(absl::Span<int16_t> samples) override;
+
   /// Decodes audio in packet loss mode.
   ///
   /// Greedily decodes samples remaining from the last provided packet, then
@@ -98,6 +134,15 @@ class LyraDecoder : public LyraDecoderInterface {
   absl::optional<std::vector<int16_t>> DecodePacketLoss(
       int num_samples) override;
 
+  /// Same as above, but decodes |samples.size()| samples into |samples|.
+  ///
+  /// Estimating the features allocates, but the samples are generated into
+  /// buffers sized for a packet at Create time.
+  ///
+  /// @param samples Buffer to decode into.
+  /// @return True on success.
+  bool DecodePacketLoss(absl::Span<int16_t> samples) override;
+
   /// Getter for the sample rate in Hertz.
   ///
   /// @return Sample rate in Hertz.
@@ -130,11 +175,22 @@ class LyraDecoder : public LyraDecoderInterface {
               std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
               std::unique_ptr<PacketInterface> packet,
               std::unique_ptr<PacketLossHandlerInterface> packet_loss_handler,
+              std::unique_ptr<NoiseEstimatorInterface> noise_estimator,
               std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
               int num_channels, int bitrate, int num_frames_per_packet);
 
-  absl::optional<std::vector<int16_t>> RunGenerativeModelForPacketLoss(
-      int num_samples);
+  // Prepares the decoder to decode an empty packet, using the noise estimate
+  // as the features of all its frames.
+  bool SetEmptyPacket();
+
+  // Fills |samples| with comfort noise generated at |kInternalSampleRateHz|
+  // from the noise estimate. When the previous frame was not comfort noise, it
+  // fades in over at most a hop which the generative model also generates from
+  // the noise estimate. Otherwise the generative model is not run.
+  bool RunComfortNoiseGeneratorForEmptyPacket(absl::Span<int16_t> samples);
+
+  // Fills |samples| with samples generated at |kInternalSampleRateHz|.
+  bool RunGenerativeModelForPacketLoss(absl::Span<int16_t> samples);
 
   // Runs the Comfort Noise Generator and performs any necessary overlap between
   // models.
@@ -152,6 +208,10 @@ class LyraDecoder : public LyraDecoderInterface {
       const std::vector<int16_t>& preceding_frame,
       const std::vector<int16_t>& following_frame) const;
 
+  // An upper bound on the number of samples at |sample_rate_hz_| resampled
+  // from a request of |num_samples|.
+  int GetMaxNumResampledSamples(int num_samples) const;
+
   // Used to generate the time domain samples.
   std::unique_ptr<GenerativeModelInterface> generative_model_;
   // Used to generate comfort noise.
@@ -162,6 +222,9 @@ class LyraDecoder : public LyraDecoderInterface {
   std::unique_ptr<PacketInterface> packet_;
   // Used to fill in the blanks when a packet is lost.
   std::unique_ptr<PacketLossHandlerInterface> packet_loss_handler_;
+  // Tracks the noise of the received packets in the same way as the encoder,
+  // to decode the empty packets it sends in their place.
+  std::unique_ptr<NoiseEstimatorInterface> noise_estimator_;
   // Used to go from the generative model sample rate to the one expected at the
   // output.
   std::unique_ptr<ResamplerInterface> resampler_;
@@ -177,8 +240,27 @@ class LyraDecoder : public LyraDecoderInterface {
   // Prevent users from calling |DecodeSamples| without having added a real
   // encoded packet.
   bool encoded_packet_set_;
+  // Whether the most recently added packet was empty.
+  bool empty_packet_set_;
   // Used to trigger overlap when switching to or from comfort noise.
   bool prev_frame_was_comfort_noise_;
+  // Whether that comfort noise was generated for an empty packet rather than
+  // for lost packets.
+  bool prev_frame_was_empty_packet_;
+  // Samples at |kInternalSampleRateHz| waiting to be resampled, and the
+  // resampled ones, sized for a packet so that decoding does not allocate.
+  std::vector<int16_t> internal_samples_;
+  std::vector<int16_t> resampled_samples_;
+  // The quantized bits of a packet, packed as described in packed_bits.h, and
+  // the features decoded from them, likewise sized so as not to allocate.
+  std::vector<uint8_t> quantized_bits_;
+  std::vector<float> concatenated_features_;
+  std::vector<float> features_;
+  // The hop the generative model runs on the noise estimate when switching to
+  // comfort noise for an empty packet. It is generated whole, so that no
+  // samples conditioned on the noise remain queued in the model, even if less
+  // is requested.
+  std::vector<int16_t> transition_samples_;
   friend class LyraDecoderPeer;
 };
 
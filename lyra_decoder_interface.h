@@ -17,6 +17,7 @@
 #ifndef LYRA_CODEC_LYRA_DECODER_INTERFACE_H_
 #define LYRA_CODEC_LYRA_DECODER_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -48,6 +49,17 @@ class LyraDecoderInterface {
   virtual absl::optional<std::vector<int16_t>> DecodePacketLoss(
       int num_samples) = 0;
 
+  // Same as the methods above, but writes |samples.size()| samples into
+  // |samples| instead of returning them. Implementations may do so without
+  // allocating, which the default ones do not.
+  // Returns false on failure.
+  virtual bool DecodeSamples(absl::Span<int16_t> samples) {
+    return CopySamples(DecodeSamples(samples.size()), samples);
+  }
+  virtual bool DecodePacketLoss(absl::Span<int16_t> samples) {
+    return CopySamples(DecodePacketLoss(samples.size()), samples);
+  }
+
   virtual int sample_rate_hz() const = 0;
 
   virtual int num_channels() const = 0;
@@ -57,6 +69,16 @@ class LyraDecoderInterface {
   virtual int frame_rate() const = 0;
 
   virtual bool is_comfort_noise() const = 0;
+
+ private:
+  static bool CopySamples(const absl::optional<std::vector<int16_t>>& decoded,
+                          absl::Span<int16_t> samples) {
+    if (!decoded.has_value() || decoded->size() != samples.size()) {
+      return false;
+    }
+    std::copy(decoded->begin(), decoded->end(), samples.begin());
+    return true;
+  }
 };
 
 }  // namespace codec
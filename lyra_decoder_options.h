@@ -0,0 +1,41 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_DECODER_OPTIONS_H_
+#define LYRA_CODEC_LYRA_DECODER_OPTIONS_H_
+
+namespace chromemedia {
+namespace codec {
+
+/// Options controlling how a single decoder spreads its work across cores.
+/// None of them change the decoded audio beyond floating point reordering.
+struct LyraDecoderOptions {
+  /// Number of threads the sampling of each hop is split across, including
+  /// the calling thread. Each thread gets a slice of the GRU state at least
+  /// one SIMD register wide, which bounds this by the hidden size divided by
+  /// the SIMD width of the build.
+  int num_threads = 1;
+
+  /// Number of threads the conditioning stack of each packet is computed
+  /// with, including the calling thread. Must not exceed the number of
+  /// conditioning hiddens.
+  int num_conditioning_threads = 1;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_DECODER_OPTIONS_H_
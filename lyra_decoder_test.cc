@@ -15,11 +15,14 @@
 #include "lyra_decoder.h"
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <climits>
 #include <cstdint>
+#include <cstdlib>
 #include <iterator>
 #include <memory>
+#include <new>
 #include <numeric>
 #include <string>
 #include <tuple>
@@ -38,17 +41,55 @@
 #include "include/ghc/filesystem.hpp"
 #include "log_mel_spectrogram_extractor_impl.h"
 #include "lyra_config.h"
+#include "noise_estimator.h"
+#include "noise_estimator_interface.h"
 #include "packet.h"
 #include "packet_interface.h"
 #include "packet_loss_handler_interface.h"
 #include "resampler.h"
 #include "resampler_interface.h"
 #include "testing/mock_generative_model.h"
+#include "testing/mock_noise_estimator.h"
 #include "testing/mock_packet_loss_handler.h"
 #include "testing/mock_resampler.h"
 #include "testing/mock_vector_quantizer.h"
 #include "vector_quantizer_interface.h"
 
+namespace {
+
+// Counts the calls to the global operator new while |count_allocations| is
+// set, to check that decoding does not allocate.
+std::atomic<bool> count_allocations(false);
+std::atomic<int> num_allocations(0);
+
+void* CountedAllocate(std::size_t size) {
+  if (count_allocations.load()) {
+    num_allocations.fetch_add(1);
+  }
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) { return CountedAllocate(size); }
+void* operator new[](std::size_t size) { return CountedAllocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return CountedAllocate(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return operator new(size, std::nothrow);
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
 namespace chromemedia {
 namespace codec {
 namespace {
@@ -69,11 +110,31 @@ class LyraDecoderPeer {
       std::unique_ptr<MockPacketLossHandler> mock_packet_loss_handler,
       std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
       int num_frames_per_packet)
+      : LyraDecoderPeer(
+            std::move(mock_generative_model),
+            std::move(mock_comfort_noise_generator),
+            std::move(mock_vector_quantizer),
+            std::move(mock_packet_loss_handler),
+            NoiseEstimator::Create(
+                kNumFeatures,
+                static_cast<float>(GetNumSamplesPerHop(kInternalSampleRateHz)) /
+                    kInternalSampleRateHz),
+            std::move(resampler), sample_rate_hz, num_frames_per_packet) {}
+
+  LyraDecoderPeer(
+      std::unique_ptr<MockGenerativeModel> mock_generative_model,
+      std::unique_ptr<MockGenerativeModel> mock_comfort_noise_generator,
+      std::unique_ptr<MockVectorQuantizer> mock_vector_quantizer,
+      std::unique_ptr<MockPacketLossHandler> mock_packet_loss_handler,
+      std::unique_ptr<NoiseEstimatorInterface> noise_estimator,
+      std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
+      int num_frames_per_packet)
       : decoder_(std::move(mock_generative_model),
                  std::move(mock_comfort_noise_generator),
                  std::move(mock_vector_quantizer),
                  absl::make_unique<Packet<kNumQuantizedBits, kNumHeaderBits>>(),
-                 std::move(mock_packet_loss_handler), std::move(resampler),
+                 std::move(mock_packet_loss_handler),
+                 std::move(noise_estimator), std::move(resampler),
                  sample_rate_hz, kNumChannels, kBitrate,
                  num_frames_per_packet) {}
 
@@ -95,6 +156,8 @@ class LyraDecoderPeer {
     return decoder_.OverlapFrames(preceding_frame, following_frame);
   }
 
+  bool is_comfort_noise() const { return decoder_.is_comfort_noise(); }
+
  private:
   LyraDecoder decoder_;
 };
@@ -599,6 +662,159 @@ TEST_P(LyraDecoderTest, ModelsTransitionsAndTriggerOverlap) {
   EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
 }
 
+TEST_P(LyraDecoderTest, EmptyPacketsAreDecodedAsComfortNoise) {
+  // A packet is decoded with the generative model, followed by two empty
+  // packets. The generative model only runs on the noise estimate for the first
+  // hop of the first empty packet, which is overlapped with comfort noise, and
+  // the comfort noise generator decodes the rest.
+  static constexpr int kNumEmptyPackets = 2;
+  const int internal_num_samples = mock_samples_->size();
+  std::bitset<kNumQuantizedBits> quantized(0);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized.to_string());
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer,
+              DecodeToLossyFeatures(quantized.to_string()))
+      .WillOnce(Return(mock_concatenated_features_));
+
+  const std::vector<float> mock_noise_estimate(kNumFeatures, -5.0f);
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(mock_features))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_features));
+    EXPECT_CALL(*mock_noise_estimator, IsSimilarNoise(mock_features))
+        .WillOnce(Return(false));
+    EXPECT_CALL(*mock_noise_estimator, Update(mock_features))
+        .WillOnce(Return(true));
+  }
+  EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
+      .WillRepeatedly(Return(mock_noise_estimate));
+  // Lost packets following the empty ones would be estimated from the noise.
+  EXPECT_CALL(*mock_packet_loss_handler,
+              SetReceivedFeatures(mock_noise_estimate))
+      .Times(kNumEmptyPackets * num_frames_per_packet_)
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
+
+  EXPECT_CALL(*mock_generative_model, AddFeatures(mock_noise_estimate))
+      .Times(1);
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(num_frames_per_packet_ + 1)
+      .WillRepeatedly(Return(mock_samples_));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(mock_noise_estimate))
+      .Times(kNumEmptyPackets * num_frames_per_packet_);
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .Times(kNumEmptyPackets * num_frames_per_packet_)
+      .WillRepeatedly(Return(mock_samples_));
+
+  // This test is not concerned with the behavior of the resampler, so use real
+  // one.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(mock_noise_estimator), std::move(resampler), sample_rate_hz_,
+      num_frames_per_packet_);
+
+  const int num_samples = output_mock_samples_.size();
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  }
+  for (int packet_index = 0; packet_index < kNumEmptyPackets; ++packet_index) {
+    ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket({}));
+    EXPECT_TRUE(lyra_decoder_peer->is_comfort_noise());
+    for (int i = 0; i < num_frames_per_packet_; ++i) {
+      EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+    }
+    // All the samples of an empty packet have been decoded.
+    EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  }
+}
+
+TEST_P(LyraDecoderTest, EmptyPacketDecodedInChunksLeavesNoModelSamples) {
+  // An empty packet decoded in chunks shorter than a hop, between two encoded
+  // packets. The generative model still generates the whole hop conditioned
+  // on the noise estimate, so that the following packet starts afresh.
+  static constexpr int kNumChunksPerHop = 4;
+  const int internal_num_samples = mock_samples_->size();
+  std::bitset<kNumQuantizedBits> quantized(0);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized.to_string());
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer,
+              DecodeToLossyFeatures(quantized.to_string()))
+      .WillRepeatedly(Return(mock_concatenated_features_));
+
+  const std::vector<float> mock_noise_estimate(kNumFeatures, -5.0f);
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(mock_features))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_features))
+        .Times(2);
+    EXPECT_CALL(*mock_noise_estimator, IsSimilarNoise(mock_features))
+        .WillRepeatedly(Return(false));
+    EXPECT_CALL(*mock_noise_estimator, Update(mock_features))
+        .WillRepeatedly(Return(true));
+  }
+  EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
+      .WillRepeatedly(Return(mock_noise_estimate));
+  EXPECT_CALL(*mock_packet_loss_handler,
+              SetReceivedFeatures(mock_noise_estimate))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_generative_model, AddFeatures(mock_noise_estimate))
+      .Times(1);
+  // Every frame of both encoded packets, plus the whole transition hop.
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(2 * num_frames_per_packet_ + 1)
+      .WillRepeatedly(Return(mock_samples_));
+  EXPECT_CALL(*mock_generative_model,
+              GenerateSamples(testing::Ne(internal_num_samples)))
+      .Times(0);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(mock_noise_estimate))
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .WillRepeatedly([](int num_samples) {
+        return absl::optional<std::vector<int16_t>>(
+            std::vector<int16_t>(num_samples));
+      });
+
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(mock_noise_estimator), std::move(resampler), sample_rate_hz_,
+      num_frames_per_packet_);
+
+  const int num_samples = output_mock_samples_.size();
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  }
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket({}));
+  for (int i = 0; i < num_frames_per_packet_ * kNumChunksPerHop; ++i) {
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples / kNumChunksPerHop)
+                    .has_value());
+  }
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  }
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+}
+
 TEST_P(LyraDecoderTest, FrameSizesDiffer) {
   // Test that OverlapFrames() does not try to overlap two frames of different
   // sizes.
@@ -752,6 +968,9 @@ TEST_P(LyraDecoderTest, MoreSamplesRequestedThanInAPacket) {
       packet.PackQuantized(quantized_zeros.to_string());
 
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer,
+              DecodeToLossyFeatures(quantized_zeros.to_string()))
+      .WillOnce(Return(mock_concatenated_features_));
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
   EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
@@ -812,6 +1031,35 @@ TEST(LyraDecoderCreate, InvalidCreateReturnsNullptr) {
   }
 }
 
+// Setting an encoded packet and decoding it into a span do not allocate.
+// Empty packets and packet loss still do, as the noise estimate and the
+// estimated lost features are returned by value.
+TEST(LyraDecoderCreate, DecodeEncodedPacketsIntoSpanDoesNotAllocate) {
+  for (const auto& sample_rate_hz : kSupportedSampleRates) {
+    auto decoder =
+        LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                            ghc::filesystem::current_path() /
+                                kExportedModelPath);
+    ASSERT_NE(decoder, nullptr);
+    const std::vector<uint8_t> packet(kPacketSize, 0);
+    const int num_samples_per_hop = GetNumSamplesPerHop(sample_rate_hz);
+    std::vector<int16_t> samples(num_samples_per_hop);
+
+    // The first packet may set up threads and buffers.
+    for (int packet_index = 0; packet_index < 3; ++packet_index) {
+      num_allocations = 0;
+      count_allocations = packet_index > 0;
+      ASSERT_TRUE(decoder->SetEncodedPacket(packet));
+      for (int hop = 0; hop < kNumFramesPerPacket; ++hop) {
+        ASSERT_TRUE(decoder->DecodeSamples(absl::MakeSpan(samples)));
+      }
+      count_allocations = false;
+      EXPECT_EQ(num_allocations, 0) << "Sample rate " << sample_rate_hz
+                                    << ", packet " << packet_index;
+    }
+  }
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
@@ -15,7 +15,6 @@
 #include "lyra_encoder.h"
 
 #include <algorithm>
-#include <bitset>
 #include <cstdint>
 #include <memory>
 #include <utility>
@@ -26,16 +25,15 @@
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "audio/linear_filters/biquad_filter.h"
-#include "audio/linear_filters/biquad_filter_coefficients.h"
 #include "denoiser_interface.h"
 #include "dsp_util.h"
 #include "feature_extractor_interface.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_components.h"
 #include "lyra_config.h"
+#include "model_store.h"
 #include "noise_estimator.h"
 #include "noise_estimator_interface.h"
-#include "packet.h"
 #include "packet_interface.h"
 #include "resampler.h"
 #include "resampler_interface.h"
@@ -47,84 +45,29 @@ namespace codec {
 std::unique_ptr<LyraEncoder> LyraEncoder::Create(
     int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
     const WavegruBufferInterface& wavegru_buffer) {
-  absl::Status are_params_supported =
-      AreParamsSupported(sample_rate_hz, num_channels, bitrate);
-  if (!are_params_supported.ok()) {
-    std::cerr << "ERROR: " << are_params_supported << std::endl;
-    return nullptr;
-  }
-
-  std::unique_ptr<Resampler> resampler = nullptr;
-  if (kInternalSampleRateHz != sample_rate_hz) {
-    resampler = Resampler::Create(sample_rate_hz, kInternalSampleRateHz);
-    if (resampler == nullptr) {
-      fprintf(stderr, "Error: Failed to create resampler.\n");
-      return nullptr;
-    }
-  }
-
-  const int internal_samples_per_hop =
-      GetNumSamplesPerHop(kInternalSampleRateHz);
-  auto feature_extractor = CreateFeatureExtractor(
-      kInternalSampleRateHz, kNumFeatures, internal_samples_per_hop,
-      GetNumSamplesPerFrame(kInternalSampleRateHz));
-  if (feature_extractor == nullptr) {
-    fprintf(stderr, "Error: Failed to create feature extractor.\n");
-    return nullptr;
-  }
-
-  auto vector_quantizer = CreateQuantizer(
-      kNumFramesPerPacket * kNumExpectedOutputFeatures, kNumQuantizationBits,
-      wavegru_buffer);
-
-  if (vector_quantizer == nullptr) {
-    fprintf(stderr, "Error: Failed to create vector quantizer.\n");
-    return nullptr;
-  }
-
-  auto packet = CreatePacket();
-
-  std::unique_ptr<NoiseEstimatorInterface> noise_estimator =
-      NoiseEstimator::Create(
-          kNumFeatures,
-          static_cast<float>(internal_samples_per_hop) / kInternalSampleRateHz);
-  if (noise_estimator == nullptr) {
-    fprintf(stderr, "Error: Failed to create noise estimator.\n");
-    return nullptr;
-  }
-
-  // Default to the internal frame hop size.
-  auto denoiser = CreateDenoiser("");
-  if (!denoiser.ok()) {
-    fprintf(stderr, "Error: Failed to create denoiser.\n");
-    return nullptr;
-  }
-  if (denoiser.value() != nullptr) {
-    const int denoiser_samples_per_hop =
-        denoiser.value()->SamplesPerHop() == 0
-            ? internal_samples_per_hop
-            : denoiser.value()->SamplesPerHop();
-    if (internal_samples_per_hop % denoiser_samples_per_hop != 0) {
-      fprintf(stderr,
-              "Error: Denoiser hop size must divide the "
-              "encoder hop size.\n");
-      return nullptr;
-    }
-  }
-
-  // WrapUnique is used because of private c'tor.
-  return absl::WrapUnique(new LyraEncoder(
-      std::move(resampler), std::move(feature_extractor),
-      std::move(noise_estimator), std::move(vector_quantizer),
-      std::move(denoiser.value()), std::move(packet), sample_rate_hz,
-      num_channels, bitrate, kNumFramesPerPacket, enable_dtx));
+  auto model_store = ModelStore::Create(wavegru_buffer);
+  auto encoder = Create(sample_rate_hz, num_channels, bitrate, enable_dtx,
+                        model_store);
+  model_store->ReleaseWavegruBuffer();
+  return encoder;
 }
 
 std::unique_ptr<LyraEncoder> LyraEncoder::Create(
     int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
     const ghc::filesystem::path& model_path) {
+  return Create(sample_rate_hz, num_channels, bitrate, enable_dtx,
+                ModelStore::Create(model_path));
+}
+
+std::unique_ptr<LyraEncoder> LyraEncoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
+    std::shared_ptr<ModelStore> model_store) {
+  // The model configuration can only be checked when reading from disk.
   absl::Status are_params_supported =
-      AreParamsSupported(sample_rate_hz, num_channels, bitrate, model_path);
+      model_store->model_path().empty()
+          ? AreParamsSupported(sample_rate_hz, num_channels, bitrate)
+          : AreParamsSupported(sample_rate_hz, num_channels, bitrate,
+                               model_store->model_path());
   if (!are_params_supported.ok()) {
     std::cerr << "ERROR: " << are_params_supported << std::endl;
     return nullptr;
@@ -149,9 +92,9 @@ std::unique_ptr<LyraEncoder> LyraEncoder::Create(
     return nullptr;
   }
 
-  auto vector_quantizer =
-      CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
-                      kNumQuantizationBits, model_path);
+  auto vector_quantizer = CreateQuantizer(
+      kNumFramesPerPacket * kNumExpectedOutputFeatures, kNumQuantizationBits,
+      model_store);
   if (vector_quantizer == nullptr) {
     fprintf(stderr, "Error: Failed to create vector quantizer.\n");
     return nullptr;
@@ -169,7 +112,7 @@ std::unique_ptr<LyraEncoder> LyraEncoder::Create(
   }
 
   // Default to the internal frame hop size.
-  auto denoiser = CreateDenoiser(model_path);
+  auto denoiser = CreateDenoiser(model_store->model_path());
   if (!denoiser.ok()) {
     fprintf(stderr, "Error: Failed to create denoiser.\n");
     return nullptr;
@@ -213,31 +156,27 @@ LyraEncoder::LyraEncoder(
       num_channels_(num_channels),
       bitrate_(bitrate),
       num_frames_per_packet_(num_frames_per_packet),
-      enable_dtx_(enable_dtx) {
-  // This filter has a -60 dB response for frequencies below 60 Hz for 16 kHz
-  // sample rate or 30 Hz for 8 kHz sample rate. For sample rates of 32 kHz and
-  // 48 kHz, the audio is resampled to 16 kHz before filtering, so the cutoff
-  // will be 60 Hz too.
-  // TODO(b/143491858): Remove this filtering once we find a vector quantizer
-  // that is robust to DC.
-  second_order_sections_filter_.Init(
-      1, linear_filters::BiquadFilterCascadeCoefficients({
-             {{0.99860809, -1.99666786, 0.99860809},
-              {1.0, -1.99658432, 0.99729972}},
-             {{0.99597739, -1.99145467, 0.99597739},
-              {1.0, -1.99137134, 0.99203811}},
-             {{0.99353280, -1.98665193, 0.99353280},
-              {1.0, -1.98656881, 0.98714873}},
-             {{0.99137777, -1.98245157, 0.99137777},
-              {1.0, -1.98236863, 0.98283848}},
-             {{0.98960226, -1.97901469, 0.98960226},
-              {1.0, -1.97893189, 0.97928731}},
-             {{0.98827957, -1.97646836, 0.98827957},
-              {1.0, -1.97638567, 0.97664182}},
-             {{0.98746381, -1.97490392, 0.98746381},
-              {1.0, -1.9748213, 0.97501025}},
-             {{0.99357343, -0.99357343, 0.0}, {1.0, -0.98714687, 0.0}},
-         }));
+      enable_dtx_(enable_dtx),
+      // Resampling a packet may round up by a sample.
+      stream_samples_(
+          num_frames_per_packet * GetNumSamplesPerHop(kInternalSampleRateHz) +
+          ConvertNumSamplesBetweenSampleRate(
+              num_frames_per_packet * GetNumSamplesPerHop(sample_rate_hz),
+              sample_rate_hz, kInternalSampleRateHz) +
+          1),
+      num_stream_samples_(0),
+      quantized_bits_(packet_->PacketSize()),
+      unfiltered_samples_(num_frames_per_packet *
+                          GetNumSamplesPerHop(kInternalSampleRateHz)),
+      filtered_samples_(unfiltered_samples_.size()),
+      processed_samples_(unfiltered_samples_.size()),
+      features_(kNumFeatures),
+      concatenated_features_(num_frames_per_packet * kNumFeatures),
+      packet_bytes_(packet_->PacketSize()) {
+  second_order_sections_filter_.Init(1, CreateHighPassFilterCoefficients());
+  if (denoiser_ != nullptr) {
+    denoised_samples_.reserve(unfiltered_samples_.size());
+  }
 }
 
 absl::optional<std::vector<uint8_t>> LyraEncoder::Encode(
@@ -245,16 +184,111 @@ absl::optional<std::vector<uint8_t>> LyraEncoder::Encode(
   return EncodeInternal(audio, true);
 }
 
+bool LyraEncoder::EncodeStream(absl::Span<const int16_t> audio,
+                               std::vector<std::vector<uint8_t>>* packets) {
+  return EncodeStream(audio, [packets](absl::Span<const uint8_t> packet) {
+    packets->emplace_back(packet.begin(), packet.end());
+  });
+}
+
+bool LyraEncoder::EncodeStream(absl::Span<const int16_t> audio,
+                               const PacketCallback& on_packet) {
+  // Audio is resampled a packet at a time at most, so that it fits after the
+  // incomplete packet buffered.
+  const int num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_);
+  const int num_internal_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  while (!audio.empty()) {
+    const auto chunk =
+        audio.subspan(0, std::min<int>(audio.size(), num_samples_per_packet));
+    const auto buffer =
+        absl::MakeSpan(stream_samples_).subspan(num_stream_samples_);
+    int num_buffered;
+    if (kInternalSampleRateHz == sample_rate_hz_) {
+      std::copy(chunk.begin(), chunk.end(), buffer.begin());
+      num_buffered = chunk.size();
+    } else {
+      num_buffered = resampler_->Resample(chunk, buffer);
+      if (num_buffered < 0) {
+        fprintf(stderr, "Resampled audio does not fit in the stream buffer.\n");
+        return false;
+      }
+    }
+    num_stream_samples_ += num_buffered;
+    audio.remove_prefix(chunk.size());
+
+    while (num_stream_samples_ >= num_internal_samples_per_packet) {
+      if (!EncodeStreamPacket(on_packet)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool LyraEncoder::FlushStream(std::vector<std::vector<uint8_t>>* packets) {
+  return FlushStream([packets](absl::Span<const uint8_t> packet) {
+    packets->emplace_back(packet.begin(), packet.end());
+  });
+}
+
+bool LyraEncoder::FlushStream(const PacketCallback& on_packet) {
+  if (num_stream_samples_ == 0) {
+    return true;
+  }
+  const int num_internal_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  std::fill(stream_samples_.begin() + num_stream_samples_,
+            stream_samples_.begin() + num_internal_samples_per_packet, 0);
+  num_stream_samples_ = num_internal_samples_per_packet;
+  const bool success = EncodeStreamPacket(on_packet);
+  num_stream_samples_ = 0;
+  if (resampler_ != nullptr) {
+    resampler_->Reset();
+  }
+  return success;
+}
+
+bool LyraEncoder::EncodeStreamPacket(const PacketCallback& on_packet) {
+  const int num_internal_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  const auto packet_or = EncodeResampledPacket(
+      absl::MakeConstSpan(stream_samples_)
+          .subspan(0, num_internal_samples_per_packet),
+      /*filter_audio=*/true);
+  if (!packet_or.has_value()) {
+    return false;
+  }
+  on_packet(packet_or.value());
+  std::copy(stream_samples_.begin() + num_internal_samples_per_packet,
+            stream_samples_.begin() + num_stream_samples_,
+            stream_samples_.begin());
+  num_stream_samples_ -= num_internal_samples_per_packet;
+  return true;
+}
+
 absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeInternal(
     const absl::Span<const int16_t> audio, bool filter_audio) {
-  absl::Span<const int16_t> audio_for_encoding = audio;
+  if (kInternalSampleRateHz == sample_rate_hz_) {
+    return EncodeResampled(audio, filter_audio);
+  }
+  return EncodeResampled(resampler_->Resample(audio), filter_audio);
+}
 
-  // Space to store resampled and/or filtered samples.
-  std::vector<int16_t> processed;
-  if (kInternalSampleRateHz != sample_rate_hz_) {
-    processed = resampler_->Resample(audio);
-    audio_for_encoding = absl::MakeConstSpan(processed);
+absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeResampled(
+    absl::Span<const int16_t> audio, bool filter_audio) {
+  const auto packet_or = EncodeResampledPacket(audio, filter_audio);
+  if (!packet_or.has_value()) {
+    return absl::nullopt;
   }
+  return std::vector<uint8_t>(packet_or.value().begin(),
+                              packet_or.value().end());
+}
+
+absl::optional<absl::Span<const uint8_t>> LyraEncoder::EncodeResampledPacket(
+    absl::Span<const int16_t> audio, bool filter_audio) {
+  absl::Span<const int16_t> audio_for_encoding = audio;
 
   const int internal_samples_per_hop =
       GetNumSamplesPerHop(kInternalSampleRateHz);
@@ -269,9 +303,8 @@ absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeInternal(
     return absl::nullopt;
   }
 
-  std::vector<int16_t> denoised_audio;
   if (denoiser_ != nullptr) {
-    denoised_audio.reserve(audio_for_encoding.size());
+    denoised_samples_.clear();
     for (int t = 0; t < audio_for_encoding.size();
          t += denoiser_->SamplesPerHop()) {
       auto denoised_frame = denoiser_->Denoise(
@@ -280,41 +313,38 @@ absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeInternal(
         fprintf(stderr, "Denoising failed.\n");
         return absl::nullopt;
       }
-      denoised_audio.insert(denoised_audio.end(),
-                            denoised_frame.value().begin(),
-                            denoised_frame.value().end());
+      denoised_samples_.insert(denoised_samples_.end(),
+                               denoised_frame.value().begin(),
+                               denoised_frame.value().end());
     }
-    audio_for_encoding = absl::MakeConstSpan(denoised_audio);
+    audio_for_encoding = absl::MakeConstSpan(denoised_samples_);
   }
 
   if (filter_audio) {
     // High-pass filter before encoding.
-    std::vector<float> pre_filtered_floats(audio_for_encoding.begin(),
-                                           audio_for_encoding.end());
-    std::vector<float> filtered_floats;
-    second_order_sections_filter_.ProcessBlock(pre_filtered_floats,
-                                               &filtered_floats);
-    processed.resize(filtered_floats.size());
-    std::transform(filtered_floats.begin(), filtered_floats.end(),
-                   processed.begin(), ClipToInt16);
-    audio_for_encoding = absl::MakeConstSpan(processed);
+    std::copy(audio_for_encoding.begin(), audio_for_encoding.end(),
+              unfiltered_samples_.begin());
+    second_order_sections_filter_.ProcessBlock(unfiltered_samples_,
+                                               &filtered_samples_);
+    std::transform(filtered_samples_.begin(), filtered_samples_.end(),
+                   processed_samples_.begin(), ClipToInt16);
+    audio_for_encoding = absl::MakeConstSpan(processed_samples_);
   }
 
   // We send an empty packet only if all constituent frames are noise similar
   // to the previous ones.
   int num_similar_noise_frames = 0;
-  std::vector<float> concatenated_features;
   for (int i = 0; i < num_frames_per_packet_; ++i) {
-    auto features_or = feature_extractor_->Extract(audio_for_encoding.subspan(
-        internal_samples_per_hop * i, internal_samples_per_hop));
-    if (!features_or.has_value()) {
+    if (!feature_extractor_->Extract(
+            audio_for_encoding.subspan(internal_samples_per_hop * i,
+                                       internal_samples_per_hop),
+            absl::MakeSpan(features_))) {
       fprintf(stderr, "Feature extraction from audio frame failed.\n");
       return absl::nullopt;
     }
-    const std::vector<float>& features = features_or.value();
 
     if (enable_dtx_) {
-      auto is_similar_noise = noise_estimator_->IsSimilarNoise(features);
+      auto is_similar_noise = noise_estimator_->IsSimilarNoise(features_);
       if (!is_similar_noise.has_value()) {
         fprintf(stderr, "Unable to check noise estimation.\n");
         return absl::nullopt;
@@ -323,32 +353,32 @@ absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeInternal(
       if (is_similar_noise.value()) {
         num_similar_noise_frames++;
       } else {
-        if (!noise_estimator_->Update(features)) {
+        if (!noise_estimator_->Update(features_)) {
           fprintf(stderr, "Unable to update noise estimator.\n");
           return absl::nullopt;
         }
       }
     }
 
-    if (concatenated_features.empty()) {
-      concatenated_features.resize(num_frames_per_packet_ * features.size());
-    }
-    std::copy(features.begin(), features.end(),
-              concatenated_features.begin() + i * features.size());
+    std::copy(features_.begin(), features_.end(),
+              concatenated_features_.begin() + i * features_.size());
   }
 
   if (num_similar_noise_frames == num_frames_per_packet_) {
-    Packet<0, 0> empty_packet;
-    return empty_packet.PackQuantized(std::bitset<0>{}.to_string());
+    return absl::Span<const uint8_t>();
   }
 
-  auto quantized_features_or =
-      vector_quantizer_->Quantize(concatenated_features);
-  if (!quantized_features_or.has_value()) {
+  if (!vector_quantizer_->QuantizeToBits(concatenated_features_,
+                                         absl::MakeSpan(quantized_bits_))) {
     fprintf(stderr, "Vector quantization failed.\n");
     return absl::nullopt;
   }
-  return packet_->PackQuantized(quantized_features_or.value());
+  if (!packet_->PackQuantizedBits(quantized_bits_,
+                                  absl::MakeSpan(packet_bytes_))) {
+    fprintf(stderr, "Packing quantized features failed.\n");
+    return absl::nullopt;
+  }
+  return absl::MakeConstSpan(packet_bytes_);
 }
 
 int LyraEncoder::sample_rate_hz() const { return sample_rate_hz_; }
@@ -18,6 +18,7 @@
 #define LYRA_CODEC_LYRA_ENCODER_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -28,6 +29,7 @@
 #include "feature_extractor_interface.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_encoder_interface.h"
+#include "model_store.h"
 #include "noise_estimator_interface.h"
 #include "packet_interface.h"
 #include "resampler_interface.h"
@@ -65,10 +67,25 @@ class LyraEncoder : public LyraEncoderInterface {
       int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
       const ghc::filesystem::path& model_path);
 
+  /// Same as above, but the model weights are read from |wavegru_buffer|.
+  ///
+  /// @param wavegru_buffer Buffers of the model files. They are only read
+  ///                       during this call, so |wavegru_buffer| need not
+  ///                       outlive the returned encoder.
   static std::unique_ptr<LyraEncoder> Create(
       int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
       const WavegruBufferInterface& wavegru_buffer);
 
+  /// Same as above, but the quantizer tables are shared with all other
+  /// encoders and decoders created from |model_store|.
+  ///
+  /// @param model_store Store owning the model weights.
+  /// @return A unique_ptr to a LyraEncoder if all desired params are supported.
+  ///         Else it returns a nullptr.
+  static std::unique_ptr<LyraEncoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
+      std::shared_ptr<ModelStore> model_store);
+
   /// Encodes the audio samples into a vector wrapped byte array.
   ///
   /// @param audio Span of int16-formatted samples. It is assumed to contain
@@ -79,6 +96,52 @@ class LyraEncoder : public LyraEncoderInterface {
   absl::optional<std::vector<uint8_t>> Encode(
       const absl::Span<const int16_t> audio) override;
 
+  /// Encodes audio of any duration, such as the 10ms an audio device callback
+  /// delivers. The samples which do not complete a packet are buffered until
+  /// the next call, so each call encodes zero or more packets. Buffering and
+  /// resampling the audio do not allocate. Streams should not be interleaved
+  /// with calls to |Encode|, which share the resampler state.
+  ///
+  /// @param audio Span of int16-formatted samples of any size at the sample
+  ///              rate chosen at Create time.
+  /// @param packets The encoded packets are appended to it, oldest first. If
+  ///                DTX is enabled packets deemed to contain silence are empty.
+  /// @return True on success. Else the packets encoded before the failure
+  ///         have still been appended.
+  bool EncodeStream(absl::Span<const int16_t> audio,
+                    std::vector<std::vector<uint8_t>>* packets);
+
+  /// Encodes the samples buffered by |EncodeStream|, padded with silence to
+  /// complete a packet, and starts a new stream.
+  ///
+  /// @param packets The last packet of the stream is appended to it, unless
+  ///                no samples were buffered.
+  /// @return True on success.
+  bool FlushStream(std::vector<std::vector<uint8_t>>* packets);
+
+  /// Called with each packet encoded by |EncodeStream| or |FlushStream|,
+  /// oldest first. The packet is only valid during the call. If DTX is
+  /// enabled packets deemed to contain silence are empty.
+  using PacketCallback = std::function<void(absl::Span<const uint8_t>)>;
+
+  /// Same as above, but each packet is passed to |on_packet| rather than
+  /// appended to a vector, so that encoding a stream does not allocate.
+  ///
+  /// @param audio Span of int16-formatted samples of any size at the sample
+  ///              rate chosen at Create time.
+  /// @param on_packet Called with each encoded packet.
+  /// @return True on success. Else the packets encoded before the failure
+  ///         have still been passed to |on_packet|.
+  bool EncodeStream(absl::Span<const int16_t> audio,
+                    const PacketCallback& on_packet);
+
+  /// Same as above, but the last packet is passed to |on_packet|.
+  ///
+  /// @param on_packet Called with the last packet of the stream, unless no
+  ///                  samples were buffered.
+  /// @return True on success.
+  bool FlushStream(const PacketCallback& on_packet);
+
   /// Getter for the sample rate in Hertz.
   ///
   /// @return Sample rate in Hertz.
@@ -113,6 +176,19 @@ class LyraEncoder : public LyraEncoderInterface {
   absl::optional<std::vector<uint8_t>> EncodeInternal(
       const absl::Span<const int16_t> audio, bool filter_audio);
 
+  // Same as above, but |audio| is already at |kInternalSampleRateHz|.
+  absl::optional<std::vector<uint8_t>> EncodeResampled(
+      absl::Span<const int16_t> audio, bool filter_audio);
+
+  // Same as above, but the packet is encoded into |packet_bytes_| and a view
+  // of it is returned, which is empty if DTX deems the packet silent.
+  absl::optional<absl::Span<const uint8_t>> EncodeResampledPacket(
+      absl::Span<const int16_t> audio, bool filter_audio);
+
+  // Encodes the packet at the start of |stream_samples_| and moves the samples
+  // which follow it to the start.
+  bool EncodeStreamPacket(const PacketCallback& on_packet);
+
   const std::unique_ptr<ResamplerInterface> resampler_;
   const std::unique_ptr<FeatureExtractorInterface> feature_extractor_;
   const std::unique_ptr<NoiseEstimatorInterface> noise_estimator_;
@@ -125,6 +201,22 @@ class LyraEncoder : public LyraEncoderInterface {
   const int num_frames_per_packet_;
   const bool enable_dtx_;
   linear_filters::BiquadFilterCascade<float> second_order_sections_filter_;
+  // Samples at |kInternalSampleRateHz| buffered by |EncodeStream| until they
+  // complete a packet. Sized for a packet and the resampled samples of another,
+  // so that buffering does not allocate.
+  std::vector<int16_t> stream_samples_;
+  int num_stream_samples_;
+  // The quantized features of a packet, packed as described in packed_bits.h.
+  std::vector<uint8_t> quantized_bits_;
+  // Scratch space for the samples and features of a packet while it is
+  // encoded, and the packet itself, so that encoding does not allocate.
+  std::vector<int16_t> denoised_samples_;
+  std::vector<float> unfiltered_samples_;
+  std::vector<float> filtered_samples_;
+  std::vector<int16_t> processed_samples_;
+  std::vector<float> features_;
+  std::vector<float> concatenated_features_;
+  std::vector<uint8_t> packet_bytes_;
   friend class LyraEncoderPeer;
 };
 
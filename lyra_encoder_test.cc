@@ -15,12 +15,16 @@
 #include "lyra_encoder.h"
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <climits>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <limits>
 #include <memory>
+#include <new>
 #include <numeric>
 #include <string>
 #include <utility>
@@ -48,6 +52,41 @@
 #include "testing/mock_vector_quantizer.h"
 #include "vector_quantizer_interface.h"
 
+namespace {
+
+// Counts the calls to the global operator new while |count_allocations| is
+// set, to check that encoding does not allocate.
+std::atomic<bool> count_allocations(false);
+std::atomic<int> num_allocations(0);
+
+void* CountedAllocate(std::size_t size) {
+  if (count_allocations.load()) {
+    num_allocations.fetch_add(1);
+  }
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) { return CountedAllocate(size); }
+void* operator new[](std::size_t size) { return CountedAllocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return CountedAllocate(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return operator new(size, std::nothrow);
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
 namespace chromemedia {
 namespace codec {
 namespace {
@@ -500,15 +539,133 @@ TEST_P(LyraEncoderTest, CreationFromBuffersSucceeds) {
        {"lyra_16khz_quant_codebook_dimensions.gz",
         {codebook_dimensions_buffer_size, codebook_dimensions_buffer}}};
 
-  EXPECT_NE(nullptr,
-            LyraEncoder::Create(
-                sample_rate_hz_, kNumChannels, kBitrate,
-                /*enable_dtx=*/false, SimpleWavegruBuffer(models_map)));
+  // The buffers are only read by Create(), so the encoders keep working once
+  // |wavegru_buffer| is gone.
+  std::vector<std::unique_ptr<LyraEncoder>> encoders;
+  {
+    const SimpleWavegruBuffer wavegru_buffer(models_map);
+    encoders.push_back(LyraEncoder::Create(sample_rate_hz_, kNumChannels,
+                                           kBitrate, /*enable_dtx=*/false,
+                                           wavegru_buffer));
+    encoders.push_back(LyraEncoder::Create(sample_rate_hz_, kNumChannels,
+                                           kBitrate, /*enable_dtx=*/true,
+                                           wavegru_buffer));
+  }
+  const std::vector<int16_t> audio(
+      kNumFramesPerPacket * GetNumSamplesPerHop(sample_rate_hz_), 1000);
+  for (const auto& encoder : encoders) {
+    ASSERT_NE(encoder, nullptr);
+    EXPECT_TRUE(encoder->Encode(audio).has_value());
+  }
+}
 
-  EXPECT_NE(nullptr,
-            LyraEncoder::Create(
-                sample_rate_hz_, kNumChannels, kBitrate,
-                /*enable_dtx=*/true, SimpleWavegruBuffer(models_map)));
+TEST_P(LyraEncoderTest, EncodeStreamMatchesEncode) {
+  const auto valid_model_path = ghc::filesystem::current_path() / "wavegru";
+  auto encoder = LyraEncoder::Create(sample_rate_hz_, kNumChannels, kBitrate,
+                                     /*enable_dtx=*/false, valid_model_path);
+  ASSERT_NE(encoder, nullptr);
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(sample_rate_hz_);
+  const int kNumPackets = 6;
+  std::vector<int16_t> audio(kNumPackets * num_samples_per_packet);
+  for (int i = 0; i < audio.size(); ++i) {
+    audio[i] = static_cast<int16_t>(
+        8000.f * std::sin(2.f * M_PI * 440.f * i / sample_rate_hz_) +
+        1000.f * std::sin(2.f * M_PI * 3000.f * i / sample_rate_hz_));
+  }
+  std::vector<std::vector<uint8_t>> expected_packets;
+  for (int i = 0; i < kNumPackets; ++i) {
+    auto encoded_or = encoder->Encode(absl::MakeConstSpan(audio).subspan(
+        i * num_samples_per_packet, num_samples_per_packet));
+    ASSERT_TRUE(encoded_or.has_value());
+    expected_packets.push_back(encoded_or.value());
+  }
+
+  // Chunks of 10ms, as audio device callbacks deliver, and of sizes which do
+  // not divide a packet.
+  for (const int chunk_size :
+       {sample_rate_hz_ / 100, 37, 3 * num_samples_per_packet / 2}) {
+    auto stream_encoder =
+        LyraEncoder::Create(sample_rate_hz_, kNumChannels, kBitrate,
+                            /*enable_dtx=*/false, valid_model_path);
+    ASSERT_NE(stream_encoder, nullptr);
+    std::vector<std::vector<uint8_t>> packets;
+    for (int i = 0; i < audio.size(); i += chunk_size) {
+      const int num_samples = std::min<int>(chunk_size, audio.size() - i);
+      ASSERT_TRUE(stream_encoder->EncodeStream(
+          absl::MakeConstSpan(audio).subspan(i, num_samples), &packets));
+      // Packets are encoded as soon as they are complete.
+      EXPECT_EQ(packets.size(), (i + num_samples) / num_samples_per_packet);
+    }
+    EXPECT_EQ(packets, expected_packets) << "Chunk size " << chunk_size;
+
+    // Nothing is buffered after whole packets.
+    ASSERT_TRUE(stream_encoder->FlushStream(&packets));
+    EXPECT_EQ(packets.size(), kNumPackets);
+  }
+}
+
+TEST_P(LyraEncoderTest, FlushStreamEncodesBufferedSamples) {
+  const auto valid_model_path = ghc::filesystem::current_path() / "wavegru";
+  auto encoder = LyraEncoder::Create(sample_rate_hz_, kNumChannels, kBitrate,
+                                     /*enable_dtx=*/false, valid_model_path);
+  ASSERT_NE(encoder, nullptr);
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(sample_rate_hz_);
+  const std::vector<int16_t> audio(num_samples_per_packet + 11, 1000);
+
+  std::vector<std::vector<uint8_t>> packets;
+  ASSERT_TRUE(encoder->EncodeStream(audio, &packets));
+  EXPECT_EQ(packets.size(), 1);
+  ASSERT_TRUE(encoder->FlushStream(&packets));
+  ASSERT_EQ(packets.size(), 2);
+  EXPECT_EQ(packets[1].size(), kPacketSize);
+  ASSERT_TRUE(encoder->FlushStream(&packets));
+  EXPECT_EQ(packets.size(), 2);
+}
+
+TEST_P(LyraEncoderTest, EncodeStreamWithCallbackDoesNotAllocate) {
+  const auto valid_model_path = ghc::filesystem::current_path() / "wavegru";
+  for (const bool enable_dtx : {false, true}) {
+    auto encoder = LyraEncoder::Create(sample_rate_hz_, kNumChannels, kBitrate,
+                                       enable_dtx, valid_model_path);
+    ASSERT_NE(encoder, nullptr);
+    const int num_samples_per_packet =
+        kNumFramesPerPacket * GetNumSamplesPerHop(sample_rate_hz_);
+    const int kNumPackets = 4;
+    std::vector<int16_t> audio(kNumPackets * num_samples_per_packet);
+    for (int i = 0; i < audio.size(); ++i) {
+      audio[i] = static_cast<int16_t>(
+          8000.f * std::sin(2.f * M_PI * 440.f * i / sample_rate_hz_));
+    }
+    std::vector<int> packet_sizes;
+    packet_sizes.reserve(kNumPackets);
+    const LyraEncoder::PacketCallback on_packet =
+        [&packet_sizes](absl::Span<const uint8_t> packet) {
+          packet_sizes.push_back(packet.size());
+        };
+
+    // The first packet may set up buffers. The rest are streamed in chunks of
+    // 10ms, as audio device callbacks deliver.
+    const auto first_packet =
+        absl::MakeConstSpan(audio).subspan(0, num_samples_per_packet);
+    ASSERT_TRUE(encoder->EncodeStream(first_packet, on_packet));
+    const int chunk_size = sample_rate_hz_ / 100;
+    num_allocations = 0;
+    count_allocations = true;
+    for (int i = num_samples_per_packet; i < audio.size(); i += chunk_size) {
+      const int num_samples = std::min<int>(chunk_size, audio.size() - i);
+      ASSERT_TRUE(encoder->EncodeStream(
+          absl::MakeConstSpan(audio).subspan(i, num_samples), on_packet));
+    }
+    count_allocations = false;
+    EXPECT_EQ(num_allocations, 0) << "DTX " << enable_dtx;
+    ASSERT_EQ(packet_sizes.size(), kNumPackets);
+    for (const int packet_size : packet_sizes) {
+      EXPECT_TRUE(packet_size == kPacketSize ||
+                  (enable_dtx && packet_size == 0));
+    }
+  }
 }
 
 TEST_P(LyraEncoderTest, BadCreationParametersReturnNullptr) {
@@ -21,21 +21,23 @@
 #include <atomic>
 #include <cstddef>
 #include <functional>
+#include <iostream>
 #include <memory>
 #include <random>
 #include <string>
 #include <tuple>
+#include <typeinfo>
 #include <vector>
 
 #include "absl/memory/memory.h"
-#include "absl/time/clock.h"  // for SleepFor
-#include "absl/time/time.h"
+#include "absl/strings/str_cat.h"
 #include "absl/types/span.h"
 #include "causal_convolutional_conditioning.h"
 #include "dsp_util.h"
 #include "include/ghc/filesystem.hpp"
 #include "layer_wrappers_lib.h"
 #include "lyra_types.h"
+#include "model_store.h"
 #include "project_and_sample.h"
 #include "sparse_matmul/sparse_matmul.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
@@ -60,6 +62,10 @@ class LyraWavegru {
       LayerWrapper<ArWeightType, ArRhsType, ArOutputType, DiskWeightType>;
   using GruLayerType =
       LayerWrapper<GruWeightType, GruStateType, GruRhsType, DiskWeightType>;
+  using GruSparseLayerType =
+      csrblocksparse::SparseLinearLayer<GruWeightType, GruStateType>;
+  using GruGatesType =
+      csrblocksparse::GruGates<GruStateType, GruRhsType, ArRhsType>;
 
   using ConditioningType =
       CausalConvolutionalConditioning<ConditioningTypes<WeightTypeKind>>;
@@ -71,75 +77,23 @@ class LyraWavegru {
   static std::unique_ptr<LyraWavegru<WeightTypeKind>> Create(
       int num_threads, const ghc::filesystem::path& path,
       const std::string& prefix) {
-#if defined __aarch64__
-    std::cout
-        << "lyra_wavegru running fast multiplication kernels for aarch64.";
-#elif defined __AVX__
-    std::cout << "lyra_wavegru running fast multiplication kernels for AVX.";
-#else   // defined __AVX__
-    std::cout << "lyra_wavegru running in slow generic mode.";
-#endif  // defined __aarch64__
-
-    LayerParams ar_to_gates_params{.num_input_channels = kNumSplitBands,
-                                   .num_filters = 3 * kNumGruHiddens,
-                                   .length = 1,
-                                   .kernel_size = 1,
-                                   .dilation = 1,
-                                   .stride = 1,
-                                   .relu = false,
-                                   .skip_connection = false,
-                                   .type = LayerType::kConv1D,
-                                   .num_threads = num_threads,
-                                   .per_column_barrier = false,
-                                   .from =
-                                       LayerParams::FromDisk{
-                                           .path = path.string(),
-                                           .zipped = true,
-                                       },
-                                   .prefix = prefix + "_ar_to_gates_"};
-    auto ar_to_gates_layer = ArLayerType::Create(ar_to_gates_params);
-    if (ar_to_gates_layer == nullptr) {
-      return nullptr;
-    }
-
-    LayerParams gru_params{.num_input_channels = kNumGruHiddens,
-                           .num_filters = 3 * kNumGruHiddens,
-                           .length = 1,
-                           .kernel_size = 1,
-                           .dilation = 1,
-                           .stride = 1,
-                           .relu = false,
-                           .skip_connection = false,
-                           .type = LayerType::kConv1D,
-                           .num_threads = num_threads,
-                           .per_column_barrier = false,
-                           .from =
-                               LayerParams::FromDisk{
-                                   .path = path.string(),
-                                   .zipped = true,
-                               },
-                           .prefix = prefix + "_gru_layer_"};
-    auto gru_layer = GruLayerType::Create(gru_params);
-    if (gru_layer == nullptr) {
-      return nullptr;
-    }
-
-    auto project_and_sample_layer = absl::make_unique<ProjectAndSampleType>();
-    project_and_sample_layer->LoadRaw(path, prefix + "_", /*zipped=*/true);
-    if (project_and_sample_layer->PrepareForThreads(num_threads) !=
-        num_threads) {
-      std::cerr << "Could not prepare project_and_sample for " << num_threads
-                 << " threads." << std::endl;
-      return nullptr;
-    }
-    return absl::WrapUnique(new LyraWavegru<WeightTypeKind>(
-        num_threads, std::move(ar_to_gates_layer), std::move(gru_layer),
-        std::move(project_and_sample_layer)));
+    return Create(num_threads, ModelStore::Create(path), prefix);
   }
 
   static std::unique_ptr<LyraWavegru<WeightTypeKind>> Create(
       int num_threads, const WavegruBufferInterface& wavegru_buffer,
       const std::string& prefix) {
+    auto model_store = ModelStore::Create(wavegru_buffer);
+    auto wavegru = Create(num_threads, model_store, prefix);
+    model_store->ReleaseWavegruBuffer();
+    return wavegru;
+  }
+
+  // The weights and biases are shared with all other users of |model_store|,
+  // only the per-stream state is owned by the returned instance.
+  static std::unique_ptr<LyraWavegru<WeightTypeKind>> Create(
+      int num_threads, std::shared_ptr<ModelStore> model_store,
+      const std::string& prefix) {
 #if defined __aarch64__
     std::cout
         << "lyra_wavegru running fast multiplication kernels for aarch64.";
@@ -149,52 +103,31 @@ class LyraWavegru {
     std::cout << "lyra_wavegru running in slow generic mode.";
 #endif  // defined __aarch64__
 
-    LayerParams ar_to_gates_params{.num_input_channels = kNumSplitBands,
-                                   .num_filters = 3 * kNumGruHiddens,
-                                   .length = 1,
-                                   .kernel_size = 1,
-                                   .dilation = 1,
-                                   .stride = 1,
-                                   .relu = false,
-                                   .skip_connection = false,
-                                   .type = LayerType::kConv1D,
-                                   .num_threads = num_threads,
-                                   .per_column_barrier = false,
-                                   .from =
-                                       LayerParams::FromDisk{
-                                           .path = "unused-path",
-                                           .zipped = true,
-                                       },
-                                   .prefix = prefix + "_ar_to_gates_"};
-    auto ar_to_gates_layer = ArLayerType::Create(ar_to_gates_params, wavegru_buffer);
-    if (ar_to_gates_layer == nullptr) {
+    std::shared_ptr<const csrblocksparse::CacheAlignedVector<float>>
+        ar_to_gates_weights;
+    std::shared_ptr<const GruSparseLayerType> gru_layer;
+    auto project_and_sample_layer = absl::make_unique<ProjectAndSampleType>();
+    model_store->RunConcurrently(
+        {[&]() {
+           ar_to_gates_weights = GetArToGatesWeights(
+               model_store.get(), prefix + "_ar_to_gates_");
+         },
+         [&]() {
+           gru_layer =
+               GetGruLayer(model_store.get(), prefix + "_gru_layer_",
+                           num_threads);
+         },
+         [&]() {
+           project_and_sample_layer->LoadRaw(model_store, prefix + "_");
+         }});
+    if (ar_to_gates_weights == nullptr || gru_layer == nullptr) {
       return nullptr;
     }
-
-    LayerParams gru_params{.num_input_channels = kNumGruHiddens,
-                           .num_filters = 3 * kNumGruHiddens,
-                           .length = 1,
-                           .kernel_size = 1,
-                           .dilation = 1,
-                           .stride = 1,
-                           .relu = false,
-                           .skip_connection = false,
-                           .type = LayerType::kConv1D,
-                           .num_threads = num_threads,
-                           .per_column_barrier = false,
-                           .from =
-                               LayerParams::FromDisk{
-                                   .path = "unused-path",
-                                   .zipped = true,
-                               },
-                           .prefix = prefix + "_gru_layer_"};
-    auto gru_layer = GruLayerType::Create(gru_params, wavegru_buffer);
-    if (gru_layer == nullptr) {
+    if (gru_layer->rows() != 3 * kNumGruHiddens ||
+        gru_layer->cols() != kNumGruHiddens) {
+      std::cerr << "Unexpected dimensions of the GRU layer." << std::endl;
       return nullptr;
     }
-
-    auto project_and_sample_layer = absl::make_unique<ProjectAndSampleType>();
-    project_and_sample_layer->LoadRaw(wavegru_buffer, prefix + "_", /*zipped=*/true);
     if (project_and_sample_layer->PrepareForThreads(num_threads) !=
         num_threads) {
       std::cerr << "Could not prepare project_and_sample for " << num_threads
@@ -202,7 +135,7 @@ class LyraWavegru {
       return nullptr;
     }
     return absl::WrapUnique(new LyraWavegru<WeightTypeKind>(
-        num_threads, std::move(ar_to_gates_layer), std::move(gru_layer),
+        num_threads, std::move(ar_to_gates_weights), std::move(gru_layer),
         std::move(project_and_sample_layer)));
   }
 
@@ -218,16 +151,20 @@ class LyraWavegru {
     // iteration. All other threads will be in this while loop until
     // |terminate_threads_| is set to true.
     while (!terminate_threads_.load()) {
-      // |main_thread_ready_| is used to let background threads do a non-busy
-      // wait while the main thread is returned to the caller to do extra work
+      // |packet_wait_| lets background threads spin briefly and then park
+      // while the main thread is returned to the caller to do extra work
       // outside such as packet handling.
       if (tid == 0) {
         num_samples_to_generate_.store(num_samples_to_generate);
+        packet_wait_.Notify();
       } else {
-        // Background threads will effectively non-busy wait here until
-        // |num_samples_to_generate_| is set to a value greater than 0.
+        // Background threads wait here until |num_samples_to_generate_| is set
+        // to a value greater than 0 or the threads are terminated.
+        packet_wait_.Wait([this]() {
+          return num_samples_to_generate_.load() > 0 ||
+                 terminate_threads_.load();
+        });
         if (num_samples_to_generate_.load() <= 0) {
-          absl::SleepFor(absl::Microseconds(100));
           continue;
         }
       }
@@ -260,28 +197,121 @@ class LyraWavegru {
 
   // Causes all threads with |tid| != 0 to break out of their |SamplingBody|
   // loop.
-  void TerminateThreads() { terminate_threads_.store(true); }
+  void TerminateThreads() {
+    terminate_threads_.store(true);
+    packet_wait_.Notify();
+  }
+
+  // Counters of the waits of the background threads for the next packet.
+  csrblocksparse::WaitStats packet_wait_stats() const {
+    return packet_wait_.stats();
+  }
+
+  // Counters of the waits of all threads at the barriers of the sampling loop,
+  // including those in |project_and_sample_layer_|.
+  csrblocksparse::WaitStats barrier_wait_stats() const {
+    csrblocksparse::WaitStats stats = spin_barrier_->wait_stats();
+    const csrblocksparse::WaitStats sampling_stats =
+        project_and_sample_layer_->barrier_wait_stats();
+    stats.num_spin_waits += sampling_stats.num_spin_waits;
+    stats.num_parked_waits += sampling_stats.num_parked_waits;
+    stats.spin_time += sampling_stats.spin_time;
+    stats.park_time += sampling_stats.park_time;
+    return stats;
+  }
 
   void ResetConditioningStart() { conditioning_start_.store(0); }
 
+  // The step of the conditioning the next sample is generated from.
+  int conditioning_start() const { return conditioning_start_.load(); }
+
   int num_gru_hiddens() const { return kNumGruHiddens; }
 
   int num_split_bands() const { return kNumSplitBands; }
 
+  // Largest |num_threads| for which ComputeStartAndEnd() hands every thread at
+  // least one SIMD-width slice of the GRU state.
+  static constexpr int MaxNumThreads() {
+    return kNumGruHiddens / GruGatesType::kSIMDWidth;
+  }
+
+  // Returns the weights of the |kNumSplitBands| AR inputs to the GRU gates,
+  // laid out for |k4ARInputs|: the weights of samples 0 and 1 interleaved for
+  // all 3 * |kNumGruHiddens| gates, followed by those of samples 2 and 3.
+  // They are read back from the sparse layer under |prefix|, so any source of
+  // |model_store| works, and are shared through it, including with
+  // BatchedWavegru. Returns nullptr on failure.
+  static std::shared_ptr<const csrblocksparse::CacheAlignedVector<float>>
+  GetArToGatesWeights(ModelStore* model_store, const std::string& prefix) {
+    using WeightsType = csrblocksparse::CacheAlignedVector<float>;
+    return model_store->GetOrLoad<WeightsType>(
+        absl::StrCat(prefix, "|k4ARInputs|", typeid(ArWeightType).name()),
+        [&]() -> std::shared_ptr<WeightsType> {
+          auto layer = model_store->GetSparseLayer<ArWeightType, ArRhsType,
+                                                   DiskWeightType>(
+              prefix, /*num_threads=*/1);
+          if (layer == nullptr) {
+            std::cerr << "Loading " << prefix << " failed." << std::endl;
+            return nullptr;
+          }
+          constexpr int kNumGates = 3 * kNumGruHiddens;
+          if (layer->rows() != kNumGates || layer->cols() != kNumSplitBands) {
+            std::cerr << "Unexpected dimensions of " << prefix << "."
+                      << std::endl;
+            return nullptr;
+          }
+          // The kernel has nowhere to add a bias, which is expected to be in
+          // the conditioning stack instead.
+          for (int i = 0; i < layer->full_bias().size(); ++i) {
+            if (static_cast<float>(layer->full_bias()[i]) != 0.0f) {
+              std::cerr << prefix << " must not have a bias." << std::endl;
+              return nullptr;
+            }
+          }
+          // Multiplying by a diagonal matrix reads back the columns. Its value
+          // is representable by every |ArRhsType|.
+          constexpr float kDiagonal = 0.5f;
+          csrblocksparse::FatCacheAlignedVector<ArRhsType> diagonal(
+              kNumSplitBands, kNumSplitBands);
+          diagonal.FillZero();
+          for (int band = 0; band < kNumSplitBands; ++band) {
+            diagonal.data()[band * diagonal.col_stride() + band] =
+                static_cast<ArRhsType>(kDiagonal);
+          }
+          csrblocksparse::FatCacheAlignedVector<ArOutputType> columns(
+              kNumGates, kNumSplitBands);
+          layer->SpMM_bias(diagonal, &columns);
+          auto weights =
+              std::make_shared<WeightsType>(kNumSplitBands * kNumGates);
+          for (int band = 0; band < kNumSplitBands; ++band) {
+            const ArOutputType* column =
+                columns.data() + band * columns.col_stride();
+            float* pair_weights = weights->data() + band / 2 * 2 * kNumGates;
+            for (int row = 0; row < kNumGates; ++row) {
+              pair_weights[2 * row + band % 2] =
+                  static_cast<float>(column[row]) / kDiagonal;
+            }
+          }
+          return weights;
+        });
+  }
+
  private:
   static constexpr int kNumGruHiddens = 1024;
   static constexpr int kNumSplitBands = 4;
 
   LyraWavegru() = delete;
 
-  LyraWavegru(int num_threads, std::unique_ptr<ArLayerType> ar_to_gates_layer,
-              std::unique_ptr<GruLayerType> gru_layer,
-              std::unique_ptr<ProjectAndSampleType> project_and_sample_layer)
+  LyraWavegru(
+      int num_threads,
+      std::shared_ptr<const csrblocksparse::CacheAlignedVector<float>>
+          ar_to_gates_weights,
+      std::shared_ptr<const GruSparseLayerType> gru_layer,
+      std::unique_ptr<ProjectAndSampleType> project_and_sample_layer)
       : num_threads_(num_threads),
-        ar_to_gates_layer_(std::move(ar_to_gates_layer)),
+        ar_to_gates_weights_(std::move(ar_to_gates_weights)),
         gru_layer_(std::move(gru_layer)),
         project_and_sample_layer_(std::move(project_and_sample_layer)),
-        sample_at_s_(kNumSplitBands),
         terminate_threads_(false),
         num_samples_to_generate_(0),
         conditioning_start_(0) {
@@ -294,23 +324,80 @@ class LyraWavegru {
   void InitLoadedLayers() {
     std::cout << "Model size: " << ModelSize() << " bytes" << std::endl;
     // Working space for activations.
-    ar_output_buffer_ = csrblocksparse::CacheAlignedVector<ArOutputType>(
-        ar_to_gates_layer_->rows());
-    ar_output_buffer_.FillZero();
-    ar_and_cond_to_gates_buffer_ =
-        csrblocksparse::CacheAlignedVector<GruRhsType>(
-            ar_to_gates_layer_->rows());
-    ar_and_cond_to_gates_buffer_.FillZero();
     gru_gates_buffer_ =
         csrblocksparse::CacheAlignedVector<GruRhsType>(gru_layer_->rows());
     gru_gates_buffer_.FillZero();
+    gru_state_ = csrblocksparse::CacheAlignedVector<GruStateType>(
+        gru_layer_->cols());
+    gru_state_.FillZero();
+    gru_layer_input_ = csrblocksparse::CacheAlignedVector<GruStateType>(
+        gru_layer_->cols());
+    gru_layer_input_.FillZero();
+    // The samples and the AR inputs made from them, one copy per thread.
+    sample_at_s_.reserve(num_threads_);
+    sample_at_sminus1_.reserve(num_threads_);
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      sample_at_s_.emplace_back(kNumSplitBands);
+      sample_at_s_.back().FillZero();
+      sample_at_sminus1_.emplace_back(kNumSplitBands);
+      sample_at_sminus1_.back().FillZero();
+    }
+    // Scratch space for sampling, one per thread so that SamplingBody() does
+    // not allocate. Its size should be multiple of 8.
+    sample_scratch_.reserve(num_threads_);
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      sample_scratch_.emplace_back(
+          project_and_sample_layer_->expanded_mixes_size());
+      sample_scratch_.back().FillZero();
+    }
   }
 
   std::size_t ModelSize() const {
     return gru_layer_->bytes() + project_and_sample_layer_->ModelSize() +
-           ar_to_gates_layer_->bytes();
+           ar_to_gates_weights_->size() * sizeof(float);
   }
 
+  // Returns the GRU layer under |prefix|, with its rows split for the threads
+  // of SamplingBody(): the part gate * |num_threads| + tid holds the rows of
+  // the gate (reset, update or cell) in the slice of the GRU state of thread
+  // |tid|, so each thread computes its own gates without waiting for the
+  // others. A single thread computes the whole layer as one part.
+  static std::shared_ptr<const GruSparseLayerType> GetGruLayer(
+      ModelStore* model_store, const std::string& prefix, int num_threads) {
+    if (num_threads == 1) {
+      return model_store->GetSparseLayer<GruWeightType, GruStateType,
+                                         DiskWeightType>(prefix,
+                                                         /*num_threads=*/1);
+    }
+    std::vector<int> row_starts;
+    row_starts.reserve(3 * num_threads + 1);
+    for (int gate = 0; gate < 3; ++gate) {
+      for (int tid = 0; tid < num_threads; ++tid) {
+        row_starts.push_back(
+            gate * kNumGruHiddens +
+            std::get<0>(ComputeStartAndEnd(tid, num_threads, kNumGruHiddens)));
+      }
+    }
+    row_starts.push_back(3 * kNumGruHiddens);
+    return model_store->GetSparseLayerWithRowStarts<
+        GruWeightType, GruStateType, DiskWeightType>(prefix, row_starts);
+  }
+
+  // Generates the samples of the current packet on thread |tid|.
+  // Each thread owns the slice [start, end) of the GRU state given by
+  // ComputeStartAndEnd() from end to end: it computes the rows of the
+  // recurrent layer for the gates of the slice, and the gates add the
+  // conditioning and AR inputs of the slice. The threads only wait for each
+  // other where data crosses the slices, which takes three barriers a step:
+  // 1. After the gates, as the projection reads the whole new state.
+  // 2. After the projection, in GetSamples(), before the mixture layers.
+  // 3. After the mixture layers, in GetSamples(), before the logistics, which
+  //    every thread then samples itself, so that the next step has its AR
+  //    inputs without a further barrier.
+  // The state is double buffered: the gates update |gru_state_| in place while
+  // the other threads may still read the previous state from
+  // |gru_layer_input_|, to which each thread copies its slice after the first
+  // barrier.
   int SamplingBody(
       csrblocksparse::SpinBarrier* spin_barrier, int tid,
       ConditioningType* conditioning,
@@ -336,62 +423,69 @@ class LyraWavegru {
         exit(EXIT_FAILURE);
     }
 
-    // This is a scratch space, whose size should be multiple of 8.
-    csrblocksparse::CacheAlignedVector<ScratchType> sample_tmp(
-        project_and_sample_layer_->expanded_mixes_size());
-
-    sample_tmp.FillZero();
-
     std::minstd_rand* thread_local_gen = &thread_local_gens_[tid];
 
     int start, end;
-    std::tie(start, end) = ComputeStartAndEnd(tid, kNumGruHiddens);
-
+    std::tie(start, end) =
+        ComputeStartAndEnd(tid, num_threads_, kNumGruHiddens);
+
+    const csrblocksparse::VectorView<GruStateType> gru_layer_input(
+        gru_layer_input_.data(), gru_layer_input_.rows(), 1);
+    auto gru_gates = gru_gates_buffer_.AsMutableView();
+    const csrblocksparse::MutableVectorView<GruStateType> gru_state(
+        gru_state_.data(), gru_state_.rows(), 1);
+    const float* ar_01_weights = ar_to_gates_weights_->data();
+    const float* ar_23_weights = ar_01_weights + 6 * kNumGruHiddens;
+    int* sample_at_s = sample_at_s_[tid].data();
+    ArRhsType* sample_at_sminus1 = sample_at_sminus1_[tid].data();
     for (int s = 0; s < num_samples_to_generate; s += kNumSplitBands) {
-      // Bring the AR sample(s) up to 3 * kNumGruHiddens.
-      ar_to_gates_layer_->Run(tid, spin_barrier,
-                              ar_output_buffer_.AsMutableView());
-
-      // Sum the conditioning and autoregressive output.
-      SumConditioningAndAutoregressive(
-          conditioning->AtStep(conditioning_start + s), 3 * start, 3 * end,
-          spin_barrier);
-
-      // Pass through the GRU layer.
-      gru_layer_->Run(tid, spin_barrier, gru_gates_buffer_.AsMutableView());
+      // Pass the rows of this thread through the GRU layer, see
+      // GetGruLayer(). The gates add the conditioning and the AR samples times
+      // their dense weights themselves.
+      for (int part = tid; part < gru_layer_->num_threads();
+           part += num_threads_) {
+        gru_layer_->SpMM_bias(gru_layer_input, &gru_gates, /*relu=*/false,
+                              part);
+      }
       gru_gates_
-          .template GruWithARInput<csrblocksparse::ARInputsMode::k0ARInputs>(
+          .template GruWithARInput<csrblocksparse::ARInputsMode::k4ARInputs>(
               start, end, /*state_size=*/kNumGruHiddens,
               /*gru_recurrent_ptr=*/gru_gates_buffer_.data(),
-              /*input_ptr=*/ar_and_cond_to_gates_buffer_.data(),
-              /*gru_state_ptr=*/gru_layer_->InputViewToUpdate().data());
+              /*input_ptr=*/
+              conditioning->AtStep(conditioning_start + s).data(),
+              /*gru_state_ptr=*/gru_state_.data(), &sample_at_sminus1[0],
+              &sample_at_sminus1[1], ar_01_weights,
+              /*num_replicas=*/1, /*replica_stride=*/0, &sample_at_sminus1[2],
+              ar_23_weights);
       spin_barrier->barrier();
+      std::copy(gru_state_.data() + start, gru_state_.data() + end,
+                gru_layer_input_.data() + start);
 
       // Project and sample.
       project_and_sample_layer_->GetSamples(
-          gru_layer_->InputViewToUpdate(), tid, thread_local_gen, &sample_tmp,
-          kNumSplitBands, sample_at_s_.data());
+          gru_state, tid, thread_local_gen, &sample_scratch_[tid],
+          kNumSplitBands, sample_at_s, /*samples_on_all_threads=*/true);
 
+      // Loop back the samples as the AR inputs of the next step.
+      for (int i = 0; i < kNumSplitBands; ++i) {
+        sample_at_sminus1[i] =
+            static_cast<ArRhsType>(SampleToFloat(sample_at_s[i]));
+      }
       if (tid == 0) {
-        // Loop back the samples as the input of |ar_to_gates_layer_| for the
-        // next step.
-        auto sample_at_sminus1 = ar_to_gates_layer_->InputViewToUpdate();
         for (int i = 0; i < kNumSplitBands; ++i) {
-          sample_at_sminus1[i] =
-              static_cast<ArRhsType>(SampleToFloat(sample_at_s_.at(i)));
-          split_band_samples->at(i).at(s / kNumSplitBands) = sample_at_s_.at(i);
+          split_band_samples->at(i).at(s / kNumSplitBands) = sample_at_s[i];
         }
       }
-      spin_barrier->barrier();
     }  // end of for (int s = 0; ...).
     return num_samples_to_generate;
   }
 
-  // Computes the intervals of gru gates to be computed by the given tid.
-  std::tuple<int, int> ComputeStartAndEnd(int tid, int state_size) const {
-    int factor = gru_gates_.kSIMDWidth;
-    factor *= state_size / (factor * num_threads_);
-    return std::make_tuple(factor * tid, tid == num_threads_ - 1
+  // Computes the slice of the GRU state owned by |tid| out of |num_threads|.
+  static std::tuple<int, int> ComputeStartAndEnd(int tid, int num_threads,
+                                                 int state_size) {
+    int factor = GruGatesType::kSIMDWidth;
+    factor *= state_size / (factor * num_threads);
+    return std::make_tuple(factor * tid, tid == num_threads - 1
                                              ? state_size
                                              : factor * (tid + 1));
   }
@@ -414,39 +508,33 @@ class LyraWavegru {
     }
   }
 
-  void SumConditioningAndAutoregressive(
-      const absl::Span<GruRhsType> conditioning_span, int sum_start,
-      int sum_end, csrblocksparse::SpinBarrier* spin_barrier) {
-    CastVector(sum_start, sum_end, ar_output_buffer_.data(),
-               ar_and_cond_to_gates_buffer_.data());
-    csrblocksparse::detail::SumVectors(sum_start, sum_end,
-                                       conditioning_span.data(),
-                                       ar_and_cond_to_gates_buffer_.data(),
-                                       ar_and_cond_to_gates_buffer_.data());
-    spin_barrier->barrier();
-  }
-
   const int num_threads_;
 
   // Random generators for each thread.
   std::vector<std::minstd_rand> thread_local_gens_;
 
   // Layers.
-  // The layer that transforms the AR input to the input of GRU gates is just a
-  // column vector with no bias (the combined bias is handled in the
-  // conditioning stack).
-  std::unique_ptr<ArLayerType> ar_to_gates_layer_;
-  std::unique_ptr<GruLayerType> gru_layer_;
+  // The AR input to the GRU gates is a dense column vector per split band with
+  // no bias (the combined bias is handled in the conditioning stack), which
+  // the gate kernel applies. See GetArToGatesWeights().
+  std::shared_ptr<const csrblocksparse::CacheAlignedVector<float>>
+      ar_to_gates_weights_;
+  std::shared_ptr<const GruSparseLayerType> gru_layer_;
 
   // TODO(b/161747203): Use LayerWrapper for the project and sample layer.
   std::unique_ptr<ProjectAndSampleType> project_and_sample_layer_;
-  csrblocksparse::GruGates<GruStateType, GruRhsType, ArRhsType> gru_gates_;
+  GruGatesType gru_gates_;
 
   // Buffers.
-  csrblocksparse::CacheAlignedVector<ArOutputType> ar_output_buffer_;
-  csrblocksparse::CacheAlignedVector<GruRhsType> ar_and_cond_to_gates_buffer_;
   csrblocksparse::CacheAlignedVector<GruRhsType> gru_gates_buffer_;
-  std::vector<int> sample_at_s_;
+  // The GRU state, updated in place by the gates, and its copy of the previous
+  // step read by |gru_layer_|.
+  csrblocksparse::CacheAlignedVector<GruStateType> gru_state_;
+  csrblocksparse::CacheAlignedVector<GruStateType> gru_layer_input_;
+  // The samples and AR inputs of each thread.
+  std::vector<csrblocksparse::CacheAlignedVector<int>> sample_at_s_;
+  std::vector<csrblocksparse::CacheAlignedVector<ArRhsType>> sample_at_sminus1_;
+  std::vector<csrblocksparse::CacheAlignedVector<ScratchType>> sample_scratch_;
 
   std::atomic<bool> terminate_threads_;
 
@@ -455,6 +543,7 @@ class LyraWavegru {
   // as tracking the position to read next from the conditioning vector.
   std::atomic<int> num_samples_to_generate_;
   std::atomic<int> conditioning_start_;
+  csrblocksparse::HybridWait packet_wait_;
 
   std::unique_ptr<csrblocksparse::SpinBarrier> spin_barrier_;
 };
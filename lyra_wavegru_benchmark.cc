@@ -0,0 +1,117 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how the throughput of sampling one packet scales with the number of
+// threads of a single LyraWavegru. Besides the samples per second, reports the
+// barriers each thread passes per sample step, and the share of the time the
+// threads spend waiting at them.
+
+#include <chrono>  // NOLINT
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "benchmark/benchmark.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_wavegru.h"
+#include "model_store.h"
+#include "sparse_matmul/sparse_matmul.h"
+
+namespace {
+
+constexpr int kNumCondHiddens = 512;
+constexpr int kNumGruHiddens = 1024;
+constexpr char kModelPrefix[] = "lyra_16khz";
+
+#ifdef USE_FIXED16
+using ComputeType = csrblocksparse::fixed16_type;
+#else
+using ComputeType = float;
+#endif  // USE_FIXED16
+
+using LyraWavegruType = chromemedia::codec::LyraWavegru<ComputeType>;
+
+// |state.range(0)| is the number of threads.
+void BM_LyraWavegruSample(benchmark::State& state) {
+  const int num_threads = state.range(0);
+  auto model_store = chromemedia::codec::ModelStore::Create(
+      ghc::filesystem::current_path() / "wavegru");
+  auto wavegru = LyraWavegruType::Create(num_threads, model_store, kModelPrefix);
+  LyraWavegruType::ConditioningType conditioning(
+      chromemedia::codec::kNumFeatures, kNumCondHiddens, kNumGruHiddens,
+      chromemedia::codec::GetNumSamplesPerHop(
+          chromemedia::codec::kInternalSampleRateHz),
+      chromemedia::codec::kNumFramesPerPacket, /*num_threads=*/1,
+      /*silence_value=*/0.0f, model_store, kModelPrefix);
+  csrblocksparse::FatCacheAlignedVector<float> input(
+      chromemedia::codec::kNumFeatures, 1);
+  input.FillRandom();
+  conditioning.Precompute(input, 1);
+  const int num_samples = conditioning.num_samples();
+  std::vector<std::vector<int16_t>> split_band_samples(
+      wavegru->num_split_bands(),
+      std::vector<int16_t>(num_samples / wavegru->num_split_bands()));
+
+  // As in WavegruModelImpl, the calling thread is |tid| 0 and the others wait
+  // for each packet in the background.
+  std::vector<std::unique_ptr<std::thread>> background_threads;
+  for (int tid = 1; tid < num_threads; ++tid) {
+    background_threads.emplace_back(absl::make_unique<std::thread>([&, tid]() {
+      wavegru->SampleThreaded(tid, &conditioning, &split_band_samples, 0);
+    }));
+  }
+  const csrblocksparse::WaitStats start_stats = wavegru->barrier_wait_stats();
+  const auto start_time = std::chrono::steady_clock::now();
+  for (auto _ : state) {
+    wavegru->ResetConditioningStart();
+    benchmark::DoNotOptimize(wavegru->SampleThreaded(
+        /*tid=*/0, &conditioning, &split_band_samples, num_samples));
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  const csrblocksparse::WaitStats end_stats = wavegru->barrier_wait_stats();
+  wavegru->TerminateThreads();
+  for (const auto& thread : background_threads) {
+    thread->join();
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_samples);
+  if (num_threads == 1) return;
+  // All threads but the last to arrive wait at each barrier. Includes the two
+  // barriers which end each packet.
+  const double num_waits = static_cast<double>(
+      end_stats.num_spin_waits + end_stats.num_parked_waits -
+      start_stats.num_spin_waits - start_stats.num_parked_waits);
+  const double num_steps = static_cast<double>(state.iterations()) *
+                           num_samples / wavegru->num_split_bands();
+  state.counters["barriers_per_step"] =
+      num_waits / (num_steps * (num_threads - 1));
+  const std::chrono::duration<double> wait_time =
+      (end_stats.spin_time + end_stats.park_time) -
+      (start_stats.spin_time + start_stats.park_time);
+  state.counters["barrier_wait_share"] =
+      wait_time.count() / (elapsed.count() * num_threads);
+}
+
+}  // namespace
+
+BENCHMARK(BM_LyraWavegruSample)
+    ->DenseRange(1, 8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_MAIN();
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model_bundle.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "include/ghc/filesystem.hpp"
+#include "sparse_matmul/sparse_matmul.h"
+#include "wavegru_buffer/mmap_wavegru_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+uint64_t AlignUp(uint64_t offset) {
+  return (offset + ModelBundle::kSectionAlignment - 1) /
+         ModelBundle::kSectionAlignment * ModelBundle::kSectionAlignment;
+}
+
+void AppendUint32(uint32_t value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendUint64(uint64_t value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendString(const std::string& value, std::string* out) {
+  AppendUint32(value.size(), out);
+  out->append(value);
+}
+
+// Reads from a bounds checked cursor over the bundle header.
+class HeaderReader {
+ public:
+  HeaderReader(const uint8_t* data, uint64_t size) : data_(data), size_(size) {}
+
+  template <typename T>
+  bool Read(T* value) {
+    if (size_ - offset_ < sizeof(T)) return false;
+    std::memcpy(value, data_ + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadString(std::string* value) {
+    uint32_t length;
+    if (!Read(&length) || size_ - offset_ < length) return false;
+    value->assign(reinterpret_cast<const char*>(data_ + offset_), length);
+    offset_ += length;
+    return true;
+  }
+
+ private:
+  const uint8_t* const data_;
+  const uint64_t size_;
+  uint64_t offset_ = 0;
+};
+
+}  // namespace
+
+constexpr char ModelBundle::kMagic[8];
+constexpr uint32_t ModelBundle::kVersion;
+constexpr int ModelBundle::kSectionAlignment;
+
+std::unique_ptr<ModelBundle> ModelBundle::Read(
+    const ghc::filesystem::path& bundle_file) {
+  std::error_code error_code;
+  const uint64_t file_size =
+      ghc::filesystem::file_size(bundle_file, error_code);
+  if (error_code) {
+    std::cerr << "Could not stat model bundle " << bundle_file << ": "
+              << error_code.message() << std::endl;
+    return nullptr;
+  }
+  FILE* file = fopen(bundle_file.string().c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Could not open model bundle " << bundle_file << std::endl;
+    return nullptr;
+  }
+  // A single read into cache aligned memory, so that every section is aligned
+  // as well.
+  auto data =
+      std::make_shared<csrblocksparse::CacheAlignedVector<uint8_t>>(file_size);
+  const size_t read_count = fread(data->data(), 1, file_size, file);
+  fclose(file);
+  if (read_count != file_size) {
+    std::cerr << "Could only read " << read_count << " of " << file_size
+              << " bytes of model bundle " << bundle_file << std::endl;
+    return nullptr;
+  }
+  const uint8_t* bytes = data->data();
+  return Parse(std::move(data), bytes, file_size, /*is_mapped=*/false,
+               bundle_file);
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::Map(
+    const ghc::filesystem::path& bundle_file) {
+  std::shared_ptr<const MmapWavegruBuffer> mapping =
+      MmapWavegruBuffer::Create(bundle_file);
+  if (mapping == nullptr) {
+    return nullptr;
+  }
+  // Mappings start on a page boundary, so every section is aligned.
+  const std::string name = bundle_file.filename().string();
+  const auto* bytes =
+      reinterpret_cast<const uint8_t*>(mapping->GetBuffer(name));
+  const uint64_t size = mapping->GetBufferSize(name);
+  return Parse(std::move(mapping), bytes, size, /*is_mapped=*/true,
+               bundle_file);
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::Parse(
+    std::shared_ptr<const void> storage, const uint8_t* data,
+    uint64_t file_size, bool is_mapped,
+    const ghc::filesystem::path& bundle_file) {
+  HeaderReader header(data, file_size);
+  char magic[sizeof(kMagic)];
+  uint32_t version = 0;
+  std::string weight_type;
+  uint32_t num_sections = 0;
+  if (!header.Read(&magic) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    std::cerr << bundle_file << " is not a model bundle." << std::endl;
+    return nullptr;
+  }
+  if (!header.Read(&version) || version != kVersion) {
+    std::cerr << "Model bundle " << bundle_file << " has version " << version
+              << ", expected " << kVersion << "." << std::endl;
+    return nullptr;
+  }
+  if (!header.ReadString(&weight_type) || !header.Read(&num_sections)) {
+    std::cerr << "Model bundle " << bundle_file << " has a truncated header."
+              << std::endl;
+    return nullptr;
+  }
+  std::map<std::string, std::pair<uint64_t, uint64_t>> sections;
+  for (uint32_t i = 0; i < num_sections; ++i) {
+    std::string name;
+    uint64_t offset, size;
+    if (!header.ReadString(&name) || !header.Read(&offset) ||
+        !header.Read(&size)) {
+      std::cerr << "Model bundle " << bundle_file
+                << " has a truncated section table." << std::endl;
+      return nullptr;
+    }
+    if (offset % kSectionAlignment != 0 || offset > file_size ||
+        size > file_size - offset) {
+      std::cerr << "Section " << name << " of model bundle " << bundle_file
+                << " is out of bounds." << std::endl;
+      return nullptr;
+    }
+    sections[name] = std::make_pair(offset, size);
+  }
+
+  // WrapUnique is used because of private c'tor.
+  return absl::WrapUnique(
+      new ModelBundle(std::move(storage), data, is_mapped,
+                      std::move(weight_type), std::move(sections)));
+}
+
+ModelBundle::ModelBundle(
+    std::shared_ptr<const void> storage, const uint8_t* data, bool is_mapped,
+    std::string weight_type,
+    std::map<std::string, std::pair<uint64_t, uint64_t>> sections)
+    : storage_(std::move(storage)),
+      data_(data),
+      is_mapped_(is_mapped),
+      weight_type_(std::move(weight_type)),
+      sections_(std::move(sections)) {}
+
+absl::optional<absl::Span<const uint8_t>> ModelBundle::GetSection(
+    const std::string& name) const {
+  const auto it = sections_.find(name);
+  if (it == sections_.end()) {
+    return absl::nullopt;
+  }
+  return absl::MakeConstSpan(data_ + it->second.first,
+                             it->second.second);
+}
+
+ModelBundleWriter::ModelBundleWriter(const std::string& weight_type)
+    : weight_type_(weight_type) {}
+
+bool ModelBundleWriter::AddSection(const std::string& name, std::string data) {
+  return sections_.emplace(name, std::move(data)).second;
+}
+
+absl::Status ModelBundleWriter::WriteToFile(
+    const ghc::filesystem::path& bundle_file) const {
+  std::string header(ModelBundle::kMagic, sizeof(ModelBundle::kMagic));
+  AppendUint32(ModelBundle::kVersion, &header);
+  AppendString(weight_type_, &header);
+  AppendUint32(sections_.size(), &header);
+
+  // The section table has a known size, so the offsets of the data can be
+  // computed before writing it.
+  uint64_t table_size = 0;
+  for (const auto& section : sections_) {
+    table_size +=
+        sizeof(uint32_t) + section.first.size() + 2 * sizeof(uint64_t);
+  }
+  uint64_t offset = AlignUp(header.size() + table_size);
+  for (const auto& section : sections_) {
+    AppendString(section.first, &header);
+    AppendUint64(offset, &header);
+    AppendUint64(section.second.size(), &header);
+    offset = AlignUp(offset + section.second.size());
+  }
+
+  std::string contents = std::move(header);
+  for (const auto& section : sections_) {
+    contents.resize(AlignUp(contents.size()), '\0');
+    contents.append(section.second);
+  }
+
+  FILE* file = fopen(bundle_file.string().c_str(), "wb");
+  if (file == nullptr) {
+    return absl::UnavailableError(
+        absl::StrCat("Could not open ", bundle_file.string(), " for writing."));
+  }
+  const size_t write_count =
+      fwrite(contents.data(), 1, contents.size(), file);
+  if (fclose(file) != 0 || write_count != contents.size()) {
+    return absl::DataLossError(
+        absl::StrCat("Could not write ", bundle_file.string(), "."));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_MODEL_BUNDLE_H_
+#define LYRA_CODEC_MODEL_BUNDLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "include/ghc/filesystem.hpp"
+#include "sparse_matmul/sparse_matmul.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A model bundle is a single file holding all parameters of a model in the
+// form they have in memory: sparse layers already converted to
+// CsrBlockSparseMatrix and cast to their weight type, biases already padded to
+// the block size, and the vector quantizer tables already decompressed.
+// Loading a bundle therefore costs one read of the file plus one aligned copy
+// per array, instead of gunzipping and converting every layer. A bundle can
+// also be memory mapped, in which case the layers are views of the mapping and
+// their weights are never copied at all.
+//
+// Layout, all integers in host byte order:
+//   char[8]  magic "LYRAMDL"
+//   uint32   version
+//   uint32   length of the weight type name, followed by the name
+//   uint32   number of sections
+//   per section: uint32 name length, name, uint64 offset, uint64 size
+//   section data, each section starting at a multiple of |kSectionAlignment|
+// The arrays inside a layer matrix section are aligned to |kSectionAlignment|
+// as well, see CsrBlockSparseMatrix::WriteToFlatBuffer().
+//
+// A bundle is only valid for the build configuration (float, fixed16 or
+// bfloat16 weights) it was written by, which is recorded as the weight type.
+class ModelBundle {
+ public:
+  static constexpr char kMagic[8] = "LYRAMDL";
+  static constexpr uint32_t kVersion = 2;
+  static constexpr int kSectionAlignment = 64;
+
+  // Returns nullptr if |bundle_file| cannot be read or is not a bundle of
+  // version |kVersion|.
+  static std::unique_ptr<ModelBundle> Read(
+      const ghc::filesystem::path& bundle_file);
+
+  // Same as Read(), but maps |bundle_file| read-only instead of copying it
+  // into memory. The pages are shared with every other process mapping the
+  // same file.
+  static std::unique_ptr<ModelBundle> Map(
+      const ghc::filesystem::path& bundle_file);
+
+  // Returns the contents of section |name|, or nullopt if there is none. The
+  // data is aligned to |kSectionAlignment| and lives as long as the bundle.
+  absl::optional<absl::Span<const uint8_t>> GetSection(
+      const std::string& name) const;
+
+  const std::string& weight_type() const { return weight_type_; }
+  int num_sections() const { return sections_.size(); }
+  // True if the bundle was created by Map(). The sections are then read-only.
+  bool is_mapped() const { return is_mapped_; }
+
+ private:
+  ModelBundle(std::shared_ptr<const void> storage, const uint8_t* data,
+              bool is_mapped, std::string weight_type,
+              std::map<std::string, std::pair<uint64_t, uint64_t>> sections);
+
+  // Parses the header of the |file_size| bytes at |data|, which are kept alive
+  // by |storage|.
+  static std::unique_ptr<ModelBundle> Parse(
+      std::shared_ptr<const void> storage, const uint8_t* data,
+      uint64_t file_size, bool is_mapped,
+      const ghc::filesystem::path& bundle_file);
+
+  // Either the CacheAlignedVector the file was read into or the mapping.
+  const std::shared_ptr<const void> storage_;
+  const uint8_t* const data_;
+  const bool is_mapped_;
+  const std::string weight_type_;
+  // Offset and size of every section, by name.
+  const std::map<std::string, std::pair<uint64_t, uint64_t>> sections_;
+};
+
+// Collects sections and writes them out in the ModelBundle format.
+class ModelBundleWriter {
+ public:
+  explicit ModelBundleWriter(const std::string& weight_type);
+
+  // Adds section |name|. Returns false and keeps the existing contents if
+  // there already is a section with that name.
+  bool AddSection(const std::string& name, std::string data);
+
+  absl::Status WriteToFile(const ghc::filesystem::path& bundle_file) const;
+
+  int num_sections() const { return sections_.size(); }
+
+ private:
+  const std::string weight_type_;
+  std::map<std::string, std::string> sections_;
+};
+
+// Stable name of a weight type, used in section names and to tell apart
+// the bundles of the different build configurations.
+template <typename T, typename Enable = void>
+struct WeightTypeName;
+
+template <>
+struct WeightTypeName<float> {
+  static std::string Get() { return "float"; }
+};
+
+template <>
+struct WeightTypeName<csrblocksparse::bfloat16> {
+  static std::string Get() { return "bfloat16"; }
+};
+
+template <typename T>
+struct WeightTypeName<
+    T, typename std::enable_if<csrblocksparse::IsFixed16Type<T>::value>::type> {
+  static std::string Get() {
+    return absl::StrCat("fixed16_", T::kExponentBits);
+  }
+};
+
+template <typename T>
+struct WeightTypeName<
+    T, typename std::enable_if<csrblocksparse::IsFixed32Type<T>::value>::type> {
+  static std::string Get() {
+    return absl::StrCat("fixed32_", T::kExponentBits);
+  }
+};
+
+template <typename WeightType, typename RhsType>
+std::string LayerSectionName(const std::string& prefix) {
+  return absl::StrCat("layer|", prefix, "|", WeightTypeName<WeightType>::Get(),
+                      "|", WeightTypeName<RhsType>::Get());
+}
+
+inline std::string ArraySectionName(const std::string& file_name) {
+  return absl::StrCat("array|", file_name);
+}
+
+// Adds the CSR matrix and the full bias of |layer| to |writer|.
+template <typename WeightType, typename RhsType>
+void AddLayerToBundle(
+    const std::string& prefix,
+    const csrblocksparse::SparseLinearLayer<WeightType, RhsType>& layer,
+    ModelBundleWriter* writer) {
+  const std::string name = LayerSectionName<WeightType, RhsType>(prefix);
+  std::string matrix;
+  layer.sparse_matrix().WriteToFlatBuffer(&matrix,
+                                          ModelBundle::kSectionAlignment);
+  const auto& bias = layer.full_bias();
+  writer->AddSection(absl::StrCat(name, "|matrix"), std::move(matrix));
+  writer->AddSection(
+      absl::StrCat(name, "|bias"),
+      std::string(reinterpret_cast<const char*>(bias.data()), bias.bytes()));
+}
+
+// Reconstructs the layer written by AddLayerToBundle(). The layer is built in
+// place, as SparseLinearLayer assignment makes a deep copy.
+// If |view| is true, the weights, column deltas and full bias of the layer are
+// views of the bundle instead of copies, and the bundle must outlive the
+// layer. Only the derived arrays (the right hand side indices and the padded
+// bias) are then allocated.
+template <typename WeightType, typename RhsType>
+absl::StatusOr<
+    std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>>
+ReadLayerFromBundle(const ModelBundle& bundle, const std::string& prefix,
+                    bool view = false) {
+  using BiasType =
+      typename csrblocksparse::TypeOfProduct<WeightType, RhsType>::type;
+  const std::string name = LayerSectionName<WeightType, RhsType>(prefix);
+  const auto matrix = bundle.GetSection(absl::StrCat(name, "|matrix"));
+  const auto bias = bundle.GetSection(absl::StrCat(name, "|bias"));
+  if (!matrix.has_value() || !bias.has_value()) {
+    return absl::NotFoundError(absl::StrCat("Bundle has no layer ", name, "."));
+  }
+  if (bias->size() % sizeof(BiasType) != 0) {
+    return absl::DataLossError(
+        absl::StrCat("Bias of ", name, " has a partial element."));
+  }
+  csrblocksparse::CsrBlockSparseMatrix<WeightType, RhsType> weights(
+      matrix->data(), matrix->size(), ModelBundle::kSectionAlignment, view);
+  const auto* bias_data = reinterpret_cast<const BiasType*>(bias->data());
+  const int bias_size = bias->size() / sizeof(BiasType);
+  csrblocksparse::CacheAlignedVector<BiasType> bias_vector =
+      view ? csrblocksparse::CacheAlignedVector<BiasType>::View(bias_data,
+                                                                bias_size)
+           : csrblocksparse::CacheAlignedVector<BiasType>(bias_data,
+                                                          bias_size);
+  if (weights.rows() != bias_vector.size()) {
+    return absl::DataLossError(
+        absl::StrCat("Layer ", name, " has ", weights.rows(), " rows but ",
+                     bias_vector.size(), " biases."));
+  }
+  return absl::make_unique<
+      csrblocksparse::SparseLinearLayer<WeightType, RhsType>>(
+      std::move(weights), std::move(bias_vector));
+}
+
+// Copies the array written under |file_name| into |array|.
+template <typename T>
+absl::Status ReadArrayFromBundle(const ModelBundle& bundle,
+                                 const std::string& file_name,
+                                 std::vector<T>* array) {
+  const auto section = bundle.GetSection(ArraySectionName(file_name));
+  if (!section.has_value()) {
+    return absl::NotFoundError(
+        absl::StrCat("Bundle has no array ", file_name, "."));
+  }
+  if (section->size() % sizeof(T) != 0) {
+    return absl::DataLossError(
+        absl::StrCat("Array ", file_name, " has a partial element."));
+  }
+  array->resize(section->size() / sizeof(T));
+  std::memcpy(array->data(), section->data(), section->size());
+  return absl::OkStatus();
+}
+
+template <typename T>
+void AddArrayToBundle(const std::string& file_name,
+                      const std::vector<T>& array, ModelBundleWriter* writer) {
+  writer->AddSection(ArraySectionName(file_name),
+                     std::string(reinterpret_cast<const char*>(array.data()),
+                                 array.size() * sizeof(T)));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MODEL_BUNDLE_H_
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cold start time of the encoder and decoder parameters, i.e. the
+// time to load every layer and quantizer table into a fresh ModelStore, from
+// the gzipped model files, from a precompiled model bundle and from a memory
+// mapped model bundle. Loading from the model files is measured with a range
+// of loading threads, and the time spent on each layer of the last iteration
+// is reported as a counter named after the layer.
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "include/ghc/filesystem.hpp"
+#include "model_bundle_converter_lib.h"
+#include "model_store.h"
+
+namespace {
+
+const ghc::filesystem::path& ModelPath() {
+  static const auto* const kModelPath =
+      new ghc::filesystem::path(ghc::filesystem::current_path() / "wavegru");
+  return *kModelPath;
+}
+
+const ghc::filesystem::path& BundlePath() {
+  static const auto* const kBundlePath = [] {
+    auto* path = new ghc::filesystem::path(
+        ghc::filesystem::temp_directory_path() / "lyra_model_bundle");
+    const absl::Status status =
+        chromemedia::codec::ConvertToModelBundle(ModelPath(), *path);
+    if (!status.ok()) {
+      std::cerr << "Could not write bundle: " << status << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    return path;
+  }();
+  return *kBundlePath;
+}
+
+void LoadOrDie(std::shared_ptr<chromemedia::codec::ModelStore> model_store) {
+  if (model_store == nullptr ||
+      !chromemedia::codec::LoadAllParameters(model_store).ok()) {
+    std::cerr << "Could not load parameters." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// |state.range(0)| is the number of loading threads, 0 loads sequentially.
+void BM_ColdStartFromModelFiles(benchmark::State& state) {
+  std::shared_ptr<chromemedia::codec::ModelStore> model_store;
+  for (auto _ : state) {
+    model_store = chromemedia::codec::ModelStore::Create(ModelPath());
+    model_store->EnableParallelLoading(state.range(0));
+    LoadOrDie(model_store);
+  }
+  for (const auto& load_time : model_store->layer_load_times()) {
+    state.counters[load_time.first + "ms"] =
+        absl::ToDoubleMilliseconds(load_time.second);
+  }
+}
+
+void BM_ColdStartFromBundle(benchmark::State& state) {
+  const ghc::filesystem::path& bundle_path = BundlePath();
+  for (auto _ : state) {
+    LoadOrDie(chromemedia::codec::ModelStore::CreateFromBundle(bundle_path));
+  }
+}
+
+void BM_ColdStartFromMappedBundle(benchmark::State& state) {
+  const ghc::filesystem::path& bundle_path = BundlePath();
+  for (auto _ : state) {
+    LoadOrDie(
+        chromemedia::codec::ModelStore::CreateFromMappedBundle(bundle_path));
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_ColdStartFromModelFiles)
+    ->Arg(0)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ColdStartFromBundle)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ColdStartFromMappedBundle)->Unit(benchmark::kMillisecond);
+BENCHMARK_MAIN();
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model_bundle_converter_lib.h"
+
+#include <memory>
+
+#include "absl/status/status.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_components.h"
+#include "lyra_config.h"
+#include "generative_model_interface.h"
+#include "model_store.h"
+#include "vector_quantizer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+#ifdef USE_FIXED16
+const char kBundleWeightType[] = "fixed16";
+#elif USE_BFLOAT16
+const char kBundleWeightType[] = "bfloat16";
+#else
+const char kBundleWeightType[] = "float";
+#endif  // USE_FIXED16
+
+absl::Status LoadAllParameters(std::shared_ptr<ModelStore> model_store) {
+  // Both are always set up for |kInternalSampleRateHz|, and are independent
+  // so they may be loaded concurrently.
+  std::unique_ptr<GenerativeModelInterface> model;
+  std::unique_ptr<VectorQuantizerInterface> vector_quantizer;
+  model_store->RunConcurrently(
+      {[&]() {
+         model = CreateGenerativeModel(
+             GetNumSamplesPerHop(kInternalSampleRateHz),
+             kNumExpectedOutputFeatures, kNumFramesPerPacket, model_store);
+       },
+       [&]() {
+         vector_quantizer =
+             CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
+                             kNumQuantizationBits, model_store);
+       }});
+  if (model == nullptr) {
+    return absl::InternalError("Could not load the generative model.");
+  }
+  if (vector_quantizer == nullptr) {
+    return absl::InternalError("Could not load the vector quantizer.");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ConvertToModelBundle(const ghc::filesystem::path& model_path,
+                                  const ghc::filesystem::path& bundle_file) {
+  auto model_store = ModelStore::Create(model_path);
+  model_store->RecordBundle(kBundleWeightType);
+  const absl::Status status = LoadAllParameters(model_store);
+  if (!status.ok()) {
+    return status;
+  }
+  return model_store->WriteBundle(bundle_file);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
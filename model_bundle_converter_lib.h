@@ -0,0 +1,45 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_MODEL_BUNDLE_CONVERTER_LIB_H_
+#define LYRA_CODEC_MODEL_BUNDLE_CONVERTER_LIB_H_
+
+#include <memory>
+
+#include "absl/status/status.h"
+#include "include/ghc/filesystem.hpp"
+#include "model_store.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Name of the weight type of this build, as recorded in the bundles it writes.
+extern const char kBundleWeightType[];
+
+// Loads every parameter used by the encoder and the decoder from
+// |model_store|, as the generative model and the vector quantizer do.
+absl::Status LoadAllParameters(std::shared_ptr<ModelStore> model_store);
+
+// Converts the model files under |model_path| into a single bundle at
+// |bundle_file|, holding the parameters in the final form for the weight type
+// this library was built for.
+absl::Status ConvertToModelBundle(const ghc::filesystem::path& model_path,
+                                  const ghc::filesystem::path& bundle_file);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MODEL_BUNDLE_CONVERTER_LIB_H_
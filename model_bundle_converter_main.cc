@@ -0,0 +1,64 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Converts the gzipped model files into a single precompiled model bundle,
+// which can be loaded with ModelStore::CreateFromBundle().
+// The bundle holds the weights in the form used by this build, so
+// model_bundle_converter_fixed16 has to be used for fixed16 decoders.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "architecture_utils.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "model_bundle_converter_lib.h"
+
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+ABSL_FLAG(std::string, output_path, "",
+          "Complete path of the bundle file to be written. Will overwrite "
+          "an existing file.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  const ghc::filesystem::path model_path =
+      chromemedia::codec::GetCompleteArchitecturePath(
+          absl::GetFlag(FLAGS_model_path));
+  const ghc::filesystem::path output_path(absl::GetFlag(FLAGS_output_path));
+  if (output_path.empty()) {
+    LOG(ERROR) << "Flag --output_path not set.";
+    return -1;
+  }
+
+  const absl::Status status =
+      chromemedia::codec::ConvertToModelBundle(model_path, output_path);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to convert " << model_path << ": " << status;
+    return -1;
+  }
+  LOG(INFO) << "Wrote " << chromemedia::codec::kBundleWeightType
+            << " model bundle " << output_path;
+  return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model_bundle.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Placeholder for get runfiles header.
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "model_store.h"
+#include "sparse_matmul/sparse_matmul.h"
+#include "vector_quantizer_impl.h"
+#include "wavegru_buffer/mmap_wavegru_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static constexpr char kGruLayerPrefix[] = "lyra_16khz_gru_layer_";
+
+class ModelBundleTest : public testing::Test {
+ protected:
+  ModelBundleTest()
+      : model_path_(ghc::filesystem::current_path() / "wavegru"),
+        bundle_path_(ghc::filesystem::path(testing::TempDir()) /
+                     "model_bundle_test_bundle") {}
+
+  ~ModelBundleTest() override { ghc::filesystem::remove(bundle_path_); }
+
+  void WriteRawFile(const std::string& contents) {
+    FILE* file = fopen(bundle_path_.string().c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+  }
+
+  const ghc::filesystem::path model_path_;
+  const ghc::filesystem::path bundle_path_;
+};
+
+TEST_F(ModelBundleTest, SectionsRoundTrip) {
+  ModelBundleWriter writer("float");
+  EXPECT_TRUE(writer.AddSection("a", "first"));
+  EXPECT_TRUE(writer.AddSection("b", std::string(100, 'x')));
+  EXPECT_FALSE(writer.AddSection("a", "duplicate"));
+  ASSERT_TRUE(writer.WriteToFile(bundle_path_).ok());
+
+  auto bundle = ModelBundle::Read(bundle_path_);
+  ASSERT_NE(bundle, nullptr);
+  EXPECT_EQ(bundle->weight_type(), "float");
+  EXPECT_EQ(bundle->num_sections(), 2);
+  const auto a = bundle->GetSection("a");
+  ASSERT_TRUE(a.has_value());
+  EXPECT_EQ(std::string(a->begin(), a->end()), "first");
+  const auto b = bundle->GetSection("b");
+  ASSERT_TRUE(b.has_value());
+  EXPECT_EQ(std::string(b->begin(), b->end()), std::string(100, 'x'));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(b->data()) %
+                ModelBundle::kSectionAlignment,
+            0);
+  EXPECT_FALSE(bundle->GetSection("c").has_value());
+}
+
+TEST_F(ModelBundleTest, RejectsInvalidFiles) {
+  EXPECT_EQ(ModelBundle::Read(bundle_path_), nullptr);
+
+  WriteRawFile("not a bundle");
+  EXPECT_EQ(ModelBundle::Read(bundle_path_), nullptr);
+
+  // Wrong version.
+  std::string header(ModelBundle::kMagic, sizeof(ModelBundle::kMagic));
+  const uint32_t version = ModelBundle::kVersion + 1;
+  header.append(reinterpret_cast<const char*>(&version), sizeof(version));
+  WriteRawFile(header);
+  EXPECT_EQ(ModelBundle::Read(bundle_path_), nullptr);
+
+  // Truncated section table.
+  ModelBundleWriter writer("float");
+  writer.AddSection("a", "first");
+  ASSERT_TRUE(writer.WriteToFile(bundle_path_).ok());
+  ghc::filesystem::resize_file(bundle_path_, 30);
+  EXPECT_EQ(ModelBundle::Read(bundle_path_), nullptr);
+}
+
+TEST_F(ModelBundleTest, LayerMatchesModelFiles) {
+  auto file_store = ModelStore::Create(model_path_);
+  file_store->RecordBundle("float");
+  auto file_layer = file_store->GetSparseLayer<float, float, float>(
+      kGruLayerPrefix, /*num_threads=*/1);
+  ASSERT_NE(file_layer, nullptr);
+  ASSERT_TRUE(file_store->WriteBundle(bundle_path_).ok());
+
+  auto bundle_store = ModelStore::CreateFromBundle(bundle_path_);
+  ASSERT_NE(bundle_store, nullptr);
+  auto bundle_layer = bundle_store->GetSparseLayer<float, float, float>(
+      kGruLayerPrefix, /*num_threads=*/1);
+  ASSERT_NE(bundle_layer, nullptr);
+
+  ASSERT_EQ(bundle_layer->rows(), file_layer->rows());
+  ASSERT_EQ(bundle_layer->cols(), file_layer->cols());
+  EXPECT_EQ(bundle_layer->block_height(), file_layer->block_height());
+  EXPECT_EQ(bundle_layer->block_width(), file_layer->block_width());
+  for (int i = 0; i < file_layer->rows(); ++i) {
+    EXPECT_EQ(bundle_layer->full_bias()[i], file_layer->full_bias()[i]);
+  }
+
+  csrblocksparse::CacheAlignedVector<float> rhs(file_layer->cols());
+  rhs.FillRandom();
+  csrblocksparse::CacheAlignedVector<float> file_output(file_layer->rows());
+  csrblocksparse::CacheAlignedVector<float> bundle_output(file_layer->rows());
+  file_layer->SpMM_bias(rhs, &file_output);
+  bundle_layer->SpMM_bias(rhs, &bundle_output);
+  for (int i = 0; i < file_layer->rows(); ++i) {
+    EXPECT_EQ(bundle_output[i], file_output[i]);
+  }
+}
+
+TEST_F(ModelBundleTest, MappedSectionsRoundTrip) {
+  ModelBundleWriter writer("float");
+  EXPECT_TRUE(writer.AddSection("a", "first"));
+  EXPECT_TRUE(writer.AddSection("b", std::string(100, 'x')));
+  ASSERT_TRUE(writer.WriteToFile(bundle_path_).ok());
+
+  auto bundle = ModelBundle::Map(bundle_path_);
+  ASSERT_NE(bundle, nullptr);
+  EXPECT_TRUE(bundle->is_mapped());
+  EXPECT_EQ(bundle->num_sections(), 2);
+  const auto b = bundle->GetSection("b");
+  ASSERT_TRUE(b.has_value());
+  EXPECT_EQ(std::string(b->begin(), b->end()), std::string(100, 'x'));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(b->data()) %
+                ModelBundle::kSectionAlignment,
+            0);
+  EXPECT_EQ(ModelBundle::Map(bundle_path_.string() + "_missing"), nullptr);
+}
+
+TEST_F(ModelBundleTest, MappedLayerIsAView) {
+  auto file_store = ModelStore::Create(model_path_);
+  file_store->RecordBundle("float");
+  auto file_layer = file_store->GetSparseLayer<float, float, float>(
+      kGruLayerPrefix, /*num_threads=*/1);
+  ASSERT_NE(file_layer, nullptr);
+  ASSERT_TRUE(file_store->WriteBundle(bundle_path_).ok());
+
+  auto mapped_store = ModelStore::CreateFromMappedBundle(bundle_path_);
+  ASSERT_NE(mapped_store, nullptr);
+  auto mapped_layer = mapped_store->GetSparseLayer<float, float, float>(
+      kGruLayerPrefix, /*num_threads=*/1);
+  ASSERT_NE(mapped_layer, nullptr);
+  EXPECT_FALSE(mapped_layer->full_bias().owns_data());
+
+  // The layer keeps the mapping alive on its own.
+  mapped_store.reset();
+  csrblocksparse::CacheAlignedVector<float> rhs(file_layer->cols());
+  rhs.FillRandom();
+  csrblocksparse::CacheAlignedVector<float> file_output(file_layer->rows());
+  csrblocksparse::CacheAlignedVector<float> mapped_output(file_layer->rows());
+  file_layer->SpMM_bias(rhs, &file_output);
+  mapped_layer->SpMM_bias(rhs, &mapped_output);
+  for (int i = 0; i < file_layer->rows(); ++i) {
+    EXPECT_EQ(mapped_output[i], file_output[i]);
+  }
+}
+
+TEST_F(ModelBundleTest, MmapWavegruBufferMapsDirectory) {
+  auto buffer = MmapWavegruBuffer::Create(model_path_);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_GT(buffer->num_buffers(), 0);
+  const std::string name = "lyra_16khz_quant_mean_vectors.gz";
+  EXPECT_EQ(buffer->GetBufferSize(name),
+            ghc::filesystem::file_size(model_path_ / name));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer->GetBuffer(name)) %
+                ModelBundle::kSectionAlignment,
+            0);
+  EXPECT_EQ(buffer->GetBuffer("non_existent"), nullptr);
+  EXPECT_EQ(buffer->GetBufferSize("non_existent"), 0);
+}
+
+TEST_F(ModelBundleTest, QuantizerMatchesModelFiles) {
+  const int num_features = kNumFramesPerPacket * kNumExpectedOutputFeatures;
+  auto file_store = ModelStore::Create(model_path_);
+  file_store->RecordBundle("float");
+  auto file_quantizer = VectorQuantizerImpl::Create(
+      num_features, kNumQuantizationBits, file_store);
+  ASSERT_NE(file_quantizer, nullptr);
+  ASSERT_TRUE(file_store->WriteBundle(bundle_path_).ok());
+
+  auto bundle_quantizer = VectorQuantizerImpl::Create(
+      num_features, kNumQuantizationBits,
+      ModelStore::CreateFromBundle(bundle_path_));
+  ASSERT_NE(bundle_quantizer, nullptr);
+
+  std::vector<float> features(num_features);
+  for (int i = 0; i < num_features; ++i) {
+    features[i] = static_cast<float>(i % 7) - 3.f;
+  }
+  const auto bits = file_quantizer->Quantize(features);
+  ASSERT_TRUE(bits.has_value());
+  EXPECT_EQ(bundle_quantizer->Quantize(features), bits);
+  EXPECT_EQ(bundle_quantizer->DecodeToLossyFeatures(bits.value()),
+            file_quantizer->DecodeToLossyFeatures(bits.value()));
+}
+
+TEST_F(ModelBundleTest, MissingLayerFails) {
+  ModelBundleWriter writer("float");
+  ASSERT_TRUE(writer.WriteToFile(bundle_path_).ok());
+  auto bundle_store = ModelStore::CreateFromBundle(bundle_path_);
+  ASSERT_NE(bundle_store, nullptr);
+  EXPECT_EQ((bundle_store->GetSparseLayer<float, float, float>(
+                kGruLayerPrefix, /*num_threads=*/1)),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model_store.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "include/ghc/filesystem.hpp"
+#include "model_bundle.h"
+#include "thread_pool.h"
+#include "wavegru_buffer/wavegru_buffer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::shared_ptr<ModelStore> ModelStore::Create(
+    const ghc::filesystem::path& model_path) {
+  // std::shared_ptr is constructed directly because of private c'tor.
+  return std::shared_ptr<ModelStore>(new ModelStore(
+      model_path, /*wavegru_buffer=*/nullptr, /*bundle=*/nullptr));
+}
+
+std::shared_ptr<ModelStore> ModelStore::Create(
+    const WavegruBufferInterface& wavegru_buffer) {
+  return std::shared_ptr<ModelStore>(new ModelStore(
+      ghc::filesystem::path(), &wavegru_buffer, /*bundle=*/nullptr));
+}
+
+std::shared_ptr<ModelStore> ModelStore::CreateFromBundle(
+    const ghc::filesystem::path& bundle_file) {
+  std::unique_ptr<const ModelBundle> bundle = ModelBundle::Read(bundle_file);
+  if (bundle == nullptr) {
+    return nullptr;
+  }
+  return std::shared_ptr<ModelStore>(
+      new ModelStore(ghc::filesystem::path(), /*wavegru_buffer=*/nullptr,
+                     std::move(bundle)));
+}
+
+std::shared_ptr<ModelStore> ModelStore::CreateFromMappedBundle(
+    const ghc::filesystem::path& bundle_file) {
+  std::unique_ptr<const ModelBundle> bundle = ModelBundle::Map(bundle_file);
+  if (bundle == nullptr) {
+    return nullptr;
+  }
+  return std::shared_ptr<ModelStore>(
+      new ModelStore(ghc::filesystem::path(), /*wavegru_buffer=*/nullptr,
+                     std::move(bundle)));
+}
+
+ModelStore::ModelStore(const ghc::filesystem::path& model_path,
+                       const WavegruBufferInterface* wavegru_buffer,
+                       std::shared_ptr<const ModelBundle> bundle)
+    : model_path_(model_path),
+      from_wavegru_buffer_(wavegru_buffer != nullptr),
+      wavegru_buffer_(wavegru_buffer),
+      bundle_(std::move(bundle)) {}
+
+absl::Status ModelStore::ReleasedWavegruBufferError(const std::string& name) {
+  return absl::FailedPreconditionError(
+      absl::StrCat("Cannot load |", name,
+                   "| after the wavegru buffer was released."));
+}
+
+void ModelStore::EnableParallelLoading(int num_threads) {
+  std::lock_guard<std::mutex> lock(loading_pool_mutex_);
+  loading_pool_ =
+      num_threads > 0 ? std::make_shared<ThreadPool>(num_threads) : nullptr;
+}
+
+void ModelStore::RunConcurrently(std::vector<std::function<void()>> tasks) {
+  std::shared_ptr<ThreadPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(loading_pool_mutex_);
+    pool = loading_pool_;
+  }
+  if (pool == nullptr) {
+    for (auto& task : tasks) {
+      task();
+    }
+    return;
+  }
+  pool->RunAll(std::move(tasks));
+}
+
+std::map<std::string, absl::Duration> ModelStore::layer_load_times() const {
+  std::lock_guard<std::mutex> lock(load_times_mutex_);
+  return load_times_;
+}
+
+void ModelStore::RecordBundle(const std::string& weight_type) {
+  std::lock_guard<std::mutex> lock(bundle_writer_mutex_);
+  bundle_writer_ = absl::make_unique<ModelBundleWriter>(weight_type);
+}
+
+absl::Status ModelStore::WriteBundle(
+    const ghc::filesystem::path& bundle_file) const {
+  std::lock_guard<std::mutex> lock(bundle_writer_mutex_);
+  if (bundle_writer_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "RecordBundle() was not called before loading the model.");
+  }
+  return bundle_writer_->WriteToFile(bundle_file);
+}
+
+int ModelStore::size() const {
+  // Entries are inspected without holding |entries_mutex_|, as a |load| in
+  // progress holds its entry's mutex and may need |entries_mutex_|.
+  std::vector<std::shared_ptr<Entry>> entries;
+  {
+    std::lock_guard<std::mutex> lock(entries_mutex_);
+    for (const auto& entry : entries_) {
+      entries.push_back(entry.second);
+    }
+  }
+  int size = 0;
+  for (const auto& entry : entries) {
+    std::lock_guard<std::mutex> entry_lock(entry->mutex);
+    if (entry->value != nullptr) {
+      ++size;
+    }
+  }
+  return size;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
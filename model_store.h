@@ -0,0 +1,322 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_MODEL_STORE_H_
+#define LYRA_CODEC_MODEL_STORE_H_
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "include/ghc/filesystem.hpp"
+#include "model_bundle.h"
+#include "sparse_matmul/sparse_matmul.h"
+#include "thread_pool.h"
+#include "wavegru_buffer/wavegru_buffer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Owns the immutable parameters of a model, i.e. the CSR weights and biases of
+// the sparse layers and the vector quantizer tables, so that they are loaded
+// once and shared read-only by every encoder and decoder created from the same
+// store. Users hold the store through a std::shared_ptr and the parameters are
+// released when the last of them is destroyed.
+// Per-stream state (input buffers, hidden states, random generators, scratch
+// space) is never kept in the store.
+// The parameters are read from a model directory, a WavegruBufferInterface or
+// a precompiled ModelBundle; a store can also record the parameters it loads
+// into a new bundle.
+// Independent parameters can optionally be loaded concurrently, see
+// EnableParallelLoading().
+// All methods are thread-safe.
+class ModelStore {
+ public:
+  // Returns a store which loads the parameters from the files in
+  // |model_path|.
+  static std::shared_ptr<ModelStore> Create(
+      const ghc::filesystem::path& model_path);
+
+  // Returns a store which loads the parameters from |wavegru_buffer|, which
+  // must outlive the store or a call to ReleaseWavegruBuffer().
+  static std::shared_ptr<ModelStore> Create(
+      const WavegruBufferInterface& wavegru_buffer);
+
+  // Returns a store which loads the parameters from the bundle written by
+  // WriteBundle(), or nullptr if |bundle_file| is not a valid bundle.
+  static std::shared_ptr<ModelStore> CreateFromBundle(
+      const ghc::filesystem::path& bundle_file);
+
+  // Same as CreateFromBundle(), but maps |bundle_file| instead of reading it.
+  // The weights and biases of the sparse layers are then views of the mapping
+  // rather than copies, so processes using the same bundle share them through
+  // the page cache. The mapping lives until the store and every layer taken
+  // from it are destroyed.
+  static std::shared_ptr<ModelStore> CreateFromMappedBundle(
+      const ghc::filesystem::path& bundle_file);
+
+  // Returns the sparse layer stored with |prefix|, prepared for
+  // |num_threads|. The layer is loaded on the first call, later calls with the
+  // same arguments return the same object. Returns nullptr on failure.
+  template <typename WeightType, typename RhsType, typename DiskWeightType>
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  GetSparseLayer(const std::string& prefix, int num_threads) {
+    return GetGenericLayer<WeightType, RhsType, DiskWeightType>(
+        prefix, /*default_bias=*/0.0f, num_threads);
+  }
+
+  // Same as GetSparseLayer(), but with the rows split into the parts
+  // [|row_starts|[i], |row_starts|[i + 1]) instead of one balanced part per
+  // thread, see SparseLinearLayer::PrepareForRowStarts(). The part is selected
+  // by the |tid| passed to the layer.
+  template <typename WeightType, typename RhsType, typename DiskWeightType>
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  GetSparseLayerWithRowStarts(const std::string& prefix,
+                              const std::vector<int>& row_starts) {
+    return GetGenericLayer<WeightType, RhsType, DiskWeightType>(
+        prefix, /*default_bias=*/0.0f,
+        /*num_threads=*/static_cast<int>(row_starts.size()) - 1, row_starts);
+  }
+
+  // Same as GetSparseLayer(), but the bias of the rows padded up to the block
+  // size is set to the lowest float, as required by the layers feeding a
+  // softmax.
+  template <typename WeightType, typename RhsType, typename DiskWeightType>
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  GetLogitLayer(const std::string& prefix, int num_threads) {
+    return GetGenericLayer<WeightType, RhsType, DiskWeightType>(
+        prefix, std::numeric_limits<float>::lowest(), num_threads);
+  }
+
+  // Returns the object of type |T| stored under |key|, calling |load| to
+  // create it if it is not in the store yet. If |load| returns nullptr,
+  // nothing is stored and nullptr is returned. |load| may return a
+  // std::shared_ptr with a custom deleter to keep other resources alive as
+  // long as the object.
+  // Concurrent calls for different keys load in parallel, concurrent calls for
+  // the same key load only once.
+  template <typename T>
+  std::shared_ptr<const T> GetOrLoad(
+      const std::string& key, const std::function<std::shared_ptr<T>()>& load) {
+    std::shared_ptr<Entry> entry;
+    {
+      std::lock_guard<std::mutex> lock(entries_mutex_);
+      auto& slot = entries_[std::make_pair(std::type_index(typeid(T)), key)];
+      if (slot == nullptr) {
+        slot = std::make_shared<Entry>();
+      }
+      entry = slot;
+    }
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (entry->value == nullptr) {
+      std::shared_ptr<const T> value = load();
+      if (value == nullptr) {
+        return nullptr;
+      }
+      entry->value = std::move(value);
+    }
+    return std::static_pointer_cast<const T>(entry->value);
+  }
+
+  // Reads the array |file_name| from the model files.
+  template <typename T>
+  absl::Status ReadArray(const std::string& file_name, std::vector<T>* array) {
+    absl::Status status;
+    const WavegruBufferInterface* wavegru_buffer = wavegru_buffer_.load();
+    if (bundle_ != nullptr) {
+      status = ReadArrayFromBundle(*bundle_, file_name, array);
+    } else if (from_wavegru_buffer_) {
+      status = wavegru_buffer != nullptr
+                   ? csrblocksparse::ReadArrayFromBuffer(
+                         wavegru_buffer->GetBuffer(file_name),
+                         wavegru_buffer->GetBufferSize(file_name), array)
+                   : ReleasedWavegruBufferError(file_name);
+    } else {
+      status = csrblocksparse::ReadArrayFromFile(file_name, array,
+                                                 model_path_.string());
+    }
+    if (status.ok()) {
+      std::lock_guard<std::mutex> lock(bundle_writer_mutex_);
+      if (bundle_writer_ != nullptr) {
+        AddArrayToBundle(file_name, *array, bundle_writer_.get());
+      }
+    }
+    return status;
+  }
+
+  // From now on, runs the tasks given to RunConcurrently() on |num_threads|
+  // worker threads plus the calling thread. Components use it to decompress
+  // and convert their independent layers in parallel; the layers are still
+  // assigned to the same members in the same order, so the result does not
+  // depend on this setting. A |num_threads| of 0 restores sequential loading.
+  // Must not be called while parameters are being loaded.
+  void EnableParallelLoading(int num_threads);
+
+  // Runs |tasks| and returns once all have finished: concurrently if
+  // EnableParallelLoading() was called, else one after another in order.
+  // Tasks must therefore be independent, such as loads of different layers
+  // which each write only their own output. Tasks may call RunConcurrently()
+  // themselves.
+  void RunConcurrently(std::vector<std::function<void()>> tasks);
+
+  // Wall time spent loading and preparing each sparse layer, by prefix. If a
+  // layer was loaded for several thread counts, the latest load is reported.
+  std::map<std::string, absl::Duration> layer_load_times() const;
+
+  // From now on, keeps a copy of every parameter loaded for WriteBundle().
+  // |weight_type| names the build configuration the bundle is meant for.
+  void RecordBundle(const std::string& weight_type);
+
+  // Writes all parameters loaded since RecordBundle() to |bundle_file|.
+  absl::Status WriteBundle(const ghc::filesystem::path& bundle_file) const;
+
+  // Stops reading from the WavegruBufferInterface the store was created from,
+  // which may be destroyed as soon as this returns. The parameters loaded so
+  // far stay in the store, loading any other fails. Components created from a
+  // WavegruBufferInterface call this once they are created, so that the
+  // buffer is only read during their Create(). Must not be called while
+  // parameters are being loaded.
+  void ReleaseWavegruBuffer() { wavegru_buffer_.store(nullptr); }
+
+  // Empty if the store does not read from a model directory.
+  const ghc::filesystem::path& model_path() const { return model_path_; }
+
+  // The number of objects currently held by the store.
+  int size() const;
+
+ private:
+  struct Entry {
+    std::mutex mutex;
+    std::shared_ptr<const void> value;
+  };
+
+  ModelStore(const ghc::filesystem::path& model_path,
+             const WavegruBufferInterface* wavegru_buffer,
+             std::shared_ptr<const ModelBundle> bundle);
+
+  static absl::Status ReleasedWavegruBufferError(const std::string& name);
+
+  template <typename WeightType, typename RhsType, typename DiskWeightType>
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  GetGenericLayer(const std::string& prefix, float default_bias,
+                  int num_threads, const std::vector<int>& row_starts = {}) {
+    using LayerType = csrblocksparse::SparseLinearLayer<WeightType, RhsType>;
+    const std::string key = absl::StrCat(
+        prefix, "|", typeid(DiskWeightType).name(), "|", default_bias, "|",
+        num_threads, "|", absl::StrJoin(row_starts, ","));
+    return GetOrLoad<LayerType>(
+        key, [&]() -> std::shared_ptr<LayerType> {
+          const absl::Time start = absl::Now();
+          std::unique_ptr<LayerType> layer;
+          absl::Status status;
+          // Layers of a mapped bundle are views of the mapping.
+          const bool view = bundle_ != nullptr && bundle_->is_mapped();
+          if (bundle_ != nullptr) {
+            auto layer_or = ReadLayerFromBundle<WeightType, RhsType>(
+                *bundle_, prefix, view);
+            status = layer_or.status();
+            if (status.ok()) layer = std::move(layer_or.value());
+          } else if (from_wavegru_buffer_) {
+            const WavegruBufferInterface* wavegru_buffer =
+                wavegru_buffer_.load();
+            layer = absl::make_unique<LayerType>();
+            status = wavegru_buffer != nullptr
+                         ? csrblocksparse::LoadGenericLayer<
+                               WeightType, RhsType, DiskWeightType>(
+                               prefix, /*zipped=*/true, *wavegru_buffer,
+                               default_bias, layer.get())
+                         : ReleasedWavegruBufferError(prefix);
+          } else {
+            layer = absl::make_unique<LayerType>();
+            status = csrblocksparse::LoadGenericLayer<WeightType, RhsType,
+                                                      DiskWeightType>(
+                prefix, /*zipped=*/true, model_path_.string(), default_bias,
+                layer.get());
+          }
+          if (!status.ok()) {
+            std::cerr << "Could not load layer |" << prefix
+                      << "|: " << status.message() << std::endl;
+            return nullptr;
+          }
+          {
+            // Recorded before being split for threads.
+            std::lock_guard<std::mutex> lock(bundle_writer_mutex_);
+            if (bundle_writer_ != nullptr) {
+              AddLayerToBundle(prefix, *layer, bundle_writer_.get());
+            }
+          }
+          const int num_parts = row_starts.empty()
+                                    ? layer->PrepareForThreads(num_threads)
+                                    : layer->PrepareForRowStarts(row_starts);
+          if (num_parts != num_threads) {
+            std::cerr << "Could not prepare layer |" << prefix << "| for "
+                      << num_threads << " threads." << std::endl;
+            return nullptr;
+          }
+          {
+            std::lock_guard<std::mutex> lock(load_times_mutex_);
+            load_times_[prefix] = absl::Now() - start;
+          }
+          if (view) {
+            // The bundle must outlive the views, even if the store does not.
+            return std::shared_ptr<LayerType>(
+                layer.release(), [bundle = bundle_](LayerType* view_layer) {
+                  delete view_layer;
+                });
+          }
+          return layer;
+        });
+  }
+
+  const ghc::filesystem::path model_path_;
+  // Whether the store was created from a WavegruBufferInterface, which
+  // |wavegru_buffer_| points to until ReleaseWavegruBuffer().
+  const bool from_wavegru_buffer_;
+  std::atomic<const WavegruBufferInterface*> wavegru_buffer_;
+  const std::shared_ptr<const ModelBundle> bundle_;
+
+  mutable std::mutex bundle_writer_mutex_;
+  std::unique_ptr<ModelBundleWriter> bundle_writer_;
+
+  mutable std::mutex loading_pool_mutex_;
+  std::shared_ptr<ThreadPool> loading_pool_;
+
+  mutable std::mutex load_times_mutex_;
+  std::map<std::string, absl::Duration> load_times_;
+
+  mutable std::mutex entries_mutex_;
+  std::map<std::pair<std::type_index, std::string>, std::shared_ptr<Entry>>
+      entries_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MODEL_STORE_H_
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model_store.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Placeholder for get runfiles header.
+#include "absl/memory/memory.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_wavegru.h"
+#include "sparse_matmul/sparse_matmul.h"
+#include "vector_quantizer_impl.h"
+#include "wavegru_buffer/mmap_wavegru_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static constexpr char kPrefix[] = "lyra_16khz";
+
+class ModelStoreTest : public testing::Test {
+ protected:
+  ModelStoreTest()
+      : model_store_(
+            ModelStore::Create(ghc::filesystem::current_path() / "wavegru")) {}
+
+  std::shared_ptr<ModelStore> model_store_;
+};
+
+TEST_F(ModelStoreTest, SameLayerIsLoadedOnce) {
+  auto first = model_store_->GetSparseLayer<float, float, float>(
+      std::string(kPrefix) + "_gru_layer_", /*num_threads=*/1);
+  auto second = model_store_->GetSparseLayer<float, float, float>(
+      std::string(kPrefix) + "_gru_layer_", /*num_threads=*/1);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(model_store_->size(), 1);
+}
+
+TEST_F(ModelStoreTest, DifferentThreadCountsAreStoredSeparately) {
+  auto single = model_store_->GetSparseLayer<float, float, float>(
+      std::string(kPrefix) + "_gru_layer_", /*num_threads=*/1);
+  auto multi = model_store_->GetSparseLayer<float, float, float>(
+      std::string(kPrefix) + "_gru_layer_", /*num_threads=*/2);
+  ASSERT_NE(single, nullptr);
+  ASSERT_NE(multi, nullptr);
+  EXPECT_NE(single.get(), multi.get());
+  EXPECT_EQ(model_store_->size(), 2);
+}
+
+TEST_F(ModelStoreTest, MissingLayerIsNotStored) {
+  EXPECT_EQ((model_store_->GetSparseLayer<float, float, float>(
+                "non_existent_", /*num_threads=*/1)),
+            nullptr);
+  EXPECT_EQ(model_store_->size(), 0);
+}
+
+TEST_F(ModelStoreTest, QuantizersShareTables) {
+  const int num_features = kNumFramesPerPacket * kNumExpectedOutputFeatures;
+  auto first = VectorQuantizerImpl::Create(num_features, kNumQuantizationBits,
+                                           model_store_);
+  ASSERT_NE(first, nullptr);
+  const int size_after_first = model_store_->size();
+  auto second = VectorQuantizerImpl::Create(num_features, kNumQuantizationBits,
+                                            model_store_);
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(model_store_->size(), size_after_first);
+
+  const std::vector<float> features(num_features, 0.5f);
+  EXPECT_EQ(first->Quantize(features), second->Quantize(features));
+}
+
+TEST_F(ModelStoreTest, WavegrusShareLayers) {
+  auto first = LyraWavegru<float>::Create(/*num_threads=*/1, model_store_,
+                                          kPrefix);
+  ASSERT_NE(first, nullptr);
+  const int size_after_first = model_store_->size();
+  auto second = LyraWavegru<float>::Create(/*num_threads=*/1, model_store_,
+                                           kPrefix);
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(model_store_->size(), size_after_first);
+}
+
+TEST_F(ModelStoreTest, LayersOutliveStoreHandle) {
+  auto layer = model_store_->GetSparseLayer<float, float, float>(
+      std::string(kPrefix) + "_gru_layer_", /*num_threads=*/1);
+  ASSERT_NE(layer, nullptr);
+  const int rows = layer->rows();
+  model_store_.reset();
+  EXPECT_EQ(layer->rows(), rows);
+}
+
+TEST_F(ModelStoreTest, ReleasedWavegruBufferKeepsLoadedLayers) {
+  const std::string gru_prefix = std::string(kPrefix) + "_gru_layer_";
+  std::shared_ptr<ModelStore> buffer_store;
+  {
+    auto wavegru_buffer =
+        MmapWavegruBuffer::Create(ghc::filesystem::current_path() / "wavegru");
+    ASSERT_NE(wavegru_buffer, nullptr);
+    buffer_store = ModelStore::Create(*wavegru_buffer);
+    ASSERT_NE((buffer_store->GetSparseLayer<float, float, float>(
+                  gru_prefix, /*num_threads=*/1)),
+              nullptr);
+    buffer_store->ReleaseWavegruBuffer();
+  }
+
+  EXPECT_NE((buffer_store->GetSparseLayer<float, float, float>(
+                gru_prefix, /*num_threads=*/1)),
+            nullptr);
+  EXPECT_EQ((buffer_store->GetSparseLayer<float, float, float>(
+                gru_prefix, /*num_threads=*/2)),
+            nullptr);
+  std::vector<float> array;
+  EXPECT_FALSE(
+      buffer_store->ReadArray(std::string(kPrefix) + "_gru_layer_bias.raw.gz",
+                              &array)
+          .ok());
+  EXPECT_EQ(buffer_store->size(), 1);
+}
+
+TEST_F(ModelStoreTest, ParallelLoadingMatchesSequentialLoading) {
+  auto sequential = LyraWavegru<float>::Create(/*num_threads=*/1,
+                                               model_store_, kPrefix);
+  ASSERT_NE(sequential, nullptr);
+
+  auto parallel_store =
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru");
+  parallel_store->EnableParallelLoading(/*num_threads=*/4);
+  auto parallel = LyraWavegru<float>::Create(/*num_threads=*/1,
+                                             parallel_store, kPrefix);
+  ASSERT_NE(parallel, nullptr);
+  EXPECT_EQ(parallel_store->size(), model_store_->size());
+
+  const std::string gru_prefix = std::string(kPrefix) + "_gru_layer_";
+  auto sequential_layer = model_store_->GetSparseLayer<float, float, float>(
+      gru_prefix, /*num_threads=*/1);
+  auto parallel_layer = parallel_store->GetSparseLayer<float, float, float>(
+      gru_prefix, /*num_threads=*/1);
+  ASSERT_EQ(parallel_layer->rows(), sequential_layer->rows());
+  for (int i = 0; i < sequential_layer->rows(); ++i) {
+    EXPECT_EQ(parallel_layer->full_bias()[i],
+              sequential_layer->full_bias()[i]);
+  }
+}
+
+TEST_F(ModelStoreTest, ReportsLayerLoadTimes) {
+  EXPECT_TRUE(model_store_->layer_load_times().empty());
+  const std::string gru_prefix = std::string(kPrefix) + "_gru_layer_";
+  ASSERT_NE((model_store_->GetSparseLayer<float, float, float>(
+                gru_prefix, /*num_threads=*/1)),
+            nullptr);
+  const auto load_times = model_store_->layer_load_times();
+  ASSERT_EQ(load_times.size(), 1);
+  EXPECT_EQ(load_times.begin()->first, gru_prefix);
+  EXPECT_GT(load_times.begin()->second, absl::ZeroDuration());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
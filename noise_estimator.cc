@@ -65,11 +65,12 @@ void UpdateMinAndTemp(uint64_t frame_num, int num_frames_per_update,
 // (when there is noise in this frequency bin).
 // Values closer to 0 indicate smoothed_power should take on the current
 // power level at this frequency bin (when there is speech in this
-// frequency bin).
-std::vector<float> SmoothingFactor(float max_smoothing,
-                                   const std::vector<float>& curr_power_db,
-                                   const std::vector<float>& smoothed_power,
-                                   const std::vector<float>& noise_estimate) {
+// frequency bin). The factor of each band is written to |smoothing_factor|.
+void SmoothingFactor(float max_smoothing,
+                     const std::vector<float>& curr_power_db,
+                     const std::vector<float>& smoothed_power,
+                     const std::vector<float>& noise_estimate,
+                     std::vector<float>* smoothing_factor) {
   constexpr float kPowDiff = 0.3f;
   // The smoothing correction factor approaches 0 as the current power value
   // moves away from the previously calculated smoothed power, and is 1 when
@@ -77,15 +78,12 @@ std::vector<float> SmoothingFactor(float max_smoothing,
   float smoothing_correction = std::exp(-audio_dsp::Square(
       (Average(smoothed_power) - Average(curr_power_db)) / kPowDiff));
 
-  std::vector<float> smoothing_factor(noise_estimate.size());
   for (int i = 0; i < smoothed_power.size(); ++i) {
-    smoothing_factor.at(i) =
+    smoothing_factor->at(i) =
         max_smoothing * smoothing_correction *
         std::exp(-audio_dsp::Square(
             (smoothed_power.at(i) - noise_estimate.at(i)) / kPowDiff));
   }
-
-  return smoothing_factor;
 }
 
 }  // namespace
@@ -118,7 +116,8 @@ NoiseEstimator::NoiseEstimator(int num_features, int num_frames_per_update,
       tmp_min_smoothed_power_(num_features),
       noise_estimate_(num_features,
                       LogMelSpectrogramExtractorImpl::GetSilenceValue()),
-      noise_bound_(num_features, 0.f) {}
+      noise_bound_(num_features, 0.f),
+      smoothing_factor_(num_features) {}
 
 // The variance of non-smoothed noise is estimated and used to calculate the
 // upper bound of the noise bound.
@@ -147,18 +146,19 @@ bool NoiseEstimator::Update(const std::vector<float>& curr_power_db) {
     tmp_min_smoothed_power_ = curr_power_db;
   }
 
-  std::vector<float> smoothing_factor = SmoothingFactor(
-      max_smoothing_, curr_power_db, smoothed_power_, noise_estimate_);
+  SmoothingFactor(max_smoothing_, curr_power_db, smoothed_power_,
+                  noise_estimate_, &smoothing_factor_);
 
   // smoothed_power_ per frequency band = smoothing_factor * smoothed_power +
   // (1 - smoothing_factor) * curr_power_db.
   for (int i = 0; i < smoothed_power_.size(); ++i) {
     smoothed_power_.at(i) =
-        smoothing_factor.at(i) * smoothed_power_.at(i) +
-        (1.f - smoothing_factor.at(i)) * curr_power_db.at(i);
+        smoothing_factor_.at(i) * smoothed_power_.at(i) +
+        (1.f - smoothing_factor_.at(i)) * curr_power_db.at(i);
     squared_smoothed_power_.at(i) =
-        smoothing_factor.at(i) * squared_smoothed_power_.at(i) +
-        (1.f - smoothing_factor.at(i)) * audio_dsp::Square(curr_power_db.at(i));
+        smoothing_factor_.at(i) * squared_smoothed_power_.at(i) +
+        (1.f - smoothing_factor_.at(i)) *
+            audio_dsp::Square(curr_power_db.at(i));
   }
 
   UpdateMinAndTemp(num_frames_received_, num_frames_per_update_,
@@ -62,6 +62,8 @@ class NoiseEstimator : public NoiseEstimatorInterface {
   std::vector<float> tmp_min_smoothed_power_;
   std::vector<float> noise_estimate_;
   std::vector<float> noise_bound_;
+  // Scratch space for the smoothing factor of each frame.
+  std::vector<float> smoothing_factor_;
   int num_frames_received_ = 0;
 };
 
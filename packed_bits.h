@@ -0,0 +1,121 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_PACKED_BITS_H_
+#define LYRA_CODEC_PACKED_BITS_H_
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Quantized bits are packed into bytes most significant bit first, as they are
+// sent over the wire: bit |i| of a buffer is bit 7 - i % 8 of byte i / 8.
+
+// Returns the number of bytes needed to pack |num_bits| bits.
+constexpr int NumPackedBytes(int num_bits) {
+  return (num_bits + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+// Writes the |num_bits| least significant bits of |value|, most significant
+// first, to |packed_bits| starting at bit |bit_offset|. The other bits are
+// left unchanged.
+inline void WritePackedBits(uint32_t value, int num_bits, int bit_offset,
+                            absl::Span<uint8_t> packed_bits) {
+  for (int i = 0; i < num_bits; ++i) {
+    const int bit = bit_offset + i;
+    const uint8_t mask = 0x80 >> (bit % CHAR_BIT);
+    if ((value >> (num_bits - 1 - i)) & 1) {
+      packed_bits[bit / CHAR_BIT] |= mask;
+    } else {
+      packed_bits[bit / CHAR_BIT] &= ~mask;
+    }
+  }
+}
+
+// Returns the |num_bits| bits of |packed_bits| starting at bit |bit_offset|,
+// with the first of them as the most significant.
+inline uint32_t ReadPackedBits(absl::Span<const uint8_t> packed_bits,
+                               int bit_offset, int num_bits) {
+  uint32_t value = 0;
+  for (int i = 0; i < num_bits; ++i) {
+    const int bit = bit_offset + i;
+    const int shift = CHAR_BIT - 1 - bit % CHAR_BIT;
+    value = (value << 1) | ((packed_bits[bit / CHAR_BIT] >> shift) & 1);
+  }
+  return value;
+}
+
+// Copies |num_bits| bits of |source| from bit |source_offset| on to
+// |destination| from bit |destination_offset| on.
+inline void CopyPackedBits(absl::Span<const uint8_t> source, int source_offset,
+                           int num_bits, int destination_offset,
+                           absl::Span<uint8_t> destination) {
+  if (source_offset % CHAR_BIT == 0 && destination_offset % CHAR_BIT == 0) {
+    const int num_bytes = num_bits / CHAR_BIT;
+    if (num_bytes > 0) {
+      std::memcpy(destination.data() + destination_offset / CHAR_BIT,
+                  source.data() + source_offset / CHAR_BIT, num_bytes);
+    }
+    const int num_copied_bits = num_bytes * CHAR_BIT;
+    source_offset += num_copied_bits;
+    destination_offset += num_copied_bits;
+    num_bits -= num_copied_bits;
+  }
+  for (int i = 0; i < num_bits; i += CHAR_BIT) {
+    const int num_chunk_bits = std::min(CHAR_BIT, num_bits - i);
+    WritePackedBits(ReadPackedBits(source, source_offset + i, num_chunk_bits),
+                    num_chunk_bits, destination_offset + i, destination);
+  }
+}
+
+// Returns the first |num_bits| bits of |packed_bits| as a string of '0' and
+// '1' characters.
+inline std::string PackedBitsToString(absl::Span<const uint8_t> packed_bits,
+                                      int num_bits) {
+  std::string bits_string(num_bits, '0');
+  for (int i = 0; i < num_bits; ++i) {
+    if (ReadPackedBits(packed_bits, i, 1)) {
+      bits_string[i] = '1';
+    }
+  }
+  return bits_string;
+}
+
+// Packs a string of '0' and '1' characters into the first |num_bits| bits of
+// |packed_bits|. As when constructing a std::bitset<num_bits> from it, a
+// shorter string is padded with leading zeros and a longer one truncated.
+inline void StringToPackedBits(const std::string& bits_string, int num_bits,
+                               absl::Span<uint8_t> packed_bits) {
+  const int num_leading_zeros =
+      std::max(num_bits - static_cast<int>(bits_string.size()), 0);
+  for (int i = 0; i < num_bits; ++i) {
+    const bool bit =
+        i >= num_leading_zeros && bits_string[i - num_leading_zeros] == '1';
+    WritePackedBits(bit, 1, i, packed_bits);
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PACKED_BITS_H_
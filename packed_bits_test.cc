@@ -0,0 +1,93 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "packed_bits.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(PackedBitsTest, NumPackedBytes) {
+  EXPECT_EQ(NumPackedBytes(0), 0);
+  EXPECT_EQ(NumPackedBytes(1), 1);
+  EXPECT_EQ(NumPackedBytes(8), 1);
+  EXPECT_EQ(NumPackedBytes(9), 2);
+  EXPECT_EQ(NumPackedBytes(120), 15);
+}
+
+TEST(PackedBitsTest, WriteAndReadAcrossBytes) {
+  std::vector<uint8_t> packed_bits(3, 0b11111111);
+
+  WritePackedBits(0b0110010, 7, 5, absl::MakeSpan(packed_bits));
+
+  EXPECT_EQ(packed_bits, std::vector<uint8_t>(
+                             {0b11111011, 0b00101111, 0b11111111}));
+  EXPECT_EQ(ReadPackedBits(packed_bits, 5, 7), 0b0110010);
+  EXPECT_EQ(ReadPackedBits(packed_bits, 0, 5), 0b11111);
+  EXPECT_EQ(ReadPackedBits(packed_bits, 3, 0), 0);
+}
+
+TEST(PackedBitsTest, CopyUnalignedBits) {
+  const std::vector<uint8_t> source = {0b10110011, 0b10001111, 0b01010101};
+  std::vector<uint8_t> destination(3, 0);
+
+  CopyPackedBits(source, 2, 19, 3, absl::MakeSpan(destination));
+
+  EXPECT_EQ(PackedBitsToString(destination, 24),
+            "000" + PackedBitsToString(source, 21).substr(2) + "00");
+}
+
+TEST(PackedBitsTest, CopyAlignedBits) {
+  const std::vector<uint8_t> source = {0b10110011, 0b10001111, 0b01010101};
+  std::vector<uint8_t> destination(4, 0);
+
+  CopyPackedBits(source, 0, 20, 8, absl::MakeSpan(destination));
+
+  EXPECT_EQ(destination, std::vector<uint8_t>(
+                             {0, 0b10110011, 0b10001111, 0b01010000}));
+}
+
+TEST(PackedBitsTest, StringRoundTrip) {
+  const std::string bits_string = "1011001110001";
+  std::vector<uint8_t> packed_bits(2, 0);
+
+  StringToPackedBits(bits_string, bits_string.size(),
+                     absl::MakeSpan(packed_bits));
+
+  EXPECT_EQ(packed_bits, std::vector<uint8_t>({0b10110011, 0b10001000}));
+  EXPECT_EQ(PackedBitsToString(packed_bits, bits_string.size()), bits_string);
+}
+
+TEST(PackedBitsTest, StringIsAlignedAsBitset) {
+  std::vector<uint8_t> packed_bits(1, 0);
+
+  // Shorter strings are padded with leading zeros.
+  StringToPackedBits("101", 6, absl::MakeSpan(packed_bits));
+  EXPECT_EQ(PackedBitsToString(packed_bits, 6), "000101");
+
+  // Longer strings are truncated.
+  StringToPackedBits("11011011", 6, absl::MakeSpan(packed_bits));
+  EXPECT_EQ(PackedBitsToString(packed_bits, 6), "110110");
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -17,15 +17,17 @@
 #ifndef LYRA_CODEC_PACKET_H_
 #define LYRA_CODEC_PACKET_H_
 
-#include <bitset>
+#include <algorithm>
+#include <array>
 #include <climits>
-#include <cmath>
 #include <cstdint>
+#include <iostream>
 #include <string>
 #include <vector>
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "packed_bits.h"
 #include "packet_interface.h"
 
 namespace chromemedia {
@@ -38,117 +40,73 @@ class Packet : public PacketInterface {
  public:
   std::vector<uint8_t> PackQuantized(
       const std::string& quantized_string) override {
-    const std::bitset<NumQuantizedBits> quantized_features(quantized_string);
-    return Pack(quantized_features);
+    std::array<uint8_t, kNumQuantizedBytes> quantized_bits = {};
+    StringToPackedBits(quantized_string, NumQuantizedBits,
+                       absl::MakeSpan(quantized_bits));
+    std::vector<uint8_t> packet(kPacketSize);
+    PackQuantizedBits(quantized_bits, absl::MakeSpan(packet));
+    return packet;
   }
 
   absl::optional<std::string> UnpackPacket(
       const absl::Span<const uint8_t> packet) override {
-    const int expected_packet_size = static_cast<int>(std::ceil(
-        static_cast<float>(NumQuantizedBits + NumHeaderBits) / CHAR_BIT));
-    if (packet.length() != expected_packet_size) {
-      std::cerr << "Packet of unexpected length: " << packet.length() << std::endl;
+    std::array<uint8_t, kNumQuantizedBytes> quantized_bits;
+    if (!UnpackQuantizedBits(packet, absl::MakeSpan(quantized_bits))) {
       return absl::nullopt;
     }
-    std::bitset<NumQuantizedBits> quantized_features = UnpackFeatures(packet);
-    return quantized_features.to_string();
+    return PackedBitsToString(quantized_bits, NumQuantizedBits);
   }
 
-  int PacketSize() const override {
-    return static_cast<int>(std::ceil(
-        static_cast<float>(NumQuantizedBits + NumHeaderBits) / CHAR_BIT));
-  }
-
- private:
-  // Creates a vector of bytes containing a header of variable bits with the
-  // quantized data following directly after. For example:
+  // Creates a packet containing a header of variable bits with the quantized
+  // data following directly after. For example:
   //  +--------+--------+---------+
   //  |  ||    |        |  ||     |
   //  +--------+--------+---------+
   //   ^           ^           ^
   //   |           |           |
   // Header   Quantized     Extra Space
-  static std::vector<uint8_t> Pack(
-      const std::bitset<NumQuantizedBits>& quantized_features) {
-    const int kTotalNumPacketBits = NumQuantizedBits + NumHeaderBits;
-    const std::bitset<kTotalNumPacketBits> kByteMask(0b11111111);
-    int right_shift_amount = static_cast<int>(kTotalNumPacketBits) - CHAR_BIT;
-
-    std::bitset<kTotalNumPacketBits> packet_bits =
-        GeneratePacketBits(quantized_features);
-    std::vector<uint8_t> byte_array(
-        static_cast<int>(std::ceil(static_cast<float>(kTotalNumPacketBits) /
-                                   static_cast<float>(CHAR_BIT))));
-
-    // Shift the quantized bits into their proper byte in byte_array. The
-    // leftmost bits of quantized will occupy byte_array.at(NumHeaderBits) after
-    // the header.
-    for (auto& packet_byte : byte_array) {
-      std::bitset<kTotalNumPacketBits> shifted_bits;
-      if (right_shift_amount >= 0) {
-        shifted_bits = packet_bits >> right_shift_amount;
-      } else {
-        // When the quantized bits do not take up the entire last byte, shift
-        // the bits so they take up the upper part of the last byte.
-        shifted_bits = packet_bits << -right_shift_amount;
-      }
-      // Mask off bits at index 8 or greater to avoid errors when casting.
-      shifted_bits &= kByteMask;
-      packet_byte = static_cast<uint8_t>(shifted_bits.to_ulong());
-      right_shift_amount -= CHAR_BIT;
+  bool PackQuantizedBits(absl::Span<const uint8_t> quantized_bits,
+                         absl::Span<uint8_t> packet) override {
+    if (quantized_bits.size() < kNumQuantizedBytes) {
+      std::cerr << "Too few quantized bytes: " << quantized_bits.size()
+                << std::endl;
+      return false;
     }
-
-    return byte_array;
+    if (packet.size() != kPacketSize) {
+      std::cerr << "Packet of unexpected length: " << packet.size()
+                << std::endl;
+      return false;
+    }
+    // The header has no fields yet, so all its bits are zero, as are those of
+    // the extra space.
+    std::fill(packet.begin(), packet.end(), 0);
+    CopyPackedBits(quantized_bits, 0, NumQuantizedBits, NumHeaderBits, packet);
+    return true;
   }
 
-  // Unpacks the bytes from a packet into a bitset representing the indices of
-  // the transformed features.
-  static std::bitset<NumQuantizedBits> UnpackFeatures(
-      const absl::Span<const uint8_t> encoded) {
-    std::bitset<NumQuantizedBits> quantized_features(0);
-    int left_shift_amount = static_cast<int>(NumQuantizedBits) +
-                            static_cast<int>(NumHeaderBits) - CHAR_BIT;
-    // Shift each byte from packet into its proper place in quantized_features
-    // where the first bit of quantized data occurs after the header bits.
-    for (uint8_t packet_byte : encoded) {
-      std::bitset<NumQuantizedBits> shifted_packet_data(packet_byte);
-      if (left_shift_amount >= 0) {
-        shifted_packet_data <<= left_shift_amount;
-      } else {
-        // When the quantized bits do not take up the entire last byte, shift
-        // the bits so they take up the upper part of the last byte.
-        shifted_packet_data >>= -left_shift_amount;
-      }
-      quantized_features |= shifted_packet_data;
-      left_shift_amount -= CHAR_BIT;
+  bool UnpackQuantizedBits(absl::Span<const uint8_t> packet,
+                           absl::Span<uint8_t> quantized_bits) override {
+    if (packet.size() != kPacketSize) {
+      std::cerr << "Packet of unexpected length: " << packet.size()
+                << std::endl;
+      return false;
     }
-
-    return quantized_features;
+    if (quantized_bits.size() < kNumQuantizedBytes) {
+      std::cerr << "Too few quantized bytes: " << quantized_bits.size()
+                << std::endl;
+      return false;
+    }
+    std::fill(quantized_bits.begin(), quantized_bits.end(), 0);
+    CopyPackedBits(packet, NumHeaderBits, NumQuantizedBits, 0, quantized_bits);
+    return true;
   }
 
-  // Combine header and quantized features into a bitset.
-  static std::bitset<NumHeaderBits + NumQuantizedBits> GeneratePacketBits(
-      const std::bitset<NumQuantizedBits>& quantized_features) {
-    std::bitset<NumHeaderBits + NumQuantizedBits> packet_bits = SetHeader();
+  int PacketSize() const override { return kPacketSize; }
 
-    std::bitset<NumQuantizedBits + NumHeaderBits> quantized_bitset(
-        quantized_features.to_string());
-    packet_bits |= quantized_bitset;
-
-    return packet_bits;
-  }
-
-  // Includes space for NumQuantBits so can be or'ed at end.
-  static std::bitset<NumHeaderBits + NumQuantizedBits> SetHeader() {
-    std::bitset<NumHeaderBits + NumQuantizedBits> header;
-    // Must update if adding new header sections.
-    int unused_bits = NumHeaderBits;
-    // For each entry in the header, subtract the number of bits from the
-    // unused_bits, get the bits, or it with header and the shift by the number
-    // of bits of the next entry.
-    header <<= (unused_bits + NumQuantizedBits);
-    return header;
-  }
+ private:
+  static constexpr int kNumQuantizedBytes = NumPackedBytes(NumQuantizedBits);
+  static constexpr int kPacketSize =
+      NumPackedBytes(NumQuantizedBits + NumHeaderBits);
 };
 
 }  // namespace codec
@@ -0,0 +1,69 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "packet_framing.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+bool AppendFramedPacket(absl::Span<const uint8_t> packet,
+                        std::vector<uint8_t>* packet_stream) {
+  if (packet.size() > kMaxFramedPacketSize) {
+    std::cerr << "Packet of " << packet.size()
+              << " bytes is too large to be framed, the maximum is "
+              << kMaxFramedPacketSize << "." << std::endl;
+    return false;
+  }
+  packet_stream->push_back(static_cast<uint8_t>(packet.size()));
+  packet_stream->insert(packet_stream->end(), packet.begin(), packet.end());
+  return true;
+}
+
+absl::optional<std::vector<absl::Span<const uint8_t>>> SplitFramedPackets(
+    absl::Span<const uint8_t> packet_stream) {
+  std::vector<absl::Span<const uint8_t>> packets;
+  int index = 0;
+  while (index < packet_stream.size()) {
+    const int packet_size = packet_stream[index];
+    ++index;
+    if (index + packet_size > packet_stream.size()) {
+      std::cerr << "Packet of " << packet_size << " bytes starting at byte "
+                << index << " is truncated." << std::endl;
+      return absl::nullopt;
+    }
+    packets.push_back(packet_stream.subspan(index, packet_size));
+    index += packet_size;
+  }
+  return packets;
+}
+
+std::vector<absl::Span<const uint8_t>> SplitFixedSizePackets(
+    absl::Span<const uint8_t> packet_stream, int packet_size) {
+  std::vector<absl::Span<const uint8_t>> packets;
+  for (int index = 0; index + packet_size <= packet_stream.size();
+       index += packet_size) {
+    packets.push_back(packet_stream.subspan(index, packet_size));
+  }
+  return packets;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
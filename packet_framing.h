@@ -0,0 +1,52 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_PACKET_FRAMING_H_
+#define LYRA_CODEC_PACKET_FRAMING_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Packets in a length-prefixed stream are preceded by a byte holding their
+// size, so that the empty packets an encoder with DTX enabled sends during
+// noise can be stored along with the full ones.
+constexpr int kMaxFramedPacketSize = UINT8_MAX;
+
+// Appends |packet| preceded by its size to |packet_stream|. Returns false if
+// the packet is larger than |kMaxFramedPacketSize|.
+bool AppendFramedPacket(absl::Span<const uint8_t> packet,
+                        std::vector<uint8_t>* packet_stream);
+
+// Splits a length-prefixed stream into its packets, which point into
+// |packet_stream|. Returns a nullopt if the last packet is truncated.
+absl::optional<std::vector<absl::Span<const uint8_t>>> SplitFramedPackets(
+    absl::Span<const uint8_t> packet_stream);
+
+// Splits a stream of packets of |packet_size| bytes into its packets, which
+// point into |packet_stream|. Excess bytes at the end are ignored.
+std::vector<absl::Span<const uint8_t>> SplitFixedSizePackets(
+    absl::Span<const uint8_t> packet_stream, int packet_size);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PACKET_FRAMING_H_
@@ -0,0 +1,80 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "packet_framing.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(PacketFramingTest, SplitsAppendedPackets) {
+  const std::vector<std::vector<uint8_t>> packets = {
+      {1, 2, 3}, {}, {4, 5, 6}, {}, {}, {7}};
+  std::vector<uint8_t> packet_stream;
+  for (const auto& packet : packets) {
+    ASSERT_TRUE(AppendFramedPacket(packet, &packet_stream));
+  }
+  EXPECT_EQ(packet_stream.size(), 7 + packets.size());
+
+  const auto split_or = SplitFramedPackets(packet_stream);
+  ASSERT_TRUE(split_or.has_value());
+  ASSERT_EQ(split_or->size(), packets.size());
+  for (int i = 0; i < packets.size(); ++i) {
+    EXPECT_EQ(std::vector<uint8_t>(split_or->at(i).begin(),
+                                   split_or->at(i).end()),
+              packets[i]);
+  }
+}
+
+TEST(PacketFramingTest, TooLargePacketFails) {
+  std::vector<uint8_t> packet_stream;
+  EXPECT_FALSE(AppendFramedPacket(
+      std::vector<uint8_t>(kMaxFramedPacketSize + 1), &packet_stream));
+  EXPECT_TRUE(packet_stream.empty());
+  EXPECT_TRUE(AppendFramedPacket(std::vector<uint8_t>(kMaxFramedPacketSize),
+                                 &packet_stream));
+}
+
+TEST(PacketFramingTest, TruncatedPacketFails) {
+  std::vector<uint8_t> packet_stream;
+  ASSERT_TRUE(AppendFramedPacket(std::vector<uint8_t>(15), &packet_stream));
+  ASSERT_TRUE(AppendFramedPacket(std::vector<uint8_t>(15), &packet_stream));
+  packet_stream.pop_back();
+  EXPECT_FALSE(SplitFramedPackets(packet_stream).has_value());
+}
+
+TEST(PacketFramingTest, EmptyStreamHasNoPackets) {
+  const auto split_or = SplitFramedPackets({});
+  ASSERT_TRUE(split_or.has_value());
+  EXPECT_TRUE(split_or->empty());
+}
+
+TEST(PacketFramingTest, SplitFixedSizePacketsIgnoresExcessBytes) {
+  const std::vector<uint8_t> packet_stream = {1, 2, 3, 4, 5, 6, 7};
+  const auto packets = SplitFixedSizePackets(packet_stream, 3);
+  ASSERT_EQ(packets.size(), 2);
+  EXPECT_EQ(packets[0].data(), packet_stream.data());
+  EXPECT_EQ(packets[1].data(), packet_stream.data() + 3);
+  EXPECT_EQ(packets[1].size(), 3);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -41,6 +41,18 @@ class PacketInterface {
   virtual absl::optional<std::string> UnpackPacket(
       const absl::Span<const uint8_t> packet) = 0;
 
+  // Packs quantized bits, packed as described in packed_bits.h, into |packet|,
+  // which must have PacketSize() bytes. Returns false if |quantized_bits| is
+  // too short or |packet| of the wrong size.
+  virtual bool PackQuantizedBits(absl::Span<const uint8_t> quantized_bits,
+                                 absl::Span<uint8_t> packet) = 0;
+
+  // Unpacks the quantized bits of |packet|, packed as described in
+  // packed_bits.h, into |quantized_bits|. Returns false if |packet| is of the
+  // wrong size or |quantized_bits| too short.
+  virtual bool UnpackQuantizedBits(absl::Span<const uint8_t> packet,
+                                   absl::Span<uint8_t> quantized_bits) = 0;
+
   virtual int PacketSize() const = 0;
 };
 
@@ -243,6 +243,44 @@ TEST_F(PacketTest, PackBigHeader) {
       encoded, quantized.to_string(), kNumHeaderBitsTest, kNumQuantizedBits));
 }
 
+TEST_F(PacketTest, PackAndUnpackQuantizedBitsMatchStrings) {
+  constexpr int kNumHeaderBitsTest = 3;
+  constexpr int kNumQuantizedBitsTest = 21;
+  const std::bitset<kNumQuantizedBitsTest> quantized(0b101100111000111100001);
+  // The quantized bits packed most significant bit first.
+  const std::vector<uint8_t> quantized_bits = {0b10110011, 0b10001111,
+                                               0b00001000};
+
+  Packet<kNumQuantizedBitsTest, kNumHeaderBitsTest> packet;
+  std::vector<uint8_t> encoded(packet.PacketSize());
+  ASSERT_TRUE(packet.PackQuantizedBits(quantized_bits,
+                                       absl::MakeSpan(encoded)));
+  EXPECT_EQ(encoded, packet.PackQuantized(quantized.to_string()));
+
+  std::vector<uint8_t> unpacked_bits(quantized_bits.size(), 0b11111111);
+  ASSERT_TRUE(packet.UnpackQuantizedBits(encoded,
+                                         absl::MakeSpan(unpacked_bits)));
+  EXPECT_EQ(unpacked_bits, quantized_bits);
+}
+
+TEST_F(PacketTest, QuantizedBitsOfInvalidSize) {
+  Packet<kNumQuantizedBits, kNumHeaderBits> packet;
+  const std::vector<uint8_t> quantized_bits(kNumQuantizedBits / CHAR_BIT);
+  std::vector<uint8_t> encoded(kPacketSize);
+
+  EXPECT_FALSE(packet.PackQuantizedBits(
+      absl::MakeConstSpan(quantized_bits).subspan(1),
+      absl::MakeSpan(encoded)));
+  EXPECT_FALSE(packet.PackQuantizedBits(
+      quantized_bits, absl::MakeSpan(encoded).subspan(1)));
+
+  std::vector<uint8_t> unpacked_bits(kNumQuantizedBits / CHAR_BIT);
+  EXPECT_FALSE(packet.UnpackQuantizedBits(
+      absl::MakeConstSpan(encoded).subspan(1), absl::MakeSpan(unpacked_bits)));
+  EXPECT_FALSE(packet.UnpackQuantizedBits(
+      encoded, absl::MakeSpan(unpacked_bits).subspan(1)));
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
@@ -17,20 +17,28 @@
 #ifndef LYRA_CODEC_PROJECT_AND_SAMPLE_H_
 #define LYRA_CODEC_PROJECT_AND_SAMPLE_H_
 
+#if defined __AVX2__
+#include <immintrin.h>
+#endif
+
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <random>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "batched_uniform_random.h"
 #include "lyra_types.h"
+#include "model_store.h"
 #include "sparse_matmul/sparse_matmul.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
 
@@ -49,9 +57,11 @@ namespace codec {
 // softmax.
 // These layers don't parallelize well as the inter-thread communication
 // typically exceeds the saving resulting from computing with more parallelism.
-// As the projection gets faster with more threads, so the mixture_of_logistics
-// and softmax typically get slower. Some hand-crafted optimization is necessary
-// here, and this factored class is the place it is going to be.
+// So each layer is split by rows across all the threads, which then meet at a
+// single barrier per layer: after the projection, and after the
+// mixture_of_logistics, whose threads also reduce the maximum of each softmax
+// over their rows. The softmax and sampling that follow are too small to be
+// worth another barrier.
 template <typename Types>
 class ProjectAndSample {
  public:
@@ -86,69 +96,130 @@ class ProjectAndSample {
                bool zipped) {
     // compiler gets confused by putting this inside CHECK, thinks it is
     // multiple arguments to CHECK itself.
+    auto proj_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType>>();
     auto LoadLayer =
         csrblocksparse::LoadSparseLayer<ProjWeightType, ProjRhsType,
                                         DiskWeightType>;
-    if (!LoadLayer(prefix + "proj_", zipped, &proj_layer_, path).ok()) {
+    if (!LoadLayer(prefix + "proj_", zipped, proj_layer.get(), path).ok()) {
       exit(EXIT_FAILURE);
     }
+    auto mix_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType>>();
     auto LoadMixLayer =
         csrblocksparse::LoadLogitLayer<MixWeightType, ProjMatMulOutType,
                                        DiskWeightType>;
-    if (!LoadMixLayer(prefix + "mix_", zipped, path, &mix_layer_).ok()) {
+    if (!LoadMixLayer(prefix + "mix_", zipped, path, mix_layer.get()).ok()) {
       exit(EXIT_FAILURE);
     }
 
+    auto mean_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<MeanWeightType, ProjMatMulOutType>>();
     auto LoadMeanLayer =
         csrblocksparse::LoadLogitLayer<MeanWeightType, ProjMatMulOutType,
                                        DiskWeightType>;
-    if (!LoadMeanLayer(prefix + "means_", zipped, path, &mean_layer_).ok()) {
+    if (!LoadMeanLayer(prefix + "means_", zipped, path, mean_layer.get())
+             .ok()) {
       exit(EXIT_FAILURE);
     }
 
+    auto scale_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<ScaleWeightType,
+                                          ProjMatMulOutType>>();
     auto LoadScaleLayer =
         csrblocksparse::LoadLogitLayer<ScaleWeightType, ProjMatMulOutType,
                                        DiskWeightType>;
-    if (!LoadScaleLayer(prefix + "scales_", zipped, path, &scale_layer_).ok()) {
+    if (!LoadScaleLayer(prefix + "scales_", zipped, path, scale_layer.get())
+             .ok()) {
       exit(EXIT_FAILURE);
     }
+    SetLoadedLayers(std::move(proj_layer), std::move(mix_layer),
+                    std::move(mean_layer), std::move(scale_layer));
   }
 
   void LoadRaw(const WavegruBufferInterface& wavegru_buffer,
                const std::string& prefix, bool zipped) {
     // compiler gets confused by putting this inside CHECK, thinks it is
     // multiple arguments to CHECK itself.
+    auto proj_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType>>();
     auto LoadLayer =
         csrblocksparse::LoadSparseLayerFromBuffer<ProjWeightType, ProjRhsType,
                                         DiskWeightType>;
-    if (!LoadLayer(prefix + "proj_", zipped, &proj_layer_, wavegru_buffer)
+    if (!LoadLayer(prefix + "proj_", zipped, proj_layer.get(), wavegru_buffer)
              .ok()) {
       exit(EXIT_FAILURE);
     }
+    auto mix_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType>>();
     auto LoadMixLayer =
         csrblocksparse::LoadLogitLayerFromBuffer<MixWeightType, ProjMatMulOutType,
                                        DiskWeightType>;
-    if (!LoadMixLayer(prefix + "mix_", zipped, wavegru_buffer, &mix_layer_)
+    if (!LoadMixLayer(prefix + "mix_", zipped, wavegru_buffer, mix_layer.get())
              .ok()) {
       exit(EXIT_FAILURE);
     }
 
+    auto mean_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<MeanWeightType, ProjMatMulOutType>>();
     auto LoadMeanLayer =
         csrblocksparse::LoadLogitLayerFromBuffer<MeanWeightType, ProjMatMulOutType,
                                        DiskWeightType>;
-    if (!LoadMeanLayer(prefix + "means_", zipped, wavegru_buffer, &mean_layer_)
+    if (!LoadMeanLayer(prefix + "means_", zipped, wavegru_buffer,
+                       mean_layer.get())
              .ok()) {
       exit(EXIT_FAILURE);
     }
 
+    auto scale_layer = std::make_shared<
+        csrblocksparse::SparseLinearLayer<ScaleWeightType,
+                                          ProjMatMulOutType>>();
     auto LoadScaleLayer =
         csrblocksparse::LoadLogitLayerFromBuffer<ScaleWeightType, ProjMatMulOutType,
                                        DiskWeightType>;
     if (!LoadScaleLayer(prefix + "scales_", zipped, wavegru_buffer,
-                        &scale_layer_)
+                        scale_layer.get())
              .ok()) {
       exit(EXIT_FAILURE);
     }
+    SetLoadedLayers(std::move(proj_layer), std::move(mix_layer),
+                    std::move(mean_layer), std::move(scale_layer));
+  }
+
+  // Shares the weights and biases with all other users of |model_store|.
+  void LoadRaw(std::shared_ptr<ModelStore> model_store,
+               const std::string& prefix) {
+    model_store_ = std::move(model_store);
+    proj_prefix_ = prefix + "proj_";
+    mix_prefix_ = prefix + "mix_";
+    mean_prefix_ = prefix + "means_";
+    scale_prefix_ = prefix + "scales_";
+    model_store_->RunConcurrently({
+        [&]() {
+          proj_layer_ = model_store_->GetSparseLayer<
+              ProjWeightType, ProjRhsType, DiskWeightType>(proj_prefix_,
+                                                           /*num_threads=*/1);
+        },
+        [&]() {
+          mix_layer_ = model_store_->GetLogitLayer<
+              MixWeightType, ProjMatMulOutType, DiskWeightType>(
+              mix_prefix_, /*num_threads=*/1);
+        },
+        [&]() {
+          mean_layer_ = model_store_->GetLogitLayer<
+              MeanWeightType, ProjMatMulOutType, DiskWeightType>(
+              mean_prefix_, /*num_threads=*/1);
+        },
+        [&]() {
+          scale_layer_ = model_store_->GetLogitLayer<
+              ScaleWeightType, ProjMatMulOutType, DiskWeightType>(
+              scale_prefix_, /*num_threads=*/1);
+        },
+    });
+    if (proj_layer_ == nullptr || mix_layer_ == nullptr ||
+        mean_layer_ == nullptr || scale_layer_ == nullptr) {
+      exit(EXIT_FAILURE);
+    }
   }
 
   ~ProjectAndSample() {}
@@ -162,13 +233,41 @@ class ProjectAndSample {
     } else {
       barrier_ = nullptr;
     }
-    if (num_threads != proj_layer_.PrepareForThreads(num_threads)) {
-      exit(EXIT_FAILURE);
+    if (model_store_ != nullptr) {
+      // Use the copies prepared for |num_threads| shared through the store.
+      if (proj_layer_->num_threads() != num_threads) {
+        proj_layer_ = model_store_->GetSparseLayer<ProjWeightType, ProjRhsType,
+                                                   DiskWeightType>(
+            proj_prefix_, num_threads);
+      }
+      if (mix_layer_->num_threads() != num_threads) {
+        mix_layer_ = model_store_->GetLogitLayer<
+            MixWeightType, ProjMatMulOutType, DiskWeightType>(mix_prefix_,
+                                                              num_threads);
+      }
+      if (mean_layer_->num_threads() != num_threads) {
+        mean_layer_ = model_store_->GetLogitLayer<
+            MeanWeightType, ProjMatMulOutType, DiskWeightType>(mean_prefix_,
+                                                               num_threads);
+      }
+      if (scale_layer_->num_threads() != num_threads) {
+        scale_layer_ = model_store_->GetLogitLayer<
+            ScaleWeightType, ProjMatMulOutType, DiskWeightType>(scale_prefix_,
+                                                                num_threads);
+      }
+      if (proj_layer_ == nullptr || mix_layer_ == nullptr ||
+          mean_layer_ == nullptr || scale_layer_ == nullptr) {
+        exit(EXIT_FAILURE);
+      }
     }
-
-    if (mix_layer_.PrepareForThreads(1) != 1 ||
-        mean_layer_.PrepareForThreads(1) != 1 ||
-        scale_layer_.PrepareForThreads(1) != 1) {
+    if (num_threads != csrblocksparse::PrepareSharedLayerForThreads(
+                           num_threads, &proj_layer_) ||
+        num_threads != csrblocksparse::PrepareSharedLayerForThreads(
+                           num_threads, &mix_layer_) ||
+        num_threads != csrblocksparse::PrepareSharedLayerForThreads(
+                           num_threads, &mean_layer_) ||
+        num_threads != csrblocksparse::PrepareSharedLayerForThreads(
+                           num_threads, &scale_layer_)) {
       exit(EXIT_FAILURE);
     }
     return this->num_threads_;
@@ -177,22 +276,30 @@ class ProjectAndSample {
   // Runs the proj layer on the proj_h input, and whichever sampling is
   // required. Returns the value of the sample, or places samples in
   // output_samples for MoL with depth > 1.
+  // Only |tid| 0 writes |output_samples|, unless |samples_on_all_threads|, in
+  // which case every thread writes the same samples to its own
+  // |output_samples|. This repeats the last and cheapest stage of sampling on
+  // each thread, but saves callers which need the samples on all threads a
+  // barrier. The |thread_local_gen| of the threads which sample must then
+  // produce the same sequence.
   void GetSamples(const csrblocksparse::MutableVectorView<ProjRhsType>& proj_h,
                   int tid, std::minstd_rand* thread_local_gen,
                   csrblocksparse::CacheAlignedVector<ScratchType>* sample_tmp,
-                  int num_samples, int* output_samples) {
+                  int num_samples, int* output_samples,
+                  bool samples_on_all_threads = false) {
     absl::Time t_start;
     if (time_components_) t_start = absl::Now();
     auto output = proj_out_.slice(0);
-    proj_layer_.MatVec(proj_h, /*relu=*/true, tid, num_proj_replicas_,
-                       proj_layer_.rows(), &output);
+    proj_layer_->MatVec(proj_h, /*relu=*/true, tid, num_proj_replicas_,
+                        proj_layer_->rows(), &output);
     if (barrier_ != nullptr) barrier_->barrier();
     if (time_components_ && tid == 0) {
       absl::Time t_now = absl::Now();
       proj_duration_ += t_now - t_start;
       t_start = t_now;
     }
-    MolSamples(tid, thread_local_gen, num_samples, output_samples);
+    MolSamples(tid, thread_local_gen, num_samples, output_samples,
+               samples_on_all_threads);
   }
 
   // The next multiple of 8 of the output size of the mix layer. This
@@ -203,8 +310,146 @@ class ProjectAndSample {
   }
 
   std::size_t ModelSize() const {
-    return proj_layer_.bytes() + mix_layer_.bytes() + mean_layer_.bytes() +
-           scale_layer_.bytes();
+    return proj_layer_->bytes() + mix_layer_->bytes() + mean_layer_->bytes() +
+           scale_layer_->bytes();
+  }
+
+  // Counters of the waits of the threads at the barriers of GetSamples().
+  csrblocksparse::WaitStats barrier_wait_stats() const {
+    return barrier_ != nullptr ? barrier_->wait_stats()
+                               : csrblocksparse::WaitStats();
+  }
+
+  // The sampling helpers below are static so that BatchedWavegru samples each
+  // of its streams in the same way.
+
+  // Samples an index in [|begin|, |end|) from the softmax of |logits| at
+  // |temperature|, with |uniform| in [0, 1), in the same way as
+  // CacheAlignedVector::ScalarSample(). |max_value| is the maximum of the
+  // logits and |exps| is scratch space for as many floats as |logits|.
+  static int SampleMixture(const float* logits, int begin, int end,
+                           float max_value, float temperature, float uniform,
+                           float* exps) {
+    const float inv_temperature = 1.f / temperature;
+#if defined __AVX2__
+    if ((end - begin) % 8 == 0) {
+      const __m256 max_values = _mm256_set1_ps(max_value);
+      const __m256 inv_temperatures = _mm256_set1_ps(inv_temperature);
+      __m256 sums = _mm256_setzero_ps();
+      for (int i = begin; i < end; i += 8) {
+        const __m256 values = csrblocksparse::fast_exp(_mm256_mul_ps(
+            _mm256_sub_ps(_mm256_loadu_ps(logits + i), max_values),
+            inv_temperatures));
+        _mm256_storeu_ps(exps + i, values);
+        sums = _mm256_add_ps(sums, values);
+      }
+      sums = _mm256_add_ps(sums, _mm256_permute2f128_ps(sums, sums, 0x01));
+      sums = _mm256_add_ps(sums, _mm256_permute_ps(sums, 0x4E));
+      sums = _mm256_add_ps(sums, _mm256_permute_ps(sums, 0xB1));
+      // Rather than normalize the probabilities, scale the random number.
+      const __m256 targets = _mm256_mul_ps(sums, _mm256_set1_ps(uniform));
+      // Inclusive prefix sums of 8 exponents at a time, carrying the total of
+      // the previous ones in every lane of |carry|.
+      __m256 carry = _mm256_setzero_ps();
+      for (int i = begin; i < end; i += 8) {
+        __m256 cumsums = _mm256_loadu_ps(exps + i);
+        cumsums = _mm256_add_ps(
+            cumsums, _mm256_castsi256_ps(_mm256_slli_si256(
+                         _mm256_castps_si256(cumsums), 4)));
+        cumsums = _mm256_add_ps(
+            cumsums, _mm256_castsi256_ps(_mm256_slli_si256(
+                         _mm256_castps_si256(cumsums), 8)));
+        // Add the total of the lower half to the upper half.
+        const __m256 lower_totals = _mm256_permute_ps(cumsums, 0xFF);
+        cumsums = _mm256_add_ps(
+            cumsums, _mm256_permute2f128_ps(lower_totals, lower_totals, 0x08));
+        cumsums = _mm256_add_ps(cumsums, carry);
+        const int mask = _mm256_movemask_ps(
+            _mm256_cmp_ps(cumsums, targets, _CMP_GE_OQ));
+        if (mask != 0) return i + __builtin_ctz(mask);
+        const __m256 totals = _mm256_permute_ps(cumsums, 0xFF);
+        carry = _mm256_permute2f128_ps(totals, totals, 0x11);
+      }
+      return end - 1;
+    }
+#endif  // __AVX2__
+    float sum = 0.f;
+    for (int i = begin; i < end; ++i) {
+      exps[i] = csrblocksparse::fast_exp((logits[i] - max_value) *
+                                         inv_temperature);
+      sum += exps[i];
+    }
+    const float target = uniform * sum;
+    float cumsum = 0.f;
+    for (int i = begin; i < end; ++i) {
+      cumsum += exps[i];
+      if (cumsum >= target) return i;
+    }
+    return end - 1;
+  }
+
+  // Writes to |output_samples| samples of the truncated logistic distributions
+  // of |mixture_indices| in |means| and |scales|, with |uniforms| in [0, 1)
+  // mapped to probabilities at least |probability_offset| from 0 and 1.
+  static void SampleLogistics(int num_samples, const float* uniforms,
+                              const int* mixture_indices,
+                              const MeanMatMulOutType* means,
+                              const ScaleMatMulOutType* scales,
+                              float probability_offset, int* output_samples) {
+    const float kProbabilityScale = 1.0f - 2.0f * probability_offset;
+    int s = 0;
+#if defined __AVX2__
+    // The samples of all the bands fit in a register at once.
+    for (; s < num_samples; s += 8) {
+      const int num_lanes = std::min(8, num_samples - s);
+      alignas(32) float lane_means[8] = {0.f};
+      alignas(32) float lane_scales[8] = {0.f};
+      alignas(32) float probs[8] = {.5f, .5f, .5f, .5f, .5f, .5f, .5f, .5f};
+      for (int lane = 0; lane < num_lanes; ++lane) {
+        const int index = mixture_indices[s + lane];
+        lane_means[lane] = static_cast<float>(means[index]);
+        lane_scales[lane] = static_cast<float>(scales[index]);
+        probs[lane] =
+            uniforms[s + lane] * kProbabilityScale + probability_offset;
+      }
+      const __m256 one = _mm256_set1_ps(1.0f);
+      // Softplus the scale.
+      __m256 scale = csrblocksparse::accurate_log(_mm256_add_ps(
+          csrblocksparse::accurate_exp(_mm256_load_ps(lane_scales)), one));
+      const __m256 prob = _mm256_load_ps(probs);
+      const __m256 logit = csrblocksparse::accurate_log(
+          _mm256_div_ps(_mm256_sub_ps(one, prob), prob));
+      __m256 result = _mm256_mul_ps(
+          _mm256_add_ps(_mm256_load_ps(lane_means),
+                        _mm256_mul_ps(scale, logit)),
+          _mm256_set1_ps(256.f));
+      // Clamps before the conversion, which is undefined out of range.
+      result = _mm256_min_ps(
+          _mm256_max_ps(result, _mm256_set1_ps(
+                                    std::numeric_limits<int16_t>::min())),
+          _mm256_set1_ps(std::numeric_limits<int16_t>::max()));
+      alignas(32) int results[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(results),
+                         _mm256_cvttps_epi32(result));
+      std::copy(results, results + num_lanes, output_samples + s);
+    }
+#endif  // __AVX2__
+    for (; s < num_samples; s++) {
+      int index = mixture_indices[s];
+      float mean = static_cast<float>(means[index]);
+      float scale = static_cast<float>(scales[index]);
+      // Softplus the scale.
+      scale = logf(expf(scale) + 1.0f);
+
+      // Truncated logistic distribution.
+      float prob = uniforms[s] * kProbabilityScale + probability_offset;
+      float f_result = mean + scale * log((1.0f - prob) / prob);
+      int result = std::min(
+          static_cast<int>(std::numeric_limits<int16_t>::max()),
+          std::max(static_cast<int>(std::numeric_limits<int16_t>::min()),
+                   static_cast<int>(f_result * 256)));
+      output_samples[s] = result;
+    }
   }
 
   std::string ReportTiming() const {
@@ -217,6 +462,27 @@ class ProjectAndSample {
   }
 
  private:
+  // Takes ownership of freshly loaded layers.
+  void SetLoadedLayers(
+      std::shared_ptr<
+          csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType>>
+          proj_layer,
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<MixWeightType,
+                                                        ProjMatMulOutType>>
+          mix_layer,
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<MeanWeightType,
+                                                        ProjMatMulOutType>>
+          mean_layer,
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<ScaleWeightType,
+                                                        ProjMatMulOutType>>
+          scale_layer) {
+    model_store_ = nullptr;
+    proj_layer_ = std::move(proj_layer);
+    mix_layer_ = std::move(mix_layer);
+    mean_layer_ = std::move(mean_layer);
+    scale_layer_ = std::move(scale_layer);
+  }
+
   void InitLoadedLayers(int num_threads) {
     const int size = proj_size();
     int output_bins = expanded_mixes_size();
@@ -237,82 +503,109 @@ class ProjectAndSample {
     // vector with a value that will not disturb the softmax calculation.
     mixes_.FillWith(
         static_cast<MixMatMulOutType>(std::numeric_limits<float>::lowest()));
-    if (size != mix_layer_.cols() || size != mean_layer_.cols() ||
-        size != scale_layer_.cols()) {
+    if (size != mix_layer_->cols() || size != mean_layer_->cols() ||
+        size != scale_layer_->cols()) {
       exit(EXIT_FAILURE);
     }
     means_ = std::move(
         csrblocksparse::CacheAlignedVector<MeanMatMulOutType>(output_bins));
     scales_ = std::move(
         csrblocksparse::CacheAlignedVector<ScaleMatMulOutType>(output_bins));
-    mol_sample_tmp_ = csrblocksparse::CacheAlignedVector<float>(output_bins);
+    mix_logits_ = csrblocksparse::CacheAlignedVector<float>(output_bins);
+    // Each thread has a column of the scratch space of the sampling, there
+    // are never more samples than mixtures.
+    mixture_maxes_ =
+        csrblocksparse::FatCacheAlignedVector<float>(output_bins, num_threads);
+    mol_sample_tmp_ =
+        csrblocksparse::FatCacheAlignedVector<float>(output_bins, num_threads);
+    // One uniform number for the mixture and one for the logistic of each
+    // sample.
+    uniforms_ = csrblocksparse::FatCacheAlignedVector<float>(2 * output_bins,
+                                                             num_threads);
+    mixture_indices_ = std::vector<std::vector<int>>(
+        num_threads, std::vector<int>(output_bins));
   }
 
   void MolSamples(int tid, std::minstd_rand* thread_local_gen, int num_samples,
-                  int* output_samples) {
+                  int* output_samples, bool samples_on_all_threads) {
     // DCHECK_NE(output_samples, nullptr);
     absl::Time t_start;
     if (time_components_) t_start = absl::Now();
-    if (tid == 0) {
-      // If there are two threads, we run the mix layer and its sampling in one,
-      // and the mean + scale layers in the other. If there are more than two
-      // threads, the others are not used, as more than 2 threads isn't really
-      // helpful.
-      mix_layer_.MatVec(proj_out_.slice(std::min(tid, num_proj_replicas_ - 1)),
-                        /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0,
-                        &mixes_);
-      int mixtures_per_sample = mixes_.size() / num_samples;
-      for (int i = 0; i < num_samples; i++) {
-        output_samples[i] = mixes_.ScalarSample(
-            temperature_, thread_local_gen, &mol_sample_tmp_, tid,
-            i * mixtures_per_sample, (i + 1) * mixtures_per_sample);
-      }
-    }
-    if (tid == num_threads_ - 1) {
-      mean_layer_.MatVec(proj_out_.slice(std::min(tid, num_proj_replicas_ - 1)),
-                         /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0,
-                         &means_);
-      scale_layer_.MatVec(
-          proj_out_.slice(std::min(tid, num_proj_replicas_ - 1)),
-          /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0, &scales_);
+    // Each thread computes its rows of all three layers.
+    const auto proj_out =
+        proj_out_.slice(std::min(tid, num_proj_replicas_ - 1));
+    mix_layer_->MatVec(proj_out, /*relu=*/false, tid, /*replicas*/ 1,
+                       /*stride*/ 0, &mixes_);
+    mean_layer_->MatVec(proj_out, /*relu=*/false, tid, /*replicas*/ 1,
+                        /*stride*/ 0, &means_);
+    scale_layer_->MatVec(proj_out, /*relu=*/false, tid, /*replicas*/ 1,
+                         /*stride*/ 0, &scales_);
+    ReduceMixtureMaxes(tid, num_samples);
+    const bool samples_on_this_thread = tid == 0 || samples_on_all_threads;
+    float* uniforms = uniforms_.slice(tid).data();
+    if (samples_on_this_thread) {
+      // All the random numbers of the samples are drawn at once, in the order
+      // in which they were drawn one at a time: the mixtures, then the
+      // logistics.
+      DrawUniformFloats(thread_local_gen, 2 * num_samples, uniforms);
     }
     if (barrier_ != nullptr) barrier_->barrier();
-    if (tid > 0) return;
-    if (time_components_) {
+    if (!samples_on_this_thread) return;
+    if (time_components_ && tid == 0) {
       absl::Time t_now = absl::Now();
       mixture_of_logistics_duration_ += t_now - t_start;
       t_start = t_now;
     }
-    for (int s = 0; s < num_samples; s++) {
-      int index = output_samples[s];
-      float mean = static_cast<float>(means_[index]);
-      float scale = static_cast<float>(scales_[index]);
-      // Softplus the scale.
-      scale = logf(expf(scale) + 1.0f);
-      std::uniform_real_distribution<float> dist;
-
-      // Truncated logistic distribution.
-      const float kProbabilityScale = 1.0f - 2.0f * probability_offset_;
-      float prob =
-          dist(*thread_local_gen) * kProbabilityScale + probability_offset_;
-      float f_result = mean + scale * log((1.0f - prob) / prob);
-      int result = std::min(
-          static_cast<int>(std::numeric_limits<int16_t>::max()),
-          std::max(static_cast<int>(std::numeric_limits<int16_t>::min()),
-                   static_cast<int>(f_result * 256)));
-      output_samples[s] = result;
+    int* mixture_indices = mixture_indices_[tid].data();
+    const int mixtures_per_sample = mixes_.size() / num_samples;
+    for (int i = 0; i < num_samples; i++) {
+      float max_value = std::numeric_limits<float>::lowest();
+      for (int t = 0; t < num_threads_; ++t) {
+        max_value = std::max(max_value, mixture_maxes_.slice(t)[i]);
+      }
+      mixture_indices[i] = SampleMixture(
+          mix_logits_.data(), i * mixtures_per_sample,
+          (i + 1) * mixtures_per_sample, max_value, temperature_, uniforms[i],
+          mol_sample_tmp_.slice(tid).data());
     }
+    SampleLogistics(num_samples, uniforms + num_samples, mixture_indices,
+                    means_.data(), scales_.data(), probability_offset_,
+                    output_samples);
 
-    if (time_components_) {
+    if (time_components_ && tid == 0) {
       absl::Time t_now = absl::Now();
       samp_duration_ += t_now - t_start;
       t_start = t_now;
     }
   }
 
-  int proj_size() const { return proj_layer_.rows(); }
+  // Converts the mix logits of the rows of |tid| to float in |mix_logits_|,
+  // and writes the maximum of those of each of the |num_samples| softmaxes to
+  // column |tid| of |mixture_maxes_|. The maximum of a softmax over all the
+  // threads is then that of their columns.
+  void ReduceMixtureMaxes(int tid, int num_samples) {
+    const std::vector<int>& split_points = mix_layer_->split_points();
+    const int begin = split_points[tid] * mix_layer_->block_height();
+    // The last thread also converts the bins added by rounding up.
+    const int end = tid == num_threads_ - 1
+                        ? static_cast<int>(mixes_.size())
+                        : split_points[tid + 1] * mix_layer_->block_height();
+    const int mixtures_per_sample = mixes_.size() / num_samples;
+    auto maxes = mixture_maxes_.slice(tid);
+    std::fill(maxes.data(), maxes.data() + num_samples,
+              std::numeric_limits<float>::lowest());
+    for (int i = begin; i < end; ++i) {
+      mix_logits_[i] = static_cast<float>(mixes_[i]);
+      const int sample = i / mixtures_per_sample;
+      if (sample < num_samples) {
+        maxes[sample] = std::max(maxes[sample], mix_logits_[i]);
+      }
+    }
+  }
+
+  int proj_size() const { return proj_layer_->rows(); }
   int mixes_size() const {
-    int output_bins = mix_layer_.rows();
+    int output_bins = mix_layer_->rows();
 #ifdef __AVX2__
     output_bins = ((output_bins + kSIMDWidth - 1) / kSIMDWidth) * kSIMDWidth;
 #endif
@@ -325,20 +618,38 @@ class ProjectAndSample {
   int num_threads_ = 0;
   int num_proj_replicas_ = 0;
   std::unique_ptr<csrblocksparse::SpinBarrier> barrier_;
-  // Parameters of the model.
-  csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType> proj_layer_;
-  csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType>
+  // Parameters of the model, which may be shared with other instances through
+  // |model_store_|.
+  std::shared_ptr<ModelStore> model_store_;
+  std::string proj_prefix_;
+  std::string mix_prefix_;
+  std::string mean_prefix_;
+  std::string scale_prefix_;
+  std::shared_ptr<
+      const csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType>>
+      proj_layer_;
+  std::shared_ptr<
+      const csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType>>
       mix_layer_;
-  csrblocksparse::SparseLinearLayer<MeanWeightType, ProjMatMulOutType>
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<MeanWeightType,
+                                                          ProjMatMulOutType>>
       mean_layer_;
-  csrblocksparse::SparseLinearLayer<ScaleWeightType, ProjMatMulOutType>
+  std::shared_ptr<const csrblocksparse::SparseLinearLayer<ScaleWeightType,
+                                                          ProjMatMulOutType>>
       scale_layer_;
   // Scratch space for computation
   csrblocksparse::FatCacheAlignedVector<ProjMatMulOutType> proj_out_;
   csrblocksparse::CacheAlignedVector<MixMatMulOutType> mixes_;
   csrblocksparse::CacheAlignedVector<MeanMatMulOutType> means_;
   csrblocksparse::CacheAlignedVector<ScaleMatMulOutType> scales_;
-  csrblocksparse::CacheAlignedVector<float> mol_sample_tmp_;
+  csrblocksparse::CacheAlignedVector<float> mix_logits_;
+  // The columns of these and the elements of |mixture_indices_| are per
+  // thread.
+  csrblocksparse::FatCacheAlignedVector<float> mixture_maxes_;
+  csrblocksparse::FatCacheAlignedVector<float> mol_sample_tmp_;
+  csrblocksparse::FatCacheAlignedVector<float> uniforms_;
+  // The mixture sampled for each sample.
+  std::vector<std::vector<int>> mixture_indices_;
 
   bool time_components_ = false;
   absl::Duration proj_duration_;
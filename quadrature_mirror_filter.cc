@@ -103,25 +103,41 @@ std::vector<T> MergeQuadratureMirrorFilter<T>::Merge(const Bands<T>& bands) {
     exit(EXIT_FAILURE);
   }
 
+  std::vector<T> merged_signal(2 * bands.num_samples_per_band);
+  Merge(absl::MakeConstSpan(bands.low_band),
+        absl::MakeConstSpan(bands.high_band), absl::MakeSpan(merged_signal));
+  return merged_signal;
+}
+
+template <typename T>
+void MergeQuadratureMirrorFilter<T>::Merge(absl::Span<const T> low_band,
+                                           absl::Span<const T> high_band,
+                                           absl::Span<T> signal) {
+  if (high_band.size() != low_band.size() ||
+      signal.size() != 2 * low_band.size()) {
+    fprintf(stderr,
+            "The bands have to have the same size and the signal twice that, "
+            "but were %d, %d and %d.\n",
+            static_cast<int>(low_band.size()),
+            static_cast<int>(high_band.size()),
+            static_cast<int>(signal.size()));
+    exit(EXIT_FAILURE);
+  }
+
   float all_pass_out_1, all_pass_out_2;
-  std::vector<T> merged_signal;
-  merged_signal.reserve(2 * bands.num_samples_per_band);
-  for (int i = 0; i < bands.num_samples_per_band; ++i) {
-    all_pass_1_.ProcessSample(
-        static_cast<float>(bands.low_band.at(i) - bands.high_band.at(i)),
-        &all_pass_out_1);
-    all_pass_2_.ProcessSample(
-        static_cast<float>(bands.low_band.at(i) + bands.high_band.at(i)),
-        &all_pass_out_2);
+  for (int i = 0; i < low_band.size(); ++i) {
+    all_pass_1_.ProcessSample(static_cast<float>(low_band[i] - high_band[i]),
+                              &all_pass_out_1);
+    all_pass_2_.ProcessSample(static_cast<float>(low_band[i] + high_band[i]),
+                              &all_pass_out_2);
     if (std::is_same<T, int16_t>::value) {
-      merged_signal.push_back(ClipToInt16(all_pass_out_2));
-      merged_signal.push_back(ClipToInt16(all_pass_out_1));
+      signal[2 * i] = ClipToInt16(all_pass_out_2);
+      signal[2 * i + 1] = ClipToInt16(all_pass_out_1);
     } else {
-      merged_signal.push_back(all_pass_out_2);
-      merged_signal.push_back(all_pass_out_1);
+      signal[2 * i] = all_pass_out_2;
+      signal[2 * i + 1] = all_pass_out_1;
     }
   }
-  return merged_signal;
 }
 
 template struct Bands<int16_t>;
@@ -69,6 +69,11 @@ class MergeQuadratureMirrorFilter {
   // The low and high band have to have the same size as num_samples_per_band.
   std::vector<T> Merge(const Bands<T>& bands);
 
+  // Same as above, but writes the merged signal into |signal|, which has to
+  // be twice as long as each band.
+  void Merge(absl::Span<const T> low_band, absl::Span<const T> high_band,
+             absl::Span<T> signal);
+
  private:
   // Two all-pass filters with a relative phase difference that allows the
   // merging of the sum and difference of the low and high bands.
@@ -46,7 +46,10 @@ std::unique_ptr<Resampler> Resampler::Create(double input_sample_rate_hz,
 Resampler::~Resampler() {}
 
 Resampler::Resampler(audio_dsp::QResampler<float> dsp_resampler)
-    : resampler_(std::move(dsp_resampler)) {
+    : resampler_(std::move(dsp_resampler)),
+      input_floats_(kMaxNumInputSamplesPerChunk),
+      output_floats_(
+          resampler_.MaxOutputFrames(kMaxNumInputSamplesPerChunk)) {
   resampler_.ResetFullyPrimed();
 }
 
@@ -60,6 +63,33 @@ std::vector<int16_t> Resampler::Resample(absl::Span<const int16_t> audio) {
   return output;
 }
 
+int Resampler::Resample(absl::Span<const int16_t> audio,
+                        absl::Span<int16_t> resampled) {
+  // Checked before any chunk is processed, so that the state is unchanged on
+  // failure.
+  if (resampler_.NextNumOutputFrames(audio.size()) > resampled.size()) {
+    return -1;
+  }
+  int num_resampled = 0;
+  while (!audio.empty()) {
+    const int num_input_samples =
+        std::min<int>(audio.size(), kMaxNumInputSamplesPerChunk);
+    const int num_output_samples =
+        resampler_.NextNumOutputFrames(num_input_samples);
+    std::copy(audio.begin(), audio.begin() + num_input_samples,
+              input_floats_.begin());
+    resampler_.ProcessSamples(
+        absl::MakeConstSpan(input_floats_.data(), num_input_samples),
+        absl::MakeSpan(output_floats_.data(), num_output_samples));
+    std::transform(output_floats_.begin(),
+                   output_floats_.begin() + num_output_samples,
+                   resampled.begin() + num_resampled, ClipToInt16);
+    num_resampled += num_output_samples;
+    audio.remove_prefix(num_input_samples);
+  }
+  return num_resampled;
+}
+
 void Resampler::Reset() { resampler_.ResetFullyPrimed(); }
 
 }  // namespace codec
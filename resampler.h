@@ -38,11 +38,23 @@ class Resampler : public ResamplerInterface {
   // Resamples audio at input_sample_rate_hz to target_sample_rate_hz.
   std::vector<int16_t> Resample(absl::Span<const int16_t> audio) override;
 
+  // Same as above, but writes the resampled audio to the beginning of
+  // |resampled|. Returns the number of samples written, or -1 if they do not
+  // fit, in which case nothing is resampled. Does not allocate.
+  int Resample(absl::Span<const int16_t> audio,
+               absl::Span<int16_t> resampled) override;
+
   void Reset() override;
 
  private:
+  // The audio is resampled in chunks of at most this many samples, so that
+  // the float buffers can be allocated up front.
+  static constexpr int kMaxNumInputSamplesPerChunk = 160;
+
   explicit Resampler(audio_dsp::QResampler<float> dsp_resampler);
   audio_dsp::QResampler<float> resampler_;
+  std::vector<float> input_floats_;
+  std::vector<float> output_floats_;
 };
 
 }  // namespace codec
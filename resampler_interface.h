@@ -17,6 +17,7 @@
 #ifndef LYRA_CODEC_RESAMPLER_INTERFACE_H_
 #define LYRA_CODEC_RESAMPLER_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -31,6 +32,19 @@ class ResamplerInterface {
 
   virtual std::vector<int16_t> Resample(absl::Span<const int16_t> audio) = 0;
 
+  // Same as above, but writes the resampled audio to the beginning of
+  // |resampled|. Returns the number of samples written, or -1 if they do not
+  // fit. Implementations override this to resample without allocating.
+  virtual int Resample(absl::Span<const int16_t> audio,
+                       absl::Span<int16_t> resampled) {
+    const std::vector<int16_t> output = Resample(audio);
+    if (output.size() > resampled.size()) {
+      return -1;
+    }
+    std::copy(output.begin(), output.end(), resampled.begin());
+    return output.size();
+  }
+
   virtual void Reset() = 0;
 };
 
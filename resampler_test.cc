@@ -41,6 +41,42 @@ TEST_P(ResamplerSampleRateTest, ResamplingWorksAllZeros) {
   EXPECT_EQ(resampled, expected);
 }
 
+TEST_P(ResamplerSampleRateTest, ResampleIntoSpanMatchesResample) {
+  const double input_sample_rate = GetParam().first;
+  const double output_sample_rate = GetParam().second;
+  std::vector<double> doubles_samples;
+  audio_dsp::ComputeSineWaveVector(440, input_sample_rate, 0.0, 1600,
+                                   &doubles_samples);
+  std::vector<int16_t> samples;
+  for (auto val : doubles_samples) {
+    samples.push_back(val * 1000);
+  }
+  auto resampler = Resampler::Create(input_sample_rate, output_sample_rate);
+  auto span_resampler =
+      Resampler::Create(input_sample_rate, output_sample_rate);
+
+  // Requests of a range of sizes, some longer than the chunks the resampler
+  // works on, give the same samples either way.
+  int start = 0;
+  for (const int num_samples : {1, 37, 160, 161, 500, 640}) {
+    const auto input =
+        absl::MakeConstSpan(samples).subspan(start, num_samples);
+    start += num_samples;
+    const auto resampled = resampler->Resample(input);
+    std::vector<int16_t> span_resampled(resampled.size() + 2);
+    ASSERT_EQ(span_resampler->Resample(input, absl::MakeSpan(span_resampled)),
+              resampled.size());
+    span_resampled.resize(resampled.size());
+    EXPECT_EQ(span_resampled, resampled);
+  }
+
+  // Output which does not fit is refused.
+  std::vector<int16_t> too_short(1);
+  EXPECT_EQ(span_resampler->Resample(absl::MakeConstSpan(samples),
+                                     absl::MakeSpan(too_short)),
+            -1);
+}
+
 INSTANTIATE_TEST_SUITE_P(UpsampleAndDownsample, ResamplerSampleRateTest,
                          testing::Values(std::make_pair(32000, 16000),
                                          std::make_pair(16000, 32000)));
@@ -30,6 +30,10 @@ enum class ARInputsMode {
   // Three autoregressive inputs, such as prev coarse and fine plus current
   // coarse for WaveRNN.
   k3ARInputs,
+  // Four autoregressive inputs, such as the previous samples of the 4 split
+  // bands of the Lyra WaveGRU. The second pair is handled like the first, with
+  // the weights interleaved for samples 2 and 3.
+  k4ARInputs,
 };
 
 }  // namespace csrblocksparse
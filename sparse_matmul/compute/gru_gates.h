@@ -24,7 +24,9 @@
 #include "sparse_matmul/compute/ar_inputs.h"
 #include "sparse_matmul/compute/gru_gates_arm.h"
 #include "sparse_matmul/compute/gru_gates_avx_fixed.h"
+#include "sparse_matmul/compute/gru_gates_avx_float.h"
 #include "sparse_matmul/compute/gru_gates_generic.h"
+#include "sparse_matmul/compute/gru_gates_wasm.h"
 #include "sparse_matmul/compute/matmul.h"
 #include "sparse_matmul/numerics/fixed_types.h"
 #include "sparse_matmul/numerics/type_utils.h"
@@ -52,6 +54,9 @@ class GruGates : public MatmulBase {
   // - |kInputsMode| == |k3ARInputs|: |ar_sample2| is multiplied by
   //   |ar_2_weights| and added to the other two |ar_inputs| (and added to the
   //   conditioning input).
+  // - |kInputsMode| == |k4ARInputs|: |ar_sample2| points to 2 samples, which
+  //   are multiplied by |ar_2_weights|, interleaved like |ar_01_weights|, and
+  //   added to the other two |ar_inputs| (and to the conditioning input).
   // - If |kSplitGates| is true: The |*gru_recurrent_other_ptr| is secondary
   //   recurrent input that must be added to |*gru_recurrent_ptr|.
   // - |num_replicas| determines the number of duplicates of the output to be
@@ -96,12 +101,19 @@ class GruGates : public MatmulBase {
   }
 };
 
-#if defined __ARM_NEON || defined __aarch64__
+#if defined __ARM_NEON || defined __aarch64__ || defined __AVX2__ || \
+    defined __wasm_simd128__
 // Partial specialization for float.
 template <>
 class GruGates<float, float, float> : public MatmulBase {
  public:
+#if defined __AVX2__
+  static constexpr int kSIMDWidth = kAVX2SIMDWidth * 2;
+#elif defined __wasm_simd128__
+  static constexpr int kSIMDWidth = kWasmSIMDWidth;
+#else
   static constexpr int kSIMDWidth = kNeonSIMDWidth;
+#endif  // __AVX2__ / __wasm_simd128__
 
   // Generic GRU function covers all uses for WaveRNN-like architectures and
   // conditioning.
@@ -116,14 +128,25 @@ class GruGates<float, float, float> : public MatmulBase {
                       const float* ar_sample2 = nullptr,
                       const float* ar_2_weights = nullptr,
                       const float* gru_recurrent_other_data = nullptr) {
+#if defined __AVX2__
+    if (!using_avx2_) {
+      std::cout << "Compiled for AVX2, but cpu flag not set!" << std::endl;
+      exit(1);
+    }
+    GruGatesAVXFloat<kInputsMode, kSplitGates>(
+        start, end, state_size, gru_recurrent_data, input_data, ar_sample0,
+        ar_sample1, ar_01_weights, num_replicas, replica_stride, ar_sample2,
+        ar_2_weights, gru_recurrent_other_data, gru_state_data);
+#else   // ARM and WebAssembly.
     //DCHECK_EQ(num_replicas, 1) << "ARM code should always have 1 replica";
     GoThroughGatesFloat<kInputsMode, kSplitGates>(
         start, end, ar_01_weights, gru_recurrent_data, gru_recurrent_other_data,
         input_data, gru_state_data, ar_2_weights, state_size, ar_sample0,
         ar_sample1, ar_sample2);
+#endif  // __AVX2__ / ARM and WebAssembly.
   }
 };
-#endif  // defined __ARM_NEON || defined __aarch64__
+#endif  // __ARM_NEON || __aarch64__ || __AVX2__ || __wasm_simd128__
 
 // Partial specialization for fixed types. The sample weights are always float
 // whatever the fixed type of the other weights.
@@ -135,9 +158,11 @@ class GruGates<fixed16<kGRUStateBits>, fixed32<kInputBits>,
   static constexpr int kSIMDWidth = kNeonSIMDWidth;
 #elif defined __AVX2__
   static constexpr int kSIMDWidth = kAVX2SIMDWidth * 2;
+#elif defined __wasm_simd128__
+  static constexpr int kSIMDWidth = kWasmSIMDWidth;
 #else   // Generic case.
   static constexpr int kSIMDWidth = kGenericSIMDWidth;
-#endif  // __ARM_NEON || defined __aarch64__ / __AVX2__
+#endif  // __ARM_NEON || defined __aarch64__ / __AVX2__ / __wasm_simd128__
 
   using GRUStateType = fixed16<kGRUStateBits>;
   using InputType = fixed32<kInputBits>;
@@ -160,7 +185,8 @@ class GruGates<fixed16<kGRUStateBits>, fixed32<kInputBits>,
                       const SampleType* ar_sample2 = nullptr,
                       const SampleWeightType* ar_2_weights = nullptr,
                       const InputType* gru_recurrent_other_data = nullptr) {
-#if defined __ARM_NEON || defined __aarch64__ || defined __AVX2__
+#if defined __ARM_NEON || defined __aarch64__ || defined __AVX2__ || \
+    defined __wasm_simd128__
     const int32_t* gru_recurrent_ptr =
         reinterpret_cast<const int32_t*>(gru_recurrent_data);
     const int32_t* gru_recurrent_other_ptr =
@@ -176,15 +202,19 @@ class GruGates<fixed16<kGRUStateBits>, fixed32<kInputBits>,
     const float sample_factor = 1.0f;
 #endif
     // AR sample 0 and 1 are packed into a pair because the QR weights are
-    // formatted with the weights interleaved for sample 0 and 1.
+    // formatted with the weights interleaved for sample 0 and 1. Likewise
+    // samples 2 and 3 with |k4ARInputs|.
     std::pair<float, float> ar_sample01;
-    float ar_sample2_float = 0.0f;
-    if (kInputsMode == ARInputsMode::k2ARInputs ||
-        kInputsMode == ARInputsMode::k3ARInputs) {
+    float ar_sample23[2] = {0.0f, 0.0f};
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
       ar_sample01 = {static_cast<float>(*ar_sample0) * sample_factor,
                      static_cast<float>(*ar_sample1) * sample_factor};
-      if (kInputsMode == ARInputsMode::k3ARInputs) {
-        ar_sample2_float = static_cast<float>(*ar_sample2) * sample_factor;
+      if (kInputsMode == ARInputsMode::k3ARInputs ||
+          kInputsMode == ARInputsMode::k4ARInputs) {
+        ar_sample23[0] = static_cast<float>(ar_sample2[0]) * sample_factor;
+      }
+      if (kInputsMode == ARInputsMode::k4ARInputs) {
+        ar_sample23[1] = static_cast<float>(ar_sample2[1]) * sample_factor;
       }
     }
 #if defined __AVX2__
@@ -195,15 +225,15 @@ class GruGates<fixed16<kGRUStateBits>, fixed32<kInputBits>,
     GruGatesAVXFixed<kInputMantissaBits, kStateMantissaBits, kInputsMode,
                      kSplitGates>(
         start, end, state_size, gru_recurrent_ptr, input_ptr, &ar_sample01,
-        ar_01_weights, num_replicas, replica_stride, &ar_sample2_float,
-        ar_2_weights, gru_recurrent_other_ptr, gru_state_ptr);
-#else   // ARM.
+        ar_01_weights, num_replicas, replica_stride, ar_sample23, ar_2_weights,
+        gru_recurrent_other_ptr, gru_state_ptr);
+#else   // ARM and WebAssembly.
     //DCHECK_EQ(num_replicas, 1) << "ARM code should always have 1 replica";
     GoThroughGatesFixed<GRUStateType, InputType, kInputsMode, kSplitGates>(
         start, end, ar_01_weights, gru_recurrent_ptr, gru_recurrent_other_ptr,
         input_ptr, gru_state_ptr, ar_2_weights, state_size, &ar_sample01,
-        &ar_sample2_float);
-#endif  // __AVX2__ / ARM.
+        ar_sample23);
+#endif  // __AVX2__ / ARM and WebAssembly.
 #else   // Generic case.
     if (num_replicas != 1) {
       std::cout << "Generic code should always have 1 replica" << std::endl;
@@ -214,7 +244,7 @@ class GruGates<fixed16<kGRUStateBits>, fixed32<kInputBits>,
         start, end, ar_01_weights, gru_recurrent_data, gru_recurrent_other_data,
         input_data, gru_state_data, ar_2_weights, state_size, ar_sample0,
         ar_sample1, ar_sample2);
-#endif  // __ARM_NEON || defined __aarch64__ / __AVX2__
+#endif  // __ARM_NEON || defined __aarch64__ / __AVX2__ / __wasm_simd128__
   }
 };
 
@@ -37,6 +37,10 @@ static constexpr int kNeonSIMDWidth = 4;
 // |sample| = (|coarse_at_sminus1|, |fine_at_sminus1|,
 //             |coarse_at_sminus1|, |fine_at_sminus1|)
 // |w_sample| = (|coarse_at_s|, |coarse_at_s|, |coarse_at_s|, |coarse_at_s|)
+// or with |k4ARInputs|, where |coarse_at_s| points to samples 2 and 3 and
+// |w_hat| is interleaved like |qr_ptr|:
+// |w_sample| = (|coarse_at_s[0]|, |coarse_at_s[1]|,
+//               |coarse_at_s[0]|, |coarse_at_s[1]|)
 //
 // CHEATSHEET:
 // vld1q_f32 = load 4 32-bit floats
@@ -85,6 +89,10 @@ void GoThroughGatesFloat(int start, int end, const float* qr_ptr,
       DCHECK_NE(w_hat, nullptr);
       DCHECK_NE(coarse_at_s, nullptr);
       w_hat += start;
+    } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+      DCHECK_NE(w_hat, nullptr);
+      DCHECK_NE(coarse_at_s, nullptr);
+      w_hat += 2 * start;
     }
   }
   for (int i = start; i < end; i += kNeonSIMDWidth) {
@@ -125,6 +133,21 @@ void GoThroughGatesFloat(int start, int end, const float* qr_ptr,
             vmlaq_f32(qr_update, vld1q_f32(w_hat + proj_size), w_sample);
         qr_cell =
             vmlaq_f32(qr_cell, vld1q_f32(w_hat + 2 * proj_size), w_sample);
+      } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+        float32x4_t w_sample = vdupq_n_f32(coarse_at_s[0]);
+        w_sample = vsetq_lane_f32(coarse_at_s[1], w_sample, 1);
+        w_sample = vsetq_lane_f32(coarse_at_s[1], w_sample, 3);
+        auto w_reset_0 = vmulq_f32(vld1q_f32(w_hat), w_sample);
+        auto w_reset_1 = vmulq_f32(vld1q_f32(w_hat + 4), w_sample);
+        qr_reset = vaddq_f32(qr_reset, vpaddq_f32(w_reset_0, w_reset_1));
+        auto w_update_0 = vmulq_f32(vld1q_f32(w_hat + 2 * proj_size), w_sample);
+        auto w_update_1 =
+            vmulq_f32(vld1q_f32(w_hat + 4 + 2 * proj_size), w_sample);
+        qr_update = vaddq_f32(qr_update, vpaddq_f32(w_update_0, w_update_1));
+        auto w_cell_0 = vmulq_f32(vld1q_f32(w_hat + 4 * proj_size), w_sample);
+        auto w_cell_1 =
+            vmulq_f32(vld1q_f32(w_hat + 4 + 4 * proj_size), w_sample);
+        qr_cell = vaddq_f32(qr_cell, vpaddq_f32(w_cell_0, w_cell_1));
       }
       reset = vaddq_f32(reset, qr_reset);
       update = vaddq_f32(update, qr_update);
@@ -155,6 +178,7 @@ void GoThroughGatesFloat(int start, int end, const float* qr_ptr,
     if (kInputsMode != ARInputsMode::k0ARInputs) {
       qr_ptr += 2 * kNeonSIMDWidth;
       if (kInputsMode == ARInputsMode::k3ARInputs) w_hat += kNeonSIMDWidth;
+      if (kInputsMode == ARInputsMode::k4ARInputs) w_hat += 2 * kNeonSIMDWidth;
     }
   }
 }
@@ -195,6 +219,13 @@ void GoThroughGatesFixed(int start, int end, const float* qr_ptr,
       DCHECK_NE(coarse_at_s, nullptr);
       w_hat += start;
       w_sample = vdupq_n_f32(*coarse_at_s);
+    } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+      DCHECK_NE(w_hat, nullptr);
+      DCHECK_NE(coarse_at_s, nullptr);
+      w_hat += 2 * start;
+      w_sample = vdupq_n_f32(coarse_at_s[0]);
+      w_sample = vsetq_lane_f32(coarse_at_s[1], w_sample, 1);
+      w_sample = vsetq_lane_f32(coarse_at_s[1], w_sample, 3);
     }
   }
   for (int i = start; i < end; i += kNeonSIMDWidth) {
@@ -235,6 +266,20 @@ void GoThroughGatesFixed(int start, int end, const float* qr_ptr,
             vmlaq_f32(qr_update, vld1q_f32(w_hat + proj_size), w_sample);
         qr_cell =
             vmlaq_f32(qr_cell, vld1q_f32(w_hat + 2 * proj_size), w_sample);
+      } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+        float32x4_t w_reset_0 = vmulq_f32(vld1q_f32(w_hat), w_sample);
+        float32x4_t w_reset_1 = vmulq_f32(vld1q_f32(w_hat + 4), w_sample);
+        qr_reset = vaddq_f32(qr_reset, vpaddq_f32(w_reset_0, w_reset_1));
+        float32x4_t w_update_0 =
+            vmulq_f32(vld1q_f32(w_hat + 2 * proj_size), w_sample);
+        float32x4_t w_update_1 =
+            vmulq_f32(vld1q_f32(w_hat + 4 + 2 * proj_size), w_sample);
+        qr_update = vaddq_f32(qr_update, vpaddq_f32(w_update_0, w_update_1));
+        float32x4_t w_cell_0 =
+            vmulq_f32(vld1q_f32(w_hat + 4 * proj_size), w_sample);
+        float32x4_t w_cell_1 =
+            vmulq_f32(vld1q_f32(w_hat + 4 + 4 * proj_size), w_sample);
+        qr_cell = vaddq_f32(qr_cell, vpaddq_f32(w_cell_0, w_cell_1));
       }
       reset = vaddq_s32(
           reset, vcvtq_n_s32_f32(qr_reset, GRUMatMulOutType::kMantissaBits));
@@ -278,6 +323,7 @@ void GoThroughGatesFixed(int start, int end, const float* qr_ptr,
     if (kInputsMode != ARInputsMode::k0ARInputs) {
       qr_ptr += 2 * kNeonSIMDWidth;
       if (kInputsMode == ARInputsMode::k3ARInputs) w_hat += kNeonSIMDWidth;
+      if (kInputsMode == ARInputsMode::k4ARInputs) w_hat += 2 * kNeonSIMDWidth;
     }
   }
 }
@@ -82,7 +82,8 @@ inline __m256 MultiplyAddFloat(const __m256& input_pairs,
   data_pair1 = _mm256_mul_ps(data_pair1, input_pairs);
   data_pair0 = _mm256_hadd_ps(data_pair0, data_pair1);
   // Swap the middle 2 64 bit pairs to correct the hadd result.
-  data_pair0 = _mm256_permute4x64_pd(data_pair0, 0xd8);
+  data_pair0 = _mm256_castpd_ps(
+      _mm256_permute4x64_pd(_mm256_castps_pd(data_pair0), 0xd8));
   if (kThreeInputs) {
     // Load 256 bits (8 x float) of data, then multiply-accumulate.
     data_pair1 = _mm256_load_ps(ptr2);
@@ -93,6 +94,30 @@ inline __m256 MultiplyAddFloat(const __m256& input_pairs,
   return _mm256_add_ps(data_pair0, accumulator);
 }
 
+// Adds the products of the AR inputs with their weights to |accumulator|
+// according to |kInputsMode|, which must not be |k0ARInputs|. With
+// |k4ARInputs|, |ar_2| holds samples 2 and 3 formatted as |ar_01|, and
+// |weights_2| are interleaved like |weights_01|, else see MultiplyAddFloat.
+template <ARInputsMode kInputsMode>
+inline __m256 MultiplyAddARInputs(const __m256& ar_01, const __m256& ar_2,
+                                  const float* weights_01,
+                                  const float* weights_2,
+                                  const __m256& accumulator) {
+  if (kInputsMode == ARInputsMode::k4ARInputs) {
+    __m256 sum = MultiplyAddFloat</*kThreeInputs=*/false>(
+        ar_01, ar_2, weights_01, weights_2, accumulator);
+    return MultiplyAddFloat</*kThreeInputs=*/false>(ar_2, ar_2, weights_2,
+                                                     weights_2, sum);
+  }
+  return MultiplyAddFloat<kInputsMode == ARInputsMode::k3ARInputs>(
+      ar_01, ar_2, weights_01, weights_2, accumulator);
+}
+
+// The number of |ar_2_weights| per row and gate for |kInputsMode|.
+constexpr int AR2WeightsPerRow(ARInputsMode inputs_mode) {
+  return inputs_mode == ARInputsMode::k4ARInputs ? 2 : 1;
+}
+
 // Processes the tanh and the final combination, returns the new GRU state.
 template <int kInputMantissaBits, int kStateMantissaBits, bool kSplitGates>
 inline __m256i GRUComputeState(const __m256& cell0, const __m256& cell1,
@@ -133,7 +158,7 @@ inline __m256i GRUComputeState(const __m256& cell0, const __m256& cell1,
   return PackFloatsToFixed16(float_gru0, float_gru1);
 }
 
-// According to |kInputsMode|, processes 0, 2 or 3 autoregressive inputs and
+// According to |kInputsMode|, processes 0, 2, 3 or 4 autoregressive inputs and
 // combines with |input| and |gates*|.
 // With 2 AR inputs, loads 8x pairs of float from |pair_weights| and multiplies
 // by |paired_ar|, likewise formatted as 8x float, but scaled such that the
@@ -147,17 +172,17 @@ inline __m256i GRUComputeState(const __m256& cell0, const __m256& cell1,
 // well.
 // Returns the total sum as a float, but on the scale of |*input|.
 template <bool kTwoGates, ARInputsMode kInputsMode>
-inline __m256i GruInput32ToFloat(const __m256& paired_ar,
-                                 const __m256& third_ar,
-                                 const float* pair_weights,
-                                 const float* third_weights,
-                                 const int32_t* gates0, const int32_t* gates1,
-                                 const int32_t* input) {
+inline __m256 GruInput32ToFloat(const __m256& paired_ar,
+                                const __m256& third_ar,
+                                const float* pair_weights,
+                                const float* third_weights,
+                                const int32_t* gates0, const int32_t* gates1,
+                                const int32_t* input) {
   __m256i data32 = _mm256_load_si256(reinterpret_cast<__m256i const*>(input));
   data32 = LoadAndAddFixed32<kTwoGates>(gates0, gates1, data32);
   __m256 float_data = _mm256_cvtepi32_ps(data32);
   if (kInputsMode != ARInputsMode::k0ARInputs) {
-    float_data = MultiplyAddFloat<kInputsMode == ARInputsMode::k3ARInputs>(
+    float_data = MultiplyAddARInputs<kInputsMode>(
         paired_ar, third_ar, pair_weights, third_weights, float_data);
   }
   return float_data;
@@ -173,6 +198,9 @@ inline __m256i GruInput32ToFloat(const __m256& paired_ar,
 //   |ar_01_weights| and added to the (conditioning) input.
 // - |kInputsMode| == |k3ARInputs|: |ar_sample2| is multiplied by |ar_2_weights|
 //   and added to the other two AR inputs (and added to the conditioning input).
+// - |kInputsMode| == |k4ARInputs|: |ar_sample2| points to samples 2 and 3,
+//   which are multiplied by |ar_2_weights|, interleaved like |ar_01_weights|,
+//   and added to the other two AR inputs (and to the conditioning input).
 // - |kReplicas| determines the number of duplicates of the output to be
 //   written, separated by |replica_stride|. If zero, then the number of
 //   replicas is variable and taken from the |replicas| argument.
@@ -193,6 +221,7 @@ inline void GruGatesTemplate(
     const float* ar_sample2, const float* ar_2_weights,
     const int32_t* gru_recurrent_other_ptr, int16_t* gru_state_ptr) {
   constexpr int kQRIncrement = kAVX2SIMDWidth;
+  constexpr int kAR2Stride = AR2WeightsPerRow(kInputsMode);
   // Increment all the pointers to save on pointer arithmetic in the loop.
   input_ptr += start;
   gru_state_ptr += start;
@@ -206,12 +235,16 @@ inline void GruGatesTemplate(
     if (kInputsMode == ARInputsMode::k3ARInputs) {
       ar_2_weights += start;
       ar_3rd_input = _mm256_set1_ps(*ar_sample2);
+    } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+      ar_2_weights += 2 * start;
+      ar_3rd_input = _mm256_castsi256_ps(
+          _mm256_set1_epi64x(*reinterpret_cast<const int64_t*>(ar_sample2)));
     } else {
-      ar_3rd_input = {};
+      ar_3rd_input = _mm256_setzero_ps();
     }
   } else {
-    ar_2_inputs = {};
-    ar_3rd_input = {};
+    ar_2_inputs = _mm256_setzero_ps();
+    ar_3rd_input = _mm256_setzero_ps();
   }
   // The transcendentals handle 2x registers of data at once, so we have to do
   // everything in duplicate.
@@ -222,17 +255,18 @@ inline void GruGatesTemplate(
         gru_recurrent_ptr, gru_recurrent_other_ptr, input_ptr);
     __m256 reset1 = GruInput32ToFloat<kSplitGates, kInputsMode>(
         ar_2_inputs, ar_3rd_input, ar_01_weights + 2 * kQRIncrement,
-        ar_2_weights + kQRIncrement, gru_recurrent_ptr + kAVX2SIMDWidth,
+        ar_2_weights + kAR2Stride * kQRIncrement,
+        gru_recurrent_ptr + kAVX2SIMDWidth,
         gru_recurrent_other_ptr + kAVX2SIMDWidth, input_ptr + kAVX2SIMDWidth);
     float_sigmoid_float<kInputBits>(reset0, reset1);
     __m256 update0 = GruInput32ToFloat<kSplitGates, kInputsMode>(
         ar_2_inputs, ar_3rd_input, ar_01_weights + 2 * state_size,
-        ar_2_weights + state_size, gru_recurrent_ptr + state_size,
+        ar_2_weights + kAR2Stride * state_size, gru_recurrent_ptr + state_size,
         gru_recurrent_other_ptr + state_size, input_ptr + state_size);
     __m256 update1 = GruInput32ToFloat<kSplitGates, kInputsMode>(
         ar_2_inputs, ar_3rd_input,
         ar_01_weights + 2 * state_size + 2 * kQRIncrement,
-        ar_2_weights + state_size + kQRIncrement,
+        ar_2_weights + kAR2Stride * (state_size + kQRIncrement),
         gru_recurrent_ptr + state_size + kAVX2SIMDWidth,
         gru_recurrent_other_ptr + state_size + kAVX2SIMDWidth,
         input_ptr + state_size + kAVX2SIMDWidth);
@@ -243,13 +277,13 @@ inline void GruGatesTemplate(
         _mm256_cvtepi32_ps(_mm256_load_si256(reinterpret_cast<__m256i const*>(
             input_ptr + 2 * state_size + kAVX2SIMDWidth)));
     if (kInputsMode != ARInputsMode::k0ARInputs) {
-      cell0 = MultiplyAddFloat<kInputsMode == ARInputsMode::k3ARInputs>(
+      cell0 = MultiplyAddARInputs<kInputsMode>(
           ar_2_inputs, ar_3rd_input, ar_01_weights + 4 * state_size,
-          ar_2_weights + 2 * state_size, cell0);
-      cell1 = MultiplyAddFloat<kInputsMode == ARInputsMode::k3ARInputs>(
+          ar_2_weights + 2 * kAR2Stride * state_size, cell0);
+      cell1 = MultiplyAddARInputs<kInputsMode>(
           ar_2_inputs, ar_3rd_input,
           ar_01_weights + 4 * state_size + 2 * kQRIncrement,
-          ar_2_weights + 2 * state_size + kQRIncrement, cell1);
+          ar_2_weights + kAR2Stride * (2 * state_size + kQRIncrement), cell1);
     }
     __m256i gru_state = GRUComputeState<kInputBits, kStateBits, kSplitGates>(
         cell0, cell1, reset0, reset1, update0, update1,
@@ -278,8 +312,9 @@ inline void GruGatesTemplate(
     if (kSplitGates) gru_recurrent_other_ptr += 2 * kAVX2SIMDWidth;
     if (kInputsMode != ARInputsMode::k0ARInputs) {
       ar_01_weights += 4 * kQRIncrement;
-      if (kInputsMode == ARInputsMode::k3ARInputs)
-        ar_2_weights += 2 * kQRIncrement;
+      if (kInputsMode == ARInputsMode::k3ARInputs ||
+          kInputsMode == ARInputsMode::k4ARInputs)
+        ar_2_weights += 2 * kAR2Stride * kQRIncrement;
     }
   }
 }
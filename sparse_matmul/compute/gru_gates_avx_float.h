@@ -0,0 +1,202 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_SPARSE_MATMUL_COMPUTE_GRU_GATES_AVX_FLOAT_H_
+#define LYRA_CODEC_SPARSE_MATMUL_COMPUTE_GRU_GATES_AVX_FLOAT_H_
+
+#if defined __AVX2__
+#include <immintrin.h>
+#endif
+#include <algorithm>
+
+#include "sparse_matmul/compute/ar_inputs.h"
+#include "sparse_matmul/compute/gru_gates_avx_fixed.h"
+#include "sparse_matmul/compute/gru_gates_generic.h"
+#include "sparse_matmul/numerics/fast_transcendentals.h"
+
+namespace csrblocksparse {
+
+#if defined __AVX2__
+
+// Returns |a| + |x| * |b|, fused if FMA is available.
+inline __m256 MultiplyAdd(const __m256& a, const __m256& x, const __m256& b) {
+#if defined __FMA__
+  return _mm256_fmadd_ps(x, b, a);
+#else
+  return _mm256_add_ps(a, _mm256_mul_ps(x, b));
+#endif  // __FMA__
+}
+
+// Loads the reset or update gate of 8 rows from |gates| (plus |gates_other| if
+// |kSplitGates|) and |input|, and adds the AR inputs according to
+// |kInputsMode|, as GruInput32ToFloat does for fixed point.
+template <bool kSplitGates, ARInputsMode kInputsMode>
+inline __m256 GruInputFloat(const __m256& paired_ar, const __m256& third_ar,
+                            const float* pair_weights,
+                            const float* third_weights, const float* gates,
+                            const float* gates_other, const float* input) {
+  __m256 data = _mm256_add_ps(_mm256_loadu_ps(gates), _mm256_loadu_ps(input));
+  if (kSplitGates) data = _mm256_add_ps(data, _mm256_loadu_ps(gates_other));
+  if (kInputsMode != ARInputsMode::k0ARInputs) {
+    data = MultiplyAddARInputs<kInputsMode>(paired_ar, third_ar, pair_weights,
+                                            third_weights, data);
+  }
+  return data;
+}
+
+// Float version of GruGatesTemplate in gru_gates_avx_fixed.h, with the same
+// arguments and calculation, but for float gates and state. Rows are processed
+// 16 at a time, with the 2-register float_sigmoid_float and float_tanh_float
+// at a mantissa of 0, and any remaining rows of [|start|, |end|) go through
+// the generic GoThroughGates.
+// Previous state is read from |*gru_state_ptr| and the new state is written to
+// *(|gru_state_ptr| + i * |replica_stride| for i in [0, |num_replicas|)).
+template <ARInputsMode kInputsMode = ARInputsMode::k2ARInputs,
+          bool kSplitGates = false>
+inline void GruGatesAVXFloat(int start, int end, int state_size,
+                             const float* gru_recurrent_ptr,
+                             const float* input_ptr, const float* ar_sample0,
+                             const float* ar_sample1,
+                             const float* ar_01_weights, int num_replicas,
+                             int replica_stride, const float* ar_sample2,
+                             const float* ar_2_weights,
+                             const float* gru_recurrent_other_ptr,
+                             float* gru_state_ptr) {
+  constexpr int kRowsPerIteration = 2 * kAVX2SIMDWidth;
+  constexpr int kAR2Stride = AR2WeightsPerRow(kInputsMode);
+  const int vector_end = start + (end - start) / kRowsPerIteration *
+                                     kRowsPerIteration;
+  if (vector_end < end) {
+    GoThroughGates<float, float, float, float, kInputsMode, kSplitGates>(
+        vector_end, end, ar_01_weights, gru_recurrent_ptr,
+        gru_recurrent_other_ptr, input_ptr, gru_state_ptr, ar_2_weights,
+        state_size, ar_sample0, ar_sample1, ar_sample2);
+    for (int j = 1; j < num_replicas; ++j) {
+      std::copy(gru_state_ptr + vector_end, gru_state_ptr + end,
+                gru_state_ptr + j * replica_stride + vector_end);
+    }
+  }
+  // Increment all the pointers to save on pointer arithmetic in the loop.
+  input_ptr += start;
+  gru_state_ptr += start;
+  gru_recurrent_ptr += start;
+  if (kSplitGates) gru_recurrent_other_ptr += start;
+  __m256 ar_2_inputs = _mm256_setzero_ps();
+  __m256 ar_3rd_input = _mm256_setzero_ps();
+  if (kInputsMode != ARInputsMode::k0ARInputs) {
+    ar_01_weights += 2 * start;
+    // The QR weights are interleaved for sample 0 and 1.
+    ar_2_inputs = _mm256_setr_ps(*ar_sample0, *ar_sample1, *ar_sample0,
+                                 *ar_sample1, *ar_sample0, *ar_sample1,
+                                 *ar_sample0, *ar_sample1);
+    if (kInputsMode == ARInputsMode::k3ARInputs) {
+      ar_2_weights += start;
+      ar_3rd_input = _mm256_set1_ps(*ar_sample2);
+    } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+      // Samples 2 and 3 are interleaved like samples 0 and 1.
+      ar_2_weights += 2 * start;
+      ar_3rd_input = _mm256_setr_ps(ar_sample2[0], ar_sample2[1],
+                                    ar_sample2[0], ar_sample2[1],
+                                    ar_sample2[0], ar_sample2[1],
+                                    ar_sample2[0], ar_sample2[1]);
+    }
+  }
+  for (int i = start; i < vector_end; i += kRowsPerIteration) {
+    __m256 reset0 = GruInputFloat<kSplitGates, kInputsMode>(
+        ar_2_inputs, ar_3rd_input, ar_01_weights, ar_2_weights,
+        gru_recurrent_ptr, gru_recurrent_other_ptr, input_ptr);
+    __m256 reset1 = GruInputFloat<kSplitGates, kInputsMode>(
+        ar_2_inputs, ar_3rd_input, ar_01_weights + 2 * kAVX2SIMDWidth,
+        ar_2_weights + kAR2Stride * kAVX2SIMDWidth,
+        gru_recurrent_ptr + kAVX2SIMDWidth,
+        gru_recurrent_other_ptr + kAVX2SIMDWidth, input_ptr + kAVX2SIMDWidth);
+    float_sigmoid_float</*kInputMantissaBits=*/0>(reset0, reset1);
+    __m256 update0 = GruInputFloat<kSplitGates, kInputsMode>(
+        ar_2_inputs, ar_3rd_input, ar_01_weights + 2 * state_size,
+        ar_2_weights + kAR2Stride * state_size, gru_recurrent_ptr + state_size,
+        gru_recurrent_other_ptr + state_size, input_ptr + state_size);
+    __m256 update1 = GruInputFloat<kSplitGates, kInputsMode>(
+        ar_2_inputs, ar_3rd_input,
+        ar_01_weights + 2 * state_size + 2 * kAVX2SIMDWidth,
+        ar_2_weights + kAR2Stride * (state_size + kAVX2SIMDWidth),
+        gru_recurrent_ptr + state_size + kAVX2SIMDWidth,
+        gru_recurrent_other_ptr + state_size + kAVX2SIMDWidth,
+        input_ptr + state_size + kAVX2SIMDWidth);
+    float_sigmoid_float</*kInputMantissaBits=*/0>(update0, update1);
+
+    // The conditioning of the cell is added after the reset, and the AR inputs
+    // before.
+    __m256 cell0 = _mm256_loadu_ps(input_ptr + 2 * state_size);
+    __m256 cell1 = _mm256_loadu_ps(input_ptr + 2 * state_size + kAVX2SIMDWidth);
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
+      cell0 = MultiplyAddARInputs<kInputsMode>(
+          ar_2_inputs, ar_3rd_input, ar_01_weights + 4 * state_size,
+          ar_2_weights + 2 * kAR2Stride * state_size, cell0);
+      cell1 = MultiplyAddARInputs<kInputsMode>(
+          ar_2_inputs, ar_3rd_input,
+          ar_01_weights + 4 * state_size + 2 * kAVX2SIMDWidth,
+          ar_2_weights + kAR2Stride * (2 * state_size + kAVX2SIMDWidth), cell1);
+    }
+    __m256 recurrent_cell0 =
+        _mm256_loadu_ps(gru_recurrent_ptr + 2 * state_size);
+    __m256 recurrent_cell1 =
+        _mm256_loadu_ps(gru_recurrent_ptr + 2 * state_size + kAVX2SIMDWidth);
+    if (kSplitGates) {
+      recurrent_cell0 = _mm256_add_ps(
+          recurrent_cell0,
+          _mm256_loadu_ps(gru_recurrent_other_ptr + 2 * state_size));
+      recurrent_cell1 = _mm256_add_ps(
+          recurrent_cell1, _mm256_loadu_ps(gru_recurrent_other_ptr +
+                                           2 * state_size + kAVX2SIMDWidth));
+    }
+    cell0 = MultiplyAdd(cell0, reset0, recurrent_cell0);
+    cell1 = MultiplyAdd(cell1, reset1, recurrent_cell1);
+    __m256 hbar0, hbar1;
+    float_tanh_float</*kInputMantissaBits=*/0, TM_ORDER4_FLOAT>(cell0, cell1,
+                                                                 hbar0, hbar1);
+
+    // new_h = hbar + (prev_h - hbar) * update.
+    __m256 new_h0 = MultiplyAdd(
+        hbar0, _mm256_sub_ps(_mm256_loadu_ps(gru_state_ptr), hbar0), update0);
+    __m256 new_h1 = MultiplyAdd(
+        hbar1,
+        _mm256_sub_ps(_mm256_loadu_ps(gru_state_ptr + kAVX2SIMDWidth), hbar1),
+        update1);
+    for (int j = 0; j < num_replicas; ++j) {
+      _mm256_storeu_ps(gru_state_ptr + j * replica_stride, new_h0);
+      _mm256_storeu_ps(gru_state_ptr + j * replica_stride + kAVX2SIMDWidth,
+                       new_h1);
+    }
+    // Increment all the pointers.
+    input_ptr += kRowsPerIteration;
+    gru_state_ptr += kRowsPerIteration;
+    gru_recurrent_ptr += kRowsPerIteration;
+    if (kSplitGates) gru_recurrent_other_ptr += kRowsPerIteration;
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
+      ar_01_weights += 2 * kRowsPerIteration;
+      if (kInputsMode == ARInputsMode::k3ARInputs ||
+          kInputsMode == ARInputsMode::k4ARInputs) {
+        ar_2_weights += kAR2Stride * kRowsPerIteration;
+      }
+    }
+  }
+}
+
+#endif  // __AVX2__
+
+}  // namespace csrblocksparse
+
+#endif  // LYRA_CODEC_SPARSE_MATMUL_COMPUTE_GRU_GATES_AVX_FLOAT_H_
@@ -0,0 +1,92 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the float GruGates, which is specialized on AVX2, ARM and
+// WebAssembly, with the generic GoThroughGates on the 1024 hiddens of the
+// WaveGRU.
+
+#include "benchmark/benchmark.h"
+#include "sparse_matmul/compute/ar_inputs.h"
+#include "sparse_matmul/compute/gru_gates.h"
+#include "sparse_matmul/vector/cache_aligned_vector.h"
+
+namespace {
+
+constexpr int kStateSize = 1024;
+
+using csrblocksparse::ARInputsMode;
+
+struct GruData {
+  GruData()
+      : qr(6 * kStateSize),
+        w(3 * kStateSize),
+        gru_gates(3 * kStateSize),
+        conditioning(3 * kStateSize),
+        gru_h(kStateSize) {
+    qr.FillRandom();
+    w.FillRandom();
+    gru_gates.FillRandom();
+    conditioning.FillRandom();
+    gru_h.FillRandom();
+  }
+
+  csrblocksparse::CacheAlignedVector<float> qr;
+  csrblocksparse::CacheAlignedVector<float> w;
+  csrblocksparse::CacheAlignedVector<float> gru_gates;
+  csrblocksparse::CacheAlignedVector<float> conditioning;
+  csrblocksparse::CacheAlignedVector<float> gru_h;
+  const float ar_sample0 = 0.03f;
+  const float ar_sample1 = 0.07f;
+  const float ar_sample2 = -0.02f;
+};
+
+template <ARInputsMode kInputsMode>
+void BM_GruGatesFloat(benchmark::State& state) {
+  GruData data;
+  csrblocksparse::GruGates<float, float, float> gru_gates_impl;
+  for (auto _ : state) {
+    gru_gates_impl.GruWithARInput<kInputsMode>(
+        /*start=*/0, kStateSize, kStateSize, data.gru_gates.data(),
+        data.conditioning.data(), data.gru_h.data(), &data.ar_sample0,
+        &data.ar_sample1, data.qr.data(), /*num_replicas=*/1,
+        /*replica_stride=*/0, &data.ar_sample2, data.w.data());
+    benchmark::DoNotOptimize(data.gru_h.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kStateSize);
+}
+
+template <ARInputsMode kInputsMode>
+void BM_GoThroughGatesFloat(benchmark::State& state) {
+  GruData data;
+  for (auto _ : state) {
+    csrblocksparse::GoThroughGates<float, float, float, float, kInputsMode,
+                                   /*SplitGates=*/false>(
+        /*start=*/0, kStateSize, data.qr.data(), data.gru_gates.data(),
+        /*gru_gates_other_ptr=*/nullptr, data.conditioning.data(),
+        data.gru_h.data(), data.w.data(), kStateSize, &data.ar_sample0,
+        &data.ar_sample1, &data.ar_sample2);
+    benchmark::DoNotOptimize(data.gru_h.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kStateSize);
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_GruGatesFloat, ARInputsMode::k0ARInputs);
+BENCHMARK_TEMPLATE(BM_GoThroughGatesFloat, ARInputsMode::k0ARInputs);
+BENCHMARK_TEMPLATE(BM_GruGatesFloat, ARInputsMode::k2ARInputs);
+BENCHMARK_TEMPLATE(BM_GoThroughGatesFloat, ARInputsMode::k2ARInputs);
+BENCHMARK_TEMPLATE(BM_GruGatesFloat, ARInputsMode::k3ARInputs);
+BENCHMARK_TEMPLATE(BM_GoThroughGatesFloat, ARInputsMode::k3ARInputs);
+BENCHMARK_MAIN();
@@ -67,6 +67,20 @@ void GoThroughGates(int start, int end, const QR_W_Type* qr_ptr,
         update += w_hat_i_update * coarse;
         qr_cell += w_hat_i_cell * coarse;
       }
+      if (kInputsMode == ARInputsMode::k4ARInputs) {
+        // |w_hat| is interleaved for samples 2 and 3 as |qr_ptr| is for 0, 1.
+        const QR_W_Type* w_reset = w_hat + 2 * i;
+        const QR_W_Type* w_update = w_hat + 2 * proj_size + 2 * i;
+        const QR_W_Type* w_cell = w_hat + 4 * proj_size + 2 * i;
+        float sample2 = static_cast<float>(coarse_at_s[0]);
+        float sample3 = static_cast<float>(coarse_at_s[1]);
+        reset += static_cast<float>(w_reset[0]) * sample2 +
+                 static_cast<float>(w_reset[1]) * sample3;
+        update += static_cast<float>(w_update[0]) * sample2 +
+                  static_cast<float>(w_update[1]) * sample3;
+        qr_cell += static_cast<float>(w_cell[0]) * sample2 +
+                   static_cast<float>(w_cell[1]) * sample3;
+      }
       reset += static_cast<float>(gru_gates_ptr[i]);
       update += static_cast<float>(gru_gates_ptr[proj_size + i]);
     }
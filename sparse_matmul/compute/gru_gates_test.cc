@@ -14,6 +14,7 @@
 
 #include "sparse_matmul/compute/gru_gates.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <numeric>
@@ -33,7 +34,8 @@ csrblocksparse::CacheAlignedVector<GRUStateType> TestGruGates() {
   using SampleWeightType = float;
   constexpr int kStateSize = 16;
   csrblocksparse::CacheAlignedVector<SampleWeightType> qr(6 * kStateSize);
-  csrblocksparse::CacheAlignedVector<SampleWeightType> w(3 * kStateSize);
+  // Large enough for the interleaved weights of |k4ARInputs|.
+  csrblocksparse::CacheAlignedVector<SampleWeightType> w(6 * kStateSize);
   csrblocksparse::CacheAlignedVector<InputType> gru_gates(3 * kStateSize);
   csrblocksparse::CacheAlignedVector<InputType> gru_other_gates(3 * kStateSize);
   csrblocksparse::CacheAlignedVector<InputType> conditioning(3 * kStateSize);
@@ -41,7 +43,8 @@ csrblocksparse::CacheAlignedVector<GRUStateType> TestGruGates() {
   csrblocksparse::GruGates<GRUStateType, InputType, SampleType> gru_gates_impl;
   const SampleType kCoarseAtSMinus1(0.03f);
   const SampleType kFineAtSMinus1(0.07f);
-  const SampleType kCoarseAtS(-0.02f);
+  // Only the first is used unless |kInputsMode| is |k4ARInputs|.
+  const SampleType kCoarseAtS[2] = {SampleType(-0.02f), SampleType(0.05f)};
 
   qr.FillOnes();
   w.FillOnes();
@@ -54,7 +57,7 @@ csrblocksparse::CacheAlignedVector<GRUStateType> TestGruGates() {
       /*start=*/0, /*end=*/kStateSize, kStateSize, gru_gates.data(),
       conditioning.data(), gru_h.data(), &kCoarseAtSMinus1, &kFineAtSMinus1,
       qr.data(),
-      /*num_replicas=*/1, /*replica_stride=*/0, &kCoarseAtS, w.data(),
+      /*num_replicas=*/1, /*replica_stride=*/0, kCoarseAtS, w.data(),
       gru_other_gates.data());
   return gru_h;
 }
@@ -107,6 +110,94 @@ TEST(GruGates, FloatTwoArInputsNonSplitGateMatchesGolden) {
   }
 }
 
+TEST(GruGates, FloatMatchesGenericWithTailRowsAndReplicas) {
+  // 40 rows leave a tail behind any SIMD width, and every replica must receive
+  // the same new state.
+  constexpr int kStateSize = 40;
+#if defined __AVX2__
+  constexpr int kNumReplicas = 2;
+#else
+  // Only the AVX2 kernels write replicas.
+  constexpr int kNumReplicas = 1;
+#endif  // __AVX2__
+  csrblocksparse::CacheAlignedVector<float> qr(6 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> w(3 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> gru_gates(3 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> gru_other_gates(3 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> conditioning(3 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> gru_h(kNumReplicas * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> expected_h(kStateSize);
+  const float kCoarseAtSMinus1 = 0.03f;
+  const float kFineAtSMinus1 = 0.07f;
+  const float kCoarseAtS = -0.02f;
+  qr.FillRandom();
+  w.FillRandom();
+  gru_gates.FillRandom();
+  gru_other_gates.FillRandom();
+  conditioning.FillRandom();
+  gru_h.FillRandom();
+  std::copy(gru_h.data(), gru_h.data() + kStateSize, expected_h.data());
+
+  csrblocksparse::GoThroughGates<float, float, float, float,
+                                 ARInputsMode::k3ARInputs,
+                                 /*SplitGates=*/true>(
+      /*start=*/0, /*end=*/kStateSize, qr.data(), gru_gates.data(),
+      gru_other_gates.data(), conditioning.data(), expected_h.data(), w.data(),
+      kStateSize, &kCoarseAtSMinus1, &kFineAtSMinus1, &kCoarseAtS);
+  csrblocksparse::GruGates<float, float, float> gru_gates_impl;
+  gru_gates_impl.GruWithARInput<ARInputsMode::k3ARInputs,
+                                /*kSplitGates=*/true>(
+      /*start=*/0, /*end=*/kStateSize, kStateSize, gru_gates.data(),
+      conditioning.data(), gru_h.data(), &kCoarseAtSMinus1, &kFineAtSMinus1,
+      qr.data(), kNumReplicas, /*replica_stride=*/kStateSize, &kCoarseAtS,
+      w.data(), gru_other_gates.data());
+
+  for (int r = 0; r < kNumReplicas; ++r) {
+    for (int i = 0; i < kStateSize; ++i) {
+      EXPECT_NEAR(expected_h[i], gru_h[r * kStateSize + i], 1e-4)
+          << "replica=" << r << " i=" << i;
+    }
+  }
+}
+
+TEST(GruGates, FloatFourArInputsMatchesInputWithArSummedIn) {
+  constexpr int kStateSize = 40;
+  csrblocksparse::CacheAlignedVector<float> ar_01_weights(6 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> ar_23_weights(6 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> gru_gates(3 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> conditioning(3 * kStateSize);
+  csrblocksparse::CacheAlignedVector<float> gru_h(kStateSize);
+  const float kArSamples[4] = {0.03f, 0.07f, -0.02f, 0.05f};
+  ar_01_weights.FillRandom();
+  ar_23_weights.FillRandom();
+  gru_gates.FillRandom();
+  conditioning.FillRandom();
+  gru_h.FillRandom();
+
+  // The same step with the AR inputs added to the conditioning beforehand.
+  csrblocksparse::CacheAlignedVector<float> ar_and_conditioning = conditioning;
+  for (int i = 0; i < 3 * kStateSize; ++i) {
+    ar_and_conditioning[i] += ar_01_weights[2 * i] * kArSamples[0] +
+                              ar_01_weights[2 * i + 1] * kArSamples[1] +
+                              ar_23_weights[2 * i] * kArSamples[2] +
+                              ar_23_weights[2 * i + 1] * kArSamples[3];
+  }
+  csrblocksparse::CacheAlignedVector<float> expected_h = gru_h;
+  csrblocksparse::GruGates<float, float, float> gru_gates_impl;
+  gru_gates_impl.GruWithARInput<ARInputsMode::k0ARInputs>(
+      /*start=*/0, /*end=*/kStateSize, kStateSize, gru_gates.data(),
+      ar_and_conditioning.data(), expected_h.data());
+  gru_gates_impl.GruWithARInput<ARInputsMode::k4ARInputs>(
+      /*start=*/0, /*end=*/kStateSize, kStateSize, gru_gates.data(),
+      conditioning.data(), gru_h.data(), &kArSamples[0], &kArSamples[1],
+      ar_01_weights.data(), /*num_replicas=*/1, /*replica_stride=*/0,
+      &kArSamples[2], ar_23_weights.data());
+
+  for (int i = 0; i < kStateSize; ++i) {
+    EXPECT_NEAR(expected_h[i], gru_h[i], 1e-4) << "i=" << i;
+  }
+}
+
 TEST(GruGates, FixedWaveRNNCoarseMatchesFloat) {
   using GRUMatMulOutType = csrblocksparse::fixed32<11>;
   using GRUStateType = csrblocksparse::fixed16<2>;
@@ -161,4 +252,22 @@ TEST(GruGates, FixedTwoArInputsNonSplitGateMatchesFloat) {
   }
 }
 
+TEST(GruGates, FixedFourArInputsMatchesFloat) {
+  using GRUMatMulOutType = csrblocksparse::fixed32<11>;
+  using GRUStateType = csrblocksparse::fixed16<2>;
+  using SampleType = csrblocksparse::fixed16<0>;
+  csrblocksparse::CacheAlignedVector<float> float_gru_h =
+      TestGruGates<float, float, float, ARInputsMode::k4ARInputs,
+                   /*kSplitGates=*/false>();
+  csrblocksparse::CacheAlignedVector<GRUStateType> fixed_gru_h =
+      TestGruGates<GRUStateType, GRUMatMulOutType, SampleType,
+                   ARInputsMode::k4ARInputs, /*kSplitGates=*/false>();
+
+  ASSERT_EQ(float_gru_h.size(), fixed_gru_h.size());
+  for (int i = 0; i < fixed_gru_h.size(); ++i) {
+    EXPECT_NEAR(float_gru_h[i], static_cast<float>(fixed_gru_h[i]), 1e-3)
+        << "i=" << i;
+  }
+}
+
 }  // namespace
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_SPARSE_MATMUL_COMPUTE_GRU_GATES_WASM_H_
+#define LYRA_CODEC_SPARSE_MATMUL_COMPUTE_GRU_GATES_WASM_H_
+
+#if defined __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+#include <cstdint>
+#include <utility>
+
+#include "sparse_matmul/compute/ar_inputs.h"
+#include "sparse_matmul/numerics/fast_transcendentals.h"
+
+namespace csrblocksparse {
+
+static constexpr int kWasmSIMDWidth = 4;
+
+// WebAssembly SIMD128 versions of the ARM GRU gates in gru_gates_arm.h, with
+// the same arguments and the same calculation. See "Efficient Neural Audio
+// Synthesis" for a description of the calculation.
+// https://arxiv.org/abs/1802.08435
+//
+// NOTE:
+// |sample| = (|coarse_at_sminus1|, |fine_at_sminus1|,
+//             |coarse_at_sminus1|, |fine_at_sminus1|)
+// |w_sample| = (|coarse_at_s|, |coarse_at_s|, |coarse_at_s|, |coarse_at_s|)
+// or with |k4ARInputs|, where |coarse_at_s| points to samples 2 and 3 and
+// |w_hat| is interleaved like |qr_ptr|:
+// |w_sample| = (|coarse_at_s[0]|, |coarse_at_s[1]|,
+//               |coarse_at_s[0]|, |coarse_at_s[1]|)
+#if defined __wasm_simd128__
+
+// Returns (a0 + a1, a2 + a3, b0 + b1, b2 + b3), as vpaddq_f32 on ARM.
+inline v128_t PairwiseAdd(v128_t a, v128_t b) {
+  return wasm_f32x4_add(wasm_i32x4_shuffle(a, b, 0, 2, 4, 6),
+                        wasm_i32x4_shuffle(a, b, 1, 3, 5, 7));
+}
+
+// Computes the products of the interleaved QR weights at |qr_ptr| with
+// |sample| for the reset, update and cell gates, two rows at a time, and adds
+// |w_hat| times |w_sample| if |kInputsMode| is |k3ARInputs|, or the products of
+// the interleaved |w_hat| with |w_sample| if it is |k4ARInputs|.
+template <ARInputsMode kInputsMode>
+inline void ComputeQRGates(const float* qr_ptr, const float* w_hat,
+                           int proj_size, v128_t sample, v128_t w_sample,
+                           v128_t* qr_reset, v128_t* qr_update,
+                           v128_t* qr_cell) {
+  *qr_reset = PairwiseAdd(wasm_f32x4_mul(wasm_v128_load(qr_ptr), sample),
+                          wasm_f32x4_mul(wasm_v128_load(qr_ptr + 4), sample));
+  *qr_update = PairwiseAdd(
+      wasm_f32x4_mul(wasm_v128_load(qr_ptr + 2 * proj_size), sample),
+      wasm_f32x4_mul(wasm_v128_load(qr_ptr + 4 + 2 * proj_size), sample));
+  *qr_cell = PairwiseAdd(
+      wasm_f32x4_mul(wasm_v128_load(qr_ptr + 4 * proj_size), sample),
+      wasm_f32x4_mul(wasm_v128_load(qr_ptr + 4 + 4 * proj_size), sample));
+  if (kInputsMode == ARInputsMode::k3ARInputs) {
+    *qr_reset = MultiplyAdd(*qr_reset, wasm_v128_load(w_hat), w_sample);
+    *qr_update =
+        MultiplyAdd(*qr_update, wasm_v128_load(w_hat + proj_size), w_sample);
+    *qr_cell =
+        MultiplyAdd(*qr_cell, wasm_v128_load(w_hat + 2 * proj_size), w_sample);
+  } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+    *qr_reset = wasm_f32x4_add(
+        *qr_reset,
+        PairwiseAdd(wasm_f32x4_mul(wasm_v128_load(w_hat), w_sample),
+                    wasm_f32x4_mul(wasm_v128_load(w_hat + 4), w_sample)));
+    *qr_update = wasm_f32x4_add(
+        *qr_update,
+        PairwiseAdd(
+            wasm_f32x4_mul(wasm_v128_load(w_hat + 2 * proj_size), w_sample),
+            wasm_f32x4_mul(wasm_v128_load(w_hat + 4 + 2 * proj_size),
+                           w_sample)));
+    *qr_cell = wasm_f32x4_add(
+        *qr_cell,
+        PairwiseAdd(
+            wasm_f32x4_mul(wasm_v128_load(w_hat + 4 * proj_size), w_sample),
+            wasm_f32x4_mul(wasm_v128_load(w_hat + 4 + 4 * proj_size),
+                           w_sample)));
+  }
+}
+
+template <ARInputsMode kInputsMode, bool SplitGates>
+void GoThroughGatesFloat(int start, int end, const float* qr_ptr,
+                         const float* gru_gates_ptr,
+                         const float* gru_gates_other_ptr,
+                         const float* conditioning_ptr, float* gru_h_ptr,
+                         const float* w_hat, int proj_size,
+                         const float* coarse_at_sminus1,
+                         const float* fine_at_sminus1,
+                         const float* coarse_at_s) {
+  // Increment all the pointers to save on pointer arithmetic in the loop.
+  conditioning_ptr += start;
+  gru_h_ptr += start;
+  gru_gates_ptr += start;
+  if (SplitGates) gru_gates_other_ptr += start;
+  v128_t sample = wasm_f32x4_splat(0.f);
+  v128_t w_sample = wasm_f32x4_splat(0.f);
+  if (kInputsMode != ARInputsMode::k0ARInputs) {
+    qr_ptr += 2 * start;
+    sample = wasm_f32x4_make(*coarse_at_sminus1, *fine_at_sminus1,
+                             *coarse_at_sminus1, *fine_at_sminus1);
+    if (kInputsMode == ARInputsMode::k3ARInputs) {
+      w_hat += start;
+      w_sample = wasm_f32x4_splat(*coarse_at_s);
+    } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+      w_hat += 2 * start;
+      w_sample = wasm_f32x4_make(coarse_at_s[0], coarse_at_s[1],
+                                 coarse_at_s[0], coarse_at_s[1]);
+    }
+  }
+  for (int i = start; i < end; i += kWasmSIMDWidth) {
+    v128_t reset = wasm_v128_load(gru_gates_ptr);
+    v128_t update = wasm_v128_load(gru_gates_ptr + proj_size);
+    v128_t cell = wasm_v128_load(gru_gates_ptr + 2 * proj_size);
+    v128_t qr_cell;
+    if (SplitGates) {
+      reset = wasm_f32x4_add(reset, wasm_v128_load(gru_gates_other_ptr));
+      update = wasm_f32x4_add(
+          update, wasm_v128_load(gru_gates_other_ptr + proj_size));
+      cell = wasm_f32x4_add(
+          cell, wasm_v128_load(gru_gates_other_ptr + 2 * proj_size));
+    }
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
+      v128_t qr_reset, qr_update;
+      ComputeQRGates<kInputsMode>(qr_ptr, w_hat, proj_size, sample, w_sample,
+                                  &qr_reset, &qr_update, &qr_cell);
+      reset = wasm_f32x4_add(reset, qr_reset);
+      update = wasm_f32x4_add(update, qr_update);
+    }
+    v128_t reset_conditioning = wasm_v128_load(conditioning_ptr);
+    v128_t update_conditioning = wasm_v128_load(conditioning_ptr + proj_size);
+    v128_t cell_conditioning = wasm_v128_load(conditioning_ptr + 2 * proj_size);
+
+    reset = fast_sigmoid(wasm_f32x4_add(reset, reset_conditioning));
+    update = fast_sigmoid(wasm_f32x4_add(update, update_conditioning));
+    if (kInputsMode == ARInputsMode::k0ARInputs) {
+      cell = wasm_f32x4_mul(reset, cell);
+    } else {
+      cell = MultiplyAdd(qr_cell, reset, cell);
+    }
+    v128_t hbar = fast_tanh(wasm_f32x4_add(cell, cell_conditioning));
+
+    v128_t prev_h = wasm_v128_load(gru_h_ptr);
+    v128_t diff = wasm_f32x4_sub(prev_h, hbar);
+    v128_t new_h = MultiplyAdd(hbar, diff, update);
+
+    wasm_v128_store(gru_h_ptr, new_h);
+    // Increment all the pointers.
+    conditioning_ptr += kWasmSIMDWidth;
+    gru_h_ptr += kWasmSIMDWidth;
+    gru_gates_ptr += kWasmSIMDWidth;
+    if (SplitGates) gru_gates_other_ptr += kWasmSIMDWidth;
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
+      qr_ptr += 2 * kWasmSIMDWidth;
+      if (kInputsMode == ARInputsMode::k3ARInputs) w_hat += kWasmSIMDWidth;
+      if (kInputsMode == ARInputsMode::k4ARInputs) w_hat += 2 * kWasmSIMDWidth;
+    }
+  }
+}
+
+// Converts 4 fixed point values with |kMantissaBits| in int32 lanes to float.
+template <int kMantissaBits>
+inline v128_t FixedToFloat(v128_t x) {
+  return wasm_f32x4_mul(wasm_f32x4_convert_i32x4(x),
+                        wasm_f32x4_splat(1.f / (1LL << kMantissaBits)));
+}
+
+// Converts 4 floats to fixed point with |kMantissaBits| in int32 lanes,
+// truncating towards zero and saturating like vcvtq_n_s32_f32.
+template <int kMantissaBits>
+inline v128_t FloatToFixed(v128_t x) {
+  return wasm_i32x4_trunc_sat_f32x4(
+      wasm_f32x4_mul(x, wasm_f32x4_splat(static_cast<float>(
+                            1LL << kMantissaBits))));
+}
+
+// This version should only be used if all of the 32-bit fixed point
+// representations have the same number of mantissa bits.
+// |ar_at_sminus1| packs sample 0 and 1 into a pair because the QR weights are
+// formatted with the weights interleaved for sample 0 and 1. The two samples
+// represent coarse and fine for WaveRNN.
+template <typename GRUStateType, typename GRUMatMulOutType,
+          ARInputsMode kInputsMode, bool SplitGates>
+void GoThroughGatesFixed(int start, int end, const float* qr_ptr,
+                         const int32_t* gru_gates_ptr,
+                         const int32_t* gru_gates_other_ptr,
+                         const int32_t* conditioning_ptr, int16_t* gru_h_ptr,
+                         const float* w_hat, int proj_size,
+                         const std::pair<float, float>* ar_at_sminus1,
+                         const float* coarse_at_s) {
+  constexpr int kInputMantissaBits = GRUMatMulOutType::kMantissaBits;
+  constexpr int kStateMantissaBits = GRUStateType::kMantissaBits;
+  // Increment all the pointers to save on pointer arithmetic in the loop.
+  conditioning_ptr += start;
+  gru_h_ptr += start;
+  gru_gates_ptr += start;
+  if (SplitGates) gru_gates_other_ptr += start;
+  v128_t sample01 = wasm_f32x4_splat(0.f);
+  v128_t w_sample = wasm_f32x4_splat(0.f);
+  if (kInputsMode != ARInputsMode::k0ARInputs) {
+    qr_ptr += 2 * start;
+    sample01 = wasm_f32x4_make(ar_at_sminus1->first, ar_at_sminus1->second,
+                               ar_at_sminus1->first, ar_at_sminus1->second);
+    if (kInputsMode == ARInputsMode::k3ARInputs) {
+      w_hat += start;
+      w_sample = wasm_f32x4_splat(*coarse_at_s);
+    } else if (kInputsMode == ARInputsMode::k4ARInputs) {
+      w_hat += 2 * start;
+      w_sample = wasm_f32x4_make(coarse_at_s[0], coarse_at_s[1],
+                                 coarse_at_s[0], coarse_at_s[1]);
+    }
+  }
+  for (int i = start; i < end; i += kWasmSIMDWidth) {
+    v128_t reset = wasm_v128_load(gru_gates_ptr);
+    v128_t update = wasm_v128_load(gru_gates_ptr + proj_size);
+    v128_t cell_int = wasm_v128_load(gru_gates_ptr + 2 * proj_size);
+    if (SplitGates) {
+      reset = wasm_i32x4_add(reset, wasm_v128_load(gru_gates_other_ptr));
+      update = wasm_i32x4_add(
+          update, wasm_v128_load(gru_gates_other_ptr + proj_size));
+      cell_int = wasm_i32x4_add(
+          cell_int, wasm_v128_load(gru_gates_other_ptr + 2 * proj_size));
+    }
+    v128_t cell = FixedToFloat<kInputMantissaBits>(cell_int);
+    v128_t qr_cell;
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
+      v128_t qr_reset, qr_update;
+      ComputeQRGates<kInputsMode>(qr_ptr, w_hat, proj_size, sample01,
+                                  w_sample, &qr_reset, &qr_update, &qr_cell);
+      reset = wasm_i32x4_add(reset, FloatToFixed<kInputMantissaBits>(qr_reset));
+      update =
+          wasm_i32x4_add(update, FloatToFixed<kInputMantissaBits>(qr_update));
+    }
+
+    v128_t reset_conditioning = wasm_v128_load(conditioning_ptr);
+    v128_t update_conditioning = wasm_v128_load(conditioning_ptr + proj_size);
+    v128_t cell_conditioning = FixedToFloat<kInputMantissaBits>(
+        wasm_v128_load(conditioning_ptr + 2 * proj_size));
+
+    v128_t reset_f32 = fast_sigmoid<GRUMatMulOutType::kExponentBits>(
+        wasm_i32x4_add(reset, reset_conditioning));
+    v128_t update_f32 = fast_sigmoid<GRUMatMulOutType::kExponentBits>(
+        wasm_i32x4_add(update, update_conditioning));
+    if (kInputsMode == ARInputsMode::k0ARInputs) {
+      cell = wasm_f32x4_mul(reset_f32, cell);
+    } else {
+      cell = MultiplyAdd(qr_cell, reset_f32, cell);
+    }
+    v128_t hbar = fast_tanh(wasm_f32x4_add(cell, cell_conditioning));
+
+    v128_t prev_h = FixedToFloat<kStateMantissaBits>(
+        wasm_i32x4_load16x4(gru_h_ptr));
+    v128_t diff = wasm_f32x4_sub(prev_h, hbar);
+    v128_t new_h = MultiplyAdd(hbar, diff, update_f32);
+
+    // Round to the nearest fixed16 value and narrow with saturation, as
+    // vqrshrn_n_s32 does on ARM, then store the bottom 64 bits.
+    v128_t new_h_int = wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_nearest(
+        wasm_f32x4_mul(new_h, wasm_f32x4_splat(static_cast<float>(
+                                  1 << kStateMantissaBits)))));
+    *reinterpret_cast<int64_t*>(gru_h_ptr) = wasm_i64x2_extract_lane(
+        wasm_i16x8_narrow_i32x4(new_h_int, new_h_int), 0);
+    // Increment all the pointers.
+    conditioning_ptr += kWasmSIMDWidth;
+    gru_h_ptr += kWasmSIMDWidth;
+    gru_gates_ptr += kWasmSIMDWidth;
+    if (SplitGates) gru_gates_other_ptr += kWasmSIMDWidth;
+    if (kInputsMode != ARInputsMode::k0ARInputs) {
+      qr_ptr += 2 * kWasmSIMDWidth;
+      if (kInputsMode == ARInputsMode::k3ARInputs) w_hat += kWasmSIMDWidth;
+      if (kInputsMode == ARInputsMode::k4ARInputs) w_hat += 2 * kWasmSIMDWidth;
+    }
+  }
+}
+#endif  // defined __wasm_simd128__
+
+}  // namespace csrblocksparse
+
+#endif  // LYRA_CODEC_SPARSE_MATMUL_COMPUTE_GRU_GATES_WASM_H_
@@ -30,7 +30,9 @@
 #include "sparse_matmul/compute/kernels_arm.h"
 #elif defined __AVX__
 #include "sparse_matmul/compute/kernels_avx.h"
-#else   // defined __AVX__
+#elif defined __wasm_simd128__
+#include "sparse_matmul/compute/kernels_wasm.h"
+#else   // defined __wasm_simd128__
 // If there is no architecture-specific implementation, then always use generic.
 template <typename WeightType, typename RhsType, typename OutType>
 struct ShouldEnableGenericSpMV_4x4 : std::true_type {};
@@ -137,16 +139,17 @@ SpMM5_4x4(const WeightType* weights_ptr, const int16_t* col_deltas_bytes,
       int col_delta = *col_deltas_bytes++ / sizeof(RhsType);
       for (int k = 0; k < 5; ++k) rhs_ptrs[k] += col_delta;
 
-      // multiply this 4x4 block
-      for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-          for (int k = 0; k < 5; ++k) {
-            accumulators[i][k] += static_cast<float>(*weights_ptr) *
+      // Multiply this 4x4 block by each column in turn, which sums in the
+      // same order as SpMV_4x4 and keeps the block in registers.
+      for (int k = 0; k < 5; ++k) {
+        for (int i = 0; i < 4; ++i) {
+          for (int j = 0; j < 4; ++j) {
+            accumulators[i][k] += static_cast<float>(weights_ptr[i * 4 + j]) *
                                   static_cast<float>(rhs_ptrs[k][j]);
           }
-          weights_ptr++;
         }
       }
+      weights_ptr += 16;
     }
 
     for (int k = 0; k < 5; ++k) {
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_SPARSE_MATMUL_COMPUTE_KERNELS_WASM_H_
+#define LYRA_CODEC_SPARSE_MATMUL_COMPUTE_KERNELS_WASM_H_
+
+#if defined __wasm_simd128__
+#include <wasm_simd128.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "sparse_matmul/numerics/fixed_types.h"
+#include "sparse_matmul/numerics/float16_types.h"
+#include "sparse_matmul/numerics/type_utils.h"
+
+namespace csrblocksparse {
+namespace detail {
+
+template <typename WeightType, typename RhsType, typename OutType>
+struct IsAllowableFloatTypes
+    : std::integral_constant<bool, std::is_same<WeightType, float>::value &&
+                                       std::is_same<RhsType, float>::value &&
+                                       std::is_same<OutType, float>::value> {};
+
+// 16-bit inputs, 32-bit output exponent matches sum of input exponents
+// OR
+// 16-bit inputs, 16-bit output - will shift to match exponent
+template <typename WeightType, typename RhsType, typename OutType>
+struct IsAllowableFixedTypes
+    : std::integral_constant<bool, (IsFixed16Type<WeightType>::value &&
+                                    IsFixed16Type<RhsType>::value) &&
+                                       (IsFixed32Type<OutType>::value ||
+                                        IsFixed16Type<OutType>::value)> {};
+
+template <typename WeightType, typename RhsType, typename OutType>
+struct ShouldEnableGenericKernel
+    : std::integral_constant<
+          bool,
+          !IsAllowableFloatTypes<WeightType, RhsType, OutType>::value &&
+              !IsAllowableFixedTypes<WeightType, RhsType, OutType>::value> {};
+
+template <typename Type>
+struct IsAddableFixedTypes
+    : std::integral_constant<bool, IsFixed32Type<Type>::value ||
+                                       IsFixed16Type<Type>::value> {};
+template <typename Type>
+struct ShouldEnableGenericAdd
+    : std::integral_constant<bool, !IsAddableFixedTypes<Type>::value> {};
+
+template <typename WeightType, typename RhsType, typename OutType>
+struct ShouldEnableGenericSpMV_4x4
+    : ShouldEnableGenericKernel<WeightType, RhsType, OutType> {};
+template <typename WeightType, typename RhsType, typename OutType>
+struct ShouldEnableGenericSpMM5_4x4
+    : ShouldEnableGenericKernel<WeightType, RhsType, OutType> {};
+template <typename WeightType, typename RhsType, typename OutType>
+struct ShouldEnableGenericSpMV_1x1 : std::true_type {};
+template <typename WeightType, typename RhsType, typename OutType>
+struct ShouldEnableGenericSpMM5_1x1 : std::true_type {};
+
+// The computational routines do NO error checking for speed.  It is assumed
+// that this has been handled by CSRBlockSparseMatrix.
+//
+// WebAssembly SIMD has 128 bit registers only, and no horizontal add. Each of
+// the 4 rows of a block is accumulated lane-wise in its own register, and the
+// 4 registers are reduced with a transpose at the end of the block row.
+
+// In-line function to reduce the per-row partial sums in |sum0| to |sum3| to
+// [|res0|, |res1|, |res2|, |res3|] and store them in memory.
+inline void Extract4Results(bool relu, v128_t sum0, v128_t sum1, v128_t sum2,
+                            v128_t sum3, float** out_ptr) {
+  // [00 10 01 11] and [02 12 03 13], where ij is lane j of row i.
+  v128_t sum01_lo = wasm_i32x4_shuffle(sum0, sum1, 0, 4, 1, 5);
+  v128_t sum01_hi = wasm_i32x4_shuffle(sum0, sum1, 2, 6, 3, 7);
+  v128_t sum23_lo = wasm_i32x4_shuffle(sum2, sum3, 0, 4, 1, 5);
+  v128_t sum23_hi = wasm_i32x4_shuffle(sum2, sum3, 2, 6, 3, 7);
+  // Lanes 0 and 1 of each row, then lanes 2 and 3, in row order.
+  v128_t sum01 = wasm_f32x4_add(sum01_lo, sum01_hi);
+  v128_t sum23 = wasm_f32x4_add(sum23_lo, sum23_hi);
+  v128_t result =
+      wasm_f32x4_add(wasm_i32x4_shuffle(sum01, sum23, 0, 1, 4, 5),
+                     wasm_i32x4_shuffle(sum01, sum23, 2, 3, 6, 7));
+  if (relu) {
+    result = wasm_f32x4_max(result, wasm_f32x4_splat(0.f));
+  }
+  wasm_v128_store(*out_ptr, result);
+  *out_ptr += 4;
+}
+
+// Performs the calculation y = A * x + b where A is a sparse matrix with a 4x4
+// blocked pattern, x is a vector and b is vector. Weights are stored for this
+// routine by making each 4x4 block contiguous. Blocks are ordered in standard
+// row-major format. column indices are converted to deltas and then multiplied
+// by 2 to convert to bytes, so that the value can be used directly to offset
+// the pointer into the rhs vector.
+//
+// NOTE: The bias is expected to have be multiplied by .25f prior to calling
+// this function.  This is automatically taken care of in SparseLinearLayer.
+// The bias is reconstructed by the sum over the 4 lanes of each row.
+template <typename WeightType, typename RhsType, typename OutType>
+typename std::enable_if<std::is_same<WeightType, float>::value &&
+                        std::is_same<RhsType, float>::value &&
+                        std::is_same<OutType, float>::value>::type
+SpMV_4x4(const WeightType* weights_ptr, const int16_t* col_deltas_bytes,
+         const int32_t* nnz_per_row, const RhsType* rhs_ptr,
+         const typename TypeOfProduct<WeightType, RhsType>::type* bias_ptr,
+         OutType* out_ptr, int64_t assigned_rows,
+         int64_t rows /* only used in SpMM variants */,
+         int64_t cols /* only used in SpMM variants */, int relu) {
+  for (int reduced_row = 0; reduced_row < assigned_rows; ++reduced_row) {
+    // Broadcast the biases by 4 to undo the division by 4 in the input biases.
+    v128_t sum0 = wasm_f32x4_splat(bias_ptr[0]);
+    v128_t sum1 = wasm_f32x4_splat(bias_ptr[1]);
+    v128_t sum2 = wasm_f32x4_splat(bias_ptr[2]);
+    v128_t sum3 = wasm_f32x4_splat(bias_ptr[3]);
+    bias_ptr += 4;
+
+    int reduced_col_count = *nnz_per_row++;
+    for (int c = 0; c < reduced_col_count; ++c) {
+      int col_delta = *col_deltas_bytes++ / sizeof(RhsType);
+      rhs_ptr += col_delta;
+      // Multiply this 4x4 block.
+      v128_t rhs = wasm_v128_load(rhs_ptr);
+      sum0 = wasm_f32x4_add(sum0,
+                            wasm_f32x4_mul(wasm_v128_load(weights_ptr), rhs));
+      sum1 = wasm_f32x4_add(
+          sum1, wasm_f32x4_mul(wasm_v128_load(weights_ptr + 4), rhs));
+      sum2 = wasm_f32x4_add(
+          sum2, wasm_f32x4_mul(wasm_v128_load(weights_ptr + 8), rhs));
+      sum3 = wasm_f32x4_add(
+          sum3, wasm_f32x4_mul(wasm_v128_load(weights_ptr + 12), rhs));
+      weights_ptr += 16;
+    }
+    Extract4Results(relu, sum0, sum1, sum2, sum3, &out_ptr);
+  }
+}
+
+// Performs the calculation y = A * x + b where A is a sparse matrix with a 4x4
+// blocked pattern, x is a fat vector with 5 columns and b is vector. b is
+// broadcast. Weights are stored for this routine by making each 4x4 block
+// contiguous. Blocks are ordered in standard row-major format. column indices
+// are converted to deltas and then multiplied by 2 to convert to bytes, so
+// that the value can be used directly to offset the pointer into the rhs
+// vector.
+//
+// NOTE: The bias is expected to have be multiplied by .25f prior to calling
+// this function.  This is automatically taken care of in SparseLinearLayer.
+// The bias is reconstructed by the sum over the 4 lanes of each row.
+template <typename WeightType, typename RhsType, typename OutType>
+typename std::enable_if<std::is_same<WeightType, float>::value &&
+                        std::is_same<RhsType, float>::value &&
+                        std::is_same<OutType, float>::value>::type
+SpMM5_4x4(const WeightType* weights_ptr, const int16_t* col_deltas_bytes,
+          const int32_t* nnz_per_row, const RhsType* rhs_ptr,
+          const typename TypeOfProduct<WeightType, RhsType>::type* bias_ptr,
+          OutType* out_ptr, int64_t assigned_rows, int64_t rows, int64_t cols,
+          int relu) {
+  const RhsType* rhs_ptrs[5];
+  for (int i = 0; i < 5; ++i) rhs_ptrs[i] = rhs_ptr + i * cols;
+
+  OutType* out_ptrs[5];
+  for (int i = 0; i < 5; ++i) out_ptrs[i] = out_ptr + i * rows;
+
+  for (int reduced_row = 0; reduced_row < assigned_rows; ++reduced_row) {
+    // We will acumulate the results in 20 registers, 4 rows by 5 columns.
+    // Broadcast the biases by 4 to undo the division by 4 in the input biases.
+    v128_t sums[5][4];
+    for (int i = 0; i < 4; ++i) {
+      sums[0][i] = wasm_f32x4_splat(bias_ptr[i]);
+      for (int k = 1; k < 5; ++k) sums[k][i] = sums[0][i];
+    }
+    bias_ptr += 4;
+
+    int reduced_col_count = *nnz_per_row++;
+    for (int c = 0; c < reduced_col_count; ++c) {
+      int col_delta = *col_deltas_bytes++ / sizeof(RhsType);
+      for (int k = 0; k < 5; ++k) rhs_ptrs[k] += col_delta;
+
+      // Multiply this 4x4 block.
+      v128_t weights[4];
+      for (int i = 0; i < 4; ++i) {
+        weights[i] = wasm_v128_load(weights_ptr + 4 * i);
+      }
+      weights_ptr += 16;
+      for (int k = 0; k < 5; ++k) {
+        v128_t rhs = wasm_v128_load(rhs_ptrs[k]);
+        for (int i = 0; i < 4; ++i) {
+          sums[k][i] =
+              wasm_f32x4_add(sums[k][i], wasm_f32x4_mul(weights[i], rhs));
+        }
+      }
+    }
+
+    for (int k = 0; k < 5; ++k) {
+      Extract4Results(relu, sums[k][0], sums[k][1], sums[k][2], sums[k][3],
+                      &out_ptrs[k]);
+    }
+  }
+}
+
+// In-line function to load 4 int32 biases as the initial value of the two
+// accumulators of a fixed point block row: [2b0 2b0 2b1 2b1] and
+// [2b2 2b2 2b3 2b3]. Each row is later reconstructed from 2 lanes, so the
+// doubling makes up for the division by 4.
+inline void LoadFixedBiases(const int32_t* bias_ptr, v128_t* sum01,
+                            v128_t* sum23) {
+  v128_t bias = wasm_v128_load(bias_ptr);
+  bias = wasm_i32x4_add(bias, bias);
+  *sum01 = wasm_i32x4_shuffle(bias, bias, 0, 0, 1, 1);
+  *sum23 = wasm_i32x4_shuffle(bias, bias, 2, 2, 3, 3);
+}
+
+// In-line function to multiply the 4x4 int16 block at |weights_ptr| by the 4
+// int16 at |rhs_ptr| and add the pairwise sums to |sum01| and |sum23|.
+inline void MultiplyFixedBlock(const int16_t* weights_ptr,
+                               const int16_t* rhs_ptr, v128_t* sum01,
+                               v128_t* sum23) {
+  // Broadcast the rhs, pretending that it is a 64-bit unit: [0123 0123].
+  v128_t rhs = wasm_v128_load64_splat(rhs_ptr);
+  // |wasm_i32x4_dot_i16x8| does 8x16x16=8x32 bit multiply and horizontally
+  // adds adjacent pairs to make 4x32 bit results, 2 per row.
+  *sum01 = wasm_i32x4_add(
+      *sum01, wasm_i32x4_dot_i16x8(wasm_v128_load(weights_ptr), rhs));
+  *sum23 = wasm_i32x4_add(
+      *sum23, wasm_i32x4_dot_i16x8(wasm_v128_load(weights_ptr + 8), rhs));
+}
+
+// In-line function to finish the computation of the result as 4x int32 from
+// the pairwise sums in |sum01| and |sum23|.
+inline v128_t Compute4Results(bool relu, int kShiftAmount, v128_t sum01,
+                              v128_t sum23) {
+  v128_t sum = wasm_i32x4_add(wasm_i32x4_shuffle(sum01, sum23, 0, 2, 4, 6),
+                              wasm_i32x4_shuffle(sum01, sum23, 1, 3, 5, 7));
+  if (kShiftAmount > 0) {
+    // Shift right with rounding to get the right number of mantissa bits.
+    sum = wasm_i32x4_add(sum, wasm_i32x4_splat(1 << (kShiftAmount - 1)));
+    sum = wasm_i32x4_shr(sum, kShiftAmount);
+  }
+  if (relu) {
+    sum = wasm_i32x4_max(sum, wasm_i32x4_splat(0));
+  }
+  return sum;
+}
+
+// In-line function to store the 4 results as int32 or, with saturation, as
+// int16.
+inline void Extract4xint32(bool relu, int kShiftAmount, v128_t sum01,
+                           v128_t sum23, int32_t** out_ptr) {
+  wasm_v128_store(*out_ptr, Compute4Results(relu, kShiftAmount, sum01, sum23));
+  *out_ptr += 4;
+}
+
+inline void Extract4xint16(bool relu, int kShiftAmount, v128_t sum01,
+                           v128_t sum23, int16_t** out_ptr) {
+  v128_t sum = Compute4Results(relu, kShiftAmount, sum01, sum23);
+  // Save 4x int16 from the bottom 64 bits.
+  sum = wasm_i16x8_narrow_i32x4(sum, sum);
+  *reinterpret_cast<int64_t*>(*out_ptr) = wasm_i64x2_extract_lane(sum, 0);
+  *out_ptr += 4;
+}
+
+// Performs the calculation y = A * x + b where A is a sparse matrix with a 4x4
+// blocked pattern, x is a vector and b is vector. Weights are stored for this
+// routine by making each 4x4 block contiguous. Blocks are ordered in standard
+// row-major format. column indices are converted to deltas and then multiplied
+// by 2 to convert to bytes, so that the value can be used directly to offset
+// the pointer into the rhs vector.
+//
+// NOTE: The bias is expected to have be multiplied by .25f prior to calling
+// this function.  This is automatically taken care of in SparseLinearLayer.
+template <typename WeightType, typename RhsType, typename OutType>
+typename std::enable_if<
+    IsFixed16Type<WeightType>::value && IsFixed16Type<RhsType>::value &&
+    (IsFixed32Type<OutType>::value || IsFixed16Type<OutType>::value)>::type
+SpMV_4x4(const WeightType* weights_ptr, const int16_t* col_deltas_bytes,
+         const int32_t* nnz_per_row, const RhsType* rhs_ptr,
+         const typename TypeOfProduct<WeightType, RhsType>::type* bias_ptr,
+         OutType* out_ptr, int64_t assigned_rows,
+         int64_t rows /* only used in SpMM variants */,
+         int64_t cols /* only used in SpMM variants */, int relu) {
+  constexpr int kShiftAmount =
+      TypeOfProduct<WeightType, RhsType>::type::kMantissaBits -
+      OutType::kMantissaBits;
+  static_assert(kShiftAmount >= 0,
+                "Result must have fewer mantissa bits than product");
+  for (int reduced_row = 0; reduced_row < assigned_rows; ++reduced_row) {
+    v128_t sum01, sum23;
+    LoadFixedBiases(reinterpret_cast<const int32_t*>(bias_ptr), &sum01,
+                    &sum23);
+    bias_ptr += 4;
+
+    int reduced_col_count = *nnz_per_row++;
+    for (int c = 0; c < reduced_col_count; ++c) {
+      int col_delta = *col_deltas_bytes++ / sizeof(RhsType);
+      rhs_ptr += col_delta;
+      MultiplyFixedBlock(reinterpret_cast<const int16_t*>(weights_ptr),
+                         reinterpret_cast<const int16_t*>(rhs_ptr), &sum01,
+                         &sum23);
+      weights_ptr += 16;
+    }
+    if (IsFixed32Type<OutType>::value) {
+      Extract4xint32(relu, kShiftAmount, sum01, sum23,
+                     reinterpret_cast<int32_t**>(&out_ptr));
+    } else {
+      Extract4xint16(relu, kShiftAmount, sum01, sum23,
+                     reinterpret_cast<int16_t**>(&out_ptr));
+    }
+  }
+}
+
+// Performs the calculation y = A * x + b where A is a sparse matrix with a 4x4
+// blocked pattern, x is a fat vector with 5 columns and b is vector. b is
+// broadcast. Weights are stored for this routine by making each 4x4 block
+// contiguous. Blocks are ordered in standard row-major format. column indices
+// are converted to deltas and then multiplied by 2 to convert to bytes, so
+// that the value can be used directly to offset the pointer into the rhs
+// vector.
+//
+// NOTE: The bias is expected to have be multiplied by .25f prior to calling
+// this function.  This is automatically taken care of in SparseLinearLayer.
+template <typename WeightType, typename RhsType, typename OutType>
+typename std::enable_if<
+    IsFixed16Type<WeightType>::value && IsFixed16Type<RhsType>::value &&
+    (IsFixed32Type<OutType>::value || IsFixed16Type<OutType>::value)>::type
+SpMM5_4x4(const WeightType* weights_ptr, const int16_t* col_deltas_bytes,
+          const int32_t* nnz_per_row, const RhsType* rhs_ptr,
+          const typename TypeOfProduct<WeightType, RhsType>::type* bias_ptr,
+          OutType* out_ptr, int64_t assigned_rows, int64_t rows, int64_t cols,
+          int relu) {
+  constexpr int kShiftAmount =
+      TypeOfProduct<WeightType, RhsType>::type::kMantissaBits -
+      OutType::kMantissaBits;
+  static_assert(kShiftAmount >= 0,
+                "Result must have fewer mantissa bits than product");
+  const RhsType* rhs_ptrs[5];
+  for (int i = 0; i < 5; ++i) rhs_ptrs[i] = rhs_ptr + i * cols;
+
+  OutType* out_ptrs[5];
+  for (int i = 0; i < 5; ++i) out_ptrs[i] = out_ptr + i * rows;
+
+  for (int reduced_row = 0; reduced_row < assigned_rows; ++reduced_row) {
+    // We will acumulate the results in 10 registers, 2 per column.
+    v128_t sum01[5], sum23[5];
+    LoadFixedBiases(reinterpret_cast<const int32_t*>(bias_ptr), &sum01[0],
+                    &sum23[0]);
+    for (int k = 1; k < 5; ++k) {
+      sum01[k] = sum01[0];
+      sum23[k] = sum23[0];
+    }
+    bias_ptr += 4;
+
+    int reduced_col_count = *nnz_per_row++;
+    for (int c = 0; c < reduced_col_count; ++c) {
+      int col_delta = *col_deltas_bytes++ / sizeof(RhsType);
+      for (int k = 0; k < 5; ++k) rhs_ptrs[k] += col_delta;
+      for (int k = 0; k < 5; ++k) {
+        MultiplyFixedBlock(reinterpret_cast<const int16_t*>(weights_ptr),
+                           reinterpret_cast<const int16_t*>(rhs_ptrs[k]),
+                           &sum01[k], &sum23[k]);
+      }
+      weights_ptr += 16;
+    }
+    for (int k = 0; k < 5; ++k) {
+      if (IsFixed32Type<OutType>::value) {
+        Extract4xint32(relu, kShiftAmount, sum01[k], sum23[k],
+                       reinterpret_cast<int32_t**>(&out_ptrs[k]));
+      } else {
+        Extract4xint16(relu, kShiftAmount, sum01[k], sum23[k],
+                       reinterpret_cast<int16_t**>(&out_ptrs[k]));
+      }
+    }
+  }
+}
+
+template <typename Type>
+typename std::enable_if<IsFixed32Type<Type>::value>::type SumVectors(
+    int start, int end, const Type* add1, const Type* add2, Type* result) {
+  constexpr int kSIMDWidth = 4;
+  int i = start;
+  for (; i + kSIMDWidth <= end; i += kSIMDWidth) {
+    v128_t data1 = wasm_v128_load(add1 + i);
+    v128_t data2 = wasm_v128_load(add2 + i);
+    wasm_v128_store(result + i, wasm_i32x4_add(data1, data2));
+  }
+  // Unlike the other architectures, a partial vector at the end is handled
+  // one by one, so nothing past |end| is ever written.
+  const int32_t* add1_int = reinterpret_cast<const int32_t*>(add1);
+  const int32_t* add2_int = reinterpret_cast<const int32_t*>(add2);
+  int32_t* result_int = reinterpret_cast<int32_t*>(result);
+  for (; i < end; ++i) result_int[i] = add1_int[i] + add2_int[i];
+}
+
+template <typename Type>
+typename std::enable_if<IsFixed16Type<Type>::value>::type SumVectors(
+    int start, int end, const Type* add1, const Type* add2, Type* result) {
+  constexpr int kSIMDWidth = 8;
+  int i = start;
+  for (; i + kSIMDWidth <= end; i += kSIMDWidth) {
+    v128_t data1 = wasm_v128_load(add1 + i);
+    v128_t data2 = wasm_v128_load(add2 + i);
+    wasm_v128_store(result + i, wasm_i16x8_add_sat(data1, data2));
+  }
+  const int16_t* add1_int = reinterpret_cast<const int16_t*>(add1);
+  const int16_t* add2_int = reinterpret_cast<const int16_t*>(add2);
+  int16_t* result_int = reinterpret_cast<int16_t*>(result);
+  for (; i < end; ++i) {
+    result_int[i] = std::max(
+        std::min(add1_int[i] + add2_int[i],
+                 static_cast<int>(std::numeric_limits<int16_t>::max())),
+        static_cast<int>(std::numeric_limits<int16_t>::min()));
+  }
+}
+
+}  // namespace detail
+}  // namespace csrblocksparse
+
+#endif  // defined __wasm_simd128__
+#endif  // LYRA_CODEC_SPARSE_MATMUL_COMPUTE_KERNELS_WASM_H_
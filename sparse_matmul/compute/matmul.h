@@ -23,6 +23,7 @@
 #include "absl/time/time.h"
 #include "sparse_matmul/compute/matmul_fixed_avx2.h"
 #include "sparse_matmul/compute/matmul_generic.h"
+#include "sparse_matmul/compute/matmul_wasm.h"
 #include "sparse_matmul/numerics/fixed_types.h"
 #include "sparse_matmul/numerics/type_utils.h"
 #if defined(__x86_64__) || defined(__i386__) || defined(_WIN32)
@@ -80,7 +81,7 @@ class Matmul : public MatmulBase {
                  const typename TypeOfProduct<WeightType, RhsType>::type* bias,
                  const int32_t* nnz_per_row, const int16_t* rhs_indices,
                  int start_row, int end_row, bool relu, int replicas,
-                 int stride, OutType* output) {
+                 int stride, OutType* output) const {
     // The specializations should take care of every real case.
     std::cerr << "Unsupported combination of types used!" << std::endl;
     exit(EXIT_FAILURE);
@@ -90,7 +91,7 @@ class Matmul : public MatmulBase {
                  const typename TypeOfProduct<WeightType, RhsType>::type* bias,
                  const int32_t* nnz_per_row, const int16_t* rhs_indices,
                  int start_row, int end_row, bool relu, int replicas,
-                 int stride, OutType* output) {
+                 int stride, OutType* output) const {
     // The specializations should take care of every real case.
     std::cerr << "Unsupported combination of types used!" << std::endl;
     exit(EXIT_FAILURE);
@@ -104,20 +105,32 @@ class Matmul<float, float> : public MatmulBase {
   void MatVec4x4(const float* weights, const float* rhs, const float* bias,
                  const int32_t* nnz_per_row, const int16_t* rhs_indices,
                  int start_row, int end_row, bool relu, int replicas,
-                 int stride, float* output) {
+                 int stride, float* output) const {
+#if defined __wasm_simd128__
+    detail::MatVecFloatWasm(weights, rhs, bias, nnz_per_row, rhs_indices,
+                            start_row, end_row, /*block_height=*/4, relu,
+                            replicas, stride, output);
+#else
     detail::MatVecFloatGeneric(weights, rhs, bias, nnz_per_row, rhs_indices,
                                start_row, end_row, /*block_height=*/4,
                                /*block_width=*/4, relu, replicas, stride,
                                output);
+#endif  // __wasm_simd128__
   }
   void MatVec8x4(const float* weights, const float* rhs, const float* bias,
                  const int32_t* nnz_per_row, const int16_t* rhs_indices,
                  int start_row, int end_row, bool relu, int replicas,
-                 int stride, float* output) {
+                 int stride, float* output) const {
+#if defined __wasm_simd128__
+    detail::MatVecFloatWasm(weights, rhs, bias, nnz_per_row, rhs_indices,
+                            start_row, end_row, /*block_height=*/8, relu,
+                            replicas, stride, output);
+#else
     detail::MatVecFloatGeneric(weights, rhs, bias, nnz_per_row, rhs_indices,
                                start_row, end_row, /*block_height=*/8,
                                /*block_width=*/4, relu, replicas, stride,
                                output);
+#endif  // __wasm_simd128__
   }
 };
 
@@ -134,7 +147,7 @@ class Matmul<fixed16<WeightBits>, fixed16<RhsBits>> : public MatmulBase {
   void MatVec4x4(const int16_t* weights, const int16_t* rhs,
                  const int32_t* bias, const int32_t* nnz_per_row,
                  const int16_t* rhs_indices, int start_row, int end_row,
-                 bool relu, int replicas, int stride, OutType* output) {
+                 bool relu, int replicas, int stride, OutType* output) const {
     constexpr int kShiftAmount =
         TypeOfProduct<WeightType, RhsType>::type::kMantissaBits -
         OutType::kMantissaBits;
@@ -162,19 +175,24 @@ class Matmul<fixed16<WeightBits>, fixed16<RhsBits>> : public MatmulBase {
         exit(EXIT_FAILURE);
     }
 
+#elif defined __wasm_simd128__
+    detail::MatVecFixedWasm(weights, rhs, bias, nnz_per_row, rhs_indices,
+                            start_row, end_row, /*block_height=*/4, relu,
+                            sizeof(*output), kShiftAmount, replicas, stride,
+                            output);
 #else
     detail::MatVecFixedGeneric(weights, rhs, bias, nnz_per_row, rhs_indices,
                                start_row, end_row, /*block_height=*/4,
                                /*block_width=*/4, relu, sizeof(*output),
                                kShiftAmount, replicas, stride, output);
-#endif  // __AVX2__
+#endif  // __AVX2__ / __aarch64__ / __wasm_simd128__
   }
 
   template <typename OutType>
   void MatVec8x4(const int16_t* weights, const int16_t* rhs,
                  const int32_t* bias, const int32_t* nnz_per_row,
                  const int16_t* rhs_indices, int start_row, int end_row,
-                 bool relu, int replicas, int stride, OutType* output) {
+                 bool relu, int replicas, int stride, OutType* output) const {
     constexpr int kShiftAmount =
         TypeOfProduct<WeightType, RhsType>::type::kMantissaBits -
         OutType::kMantissaBits;
@@ -198,12 +216,17 @@ class Matmul<fixed16<WeightBits>, fixed16<RhsBits>> : public MatmulBase {
       std::cerr << "Fixed16 MatVec8x4 not yet implemented!" << std::endl;
         exit(EXIT_FAILURE);
     }
+#elif defined __wasm_simd128__
+    detail::MatVecFixedWasm(weights, rhs, bias, nnz_per_row, rhs_indices,
+                            start_row, end_row, /*block_height=*/8, relu,
+                            sizeof(*output), kShiftAmount, replicas, stride,
+                            output);
 #else
     detail::MatVecFixedGeneric(weights, rhs, bias, nnz_per_row, rhs_indices,
                                start_row, end_row, /*block_height=*/8,
                                /*block_width=*/4, relu, sizeof(*output),
                                kShiftAmount, replicas, stride, output);
-#endif  // __AVX2__
+#endif  // __AVX2__ / __aarch64__ / __wasm_simd128__
   }
 };
 
@@ -0,0 +1,147 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sparse_matmul/compute/matmul_wasm.h"
+
+#include <cstdint>
+
+#if defined __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#include "sparse_matmul/compute/matmul.h"
+
+namespace csrblocksparse {
+namespace detail {
+
+#if defined __wasm_simd128__
+namespace {
+
+// Returns the sums over the lanes of |sum0| to |sum3| as [sum0 sum1 sum2 sum3].
+inline v128_t ReduceFloat4(v128_t sum0, v128_t sum1, v128_t sum2,
+                           v128_t sum3) {
+  v128_t sum01 =
+      wasm_f32x4_add(wasm_i32x4_shuffle(sum0, sum1, 0, 4, 1, 5),
+                     wasm_i32x4_shuffle(sum0, sum1, 2, 6, 3, 7));
+  v128_t sum23 =
+      wasm_f32x4_add(wasm_i32x4_shuffle(sum2, sum3, 0, 4, 1, 5),
+                     wasm_i32x4_shuffle(sum2, sum3, 2, 6, 3, 7));
+  return wasm_f32x4_add(wasm_i32x4_shuffle(sum01, sum23, 0, 1, 4, 5),
+                        wasm_i32x4_shuffle(sum01, sum23, 2, 3, 6, 7));
+}
+
+}  // namespace
+
+void MatVecFloatWasm(const float* weights, const float* rhs, const float* bias,
+                     const int32_t* nnz_per_row, const int16_t* rhs_indices,
+                     int start_row, int end_row, int block_height, bool relu,
+                     int replicas, int stride, float* output) {
+  const int block_size = block_height * kBlockSize;
+  const v128_t zero = wasm_f32x4_splat(0.f);
+  for (int row_block = start_row; row_block < end_row;
+       ++row_block, output += block_height, bias += block_height) {
+    const int nnz = nnz_per_row[row_block];
+    // Each group of |kBlockSize| rows of the block is computed in turn, so
+    // that the accumulators of a group fit in registers.
+    for (int i = 0; i < block_height; i += kBlockSize) {
+      const float* weights_ptr = weights + i * kBlockSize;
+      v128_t sum0 = zero;
+      v128_t sum1 = zero;
+      v128_t sum2 = zero;
+      v128_t sum3 = zero;
+      for (int c = 0; c < nnz; ++c, weights_ptr += block_size) {
+        v128_t rhs_value = wasm_v128_load(rhs + rhs_indices[c] * kBlockSize);
+        sum0 = wasm_f32x4_add(
+            sum0, wasm_f32x4_mul(wasm_v128_load(weights_ptr), rhs_value));
+        sum1 = wasm_f32x4_add(
+            sum1, wasm_f32x4_mul(wasm_v128_load(weights_ptr + 4), rhs_value));
+        sum2 = wasm_f32x4_add(
+            sum2, wasm_f32x4_mul(wasm_v128_load(weights_ptr + 8), rhs_value));
+        sum3 = wasm_f32x4_add(
+            sum3, wasm_f32x4_mul(wasm_v128_load(weights_ptr + 12), rhs_value));
+      }
+      // Biases are stored and used directly without pre-division.
+      v128_t result = wasm_f32x4_add(ReduceFloat4(sum0, sum1, sum2, sum3),
+                                     wasm_v128_load(bias + i));
+      if (relu) result = wasm_f32x4_max(result, zero);
+      for (int r = 0; r < replicas; ++r) {
+        wasm_v128_store(output + i + r * stride, result);
+      }
+    }
+    weights += nnz * block_size;
+    rhs_indices += nnz;
+  }
+}
+
+void MatVecFixedWasm(const int16_t* weights, const int16_t* rhs,
+                     const int32_t* bias, const int32_t* nnz_per_row,
+                     const int16_t* rhs_indices, int start_row, int end_row,
+                     int block_height, bool relu, int bytes_out, int shift_out,
+                     int replicas, int stride, void* output) {
+  const int block_size = block_height * kBlockSize;
+  const v128_t rounding =
+      wasm_i32x4_splat(shift_out > 0 ? (1 << (shift_out - 1)) : 0);
+  const v128_t zero = wasm_i32x4_splat(0);
+  for (int row_block = start_row; row_block < end_row;
+       ++row_block, bias += block_height) {
+    const int nnz = nnz_per_row[row_block];
+    for (int i = 0; i < block_height; i += kBlockSize) {
+      const int16_t* weights_ptr = weights + i * kBlockSize;
+      // Pairwise sums of rows [0 0 1 1] and [2 2 3 3] of the group.
+      v128_t sum01 = zero;
+      v128_t sum23 = zero;
+      for (int c = 0; c < nnz; ++c, weights_ptr += block_size) {
+        // Broadcast the 4x int16 rhs, pretending that it is a 64-bit unit.
+        v128_t rhs_value =
+            wasm_v128_load64_splat(rhs + rhs_indices[c] * kBlockSize);
+        sum01 = wasm_i32x4_add(
+            sum01, wasm_i32x4_dot_i16x8(wasm_v128_load(weights_ptr), rhs_value));
+        sum23 = wasm_i32x4_add(
+            sum23,
+            wasm_i32x4_dot_i16x8(wasm_v128_load(weights_ptr + 8), rhs_value));
+      }
+      v128_t sum = wasm_i32x4_add(wasm_i32x4_shuffle(sum01, sum23, 0, 2, 4, 6),
+                                  wasm_i32x4_shuffle(sum01, sum23, 1, 3, 5, 7));
+      sum = wasm_i32x4_add(sum, wasm_v128_load(bias + i));
+      // Shift right with rounding to get the right number of mantissa bits.
+      sum = wasm_i32x4_shr(wasm_i32x4_add(sum, rounding), shift_out);
+      if (relu) sum = wasm_i32x4_max(sum, zero);
+      if (bytes_out == 2) {
+        // Clip to 16 bit range (with saturation) and store the bottom 64 bits.
+        int16_t* out16 = reinterpret_cast<int16_t*>(output) + i;
+        const int64_t result =
+            wasm_i64x2_extract_lane(wasm_i16x8_narrow_i32x4(sum, sum), 0);
+        for (int r = 0; r < replicas; ++r) {
+          *reinterpret_cast<int64_t*>(out16 + r * stride) = result;
+        }
+      } else {
+        int32_t* out32 = reinterpret_cast<int32_t*>(output) + i;
+        for (int r = 0; r < replicas; ++r) {
+          wasm_v128_store(out32 + r * stride, sum);
+        }
+      }
+    }
+    weights += nnz * block_size;
+    rhs_indices += nnz;
+    if (bytes_out == 2) {
+      output = reinterpret_cast<int16_t*>(output) + block_height;
+    } else {
+      output = reinterpret_cast<int32_t*>(output) + block_height;
+    }
+  }
+}
+#endif  // defined __wasm_simd128__
+
+}  // namespace detail
+}  // namespace csrblocksparse
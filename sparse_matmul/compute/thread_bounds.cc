@@ -32,6 +32,23 @@ void ThreadBounds::PrepareForThreads(int block_width, int block_height,
   block_height_ = block_height;
   ComputeThreadSplitPoints(num_threads, reduced_rows_per_cache_row,
                            reduced_rows, nnz_per_row);
+  ComputeStarts(nnz_per_row);
+}
+
+void ThreadBounds::PrepareForRowStarts(int block_width, int block_height,
+                                       const std::vector<int>& row_starts,
+                                       const int* nnz_per_row) {
+  if (row_starts.size() < 2) {
+    exit(EXIT_FAILURE);
+  }
+
+  block_width_ = block_width;
+  block_height_ = block_height;
+  row_starts_ = row_starts;
+  ComputeStarts(nnz_per_row);
+}
+
+void ThreadBounds::ComputeStarts(const int* nnz_per_row) {
   weight_starts_.clear();
   rhs_indices_starts_.clear();
   bias_starts_.clear();
@@ -30,6 +30,13 @@ class ThreadBounds {
   void PrepareForThreads(int block_width, int block_height, int num_threads,
                          int reduced_rows_per_cache_row, int reduced_rows,
                          const int* nnz_per_row);
+  // Same as above, but with the (reduced) |row_starts| of the parts given
+  // instead of balanced by work. Part i does rows
+  // [|row_starts|[i], |row_starts|[i + 1]), so there is one part less than
+  // there are |row_starts|.
+  void PrepareForRowStarts(int block_width, int block_height,
+                           const std::vector<int>& row_starts,
+                           const int* nnz_per_row);
 
   // Functions that offset the appropriate type to the start of the data
   // needed by the given thread id (|tid|).
@@ -57,6 +64,8 @@ class ThreadBounds {
   // Computes the block row (reduced) index of the start of each thread.
   void ComputeThreadSplitPoints(int num_threads, int reduced_rows_per_cache_row,
                                 int reduced_rows, const int* nnz_per_row);
+  // Computes the start indices of the other data types from |row_starts_|.
+  void ComputeStarts(const int* nnz_per_row);
 
   // Sizes of a sparse block.
   int block_width_;
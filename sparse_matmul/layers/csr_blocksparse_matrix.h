@@ -65,6 +65,13 @@ class CsrBlockSparseMatrix {
     ComputeRHSIndices();
   }
 
+  // See ReadFromFlatBuffer() for |alignment| and |view|.
+  CsrBlockSparseMatrix(const uint8_t* const& buffer, const std::size_t& len,
+                       int alignment, bool view) {
+    ReadFromFlatBuffer(buffer, len, alignment, view);
+    ComputeRHSIndices();
+  }
+
   template <typename InputType>
   CsrBlockSparseMatrix(const MaskedSparseMatrix<InputType>& masked_matrix) {
     sparsity_ = masked_matrix.sparsity();
@@ -310,24 +317,22 @@ class CsrBlockSparseMatrix {
     }
   }
 
-  // Allocates memory and fills buffer.
-  // Caller is responsible for the memory de-allocation.
+  // Serializes the matrix into |csr_flatbuffer|.
+  // If |alignment| is greater than one, each array starts at a multiple of
+  // |alignment| bytes from the start of the buffer, so that a matrix read with
+  // the same |alignment| can be a view of an aligned buffer.
   // TODO(b/189958858): Both Read and Write need to eventually handle the
   // different possible HalfType and DeltaType values, but punting for now as
   // there is only one supported combination.
-  std::size_t WriteToFlatBuffer(std::string* csr_flatbuffer) {
-    std::size_t bytes = 0;
-    bytes += FixedParameterSize();
-    bytes += weights_.size() * sizeof(WeightType);
-    bytes += col_deltas_.size() * sizeof(DeltaType);
-    bytes += nnz_per_row_.size() * sizeof(int);
-
-    uint8_t* bytes_ptr_ptr = reinterpret_cast<uint8_t*>(malloc(bytes));
-    if (bytes_ptr_ptr == nullptr) {
-      exit(EXIT_FAILURE);
-    }
+  std::size_t WriteToFlatBuffer(std::string* csr_flatbuffer,
+                                int alignment = 1) const {
+    const ArrayOffsets offsets =
+        ComputeArrayOffsets(weights_.size(), col_deltas_.size(),
+                            nnz_per_row_.size(), alignment);
+    csr_flatbuffer->assign(offsets.total_bytes, '\0');
+    uint8_t* bytes_ptr = reinterpret_cast<uint8_t*>(&(*csr_flatbuffer)[0]);
 
-    int* int_bytes_ptr = reinterpret_cast<int*>(bytes_ptr_ptr);
+    int* int_bytes_ptr = reinterpret_cast<int*>(bytes_ptr);
 
     *int_bytes_ptr++ = rows_;
     *int_bytes_ptr++ = cols_;
@@ -344,29 +349,30 @@ class CsrBlockSparseMatrix {
     float* float_bytes_ptr = reinterpret_cast<float*>(int_bytes_ptr);
     *float_bytes_ptr++ = sparsity_;
 
-    uint8_t* bytes_ptr = reinterpret_cast<uint8_t*>(float_bytes_ptr);
-
-    memcpy(bytes_ptr, weights_.data(), weights_.size() * sizeof(WeightType));
-    bytes_ptr += weights_.size() * sizeof(WeightType);
-
-    memcpy(bytes_ptr, col_deltas_.data(),
+    memcpy(bytes_ptr + offsets.weights, weights_.data(),
+           weights_.size() * sizeof(WeightType));
+    memcpy(bytes_ptr + offsets.col_deltas, col_deltas_.data(),
            col_deltas_.size() * sizeof(DeltaType));
-    bytes_ptr += col_deltas_.size() * sizeof(DeltaType);
-
-    memcpy(bytes_ptr, nnz_per_row_.data(), nnz_per_row_.size() * sizeof(int));
-    bytes_ptr += nnz_per_row_.size() * sizeof(int);
-
-    csr_flatbuffer->resize(bytes);
-    csr_flatbuffer->assign(reinterpret_cast<char*>(bytes_ptr_ptr), bytes);
-    free(bytes_ptr_ptr);
+    memcpy(bytes_ptr + offsets.nnz_per_row, nnz_per_row_.data(),
+           nnz_per_row_.size() * sizeof(int));
 
-    return bytes;
+    return offsets.total_bytes;
   }
 
-  void ReadFromFlatBuffer(const uint8_t* const& bytes, const std::size_t& len) {
+  // Reads a buffer written by WriteToFlatBuffer() with the same |alignment|.
+  // If |view| is true, the arrays are not copied: the matrix refers to
+  // |bytes|, which must be aligned to |alignment| and outlive the matrix
+  // unmodified.
+  void ReadFromFlatBuffer(const uint8_t* const& bytes, const std::size_t& len,
+                          int alignment = 1, bool view = false) {
     if (len < FixedParameterSize()) {
       exit(EXIT_FAILURE);
     }
+    if (view && reinterpret_cast<uintptr_t>(bytes) % alignment != 0) {
+      std::cerr << "Flat buffer is not aligned to " << alignment << " bytes."
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
 
     const int* int_bytes_ptr = reinterpret_cast<const int*>(bytes);
     rows_ = *int_bytes_ptr++;
@@ -390,31 +396,33 @@ class CsrBlockSparseMatrix {
         reinterpret_cast<const float*>(int_bytes_ptr);
     sparsity_ = *float_bytes_ptr++;
 
-    std::size_t total_bytes =
-        FixedParameterSize() + weights_size * sizeof(WeightType) +
-        col_deltas_size * sizeof(DeltaType) + nnz_per_row_size * sizeof(int);
+    const ArrayOffsets offsets = ComputeArrayOffsets(
+        weights_size, col_deltas_size, nnz_per_row_size, alignment);
 
-    if (total_bytes != len) {
-      std::cout << "total bytes: " << total_bytes
+    if (offsets.total_bytes != len) {
+      std::cout << "total bytes: " << offsets.total_bytes
                 << ", actual len given: " << len << std::endl;
       exit(EXIT_FAILURE);
     }
 
-    const uint8_t* bytes_ptr =
-        reinterpret_cast<const uint8_t*>(float_bytes_ptr);
-    std::vector<WeightType> weights_raw(weights_size);
-    memcpy(weights_raw.data(), bytes_ptr, weights_size * sizeof(WeightType));
-    weights_ = CacheAlignedVector<WeightType>(weights_raw);
-    bytes_ptr += weights_size * sizeof(WeightType);
-
-    std::vector<DeltaType> deltas_raw(col_deltas_size);
-    memcpy(deltas_raw.data(), bytes_ptr, col_deltas_size * sizeof(DeltaType));
-    col_deltas_ = CacheAlignedVector<DeltaType>(deltas_raw);
-    bytes_ptr += col_deltas_size * sizeof(DeltaType);
-
-    std::vector<int> nnz_raw(nnz_per_row_size);
-    memcpy(nnz_raw.data(), bytes_ptr, nnz_per_row_size * sizeof(int));
-    nnz_per_row_ = CacheAlignedVector<int>(nnz_raw);
+    const auto* weights =
+        reinterpret_cast<const WeightType*>(bytes + offsets.weights);
+    const auto* col_deltas =
+        reinterpret_cast<const DeltaType*>(bytes + offsets.col_deltas);
+    const auto* nnz_per_row =
+        reinterpret_cast<const int*>(bytes + offsets.nnz_per_row);
+    if (view) {
+      weights_ = CacheAlignedVector<WeightType>::View(weights, weights_size);
+      col_deltas_ =
+          CacheAlignedVector<DeltaType>::View(col_deltas, col_deltas_size);
+      nnz_per_row_ = CacheAlignedVector<int>::View(nnz_per_row,
+                                                   nnz_per_row_size);
+    } else {
+      // Each array is copied once, straight into its aligned storage.
+      weights_ = CacheAlignedVector<WeightType>(weights, weights_size);
+      col_deltas_ = CacheAlignedVector<DeltaType>(col_deltas, col_deltas_size);
+      nnz_per_row_ = CacheAlignedVector<int>(nnz_per_row, nnz_per_row_size);
+    }
     num_threads_ = 0;
     PrepareForThreads(num_threads);
   }
@@ -504,7 +512,7 @@ class CsrBlockSparseMatrix {
   }
   template <typename MVRhsType, typename MVBiasType, typename OutType>
   void MatVec(const MVRhsType* rhs, const MVBiasType* bias, bool relu, int tid,
-              int replicas, int output_stride, OutType* output) {
+              int replicas, int output_stride, OutType* output) const {
     if (tid >= num_threads_) {
       exit(EXIT_FAILURE);
     }
@@ -618,9 +626,10 @@ class CsrBlockSparseMatrix {
       exit(EXIT_FAILURE);
     }
     // we've already prepared for this number of threads, nothing to do
-    if (num_threads == num_threads_) return num_threads_;
+    if (num_threads == num_threads_ && !has_row_starts_) return num_threads_;
 
     num_threads_ = num_threads;
+    has_row_starts_ = false;
     thread_bounds_.PrepareForThreads(
         block_width_, block_height_, num_threads_,
         ReducedRowsPerCacheLine<OutType>(cache_line_size), reduced_rows_,
@@ -628,6 +637,44 @@ class CsrBlockSparseMatrix {
     return num_threads_;
   }
 
+  // Splits the computation into the parts given by |row_starts|, instead of
+  // into one balanced part per thread. Part i does rows
+  // [|row_starts|[i], |row_starts|[i + 1]) and is computed by passing i as the
+  // |tid|, so a thread may compute several parts, in any order, and the parts
+  // of a thread need not be contiguous. |row_starts| must start at 0, end at
+  // |rows()| and not decrease, and each must be a multiple of the block height.
+  // Afterwards |num_threads()| is the number of parts, until the next call to
+  // PrepareForThreads(), which restores the balanced split. The parts are not
+  // serialized.
+  //
+  // Returns the number of parts, or 0 if |row_starts| is invalid.
+  int PrepareForRowStarts(const std::vector<int>& row_starts) {
+    if (row_starts.size() < 2 || row_starts.front() != 0 ||
+        row_starts.back() != rows_) {
+      std::cerr << "Row starts must start at 0 and end at " << rows_ << "."
+                << std::endl;
+      return 0;
+    }
+    std::vector<int> reduced_row_starts;
+    reduced_row_starts.reserve(row_starts.size());
+    for (std::size_t i = 0; i < row_starts.size(); ++i) {
+      if (row_starts[i] % block_height_ != 0 ||
+          (i > 0 && row_starts[i] < row_starts[i - 1])) {
+        std::cerr << "Row start " << row_starts[i]
+                  << " is out of order or not a multiple of "
+                  << block_height_ << "." << std::endl;
+        return 0;
+      }
+      reduced_row_starts.push_back(row_starts[i] / block_height_);
+    }
+    num_threads_ = static_cast<int>(row_starts.size()) - 1;
+    has_row_starts_ = true;
+    thread_bounds_.PrepareForRowStarts(block_width_, block_height_,
+                                       reduced_row_starts,
+                                       nnz_per_row_.data());
+    return num_threads_;
+  }
+
   // Computes and stores the |rhs_indices_| from the |col_deltas_|.
   void ComputeRHSIndices() {
     std::vector<int> cumulative_deltas = CumulativeColDeltas();
@@ -668,6 +715,31 @@ class CsrBlockSparseMatrix {
   }
 
  private:
+  struct ArrayOffsets {
+    std::size_t weights;
+    std::size_t col_deltas;
+    std::size_t nnz_per_row;
+    std::size_t total_bytes;
+  };
+
+  // Byte offsets of the arrays in a flat buffer.
+  ArrayOffsets ComputeArrayOffsets(std::size_t weights_size,
+                                   std::size_t col_deltas_size,
+                                   std::size_t nnz_per_row_size,
+                                   int alignment) const {
+    auto align = [alignment](std::size_t offset) {
+      return (offset + alignment - 1) / alignment * alignment;
+    };
+    ArrayOffsets offsets;
+    offsets.weights = align(FixedParameterSize());
+    offsets.col_deltas =
+        align(offsets.weights + weights_size * sizeof(WeightType));
+    offsets.nnz_per_row =
+        align(offsets.col_deltas + col_deltas_size * sizeof(DeltaType));
+    offsets.total_bytes = offsets.nnz_per_row + nnz_per_row_size * sizeof(int);
+    return offsets;
+  }
+
   constexpr std::size_t FixedParameterSize() const {
     return sizeof(int)      // rows
            + sizeof(int)    // cols
@@ -829,6 +901,8 @@ class CsrBlockSparseMatrix {
   int block_width_;
   int block_height_;
   int num_threads_;
+  // Whether |thread_bounds_| was given by PrepareForRowStarts().
+  bool has_row_starts_ = false;
   std::string name_;
 
   CacheAlignedVector<WeightType> weights_;
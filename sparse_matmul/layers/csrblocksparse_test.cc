@@ -75,6 +75,41 @@ TEST(CSRBlockSparseMatrix, FlatBufferSerialization) {
   CheckResult(out_ref, out_test, kCols);
 }
 
+TEST(CSRBlockSparseMatrix, AlignedFlatBufferView) {
+  const int kRows = 64;
+  const int kCols = 32;
+  const int kAlignment = 64;
+  MaskedSparseMatrix<float> matrix(kRows, kCols, /*sparsity=*/0.5f,
+                                   /*block_height=*/4, /*block_width=*/4);
+  CacheAlignedVector<float> bias(kRows);
+  CacheAlignedVector<float> rhs(kCols);
+  CacheAlignedVector<float> out_ref(kRows);
+  CacheAlignedVector<float> out_test(kRows);
+  bias.FillRandom();
+  rhs.FillRandom();
+
+  CsrBlockSparseMatrix<float, float> block_sparse_matrix(matrix);
+  block_sparse_matrix.SpMM_bias(rhs, bias, &out_ref);
+
+  std::string buffer;
+  const std::size_t num_bytes =
+      block_sparse_matrix.WriteToFlatBuffer(&buffer, kAlignment);
+  // The view requires the buffer itself to be aligned.
+  CacheAlignedVector<uint8_t> aligned_buffer(
+      reinterpret_cast<const uint8_t*>(buffer.data()), num_bytes);
+
+  CsrBlockSparseMatrix<float, float> view_matrix(
+      aligned_buffer.data(), num_bytes, kAlignment, /*view=*/true);
+  view_matrix.SpMM_bias(rhs, bias, &out_test);
+  CheckResult(out_ref, out_test, kCols);
+
+  CsrBlockSparseMatrix<float, float> copied_matrix(
+      aligned_buffer.data(), num_bytes, kAlignment, /*view=*/false);
+  out_test.FillZero();
+  copied_matrix.SpMM_bias(rhs, bias, &out_test);
+  CheckResult(out_ref, out_test, kCols);
+}
+
 template <typename ComputeType, typename RhsType, typename OutType>
 void CorrectnessCheckBlockSpMM(int rows, int cols, int block_height,
                                int block_width, float sparsity,
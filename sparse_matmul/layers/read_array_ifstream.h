@@ -20,9 +20,11 @@
 #define LYRA_CODEC_SPARSE_MATMUL_LAYERS_READ_ARRAY_IFSTREAM_H_
 
 #include <cstdint>
+#include <cstring>
 #include <fstream>
-#include <sstream>
+#include <iostream>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/strings/substitute.h"
@@ -34,17 +36,13 @@ namespace detail {
 template <typename T>
 absl::Status ReadArrayIfstream(const char* buffer, uint64_t buffer_size,
                                std::vector<T>* array, int64_t* length) {
-  std::stringstream string_buffer;
-  string_buffer.write(buffer, buffer_size);
-  if (string_buffer.str().empty()) {
+  if (buffer == nullptr || buffer_size == 0) {
     return absl::UnknownError("Failed to read array from buffer");
   }
-  std::string contents = string_buffer.str();
-  *length = contents.length();
+  *length = buffer_size;
   int64_t elem = (*length + sizeof(T) - 1) / sizeof(T);
   array->resize(elem);
-  std::move(contents.begin(), contents.end(),
-            reinterpret_cast<char*>(array->data()));
+  std::memcpy(array->data(), buffer, buffer_size);
   return absl::OkStatus();
 }
 
@@ -54,25 +52,27 @@ absl::Status ReadArrayIfstream(const std::string& file_name,
                                int64_t* length) {
   ghc::filesystem::path complete_path(path);
   complete_path /= file_name;
-  std::ifstream in_stream(complete_path.u8string(), std::ios::binary);
+  std::ifstream in_stream(complete_path.u8string(),
+                          std::ios::binary | std::ios::ate);
   if (!in_stream.is_open()) {
     return absl::UnknownError(
         absl::Substitute("Error opening $0", complete_path.string()));
   }
 
-  std::stringstream buffer;
-  buffer << in_stream.rdbuf();
-  if (buffer.str().empty()) {
+  // The file is read once, straight into |array|.
+  *length = in_stream.tellg();
+  if (*length <= 0) {
     std::cerr << "File " << complete_path << " was empty." << std::endl;
     return absl::UnknownError(
         absl::Substitute("File $0 was empty", complete_path.string()));
   }
-  std::string contents = buffer.str();
-  *length = contents.length();
   int64_t elem = (*length + sizeof(T) - 1) / sizeof(T);
   array->resize(elem);
-  std::move(contents.begin(), contents.end(),
-            reinterpret_cast<char*>(array->data()));
+  in_stream.seekg(0);
+  if (!in_stream.read(reinterpret_cast<char*>(array->data()), *length)) {
+    return absl::UnknownError(
+        absl::Substitute("Error reading $0", complete_path.string()));
+  }
 
   return absl::OkStatus();
 }
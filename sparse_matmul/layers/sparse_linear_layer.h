@@ -18,6 +18,9 @@
 #define LYRA_CODEC_SPARSE_MATMUL_LAYERS_SPARSE_LINEAR_LAYER_H_
 
 #include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "sparse_matmul/layers/csr_blocksparse_matrix.h"
@@ -93,7 +96,7 @@ class SparseLinearLayer {
   template <typename RhsClassType, typename OutType>
   void MatVec(const RhsClassType& rhs, bool relu, int tid, int replicas,
               int output_stride, OutType* output,
-              SpinBarrier* barrier = nullptr) {
+              SpinBarrier* barrier = nullptr) const {
     static_assert(
         std::is_same<typename RhsClassType::value_type, RhsType>::value, "");
 #ifdef __AVX2__
@@ -110,7 +113,7 @@ class SparseLinearLayer {
       // the first part of the split before running the second part.
       // Signal completion of the previous MatVec.
       split_pc_->produce();
-      PartLinearLayer& thread_part = thread_layers_[tid];
+      const PartLinearLayer& thread_part = thread_layers_[tid];
       auto offset_output =
           sparse_matrix_.thread_bounds().OffsetOutput(output->data(), tid);
       auto mid_output =
@@ -157,6 +160,12 @@ class SparseLinearLayer {
   int block_height() const { return sparse_matrix_.block_height(); }
   int num_threads() const { return sparse_matrix_.num_threads(); }
   const CacheAlignedVector<BiasType>& bias() const { return bias_; }
+  // The bias as given at construction, before quartering.
+  const CacheAlignedVector<BiasType>& full_bias() const { return full_bias_; }
+  const CsrBlockSparseMatrix<WeightType, RhsType, DeltaType>& sparse_matrix()
+      const {
+    return sparse_matrix_;
+  }
   const std::vector<int>& split_points() const {
     return sparse_matrix_.split_points();
   }
@@ -193,6 +202,18 @@ class SparseLinearLayer {
     return sparse_matrix_.PrepareForThreads(num_threads, cache_line_size);
   }
 
+  // Splits the computation into the parts given by |row_starts| instead of by
+  // thread, see CsrBlockSparseMatrix::PrepareForRowStarts(). The parts are
+  // computed by passing their index as the |tid| of SpMM_bias() or MatVec(),
+  // and never use the split of SliceForThreads().
+  // Returns the number of parts, or 0 if |row_starts| is invalid.
+  int PrepareForRowStarts(const std::vector<int>& row_starts) {
+    thread_layers_.clear();
+    split_pc_.reset(nullptr);
+    num_threads_ = sparse_matrix_.PrepareForRowStarts(row_starts);
+    return num_threads_;
+  }
+
   // Partitions the matrix into pieces by thread.
   // In this matrix, we can go ahead and calculate the part that only depends
   // on rhs inputs that were generated by this thread in the previous matvec,
@@ -319,7 +340,9 @@ class SparseLinearLayer {
   CacheAlignedVector<BiasType> bias_;
   CacheAlignedVector<BiasType> full_bias_;
   // Output from the self_matrix that will be given to |other_matrix| as bias.
-  CacheAlignedVector<BiasType> mid_output_;
+  // This is scratch space of MatVec, so a split layer must not be shared
+  // between independent callers.
+  mutable CacheAlignedVector<BiasType> mid_output_;
   // One partitioned pair of matrices for each thread.
   std::vector<PartLinearLayer> thread_layers_;
   // Producer-consumer lock used to wait between computing |self_matrix| and
@@ -328,6 +351,20 @@ class SparseLinearLayer {
   int num_threads_ = 0;
 };
 
+// Prepares the layer pointed to by |layer| for |num_threads|. As the layer may
+// be shared with other owners, it is never modified: if it is not already
+// prepared for |num_threads|, |layer| is replaced with a prepared copy.
+// Returns the number of threads the layer is prepared for.
+template <typename LayerType>
+int PrepareSharedLayerForThreads(int num_threads,
+                                 std::shared_ptr<const LayerType>* layer) {
+  if ((*layer)->num_threads() == num_threads) return num_threads;
+  auto prepared_layer = std::make_shared<LayerType>(**layer);
+  const int prepared_threads = prepared_layer->PrepareForThreads(num_threads);
+  *layer = std::move(prepared_layer);
+  return prepared_threads;
+}
+
 template <typename WeightType, typename RhsType>
 SparseLinearLayer<WeightType, RhsType> CreateRandomLayer(int rows, int cols,
                                                          float sparsity,
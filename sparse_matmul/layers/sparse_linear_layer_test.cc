@@ -120,6 +120,47 @@ TEST(CsrBlockSparseMatrix, SliceForThreadsLayers) {
   CheckResult(out_reference, out2, kCols);
 }
 
+// Tests that a Layer split at given row starts computes the same result as the
+// original layer, whatever the order of its parts, and that invalid row starts
+// are rejected.
+TEST(SparseLinearLayerTest, PrepareForRowStarts) {
+  MaskedSparseMatrix<float> matrix(kSize, kSize, 0.95, kBlockSize, kBlockSize);
+  FatCacheAlignedVector<float> rhs(kSize, kCols);
+  CacheAlignedVector<float> bias(kSize);
+  FatCacheAlignedVector<float> out(kSize, kCols);
+
+  bias.FillRandom();
+  rhs.FillRandom();
+  out.FillZero();
+  FatCacheAlignedVector<float> out_reference = out;
+  CsrBlockSparseMatrix<float, float> sparse_matrix(matrix);
+  SparseLinearLayer<float, float> sparse_linear_layer(std::move(sparse_matrix),
+                                                      std::move(bias));
+  sparse_linear_layer.PrepareForThreads(1);
+  sparse_linear_layer.SpMM_bias(rhs, &out_reference);
+
+  EXPECT_EQ(sparse_linear_layer.PrepareForRowStarts({0, 6, kSize}), 0);
+  EXPECT_EQ(sparse_linear_layer.PrepareForRowStarts({0, 64, 32, kSize}), 0);
+  EXPECT_EQ(sparse_linear_layer.PrepareForRowStarts({0, 64}), 0);
+  // Includes an empty part.
+  const std::vector<int> row_starts = {0, 48, 128, 128, 208, kSize};
+  ASSERT_EQ(sparse_linear_layer.PrepareForRowStarts(row_starts),
+            row_starts.size() - 1);
+  EXPECT_EQ(sparse_linear_layer.num_threads(), row_starts.size() - 1);
+  for (const int part : {3, 0, 4, 2, 1}) {
+    sparse_linear_layer.SpMM_bias(rhs, &out, /*relu=*/false, part);
+  }
+  CheckResult(out_reference, out, kCols);
+
+  // Preparing for the same number of threads restores the balanced split.
+  SparseLinearLayer<float, float> balanced_layer = sparse_linear_layer;
+  balanced_layer.PrepareForThreads(1);
+  balanced_layer.PrepareForThreads(row_starts.size() - 1);
+  EXPECT_EQ(sparse_linear_layer.PrepareForThreads(row_starts.size() - 1),
+            row_starts.size() - 1);
+  EXPECT_EQ(sparse_linear_layer.split_points(), balanced_layer.split_points());
+}
+
 // Tests that a Layer that has been DoubleBlockHeight()-ed computes the same
 // result as original layer. (Float compute type).
 TEST(CsrBlockSparseMatrix, Float8x4) {
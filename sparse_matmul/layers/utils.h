@@ -49,30 +49,62 @@
 
 namespace csrblocksparse {
 
+// Inflates the |source_size| gzipped bytes at |source| straight into |array|,
+// which is sized up front from the ISIZE field of the gzip trailer, so the
+// uncompressed data is written exactly once and no intermediate buffer is
+// allocated. ISIZE cannot be trusted blindly: it is bounded by the maximum
+// deflate ratio, and the inflated length and CRC are checked against the
+// trailer afterwards.
 template <typename T>
-void unzip(int64_t st_size, std::vector<T>* array) {
+absl::Status InflateGzipArray(const char* source, int64_t source_size,
+                              std::vector<T>* array) {
+  // Deflate cannot compress by more than about 1032:1.
+  constexpr int64_t kMaxDeflateRatio = 1032;
   ZLib z;
   z.SetGzipHeaderMode();
-  if (z.HasGzipHeader(reinterpret_cast<char*>(array->data()), st_size)) {
-    const std::size_t kMaxBufferSize = 1 << 27;  // 128MB
-
-    Bytef* dest;
-    uLongf dest_len = kMaxBufferSize;
-    if (z.UncompressGzipAndAllocate(&dest, &dest_len, (Bytef*)array->data(),
-                                    st_size) != Z_OK) {
-      exit(EXIT_FAILURE);
-    }
-    if (dest_len % sizeof(T) != 0) {
-      exit(EXIT_FAILURE);
-    }
-    array->assign(reinterpret_cast<T*>(dest),
-                  reinterpret_cast<T*>(dest + dest_len));
-    free(dest);
-  } else {
-    if (st_size % sizeof(T) != 0) {
-      exit(EXIT_FAILURE);
-    }
+  const Bytef* source_bytes = reinterpret_cast<const Bytef*>(source);
+  uLongf dest_len = z.GzipUncompressedLength(source_bytes, source_size);
+  if (dest_len % sizeof(T) != 0) {
+    return absl::DataLossError(absl::Substitute(
+        "Uncompressed size $0 is not a multiple of $1.", dest_len, sizeof(T)));
   }
+  if (dest_len > kMaxDeflateRatio * source_size) {
+    return absl::DataLossError(
+        absl::Substitute("Uncompressed size $0 is impossible for $1 bytes of "
+                         "compressed data.",
+                         dest_len, source_size));
+  }
+  array->resize(dest_len / sizeof(T));
+  const uLongf expected_len = dest_len;
+  // The destination must not be null, even if nothing is inflated.
+  Bytef empty;
+  Bytef* dest =
+      array->empty() ? &empty : reinterpret_cast<Bytef*>(array->data());
+  if (z.Uncompress(dest, &dest_len, source_bytes, source_size) != Z_OK ||
+      dest_len != expected_len) {
+    array->clear();
+    return absl::DataLossError("Could not inflate gzipped array.");
+  }
+  return absl::OkStatus();
+}
+
+// Uncompresses |array| in place if its first |st_size| bytes are gzipped,
+// otherwise checks that they hold a whole number of elements.
+template <typename T>
+absl::Status unzip(int64_t st_size, std::vector<T>* array) {
+  if (ZLib::HasGzipHeader(reinterpret_cast<char*>(array->data()), st_size)) {
+    // The compressed bytes are moved aside, not copied, and released as soon
+    // as they have been inflated.
+    std::vector<T> compressed;
+    compressed.swap(*array);
+    return InflateGzipArray(reinterpret_cast<const char*>(compressed.data()),
+                            st_size, array);
+  }
+  if (st_size % sizeof(T) != 0) {
+    return absl::DataLossError(absl::Substitute(
+        "Array size $0 is not a multiple of $1.", st_size, sizeof(T)));
+  }
+  return absl::OkStatus();
 }
 
 // Reads a file that contains an array of a single POD type.  Eventually we
@@ -93,9 +125,7 @@ ReadArrayFromFile(const std::string& file_name, std::vector<T>* array,
   if (!status.ok()) {
     return status;
   }
-  unzip(length, array);
-
-  return absl::OkStatus();
+  return unzip(length, array);
 }
 
 template <typename T, typename DiskType = T, typename ElemType = T>
@@ -103,15 +133,18 @@ typename std::enable_if<!csrblocksparse::IsFixed16Type<DiskType>::value,
                         absl::Status>::type
 ReadArrayFromBuffer(const char* buffer, uint64_t buffer_size,
                     std::vector<T>* array) {
+  // Gzipped buffers are inflated directly, without a copy of the compressed
+  // data.
+  if (buffer != nullptr && ZLib::HasGzipHeader(buffer, buffer_size)) {
+    return InflateGzipArray(buffer, buffer_size, array);
+  }
   int64_t length = 0;
   const absl::Status status =
       detail::ReadArrayIfstream(buffer, buffer_size, array, &length);
   if (!status.ok()) {
     return status;
   }
-  unzip(length, array);
-
-  return absl::OkStatus();
+  return unzip(length, array);
 }
 
 // If the metatype |DiskType| is of fixed16_type, we load int16_ts from disk and
@@ -135,6 +168,22 @@ ReadArrayFromFile(const std::string& file_name, std::vector<T>* array,
   return absl::OkStatus();
 }
 
+template <typename T, typename DiskType, typename ElemType>
+typename std::enable_if<std::is_same<T, float>::value &&
+                            csrblocksparse::IsFixed16Type<DiskType>::value,
+                        absl::Status>::type
+ReadArrayFromBuffer(const char* buffer, uint64_t buffer_size,
+                    std::vector<T>* array) {
+  std::vector<int16_t> disk_values;
+  SPARSE_MATMUL_RETURN_IF_ERROR(
+      ReadArrayFromBuffer(buffer, buffer_size, &disk_values));
+  array->resize(disk_values.size());
+  std::transform(
+      disk_values.begin(), disk_values.end(), array->begin(),
+      [](int16_t disk_value) { return static_cast<T>(ElemType(disk_value)); });
+  return absl::OkStatus();
+}
+
 // Writes a vector to a binary file.  Eventually serialization will be handled
 // with protos.
 template <typename T>
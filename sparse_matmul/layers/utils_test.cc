@@ -16,7 +16,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <random>
+#include <string>
 #include <type_traits>
 #include <vector>
 
@@ -181,5 +183,65 @@ TYPED_TEST(CsrBlockSparseMatrixUtilsTest, LoadLayer) {
     }
   }
 }
+
+// Returns |values| gzipped as by the model export.
+std::string GzipArray(const std::vector<float>& values) {
+  ZLib z;
+  z.SetGzipHeaderMode();
+  const uLong source_len = values.size() * sizeof(float);
+  uLongf dest_len = ZLib::MinCompressbufSize(source_len);
+  std::string compressed(dest_len, '\0');
+  EXPECT_EQ(z.Compress(reinterpret_cast<Bytef*>(&compressed[0]), &dest_len,
+                       reinterpret_cast<const Bytef*>(values.data()),
+                       source_len),
+            Z_OK);
+  compressed.resize(dest_len);
+  return compressed;
+}
+
+TEST(UtilsTest, ReadsGzippedArrayFromBuffer) {
+  std::vector<float> values(10000);
+  for (int i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<float>(i % 97) * 0.5f;
+  }
+  const std::string compressed = GzipArray(values);
+  ASSERT_LT(compressed.size(), values.size() * sizeof(float));
+
+  std::vector<float> array;
+  ASSERT_TRUE(
+      ReadArrayFromBuffer(compressed.data(), compressed.size(), &array).ok());
+  EXPECT_EQ(array, values);
+
+  // The same data passed through unzip() in place.
+  std::vector<float> in_place((compressed.size() + 3) / 4);
+  std::memcpy(in_place.data(), compressed.data(), compressed.size());
+  ASSERT_TRUE(unzip(compressed.size(), &in_place).ok());
+  EXPECT_EQ(in_place, values);
+}
+
+TEST(UtilsTest, RejectsCorruptGzippedArray) {
+  const std::vector<float> values(1000, 3.f);
+  std::string compressed = GzipArray(values);
+  std::vector<float> array;
+
+  // ISIZE of the trailer disagrees with the data.
+  std::string wrong_size = compressed;
+  wrong_size[wrong_size.size() - 4] ^= 4;
+  EXPECT_FALSE(
+      ReadArrayFromBuffer(wrong_size.data(), wrong_size.size(), &array).ok());
+
+  // ISIZE that no deflate stream of this size can produce.
+  std::string huge_size = compressed;
+  huge_size[huge_size.size() - 1] = 0x7f;
+  EXPECT_FALSE(
+      ReadArrayFromBuffer(huge_size.data(), huge_size.size(), &array).ok());
+
+  // Not a whole number of elements.
+  std::string partial = compressed;
+  partial[partial.size() - 4] ^= 1;
+  EXPECT_FALSE(
+      ReadArrayFromBuffer(partial.data(), partial.size(), &array).ok());
+}
+
 }  // namespace
 }  // namespace csrblocksparse
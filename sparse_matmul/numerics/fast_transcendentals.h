@@ -26,6 +26,9 @@
 #if defined __AVX__ || defined __AVX2__
 #include <immintrin.h>
 #endif
+#if defined __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
 #include <math.h>
 
 #include "sparse_matmul/numerics/fixed_types.h"
@@ -746,6 +749,134 @@ inline float fast_sigmoid(fixed32<ExponentBits> x) {
 
 #endif  // defined __aarch64__
 
+#if defined __wasm_simd128__
+// 4-wide versions of the scalar functions above for WebAssembly SIMD128. Each
+// lane is computed with the same approximation as the scalar function, as
+// selected by the same defines.
+
+// Applies the scalar |function| to each of the 4 floats in |x|.
+template <typename Function>
+inline v128_t ApplyToFloatLanes(Function function, v128_t x) {
+  return wasm_f32x4_make(function(wasm_f32x4_extract_lane(x, 0)),
+                         function(wasm_f32x4_extract_lane(x, 1)),
+                         function(wasm_f32x4_extract_lane(x, 2)),
+                         function(wasm_f32x4_extract_lane(x, 3)));
+}
+
+inline v128_t ClipToFloatBounds(const float kLimit, const v128_t x) {
+  return wasm_f32x4_max(wasm_f32x4_min(x, wasm_f32x4_splat(kLimit)),
+                        wasm_f32x4_splat(-kLimit));
+}
+
+// Returns |a| + |x| * |b|. There is no fused multiply-add in SIMD128.
+inline v128_t MultiplyAdd(v128_t a, v128_t x, v128_t b) {
+  return wasm_f32x4_add(a, wasm_f32x4_mul(x, b));
+}
+
+inline v128_t fast_exp(v128_t x) {
+#ifdef FAST_TRANSCENDENTALS
+  float AConstant, BConstant;
+  memcpy(&AConstant, &kAConstant, sizeof(int));
+  memcpy(&BConstant, &kBConstant, sizeof(int));
+  // The min and max propagate NaN, which the saturating truncation below
+  // turns into 0, so NaN returns 0.0f as in the scalar version.
+  x = ClipToFloatBounds(kMaxExpInput, x);
+  v128_t y = MultiplyAdd(wasm_f32x4_splat(BConstant), x,
+                         wasm_f32x4_splat(AConstant));
+  return wasm_i32x4_trunc_sat_f32x4(y);
+#else
+  return ApplyToFloatLanes(expf, x);
+#endif  // FAST_TRANSCENDENTALS
+}
+
+inline v128_t fast_tanh(v128_t x) {
+#if defined FAST_TRANSCENDENTALS && defined ACCURATE_TRANSCENDENTAL_APPROX
+  x = ClipToFloatBounds(kMaxTanhInput, x);
+  v128_t x2 = wasm_f32x4_mul(x, x);
+
+  // Evaluate numerator.
+  v128_t p = MultiplyAdd(wasm_f32x4_splat(kTanhAlpha11), x2,
+                         wasm_f32x4_splat(kTanhAlpha13));
+  p = MultiplyAdd(wasm_f32x4_splat(kTanhAlpha9), x2, p);
+  p = MultiplyAdd(wasm_f32x4_splat(kTanhAlpha7), x2, p);
+  p = MultiplyAdd(wasm_f32x4_splat(kTanhAlpha5), x2, p);
+  p = MultiplyAdd(wasm_f32x4_splat(kTanhAlpha3), x2, p);
+  p = MultiplyAdd(wasm_f32x4_splat(kTanhAlpha1), x2, p);
+  p = wasm_f32x4_mul(x, p);
+
+  // Evaluate denominator.
+  v128_t q = MultiplyAdd(wasm_f32x4_splat(kTanhBeta4), x2,
+                         wasm_f32x4_splat(kTanhBeta6));
+  q = MultiplyAdd(wasm_f32x4_splat(kTanhBeta2), x2, q);
+  q = MultiplyAdd(wasm_f32x4_splat(kTanhBeta0), x2, q);
+
+  return wasm_f32x4_div(p, q);
+#elif defined FAST_TRANSCENDENTALS
+  v128_t linear =
+      wasm_f32x4_lt(wasm_f32x4_abs(x), wasm_f32x4_splat(kTanhLinearRegion));
+  v128_t clipped = ClipToFloatBounds(kMaxTanhInput, x);
+  v128_t positive = fast_exp(clipped);
+  v128_t negative = fast_exp(wasm_f32x4_neg(clipped));
+  v128_t result = wasm_f32x4_div(wasm_f32x4_sub(positive, negative),
+                                 wasm_f32x4_add(positive, negative));
+  return wasm_v128_bitselect(x, result, linear);
+#else
+  return ApplyToFloatLanes(tanhf, x);
+#endif  // FAST_TRANSCENDENTALS
+}
+
+inline v128_t fast_sigmoid(v128_t x) {
+#ifdef SIGMOID_AS_TANH
+  const v128_t half = wasm_f32x4_splat(.5f);
+  return MultiplyAdd(half, half, fast_tanh(wasm_f32x4_mul(half, x)));
+#else
+#if defined FAST_TRANSCENDENTALS && defined ACCURATE_TRANSCENDENTAL_APPROX
+  x = ClipToFloatBounds(kMaxSigmoidInput, x);
+  v128_t x2 = wasm_f32x4_mul(x, x);
+
+  // Evaluate numerator.
+  v128_t p = MultiplyAdd(wasm_f32x4_splat(kSigmoidAlpha7), x2,
+                         wasm_f32x4_splat(kSigmoidAlpha9));
+  p = MultiplyAdd(wasm_f32x4_splat(kSigmoidAlpha5), x2, p);
+  p = MultiplyAdd(wasm_f32x4_splat(kSigmoidAlpha3), x2, p);
+  p = MultiplyAdd(wasm_f32x4_splat(kSigmoidAlpha1), x2, p);
+  p = wasm_f32x4_mul(x, p);
+
+  // Evaluate denominator.
+  v128_t q = MultiplyAdd(wasm_f32x4_splat(kSigmoidBeta8), x2,
+                         wasm_f32x4_splat(kSigmoidBeta10));
+  q = MultiplyAdd(wasm_f32x4_splat(kSigmoidBeta6), x2, q);
+  q = MultiplyAdd(wasm_f32x4_splat(kSigmoidBeta4), x2, q);
+  q = MultiplyAdd(wasm_f32x4_splat(kSigmoidBeta2), x2, q);
+  q = MultiplyAdd(wasm_f32x4_splat(kSigmoidBeta0), x2, q);
+
+  return wasm_f32x4_add(wasm_f32x4_div(p, q), wasm_f32x4_splat(.5f));
+#elif defined FAST_TRANSCENDENTALS
+  v128_t linear =
+      wasm_f32x4_lt(wasm_f32x4_abs(x), wasm_f32x4_splat(kSigmoidLinearRegion));
+  v128_t one = wasm_f32x4_splat(1.f);
+  v128_t sigmoid = wasm_f32x4_div(
+      one, wasm_f32x4_add(one, fast_exp(wasm_f32x4_neg(x))));
+  return wasm_v128_bitselect(
+      MultiplyAdd(wasm_f32x4_splat(.5f), wasm_f32x4_splat(.245f), x), sigmoid,
+      linear);
+#else
+  return ApplyToFloatLanes(
+      [](float lane) { return 1.f / (1.f + expf(-lane)); }, x);
+#endif  // FAST_TRANSCENDENTALS
+#endif  // SIGMOID_AS_TANH
+}
+
+// Sigmoid of 4 fixed32 values with |ExponentBits| held in int32 lanes.
+template <int ExponentBits>
+inline v128_t fast_sigmoid(v128_t x) {
+  constexpr int kMantissaBits = fixed32<ExponentBits>::kMantissaBits;
+  return fast_sigmoid(
+      wasm_f32x4_mul(wasm_f32x4_convert_i32x4(x),
+                     wasm_f32x4_splat(1.f / (1LL << kMantissaBits))));
+}
+#endif  // defined __wasm_simd128__
+
 // Number of exponent bits to use for tanh.
 static constexpr int kNumTanhExpBits = 3;
 // Number of exponent bits to use for sigmoid.
@@ -1170,6 +1301,85 @@ inline void float_sigmoid_float(__m256& y0, __m256& y1) {
   y1 = _mm256_div_ps(one, _mm256_add_ps(y1, one));
 }
 
+// 8-wide e^x, using the Cephes polynomial, which is within about 2 ulp of
+// expf for x in [kMinExpInput, kMaxExpInput]. For code which must follow expf
+// closely whether or not FAST_TRANSCENDENTALS is defined.
+inline __m256 accurate_exp(__m256 x) {
+  x = ClipToFloatBounds(kMaxExpInput, x);
+  // Split x into n * log(2) + r, with |r| <= log(2) / 2, subtracting n *
+  // log(2) in two parts for extra precision.
+  __m256 n = _mm256_floor_ps(_mm256_add_ps(
+      _mm256_mul_ps(x, _mm256_set1_ps(kOneOverLog2)), _mm256_set1_ps(.5f)));
+  __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(0.693359375f)));
+  r = _mm256_add_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(2.12194440e-4f)));
+  // e^r = 1 + r + r^2 * p(r).
+  __m256 r2 = _mm256_mul_ps(r, r);
+  __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.3981999507e-3f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(8.3334519073e-3f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(4.1665795894e-2f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.6666665459e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(5.0000001201e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r2), r);
+  p = _mm256_add_ps(p, _mm256_set1_ps(1.0f));
+  // Multiply by 2^n by building it in the exponent bits.
+  __m256i pow2n = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)),
+      kFloatMantissaBits);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(pow2n));
+}
+
+// 8-wide natural logarithm of positive normal |x|, using the Cephes
+// polynomial, which is within about 2 ulp of logf.
+inline __m256 accurate_log(__m256 x) {
+  // Split x into m * 2^e with m in [sqrt(1/2), sqrt(2)).
+  __m256i bits = _mm256_castps_si256(x);
+  __m256i exponent = _mm256_sub_epi32(
+      _mm256_srli_epi32(bits, kFloatMantissaBits), _mm256_set1_epi32(126));
+  __m256i mantissa =
+      _mm256_and_si256(bits, _mm256_set1_epi32(kFloatMantissaMask));
+  __m256 m = _mm256_castsi256_ps(
+      _mm256_or_si256(mantissa, _mm256_castps_si256(_mm256_set1_ps(.5f))));
+  __m256 e = _mm256_cvtepi32_ps(exponent);
+  __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f),
+                               _CMP_LT_OQ);
+  e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.0f)));
+  m = _mm256_add_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)),
+                    _mm256_and_ps(small, m));
+  // log(1 + m) = m - m^2 / 2 + m^3 * p(m).
+  __m256 m2 = _mm256_mul_ps(m, m);
+  __m256 p = _mm256_set1_ps(7.0376836292e-2f);
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(-1.1514610310e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(1.1676998740e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(-1.2420140846e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(1.4249322787e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(-1.6668057665e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(2.0000714765e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(-2.4999993993e-1f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, m), _mm256_set1_ps(3.3333331174e-1f));
+  p = _mm256_mul_ps(_mm256_mul_ps(p, m), m2);
+  // Add e * log(2), in two parts for extra precision.
+  p = _mm256_add_ps(p, _mm256_mul_ps(e, _mm256_set1_ps(-2.12194440e-4f)));
+  p = _mm256_sub_ps(p, _mm256_mul_ps(m2, _mm256_set1_ps(.5f)));
+  m = _mm256_add_ps(m, p);
+  return _mm256_add_ps(m, _mm256_mul_ps(e, _mm256_set1_ps(0.693359375f)));
+}
+
+// 8-wide version of the scalar fast_exp, selected by the same define.
+inline __m256 fast_exp(__m256 x) {
+#ifdef FAST_TRANSCENDENTALS
+  float AConstant, BConstant;
+  memcpy(&AConstant, &kAConstant, sizeof(int));
+  memcpy(&BConstant, &kBConstant, sizeof(int));
+  x = ClipToFloatBounds(kMaxExpInput, x);
+  __m256 y = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(AConstant)),
+                           _mm256_set1_ps(BConstant));
+  return _mm256_castsi256_ps(_mm256_cvttps_epi32(y));
+#else
+  return accurate_exp(x);
+#endif  // FAST_TRANSCENDENTALS
+}
+
 #endif  // defined __AVX2__
 
 }  // namespace csrblocksparse
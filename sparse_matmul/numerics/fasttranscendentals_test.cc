@@ -18,6 +18,9 @@
 #if defined __AVX__ || defined __AVX2__
 #include <immintrin.h>
 #endif
+#if defined __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
 
 #include <stdio.h>
 
@@ -401,6 +404,52 @@ TEST(Transcendentals, Tanh) {
 #endif
 }
 
+#if defined __wasm_simd128__
+// The SIMD128 functions compute the same approximations as the scalar ones,
+// so every lane must match the scalar result.
+TEST(Transcendentals, VectorMatchesScalarWasm) {
+  constexpr int kSIMDWidth = 4;
+  constexpr int kExponentBits = 9;
+  constexpr float kVectorRelTolerance = 1e-6f;
+  float inputs[kSIMDWidth];
+  int32_t fixed_inputs[kSIMDWidth];
+  float exp_results[kSIMDWidth];
+  float tanh_results[kSIMDWidth];
+  float sigmoid_results[kSIMDWidth];
+  float fixed_sigmoid_results[kSIMDWidth];
+  // Covers the linear regions, the clipped regions and both signs.
+  for (float x = -20.f; x < 20.f; x += .01f * kSIMDWidth) {
+    for (int i = 0; i < kSIMDWidth; ++i) {
+      inputs[i] = x + .01f * i;
+      fixed_inputs[i] =
+          csrblocksparse::fixed32<kExponentBits>(inputs[i]).raw_val();
+    }
+    v128_t input = wasm_v128_load(inputs);
+    wasm_v128_store(exp_results, csrblocksparse::fast_exp(input));
+    wasm_v128_store(tanh_results, csrblocksparse::fast_tanh(input));
+    wasm_v128_store(sigmoid_results, csrblocksparse::fast_sigmoid(input));
+    wasm_v128_store(fixed_sigmoid_results,
+                    csrblocksparse::fast_sigmoid<kExponentBits>(
+                        wasm_v128_load(fixed_inputs)));
+    for (int i = 0; i < kSIMDWidth; ++i) {
+      const float exp = csrblocksparse::fast_exp(inputs[i]);
+      const float tanh = csrblocksparse::fast_tanh(inputs[i]);
+      const float sigmoid = csrblocksparse::fast_sigmoid(inputs[i]);
+      const float fixed_sigmoid = csrblocksparse::fast_sigmoid<kExponentBits>(
+          csrblocksparse::fixed32<kExponentBits>(inputs[i]));
+      EXPECT_LE(RelDiff(exp, exp_results[i]), kVectorRelTolerance)
+          << inputs[i];
+      EXPECT_NEAR(tanh_results[i], tanh, kVectorRelTolerance) << inputs[i];
+      EXPECT_NEAR(sigmoid_results[i], sigmoid, kVectorRelTolerance)
+          << inputs[i];
+      EXPECT_NEAR(fixed_sigmoid_results[i], fixed_sigmoid,
+                  kVectorRelTolerance)
+          << inputs[i];
+    }
+  }
+}
+#endif  // __wasm_simd128__
+
 #if defined __AVX2__
 
 constexpr int kSIMDSize = 8;
@@ -660,6 +709,41 @@ TEST(Transcendentals, CubicSigmoidAVX2Float) {
   TestSigmoidAVX2Float<TM_ORDER3_16BIT>(kCubicSigmoidTolerance,
                                         kCubicSigmoidRelTolerance);
 }
+// The accurate versions follow the standard library closely enough to replace
+// it in sampling, whatever the transcendental mode.
+TEST(Transcendentals, AccurateExpAndLogAVX2) {
+  constexpr float kAccurateRelTolerance = 1e-6f;
+  float inputs[kSIMDSize];
+  float exp_results[kSIMDSize];
+  float log_results[kSIMDSize];
+  for (float x = -80.f; x < 80.f; x += .01f * kSIMDSize) {
+    for (int i = 0; i < kSIMDSize; ++i) {
+      inputs[i] = x + .01f * i;
+    }
+    __m256 input = _mm256_loadu_ps(inputs);
+    _mm256_storeu_ps(exp_results, csrblocksparse::accurate_exp(input));
+    for (int i = 0; i < kSIMDSize; ++i) {
+      EXPECT_LE(RelDiff(expf(inputs[i]), exp_results[i]),
+                kAccurateRelTolerance)
+          << inputs[i];
+    }
+  }
+  // Covers several octaves on both sides of one.
+  for (float x = 1e-6f; x < 1e6f; x *= 1.001f) {
+    for (int i = 0; i < kSIMDSize; ++i) {
+      inputs[i] = x * (1.f + 1e-4f * i);
+    }
+    __m256 input = _mm256_loadu_ps(inputs);
+    _mm256_storeu_ps(log_results, csrblocksparse::accurate_log(input));
+    for (int i = 0; i < kSIMDSize; ++i) {
+      EXPECT_NEAR(log_results[i], logf(inputs[i]),
+                  kAccurateRelTolerance * std::max(1.f, std::abs(logf(
+                                                            inputs[i]))))
+          << inputs[i];
+    }
+  }
+}
+
 #endif  // __AVX2__
 
 }  // namespace csrblocksparse
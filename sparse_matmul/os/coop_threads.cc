@@ -15,19 +15,53 @@
 #include "sparse_matmul/os/coop_threads.h"
 
 #include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
 
 namespace csrblocksparse {
 
+WaitStats HybridWait::stats() const {
+  WaitStats stats;
+  stats.num_spin_waits = num_spin_waits_.load(std::memory_order_relaxed);
+  stats.num_parked_waits = num_parked_waits_.load(std::memory_order_relaxed);
+  stats.spin_time =
+      std::chrono::nanoseconds(spin_nanos_.load(std::memory_order_relaxed));
+  stats.park_time =
+      std::chrono::nanoseconds(park_nanos_.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void HybridWait::ResetStats() {
+  num_spin_waits_.store(0, std::memory_order_relaxed);
+  num_parked_waits_.store(0, std::memory_order_relaxed);
+  spin_nanos_.store(0, std::memory_order_relaxed);
+  park_nanos_.store(0, std::memory_order_relaxed);
+}
+
+void HybridWait::AddSpinWait(std::chrono::nanoseconds spin_time) {
+  num_spin_waits_.fetch_add(1, std::memory_order_relaxed);
+  spin_nanos_.fetch_add(spin_time.count(), std::memory_order_relaxed);
+}
+
+void HybridWait::AddParkedWait(std::chrono::nanoseconds spin_time,
+                               std::chrono::nanoseconds park_time) {
+  num_parked_waits_.fetch_add(1, std::memory_order_relaxed);
+  spin_nanos_.fetch_add(spin_time.count(), std::memory_order_relaxed);
+  park_nanos_.fetch_add(park_time.count(), std::memory_order_relaxed);
+}
+
 // All threads must execute a std::memory_order_seq_cst operation on
 // |barrier_step_| this is what ensures the global memory consistency across
 // the barrier.
 //
 // It is possible for the |barrier_step_| to roll over, but this is safe here.
 //
-// |yield| instructs the processor that it is in a spin loop and can stop doing
-// things like out of order, speculative execution, prefetching, etc.  On hyper
-// threaded machines it can also choose to swap in the other thread.  Note that
-// this is a hardware level decision and the OS is never involved.
+// While spinning, |HybridWait| issues |yield| which instructs the processor
+// that it is in a spin loop and can stop doing things like out of order,
+// speculative execution, prefetching, etc.  On hyper threaded machines it can
+// also choose to swap in the other thread.  Note that this is a hardware level
+// decision and the OS is only involved once the waiting thread parks.
 void SpinBarrier::barrier() {
   if (num_threads_ < 2) return;
 
@@ -44,18 +78,74 @@ void SpinBarrier::barrier() {
     // thread to reach the barrier, reset and advance step count.
     threads_at_barrier_.store(0, std::memory_order_relaxed);
     barrier_step_.store(old_step + 1, std::memory_order_release);
+    wait_.Notify();
   } else {
     // Wait for step count to advance, then continue.
-    while (barrier_step_.load(std::memory_order_acquire) == old_step) {
-      // Intel recommends the equivalent instruction PAUSE, not be called more
-      // than once in a row, I can't find any recommendations for ARM, so
-      // following that advice here.
-#if defined __aarch64__ || defined __arm__
-      asm volatile("yield\n" ::: "memory");
-#else
-      // No pause for x86! The pause instruction on Skylake takes 141 clock
-      // cycles, which in an AVX2-down-clocked CPU is getting on for 70ns.
-#endif
+    wait_.Wait([this, old_step]() {
+      return barrier_step_.load(std::memory_order_acquire) != old_step;
+    });
+  }
+}
+
+BarrierThreadPool::BarrierThreadPool(int num_threads)
+    : num_threads_(num_threads), spin_barrier_(num_threads) {
+  threads_.reserve(num_threads_);
+  for (int tid = 1; tid < num_threads_; ++tid) {
+    threads_.emplace_back(
+        absl::make_unique<Thread>([this, tid]() { WorkerLoop(tid); }));
+  }
+}
+
+BarrierThreadPool::~BarrierThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  for (auto& thread : threads_) {
+    thread->join();
+  }
+}
+
+void BarrierThreadPool::Run(const Function& func) {
+  if (threads_.empty()) {
+    func(&spin_barrier_, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    func_ = &func;
+    num_running_ = threads_.size();
+    ++generation_;
+  }
+  changed_.notify_all();
+
+  const int kLocalTid = 0;
+  func(&spin_barrier_, kLocalTid);
+
+  // |func| must outlive every worker's copy of the call.
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this]() { return num_running_ == 0; });
+  func_ = nullptr;
+}
+
+void BarrierThreadPool::WorkerLoop(int tid) {
+  uint64_t last_generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [this, last_generation]() {
+      return stop_ || generation_ != last_generation;
+    });
+    if (stop_) {
+      return;
+    }
+    last_generation = generation_;
+    const Function* func = func_;
+    lock.unlock();
+    (*func)(&spin_barrier_, tid);
+    lock.lock();
+    if (--num_running_ == 0) {
+      changed_.notify_all();
     }
   }
 }
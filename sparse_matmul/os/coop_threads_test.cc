@@ -16,7 +16,10 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>  // NOLINT
 #include <numeric>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -132,3 +135,134 @@ TEST(Threads, ProducerConsumer) {
 
   csrblocksparse::LaunchOnThreadsWithBarrier(kNumThreads, f);
 }
+
+TEST(Threads, BarrierThreadPoolReusesThreads) {
+  const int kNumThreads = 4;
+  const int kNumRuns = 100;
+  csrblocksparse::BarrierThreadPool pool(kNumThreads);
+  EXPECT_EQ(pool.num_threads(), kNumThreads);
+
+  std::vector<csrblocksparse::ThreadId> thread_ids(kNumThreads);
+  std::vector<int> num_calls(kNumThreads, 0);
+  for (int run = 0; run < kNumRuns; ++run) {
+    pool.Run([&](csrblocksparse::SpinBarrier* barrier, int tid) {
+      if (run == 0) {
+        thread_ids[tid] = std::this_thread::get_id();
+      } else {
+        EXPECT_EQ(thread_ids[tid], std::this_thread::get_id());
+      }
+      ++num_calls[tid];
+      barrier->barrier();
+    });
+    // Every copy has returned by the time Run() does.
+    EXPECT_EQ(num_calls, std::vector<int>(kNumThreads, run + 1));
+  }
+  EXPECT_EQ(thread_ids[0], std::this_thread::get_id());
+}
+
+TEST(Threads, BarrierThreadPoolSpinBarrier) {
+  const int kNumThreads = 4;
+  csrblocksparse::BarrierThreadPool pool(kNumThreads);
+
+  std::vector<int> values(kNumThreads, 0);
+  for (int run = 1; run <= 10; ++run) {
+    pool.Run([&](csrblocksparse::SpinBarrier* barrier, int tid) {
+      values[tid] = run * tid;
+      barrier->barrier();
+      // All writes before the barrier are visible after it.
+      for (int i = 0; i < kNumThreads; ++i) {
+        EXPECT_EQ(values[i], run * i);
+      }
+      barrier->barrier();
+    });
+  }
+}
+
+TEST(Threads, BarrierThreadPoolWithOneThreadRunsOnCaller) {
+  csrblocksparse::BarrierThreadPool pool(1);
+  int num_calls = 0;
+  pool.Run([&](csrblocksparse::SpinBarrier* barrier, int tid) {
+    EXPECT_EQ(tid, 0);
+    barrier->barrier();
+    ++num_calls;
+  });
+  EXPECT_EQ(num_calls, 1);
+}
+
+TEST(Threads, HybridWaitReturnsImmediatelyIfReady) {
+  csrblocksparse::HybridWait wait;
+  wait.Wait([]() { return true; });
+  const csrblocksparse::WaitStats stats = wait.stats();
+  EXPECT_EQ(stats.num_spin_waits, 0);
+  EXPECT_EQ(stats.num_parked_waits, 0);
+}
+
+TEST(Threads, HybridWaitParksLongWaits) {
+  // Spinning is cut short, so the waiter parks well before it is notified.
+  csrblocksparse::HybridWait wait(std::chrono::microseconds(10));
+  std::atomic<bool> ready(false);
+  std::thread notifier([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ready.store(true);
+    wait.Notify();
+  });
+  wait.Wait([&]() { return ready.load(); });
+  notifier.join();
+
+  const csrblocksparse::WaitStats stats = wait.stats();
+  EXPECT_EQ(stats.num_spin_waits, 0);
+  EXPECT_EQ(stats.num_parked_waits, 1);
+  EXPECT_GE(stats.spin_time, std::chrono::microseconds(10));
+  EXPECT_GT(stats.park_time, stats.spin_time);
+
+  wait.ResetStats();
+  EXPECT_EQ(wait.stats().num_parked_waits, 0);
+  EXPECT_EQ(wait.stats().park_time, std::chrono::nanoseconds(0));
+}
+
+TEST(Threads, HybridWaitWakesAllParkedWaiters) {
+  const int kNumWaiters = 4;
+  csrblocksparse::HybridWait wait(std::chrono::nanoseconds(0));
+  std::atomic<bool> ready(false);
+  std::atomic<int> num_woken(0);
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < kNumWaiters; ++i) {
+    waiters.emplace_back([&]() {
+      wait.Wait([&]() { return ready.load(); });
+      num_woken.fetch_add(1);
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ready.store(true);
+  wait.Notify();
+  for (auto& waiter : waiters) {
+    waiter.join();
+  }
+  EXPECT_EQ(num_woken.load(), kNumWaiters);
+}
+
+TEST(Threads, SpinBarrierParksLateArrivals) {
+  const int kNumThreads = 2;
+  const int kNumIterations = 10;
+  csrblocksparse::SpinBarrier barrier(kNumThreads,
+                                      std::chrono::microseconds(10));
+  std::vector<int> values(kNumThreads, 0);
+  auto f = [&](csrblocksparse::SpinBarrier*, int tid) {
+    for (int i = 1; i <= kNumIterations; ++i) {
+      // Thread 1 arrives much later than thread 0, which has to park.
+      if (tid == 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+      values[tid] = i;
+      barrier.barrier();
+      EXPECT_EQ(values[1 - tid], i);
+      barrier.barrier();
+    }
+  };
+  csrblocksparse::LaunchOnThreadsWithBarrier(kNumThreads, f);
+
+  const csrblocksparse::WaitStats stats = barrier.wait_stats();
+  EXPECT_EQ(stats.num_spin_waits + stats.num_parked_waits,
+            2 * kNumIterations);
+  EXPECT_GE(stats.num_parked_waits, kNumIterations);
+}
@@ -108,11 +108,26 @@ class CacheAlignedVector {
   CacheAlignedVector() : size_(0), data_(nullptr) {}
 
   ~CacheAlignedVector() {
-    aligned_free(data_);
+    if (owns_data_) aligned_free(data_);
     data_ = nullptr;
     size_ = 0;
   }
 
+  // Returns a vector referring to the |size| elements at |data|, which it does
+  // not own. |data| must be aligned as if allocated by a CacheAlignedVector,
+  // and must outlive the view without being modified, as it may be read-only
+  // memory such as a mapped file. Copies of a view own their data.
+  static CacheAlignedVector View(const DataType* data, int size) {
+    CacheAlignedVector view;
+    view.size_ = size;
+    view.data_ = const_cast<DataType*>(data);
+    view.owns_data_ = false;
+    return view;
+  }
+
+  // False if this is a View().
+  bool owns_data() const { return owns_data_; }
+
   // Copies are _deep_ copies
   CacheAlignedVector(CacheAlignedVector const& other)
       : size_(0), data_(nullptr), gen_(nullptr) {
@@ -143,21 +158,25 @@ class CacheAlignedVector {
       : size_(0), data_(nullptr), gen_(std::move(other.gen_)) {
     size_ = other.size_;
     data_ = other.data_;
+    owns_data_ = other.owns_data_;
     other.size_ = 0;
     other.data_ = nullptr;
+    other.owns_data_ = true;
   }
 
   CacheAlignedVector<DataType>& operator=(
       CacheAlignedVector<DataType>&& other) {
-    aligned_free(data_);
+    if (owns_data_) aligned_free(data_);
     if (other.gen_)
       gen_ = absl::make_unique<std::minstd_rand>(std::move(*other.gen_));
     else
       gen_.reset(nullptr);
     size_ = other.size_;
     data_ = other.data_;
+    owns_data_ = other.owns_data_;
     other.size_ = 0;
     other.data_ = nullptr;
+    other.owns_data_ = true;
     return *this;
   }
 
@@ -858,7 +877,8 @@ class CacheAlignedVector {
 
  private:
   void resize(std::size_t size) {
-    aligned_free(data_);
+    if (owns_data_) aligned_free(data_);
+    owns_data_ = true;
     size_ = size;
     data_ = reinterpret_cast<DataType*>(
         aligned_malloc(size_ * sizeof(DataType), kCacheLineSize));
@@ -866,6 +886,8 @@ class CacheAlignedVector {
 
   std::size_t size_;
   DataType* data_;
+  // False if |data_| belongs to someone else, see View().
+  bool owns_data_ = true;
   // Data used by the threaded version for sampling only.
   std::vector<int> maxes_;          // Max value of logits.
   std::vector<int> thread_starts_;  // First index for this thread.
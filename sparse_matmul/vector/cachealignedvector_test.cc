@@ -308,6 +308,27 @@ void TestFatVectorView() {
   }
 }
 
+TEST(CacheAlignedVector, View) {
+  CacheAlignedVector<float> owner(16);
+  owner.FillRandom();
+  CacheAlignedVector<float> view =
+      CacheAlignedVector<float>::View(owner.data(), owner.size());
+  EXPECT_FALSE(view.owns_data());
+  EXPECT_EQ(view.data(), owner.data());
+  EXPECT_EQ(view.size(), owner.size());
+
+  // Moving keeps the view, copying makes an owning vector.
+  CacheAlignedVector<float> moved(std::move(view));
+  EXPECT_FALSE(moved.owns_data());
+  EXPECT_EQ(moved.data(), owner.data());
+  CacheAlignedVector<float> copy(moved);
+  EXPECT_TRUE(copy.owns_data());
+  EXPECT_NE(copy.data(), owner.data());
+  for (int i = 0; i < owner.size(); ++i) {
+    EXPECT_EQ(copy[i], owner[i]);
+  }
+}
+
 TEST(FatVector, View) {
   TestFatVectorView<csrblocksparse::VectorView<float>>();
 }
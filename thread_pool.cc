@@ -0,0 +1,86 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "thread_pool.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace chromemedia {
+namespace codec {
+
+ThreadPool::ThreadPool(int num_threads) {
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::RunAll(std::vector<std::function<void()>> tasks) {
+  auto batch = std::make_shared<Batch>();
+  std::unique_lock<std::mutex> lock(mutex_);
+  batch->num_pending = tasks.size();
+  for (auto& task : tasks) {
+    queue_.emplace_back(std::move(task), batch);
+  }
+  changed_.notify_all();
+  while (batch->num_pending > 0) {
+    if (!queue_.empty()) {
+      RunFrontTask(&lock);
+    } else {
+      // The remaining tasks of |batch| are running on other threads.
+      changed_.wait(lock);
+    }
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+    RunFrontTask(&lock);
+  }
+}
+
+void ThreadPool::RunFrontTask(std::unique_lock<std::mutex>* lock) {
+  auto task = std::move(queue_.front());
+  queue_.pop_front();
+  lock->unlock();
+  task.first();
+  lock->lock();
+  --task.second->num_pending;
+  changed_.notify_all();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_THREAD_POOL_H_
+#define LYRA_CODEC_THREAD_POOL_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace chromemedia {
+namespace codec {
+
+// A fixed set of worker threads running batches of independent tasks, meant
+// for coarse grained work such as loading model parameters. It is not suited
+// to the per-sample synchronization of the inference loops, which use
+// csrblocksparse::LaunchOnThreadsWithBarrier().
+class ThreadPool {
+ public:
+  // Starts |num_threads| workers. With 0 workers, all tasks run on the thread
+  // calling RunAll().
+  explicit ThreadPool(int num_threads);
+
+  // Waits for the running tasks and joins the workers.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Runs all |tasks| and returns once they have finished. Tasks run
+  // concurrently on the workers and the calling thread, in no particular
+  // order. While waiting, the calling thread runs any queued task, so tasks
+  // may call RunAll() themselves without exhausting the workers.
+  void RunAll(std::vector<std::function<void()>> tasks);
+
+  int num_threads() const { return workers_.size(); }
+
+ private:
+  // Tasks of a single RunAll() call.
+  struct Batch {
+    int num_pending = 0;
+  };
+
+  void WorkerLoop();
+
+  // Runs the front of |queue_|. |lock| must hold |mutex_| and is released
+  // while the task runs.
+  void RunFrontTask(std::unique_lock<std::mutex>* lock);
+
+  std::mutex mutex_;
+  // Notified when a task is queued, a task finishes or the pool stops.
+  std::condition_variable changed_;
+  std::deque<std::pair<std::function<void()>, std::shared_ptr<Batch>>> queue_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_THREAD_POOL_H_
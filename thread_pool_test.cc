@@ -0,0 +1,70 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+class ThreadPoolTest : public testing::TestWithParam<int> {};
+
+TEST_P(ThreadPoolTest, RunsEveryTaskOnce) {
+  ThreadPool pool(GetParam());
+  EXPECT_EQ(pool.num_threads(), GetParam());
+  std::vector<int> results(100, 0);
+  std::vector<std::function<void()>> tasks;
+  for (int i = 0; i < results.size(); ++i) {
+    tasks.push_back([i, &results]() { results[i] += i; });
+  }
+  pool.RunAll(tasks);
+  for (int i = 0; i < results.size(); ++i) {
+    EXPECT_EQ(results[i], i);
+  }
+}
+
+TEST_P(ThreadPoolTest, NestedBatchesComplete) {
+  ThreadPool pool(GetParam());
+  std::atomic<int> count(0);
+  std::vector<std::function<void()>> outer_tasks;
+  for (int i = 0; i < 8; ++i) {
+    outer_tasks.push_back([&pool, &count]() {
+      std::vector<std::function<void()>> inner_tasks(
+          8, [&count]() { count.fetch_add(1); });
+      pool.RunAll(inner_tasks);
+    });
+  }
+  pool.RunAll(outer_tasks);
+  EXPECT_EQ(count.load(), 64);
+}
+
+TEST_P(ThreadPoolTest, EmptyBatchReturns) {
+  ThreadPool pool(GetParam());
+  pool.RunAll({});
+}
+
+INSTANTIATE_TEST_SUITE_P(NumThreads, ThreadPoolTest,
+                         testing::Values(0, 1, 4));
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -14,189 +14,151 @@
 
 #include "vector_quantizer_impl.h"
 
-#include <bitset>
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <limits>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "Eigen/LU"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/types/optional.h"
-#include "audio/dsp/signal_vector_util.h"
+#include "absl/types/span.h"
 #include "include/ghc/filesystem.hpp"
+#include "model_store.h"
+#include "packed_bits.h"
 #include "sparse_matmul/sparse_matmul.h"
 
 namespace chromemedia {
 namespace codec {
 namespace {
-std::vector<std::vector<std::vector<float>>> CodeVectorsToCodebooks(
-    const std::vector<float>& flattened_code_vectors,
-    const std::vector<int16_t>& codebook_dimensions) {
-  // |codebook_dimensions| is a flattened array of arrays, where the inner
-  // arrays stored two values per codebook, the number of code vectors and the
-  // dimensionality of the vectors. Therefore, dividing the length of
-  // |codebook_dimensions| by two gives the number of codebooks.
-  const int num_codebooks = static_cast<int>(
-      std::ceil(static_cast<float>(codebook_dimensions.size()) / 2.f));
-  std::vector<std::vector<std::vector<float>>> codebooks(num_codebooks);
-
-  // |flattened_index| points to the start of an N-dimensional vector stored
-  // in |flattened_code_vectors|.
-  int flattened_index = 0;
-  for (int i = 0; i < num_codebooks; ++i) {
-    const int dimensionality = codebook_dimensions[2 * i + 1];
-
-    auto& current_codebook = codebooks[i];
-    current_codebook.resize(codebook_dimensions[2 * i]);
-    for (auto& current_code_vector : current_codebook) {
-      // Build a vector from |flattened_code_vectors| starting at index
-      // |flattened_index| ending at |flattened_index| + |dimensionality|.
-      current_code_vector = std::vector<float>(
-          flattened_code_vectors.begin() + flattened_index,
-          flattened_code_vectors.begin() + flattened_index + dimensionality);
-      flattened_index += dimensionality;
-    }
-  }
 
-  return codebooks;
+// Returns the index of the first smallest of |values|. The minimum is found
+// with a vectorized reduction before looking for its first occurrence.
+int ArgMin(const Eigen::Ref<const Eigen::RowVectorXf>& values) {
+  const float min_value = values.minCoeff();
+  const float* const begin = values.data();
+  const float* const end = begin + values.size();
+  const float* const min_position = std::find(begin, end, min_value);
+  // Only NaNs make the minimum not found.
+  return min_position == end ? 0 : static_cast<int>(min_position - begin);
 }
+
 }  // namespace
 
 std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
     int num_features, int num_bits,
     const WavegruBufferInterface& wavegru_buffer) {
-  std::vector<float> mean_vectors_array;
-  const std::string mean_vectors_model_name =
-      "lyra_16khz_quant_mean_vectors.gz";
-  auto status = csrblocksparse::ReadArrayFromBuffer(
-      wavegru_buffer.GetBuffer(mean_vectors_model_name),
-      wavegru_buffer.GetBufferSize(mean_vectors_model_name),
-      &mean_vectors_array);
-  if (!status.ok()) {
-    std::cerr << "Couldn't read " << mean_vectors_model_name << " from buffer."
-              << std::endl;
-    return nullptr;
-  }
+  auto model_store = ModelStore::Create(wavegru_buffer);
+  auto quantizer = Create(num_features, num_bits, model_store);
+  model_store->ReleaseWavegruBuffer();
+  return quantizer;
+}
 
+std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
+    int num_features, int num_bits, const ghc::filesystem::path& model_path) {
+  return Create(num_features, num_bits, ModelStore::Create(model_path));
+}
+
+std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
+    int num_features, int num_bits, std::shared_ptr<ModelStore> model_store) {
   if (num_bits > kMaxNumQuantizedBits) {
     std::cerr << "Specified number of bits " << num_bits
               << "exceeds the compile-time maximum " << kMaxNumQuantizedBits;
     return nullptr;
   }
 
-  std::vector<float> flat_transformation_matrix_array;
-  const std::string transmat_model_name = "lyra_16khz_quant_transmat.gz";
-  status = csrblocksparse::ReadArrayFromBuffer(
-      wavegru_buffer.GetBuffer(transmat_model_name),
-      wavegru_buffer.GetBufferSize(transmat_model_name),
-      &flat_transformation_matrix_array);
-  if (!status.ok()) {
-    std::cerr << "Couldn't read transmat.gz from buffer." << std::endl;
-    return nullptr;
-  }
-
-  std::vector<float> flattened_code_vectors;
-  const std::string code_vectors_model_name =
-      "lyra_16khz_quant_code_vectors.gz";
-  status = csrblocksparse::ReadArrayFromBuffer(
-      wavegru_buffer.GetBuffer(code_vectors_model_name),
-      wavegru_buffer.GetBufferSize(code_vectors_model_name),
-      &flattened_code_vectors);
-  if (!status.ok()) {
-    std::cerr << "Couldn't read code_vectors.gz from buffer." << std::endl;
-    return nullptr;
-  }
-
-  std::vector<int16_t> codebook_dimensions;
-  const std::string codebook_dimensions_model_name =
-      "lyra_16khz_quant_codebook_dimensions.gz";
-  status = csrblocksparse::ReadArrayFromBuffer(
-      wavegru_buffer.GetBuffer(codebook_dimensions_model_name),
-      wavegru_buffer.GetBufferSize(codebook_dimensions_model_name),
-      &codebook_dimensions);
-  if (!status.ok()) {
-    std::cerr << "Couldn't read codebook_dimensions.gz from buffer."
-              << std::endl;
+  const std::string kPrefix = "lyra_16khz_quant_";
+  std::shared_ptr<const Tables> tables = model_store->GetOrLoad<Tables>(
+      absl::StrCat(kPrefix, num_features),
+      [&]() -> std::unique_ptr<Tables> {
+        // Open gzipped vqs as arrays.
+        std::vector<float> mean_vector_array;
+        auto status = model_store->ReadArray(kPrefix + "mean_vectors.gz",
+                                             &mean_vector_array);
+        if (!status.ok()) {
+          std::cerr << "Couldn't read " << kPrefix << "mean_vectors.gz: "
+                    << status.message();
+          return nullptr;
+        }
+
+        std::vector<float> flat_transformation_matrix_array;
+        status = model_store->ReadArray(kPrefix + "transmat.gz",
+                                        &flat_transformation_matrix_array);
+        if (!status.ok()) {
+          std::cerr << "Couldn't read " << kPrefix << "transmat.gz: "
+                    << status.message();
+          return nullptr;
+        }
+
+        std::vector<float> flattened_code_vectors;
+        status = model_store->ReadArray(kPrefix + "code_vectors.gz",
+                                        &flattened_code_vectors);
+        if (!status.ok()) {
+          std::cerr << "Couldn't read " << kPrefix << "code_vectors.gz: "
+                    << status.message();
+          return nullptr;
+        }
+
+        std::vector<int16_t> codebook_dimensions;
+        status = model_store->ReadArray(kPrefix + "codebook_dimensions.gz",
+                                        &codebook_dimensions);
+        if (!status.ok()) {
+          std::cerr << "Couldn't read " << kPrefix
+                    << "codebook_dimensions.gz: " << status.message();
+          return nullptr;
+        }
+
+        if (mean_vector_array.size() < num_features ||
+            flat_transformation_matrix_array.size() <
+                num_features * num_features) {
+          std::cerr << "Mean vector and transformation matrix are too small "
+                    << "for " << num_features << " features.";
+          return nullptr;
+        }
+        const Eigen::Map<Eigen::RowVectorXf> mean_vector(
+            mean_vector_array.data(), num_features);
+        const Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
+                                       Eigen::RowMajor>>
+            transformation_matrix(flat_transformation_matrix_array.data(),
+                                  num_features, num_features);
+        return CreateTables(num_features, mean_vector, transformation_matrix,
+                            flattened_code_vectors, codebook_dimensions);
+      });
+  if (tables == nullptr) {
     return nullptr;
   }
-
-  const Eigen::Map<Eigen::RowVectorXf> mean_vector(mean_vectors_array.data(),
-                                                   num_features);
-  const Eigen::Map<
-      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
-      transformation_matrix(flat_transformation_matrix_array.data(),
-                            num_features, num_features);
-  return Create(num_features, num_bits, mean_vector, transformation_matrix,
-                flattened_code_vectors, codebook_dimensions);
+  return absl::WrapUnique(
+      new VectorQuantizerImpl(num_features, num_bits, std::move(tables)));
 }
 
 std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
-    int num_features, int num_bits, const ghc::filesystem::path& model_path) {
-  const std::string kPrefix = "lyra_16khz_quant_";
-
-  // Open gzipped vqs as arrays.
-  std::vector<float> mean_vector_array;
-  auto status = csrblocksparse::ReadArrayFromFile(
-      kPrefix + "mean_vectors.gz", &mean_vector_array, model_path.string());
-  if (!status.ok()) {
-    std::cerr << "Couldn't read " << model_path / (kPrefix + "mean_vectors.gz")
-              << ": " << status.message();
-    return nullptr;
-  }
-
+    int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
+    const Eigen::MatrixXf& transformation_matrix,
+    const std::vector<float>& flattened_code_vectors,
+    const std::vector<int16_t>& codebook_dimensions) {
   if (num_bits > kMaxNumQuantizedBits) {
     std::cerr << "Specified number of bits " << num_bits
               << "exceeds the compile-time maximum " << kMaxNumQuantizedBits;
     return nullptr;
   }
-
-  std::vector<float> flat_transformation_matrix_array;
-  status = csrblocksparse::ReadArrayFromFile(kPrefix + "transmat.gz",
-                                             &flat_transformation_matrix_array,
-                                             model_path.string());
-  if (!status.ok()) {
-    std::cerr << "Couldn't read " << model_path / (kPrefix + "transmat.gz")
-              << ": " << status.message();
-    return nullptr;
-  }
-
-  std::vector<float> flattened_code_vectors;
-  status = csrblocksparse::ReadArrayFromFile(kPrefix + "code_vectors.gz",
-                                             &flattened_code_vectors,
-                                             model_path.string());
-  if (!status.ok()) {
-    std::cerr << "Couldn't read " << model_path / (kPrefix + "code_vectors.gz")
-              << ": " << status.message();
-    return nullptr;
-  }
-
-  std::vector<int16_t> codebook_dimensions;
-  status = csrblocksparse::ReadArrayFromFile(kPrefix + "codebook_dimensions.gz",
-                                             &codebook_dimensions,
-                                             model_path.string());
-  if (!status.ok()) {
-    std::cerr << "Couldn't read "
-              << model_path / (kPrefix + "codebook_dimensions.gz") << ": "
-              << status.message();
+  std::unique_ptr<Tables> tables =
+      CreateTables(num_features, mean_vector, transformation_matrix,
+                   flattened_code_vectors, codebook_dimensions);
+  if (tables == nullptr) {
     return nullptr;
   }
-
-  const Eigen::Map<Eigen::RowVectorXf> mean_vector(mean_vector_array.data(),
-                                                   num_features);
-  const Eigen::Map<
-      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
-      transformation_matrix(flat_transformation_matrix_array.data(),
-                            num_features, num_features);
-  return Create(num_features, num_bits, mean_vector, transformation_matrix,
-                flattened_code_vectors, codebook_dimensions);
+  return absl::WrapUnique(
+      new VectorQuantizerImpl(num_features, num_bits, std::move(tables)));
 }
 
-std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
-    int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
+std::unique_ptr<VectorQuantizerImpl::Tables> VectorQuantizerImpl::CreateTables(
+    int num_features, const Eigen::RowVectorXf& mean_vector,
     const Eigen::MatrixXf& transformation_matrix,
     const std::vector<float>& flattened_code_vectors,
     const std::vector<int16_t>& codebook_dimensions) {
@@ -238,154 +200,292 @@ std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
     return nullptr;
   }
 
-  const std::vector<std::vector<std::vector<float>>> codebooks =
-      CodeVectorsToCodebooks(flattened_code_vectors, codebook_dimensions);
-  for (const auto& codebook : codebooks) {
-    if (codebook.empty()) {
+  // |codebook_dimensions| is a flattened array of arrays, where the inner
+  // arrays stored two values per codebook, the number of code vectors and the
+  // dimensionality of the vectors. Therefore, dividing the length of
+  // |codebook_dimensions| by two gives the number of codebooks.
+  const int num_codebooks = static_cast<int>(
+      std::ceil(static_cast<float>(codebook_dimensions.size()) / 2.f));
+  std::vector<Codebook> codebooks(num_codebooks);
+  // |flattened_index| points to the start of an N-dimensional vector stored
+  // in |flattened_code_vectors|.
+  int flattened_index = 0;
+  int start_dimension = 0;
+  for (int i = 0; i < num_codebooks; ++i) {
+    const int num_code_vectors = codebook_dimensions[2 * i];
+    const int dimensionality = codebook_dimensions[2 * i + 1];
+    if (num_code_vectors == 0) {
       std::cerr << "Codebook did not have any code vectors in it.";
       return nullptr;
     }
+    if (flattened_index + num_code_vectors * dimensionality >
+        flattened_code_vectors.size()) {
+      std::cerr << "There were " << flattened_code_vectors.size()
+                << " code vector components but the codebooks need more.";
+      return nullptr;
+    }
+
+    Codebook& codebook = codebooks[i];
+    // The flattened code vectors are the rows of a row major matrix, which is
+    // the transpose of |code_vectors|.
+    codebook.code_vectors =
+        Eigen::Map<const RowMajorMatrixXf>(
+            flattened_code_vectors.data() + flattened_index, num_code_vectors,
+            dimensionality)
+            .transpose();
+    codebook.squared_norms = codebook.code_vectors.colwise().squaredNorm();
+    codebook.start_dimension = start_dimension;
+    codebook.num_bits = static_cast<int>(
+        std::ceil(std::log2(static_cast<float>(num_code_vectors))));
+    flattened_index += num_code_vectors * dimensionality;
+    start_dimension += dimensionality;
   }
 
-  return absl::WrapUnique(new VectorQuantizerImpl(
-      num_features, num_bits, mean_vector, transformation_matrix, codebooks));
+  auto tables = absl::make_unique<Tables>();
+  tables->mean_vector = mean_vector;
+  tables->transformation_matrix = transformation_matrix;
+  tables->inverse_transformation_matrix = transformation_matrix.inverse();
+  tables->codebooks = std::move(codebooks);
+  return tables;
 }
 
-VectorQuantizerImpl::VectorQuantizerImpl(
-    int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
-    const Eigen::MatrixXf& transformation_matrix,
-    const std::vector<std::vector<std::vector<float>>>& codebooks)
+VectorQuantizerImpl::VectorQuantizerImpl(int num_features, int num_bits,
+                                         std::shared_ptr<const Tables> tables)
     : num_bits_(num_bits),
       num_features_(num_features),
-      mean_vector_(mean_vector),
-      transformation_matrix_(transformation_matrix),
-      inverse_transformation_matrix_(transformation_matrix.inverse()),
-      codebooks_(codebooks) {}
+      tables_(std::move(tables)),
+      mean_vector_(tables_->mean_vector),
+      transformation_matrix_(tables_->transformation_matrix),
+      inverse_transformation_matrix_(tables_->inverse_transformation_matrix),
+      codebooks_(tables_->codebooks),
+      centered_features_(num_features),
+      projected_features_(1, num_features),
+      chosen_indices_(codebooks_.size()),
+      klt_features_(num_features) {
+  int max_num_code_vectors = 0;
+  for (const Codebook& codebook : codebooks_) {
+    max_num_code_vectors = std::max(
+        max_num_code_vectors, static_cast<int>(codebook.code_vectors.cols()));
+  }
+  distances_.resize(max_num_code_vectors);
+}
 
 absl::optional<std::string> VectorQuantizerImpl::Quantize(
     const std::vector<float>& features) const {
+  std::vector<uint8_t> quantized_bits(NumPackedBytes(num_bits_));
+  if (!QuantizeToBits(features, absl::MakeSpan(quantized_bits))) {
+    return absl::nullopt;
+  }
+  return PackedBitsToString(quantized_bits, num_bits_);
+}
+
+bool VectorQuantizerImpl::QuantizeToBits(
+    const std::vector<float>& features,
+    absl::Span<uint8_t> quantized_bits) const {
   if (features.size() != num_features_) {
     std::cerr << "There were " << features.size()
               << " features to be quantized but expected " << num_features_;
+    return false;
+  }
+  if (quantized_bits.size() < NumPackedBytes(num_bits_)) {
+    std::cerr << "There were " << quantized_bits.size()
+              << " bytes for the quantized bits but expected "
+              << NumPackedBytes(num_bits_);
+    return false;
+  }
+
+  // Project into klt space.
+  centered_features_ =
+      Eigen::Map<const Eigen::RowVectorXf>(features.data(), num_features_) -
+      mean_vector_;
+  projected_features_.noalias() = centered_features_ * transformation_matrix_;
+
+  ChooseCodeVectors(projected_features_, absl::MakeSpan(distances_),
+                    absl::MakeSpan(chosen_indices_));
+  PackIndices(chosen_indices_, quantized_bits);
+  return true;
+}
+
+absl::optional<std::vector<std::string>> VectorQuantizerImpl::QuantizeBatch(
+    const std::vector<std::vector<float>>& features) const {
+  const int num_frames = features.size();
+  if (num_frames == 0) {
+    return std::vector<std::string>();
+  }
+  std::vector<float> batch_features(num_frames * num_features_);
+  for (int i = 0; i < num_frames; ++i) {
+    if (features[i].size() != num_features_) {
+      std::cerr << "There were " << features[i].size()
+                << " features to be quantized but expected " << num_features_;
+      return absl::nullopt;
+    }
+    std::copy(features[i].begin(), features[i].end(),
+              batch_features.begin() + i * num_features_);
+  }
+
+  const int num_bytes = NumPackedBytes(num_bits_);
+  std::vector<uint8_t> quantized_bits(num_frames * num_bytes);
+  if (!QuantizeBatchToBits(batch_features, num_frames,
+                           absl::MakeSpan(quantized_bits))) {
     return absl::nullopt;
   }
+  std::vector<std::string> quantized_features(num_frames);
+  for (int frame = 0; frame < num_frames; ++frame) {
+    quantized_features[frame] = PackedBitsToString(
+        absl::MakeConstSpan(quantized_bits).subspan(frame * num_bytes,
+                                                    num_bytes),
+        num_bits_);
+  }
+  return quantized_features;
+}
 
-  Eigen::RowVectorXf projected_features(num_features_);
-  for (int i = 0; i < features.size(); ++i) {
-    projected_features(i) = features.at(i);
+bool VectorQuantizerImpl::QuantizeBatchToBits(
+    absl::Span<const float> features, int num_frames,
+    absl::Span<uint8_t> quantized_bits) const {
+  if (num_frames <= 0 || features.size() != num_frames * num_features_) {
+    std::cerr << "There were " << features.size() << " features in "
+              << num_frames << " frames to be quantized but expected "
+              << num_features_ << " per frame";
+    return false;
   }
-  // Project into klt space.
-  projected_features =
-      (projected_features - mean_vector_) * transformation_matrix_;
+  if (quantized_bits.size() % num_frames != 0 ||
+      quantized_bits.size() / num_frames < NumPackedBytes(num_bits_)) {
+    std::cerr << "There were " << quantized_bits.size()
+              << " bytes for the quantized bits of " << num_frames
+              << " frames but expected " << NumPackedBytes(num_bits_)
+              << " per frame";
+    return false;
+  }
+
+  // Project all frames into klt space at once.
+  batch_projected_features_.noalias() =
+      (Eigen::Map<const RowMajorMatrixXf>(features.data(), num_frames,
+                                          num_features_)
+           .rowwise() -
+       mean_vector_) *
+      transformation_matrix_;
+
+  const int num_codebooks = codebooks_.size();
+  batch_distances_.resize(num_frames * distances_.size());
+  batch_chosen_indices_.resize(num_frames * num_codebooks);
+  ChooseCodeVectors(batch_projected_features_,
+                    absl::MakeSpan(batch_distances_),
+                    absl::MakeSpan(batch_chosen_indices_));
+
+  const int num_bytes = quantized_bits.size() / num_frames;
+  for (int frame = 0; frame < num_frames; ++frame) {
+    PackIndices(absl::MakeConstSpan(batch_chosen_indices_)
+                    .subspan(frame * num_codebooks, num_codebooks),
+                quantized_bits.subspan(frame * num_bytes, num_bytes));
+  }
+  return true;
+}
 
-  std::bitset<kMaxNumQuantizedBits> quantized_bits = 0;
-  uint32_t bit_shift_amount = 0;
-  uint32_t start_dimension = 0;
+void VectorQuantizerImpl::ChooseCodeVectors(
+    const RowMajorMatrixXf& projected_features, absl::Span<float> distances,
+    absl::Span<int> chosen_indices) const {
+  const int num_frames = projected_features.rows();
+  const int num_codebooks = codebooks_.size();
+  std::fill(chosen_indices.begin(), chosen_indices.end(), 0);
   // Iterate over all the codebooks.
-  for (const auto& codebook : codebooks_) {
-    // The number of bits needed to represent all code vectors in this code
-    // book.
-    int current_num_bits = std::ceil(std::log2(codebook.size()));
-    if (current_num_bits == 0) {
+  for (int i = 0; i < num_codebooks; ++i) {
+    const Codebook& codebook = codebooks_[i];
+    if (codebook.num_bits == 0) {
       break;
     }
-    bit_shift_amount += current_num_bits;
-    // There will be at least 1 code vector within each codebook.
-    uint32_t dimensionality = codebook.at(0).size();
-
-    // Take the sub dimensions of projected_features from current codebook
-    // dimensionality.
-    Eigen::RowVectorXf sub_projected_feature =
-        projected_features.segment(start_dimension, dimensionality);
-    start_dimension += dimensionality;
-    int chosen_index = FindNearest(sub_projected_feature, codebook);
-
-    // Fill quantized_bits starting from the MSB to the LSB with the bits from
-    // subsequent chosen_indexes.
-    // Eg for the two bit patterns appended in order and NUM_BITS bits = 16
-    //
-    // 0b10001, current_num_bits = 5 ->
-    //   bit_shift_amount = 5
-    //   chosen_index_shift = 16 - 5 = 11
-    // 0b0010, current_num_bits = 4 ->
-    //   bit_shift_amount = 5 + 4 = 9
-    //   chosen_index_shift = 16 - 9 = 7
-    //
-    //  quantized_bits will become:
-    //  |1 0 0 0 1 0 0 1 0 _ _ _ _ _ _ _|
-    //   |       |       |             |
-    //  bit15  bit11    bit7          bit0
-
-    int chosen_index_shift = quantized_bits.size() - bit_shift_amount;
-    quantized_bits |= std::bitset<quantized_bits.size()>(chosen_index)
-                      << chosen_index_shift;
+    // The squared l2 distance ||x - c||^2 from each frame x to each code
+    // vector c, less ||x||^2 which does not change the closest code vector, is
+    // ||c||^2 - 2 x.c. This computes them all as a single matrix product.
+    Eigen::Map<RowMajorMatrixXf> codebook_distances(
+        distances.data(), num_frames, codebook.code_vectors.cols());
+    codebook_distances.noalias() =
+        -2.f * projected_features.middleCols(codebook.start_dimension,
+                                             codebook.code_vectors.rows()) *
+        codebook.code_vectors;
+    codebook_distances.rowwise() += codebook.squared_norms;
+    for (int frame = 0; frame < num_frames; ++frame) {
+      chosen_indices[frame * num_codebooks + i] =
+          ArgMin(codebook_distances.row(frame));
+    }
   }
-
-  return quantized_bits.to_string().substr(0, num_bits_);
 }
 
-std::vector<float> VectorQuantizerImpl::DecodeToLossyFeatures(
-    const std::string& quantized_features) const {
-  const std::bitset<kMaxNumQuantizedBits> quantized_bits(quantized_features);
-  Eigen::RowVectorXf features(num_features_);
-  int dimension = 0;
-  int bit_shift_amount = num_bits_;
-  for (auto& codebook : codebooks_) {
-    // Shift right by the total bit width minus the accumulated bit width so
-    // far.
-    int current_num_bits = static_cast<int>(
-        std::ceil(std::log2(static_cast<float>(codebook.size()))));
-    if (bit_shift_amount < current_num_bits) {
-      exit(EXIT_FAILURE);
-    }
-    bit_shift_amount -= current_num_bits;
-    // Mask off bits we have already seen.
-    const std::bitset<kMaxNumQuantizedBits> kPreviouslySeenMask(
-        (1 << current_num_bits) - 1);
-    int code_vector_index =
-        ((quantized_bits >> bit_shift_amount) & kPreviouslySeenMask).to_ulong();
-
-    for (auto component : codebook.at(code_vector_index)) {
-      features(dimension) = component;
-      ++dimension;
+void VectorQuantizerImpl::PackIndices(
+    absl::Span<const int> chosen_indices,
+    absl::Span<uint8_t> quantized_bits) const {
+  std::fill(quantized_bits.begin(), quantized_bits.end(), 0);
+  // Fill |quantized_bits| from the first bit on with the bits of subsequent
+  // chosen indices, each from its most significant bit. Eg for the two bit
+  // patterns 0b10001 and 0b0010 appended in order to 16 bits:
+  //
+  //  |1 0 0 0 1 0 0 1 0 _ _ _ _ _ _ _|
+  //   |         |       |           |
+  //  bit0      bit5    bit9        bit15
+  //
+  // Bits past |num_bits_| are dropped.
+  int bit_offset = 0;
+  for (int i = 0; i < codebooks_.size() && bit_offset < num_bits_; ++i) {
+    const int current_num_bits = codebooks_[i].num_bits;
+    if (current_num_bits == 0) {
+      break;
     }
+    const int num_dropped_bits =
+        std::max(bit_offset + current_num_bits - num_bits_, 0);
+    WritePackedBits(chosen_indices[i] >> num_dropped_bits,
+                    current_num_bits - num_dropped_bits, bit_offset,
+                    quantized_bits);
+    bit_offset += current_num_bits;
   }
-  // Project back into the log mel spectrogram domain.
-  features = features * inverse_transformation_matrix_ + mean_vector_;
+}
 
-  return std::vector<float>(features.data(), features.data() + features.size());
+std::vector<float> VectorQuantizerImpl::DecodeToLossyFeatures(
+    const std::string& quantized_features) const {
+  std::vector<uint8_t> quantized_bits(NumPackedBytes(num_bits_));
+  StringToPackedBits(quantized_features, num_bits_,
+                     absl::MakeSpan(quantized_bits));
+  std::vector<float> features(num_features_);
+  DecodeBitsToLossyFeatures(quantized_bits, absl::MakeSpan(features));
+  return features;
 }
 
-int VectorQuantizerImpl::FindNearest(
-    const Eigen::RowVectorXf& sub_projected_features,
-    const std::vector<std::vector<float>>& codebook) const {
-  float min_dist = std::numeric_limits<float>::max();
-  int chosen_index = 0;
-  int current_index = 0;
-
-  // Iterate over all the code vectors in this subspace.
-  for (const auto& code_vector : codebook) {
-    float dist = 0;
-    // Iterate over each dimension of the current code vector.
-    for (int dimension = 0; dimension < sub_projected_features.size();
-         ++dimension) {
-      // Find the closest l2 distance of each code vector.
-      dist += audio_dsp::Square(sub_projected_features(dimension) -
-                                code_vector.at(dimension));
-      // No need to keep calculating distance if we are already over the
-      // previous min.
-      if (dist >= min_dist) {
-        break;
-      }
+bool VectorQuantizerImpl::DecodeBitsToLossyFeatures(
+    absl::Span<const uint8_t> quantized_bits,
+    absl::Span<float> features) const {
+  if (features.size() != num_features_) {
+    std::cerr << "There were " << features.size()
+              << " features to be decoded but expected " << num_features_;
+    return false;
+  }
+  if (quantized_bits.size() < NumPackedBytes(num_bits_)) {
+    std::cerr << "There were " << quantized_bits.size()
+              << " bytes of quantized bits but expected "
+              << NumPackedBytes(num_bits_);
+    return false;
+  }
+
+  int bit_offset = 0;
+  for (const Codebook& codebook : codebooks_) {
+    const int current_num_bits = codebook.num_bits;
+    if (bit_offset + current_num_bits > num_bits_) {
+      exit(EXIT_FAILURE);
     }
-    if (dist < min_dist) {
-      min_dist = dist;
-      chosen_index = current_index;
+    const int code_vector_index =
+        ReadPackedBits(quantized_bits, bit_offset, current_num_bits);
+    bit_offset += current_num_bits;
+    if (code_vector_index >= codebook.code_vectors.cols()) {
+      exit(EXIT_FAILURE);
     }
-    current_index++;
-  }
 
-  return chosen_index;
+    klt_features_.segment(codebook.start_dimension,
+                          codebook.code_vectors.rows()) =
+        codebook.code_vectors.col(code_vector_index).transpose();
+  }
+  // Project back into the log mel spectrogram domain.
+  Eigen::Map<Eigen::RowVectorXf> lossy_features(features.data(),
+                                                num_features_);
+  lossy_features.noalias() = klt_features_ * inverse_transformation_matrix_;
+  lossy_features += mean_vector_;
+  return true;
 }
 
 }  // namespace codec
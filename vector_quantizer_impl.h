@@ -24,7 +24,9 @@
 
 #include "Eigen/Core"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "include/ghc/filesystem.hpp"
+#include "model_store.h"
 #include "vector_quantizer_interface.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
 
@@ -43,6 +45,11 @@ class VectorQuantizerImpl : public VectorQuantizerInterface {
       int num_features, int num_bits,
       const WavegruBufferInterface& wavegru_buffer);
 
+  // The codebooks and transformation matrices are shared with all other
+  // quantizers created from |model_store|.
+  static std::unique_ptr<VectorQuantizerImpl> Create(
+      int num_features, int num_bits, std::shared_ptr<ModelStore> model_store);
+
   // Returns nullptr if the dimensions of mean_vector and transformation_matrix
   // do not match num_features or if codebooks contains unexpected number of
   // code_vectors or if the transformation matrix is not invertible.
@@ -57,38 +64,111 @@ class VectorQuantizerImpl : public VectorQuantizerInterface {
   absl::optional<std::string> Quantize(
       const std::vector<float>& features) const override;
 
+  // Quantizes each of |features| as Quantize() does, but projects and searches
+  // all of them at once, which is faster for many frames such as when
+  // transcoding files. Returns a nullopt if any does not have |num_features|.
+  absl::optional<std::vector<std::string>> QuantizeBatch(
+      const std::vector<std::vector<float>>& features) const;
+
+  // Quantizes the features as Quantize() does, but packs the indices of the
+  // code vectors directly into |quantized_bits| without allocating.
+  bool QuantizeToBits(const std::vector<float>& features,
+                      absl::Span<uint8_t> quantized_bits) const override;
+
+  // Quantizes the frames as QuantizeToBits() does, but projects and searches
+  // all of them at once. Only allocates when |num_frames| changes.
+  bool QuantizeBatchToBits(absl::Span<const float> features, int num_frames,
+                           absl::Span<uint8_t> quantized_bits) const override;
+
   // Unpacks the string of bits and looks up the KLT features. Then multiplies
   // by the inverse transformation matrix and adds the mean.
   std::vector<float> DecodeToLossyFeatures(
       const std::string& quantized_features) const override;
 
+  // Looks up the code vectors of packed bits as DecodeToLossyFeatures() does,
+  // but without allocating.
+  bool DecodeBitsToLossyFeatures(absl::Span<const uint8_t> quantized_bits,
+                                 absl::Span<float> features) const override;
+
  private:
   static constexpr int kMaxNumQuantizedBits = 200;
 
-  VectorQuantizerImpl(
-      int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
+  using RowMajorMatrixXf =
+      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+  // The code vectors of one subspace of the klt feature space.
+  struct Codebook {
+    // The code vectors are the columns of this |dimensionality| x
+    // |num_code_vectors| matrix. It is stored row major, so that each component
+    // of all the code vectors is contiguous.
+    RowMajorMatrixXf code_vectors;
+    // The squared l2 norm of each code vector.
+    Eigen::RowVectorXf squared_norms;
+    // The first dimension of the subspace in the klt feature space.
+    int start_dimension;
+    // The number of bits needed to represent all code vectors.
+    int num_bits;
+  };
+
+  // The immutable parameters of the quantizer, which can be shared between
+  // instances.
+  struct Tables {
+    // The mean of each feature over the dataset.
+    Eigen::RowVectorXf mean_vector;
+    // The transformation matrix used for projecting the mean subtracted
+    // features vector into the klt feature space.
+    Eigen::MatrixXf transformation_matrix;
+    // Store the inverse for DecodeToLossyFeatures.
+    Eigen::MatrixXf inverse_transformation_matrix;
+    // The codebooks of the consecutive subspaces of the klt feature space.
+    std::vector<Codebook> codebooks;
+  };
+
+  // Returns nullptr under the same conditions as Create().
+  static std::unique_ptr<Tables> CreateTables(
+      int num_features, const Eigen::RowVectorXf& mean_vector,
       const Eigen::MatrixXf& transformation_matrix,
-      const std::vector<std::vector<std::vector<float>>>& codebooks);
+      const std::vector<float>& code_vectors,
+      const std::vector<int16_t>& codebook_dimensions);
+
+  VectorQuantizerImpl(int num_features, int num_bits,
+                      std::shared_ptr<const Tables> tables);
 
   VectorQuantizerImpl() = delete;
-  // Find the closest (l2) code vector to sub_projected_features.
-  int FindNearest(const Eigen::RowVectorXf& sub_projected_features,
-                  const std::vector<std::vector<float>>& codebook) const;
+
+  // Chooses the closest (l2) code vector of each codebook to each row of
+  // |projected_features|, writing their indices row after row into
+  // |chosen_indices|. |distances| is scratch space for the distances from all
+  // rows to the code vectors of the largest codebook.
+  void ChooseCodeVectors(const RowMajorMatrixXf& projected_features,
+                         absl::Span<float> distances,
+                         absl::Span<int> chosen_indices) const;
+
+  // Packs the indices of the chosen code vectors of each codebook into the
+  // first |num_bits_| bits of |quantized_bits| and zeroes the others.
+  void PackIndices(absl::Span<const int> chosen_indices,
+                   absl::Span<uint8_t> quantized_bits) const;
 
   const int num_bits_;
   const int num_features_;
-  // The mean of each feature over the dataset.
-  const Eigen::RowVectorXf mean_vector_;
-  // The transformation matrix used for projecting the mean subtracted features
-  // vector into the klt feature space.
-  const Eigen::MatrixXf transformation_matrix_;
-  // Store the inverse for DecodeToLossyFeatures.
-  const Eigen::MatrixXf inverse_transformation_matrix_;
-  // The first dimension contains the subspaces of the klt feature space,
-  // of length |subvector_indexes_ + 1|. The second dimension contains the
-  // code vector points in that subspace. The third dimension contains
-  // the components of the code vector, of length |subvector_indexes[i]|.
-  const std::vector<std::vector<std::vector<float>>> codebooks_;
+  const std::shared_ptr<const Tables> tables_;
+  // References into |tables_|.
+  const Eigen::RowVectorXf& mean_vector_;
+  const Eigen::MatrixXf& transformation_matrix_;
+  const Eigen::MatrixXf& inverse_transformation_matrix_;
+  const std::vector<Codebook>& codebooks_;
+
+  // Scratch space of QuantizeToBits() and DecodeBitsToLossyFeatures(), which
+  // makes them unsafe to call concurrently on one instance.
+  mutable Eigen::RowVectorXf centered_features_;
+  mutable RowMajorMatrixXf projected_features_;
+  mutable std::vector<float> distances_;
+  mutable std::vector<int> chosen_indices_;
+  mutable Eigen::RowVectorXf klt_features_;
+  // Scratch space of QuantizeBatchToBits(), sized for the last batch.
+  mutable RowMajorMatrixXf batch_projected_features_;
+  mutable std::vector<float> batch_distances_;
+  mutable std::vector<int> batch_chosen_indices_;
 
   friend class VectorQuantizerImplPeer;
 };
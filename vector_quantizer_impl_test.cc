@@ -15,6 +15,7 @@
 #include "vector_quantizer_impl.h"
 
 #include <bitset>
+#include <climits>
 #include <cstdint>
 #include <iterator>
 #include <memory>
@@ -27,6 +28,7 @@
 #include "Eigen/Core"
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
@@ -78,11 +80,32 @@ class VectorQuantizerImplPeer {
     return quantizer_->Quantize(features);
   }
 
+  absl::optional<std::vector<std::string>> QuantizeBatch(
+      const std::vector<std::vector<float>>& features) const {
+    return quantizer_->QuantizeBatch(features);
+  }
+
   std::vector<float> DecodeToLossyFeatures(
       const std::string& quantized_features) const {
     return quantizer_->DecodeToLossyFeatures(quantized_features);
   }
 
+  bool QuantizeToBits(const std::vector<float>& features,
+                      absl::Span<uint8_t> quantized_bits) const {
+    return quantizer_->QuantizeToBits(features, quantized_bits);
+  }
+
+  bool QuantizeBatchToBits(absl::Span<const float> features, int num_frames,
+                           absl::Span<uint8_t> quantized_bits) const {
+    return quantizer_->QuantizeBatchToBits(features, num_frames,
+                                           quantized_bits);
+  }
+
+  bool DecodeBitsToLossyFeatures(absl::Span<const uint8_t> quantized_bits,
+                                 absl::Span<float> features) const {
+    return quantizer_->DecodeBitsToLossyFeatures(quantized_bits, features);
+  }
+
  private:
   explicit VectorQuantizerImplPeer(
       std::unique_ptr<VectorQuantizerImpl> quantizer)
@@ -213,6 +236,72 @@ TEST_F(VectorQuantizerImplTest, QuantizeValidNumFeatures) {
   EXPECT_THAT(quantized_or.value(), expected.to_string());
 }
 
+TEST_F(VectorQuantizerImplTest, QuantizeBatchMatchesQuantize) {
+  const std::vector<std::vector<float>> features = {
+      {0.9083545, -0.63350268, 0.9596105, -0.67812588},
+      {0.1, 0.5, 0.3, -0.2},
+      {-1.5, 2.0, 0.25, 0.75}};
+
+  auto quantized_or = quantizer_->QuantizeBatch(features);
+
+  ASSERT_TRUE(quantized_or.has_value());
+  ASSERT_EQ(quantized_or.value().size(), features.size());
+  for (int i = 0; i < features.size(); ++i) {
+    EXPECT_EQ(quantized_or.value()[i], quantizer_->Quantize(features[i]));
+  }
+}
+
+TEST_F(VectorQuantizerImplTest, QuantizeBatchWrongNumFeatures) {
+  const std::vector<std::vector<float>> features = {
+      std::vector<float>(kTestNumFeatures),
+      std::vector<float>(kTestNumFeatures + 1)};
+
+  EXPECT_FALSE(quantizer_->QuantizeBatch(features).has_value());
+}
+
+TEST_F(VectorQuantizerImplTest, QuantizeBatchToBitsMatchesQuantizeToBits) {
+  const std::vector<std::vector<float>> features = {
+      {0.9083545, -0.63350268, 0.9596105, -0.67812588},
+      {0.1, 0.5, 0.3, -0.2},
+      {-1.5, 2.0, 0.25, 0.75}};
+  const int num_frames = features.size();
+  std::vector<float> batch_features;
+  for (const auto& frame_features : features) {
+    batch_features.insert(batch_features.end(), frame_features.begin(),
+                          frame_features.end());
+  }
+  // Leaves a spare byte after the bits of each frame.
+  const int num_bytes = kTestNumBits / CHAR_BIT + 1;
+  std::vector<uint8_t> quantized_bits(num_frames * num_bytes, 0b11111111);
+
+  // Quantizing twice reuses the scratch space of the first batch.
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(quantizer_->QuantizeBatchToBits(
+        batch_features, num_frames, absl::MakeSpan(quantized_bits)));
+    for (int frame = 0; frame < num_frames; ++frame) {
+      std::vector<uint8_t> expected(num_bytes);
+      ASSERT_TRUE(quantizer_->QuantizeToBits(features[frame],
+                                             absl::MakeSpan(expected)));
+      EXPECT_EQ(std::vector<uint8_t>(
+                    quantized_bits.begin() + frame * num_bytes,
+                    quantized_bits.begin() + (frame + 1) * num_bytes),
+                expected);
+    }
+  }
+}
+
+TEST_F(VectorQuantizerImplTest, QuantizeBatchToBitsInvalidSizes) {
+  const std::vector<float> batch_features(2 * kTestNumFeatures);
+  std::vector<uint8_t> quantized_bits(2 * kTestNumBits / CHAR_BIT);
+
+  EXPECT_FALSE(quantizer_->QuantizeBatchToBits(batch_features, 0,
+                                               absl::MakeSpan(quantized_bits)));
+  EXPECT_FALSE(quantizer_->QuantizeBatchToBits(batch_features, 3,
+                                               absl::MakeSpan(quantized_bits)));
+  EXPECT_FALSE(quantizer_->QuantizeBatchToBits(
+      batch_features, 2, absl::MakeSpan(quantized_bits).subspan(2)));
+}
+
 TEST_F(VectorQuantizerImplTest, DecodeToLossyFeaturesValidNumFeatures) {
   // Bit pattern 0b110 corresponds to the quantized features {-0.5, -0.5, -0.25,
   // -0.25} in the klt domain. After multiplying by the inverse of the
@@ -230,6 +319,39 @@ TEST_F(VectorQuantizerImplTest, DecodeToLossyFeaturesValidNumFeatures) {
               testing::Pointwise(testing::FloatEq(), expected_features));
 }
 
+TEST_F(VectorQuantizerImplTest, QuantizeToBitsPacksIndices) {
+  // As in QuantizeValidNumFeatures, the chosen bit pattern is 0b001.
+  const std::vector<float> features(
+      {0.9083545, -0.63350268, 0.9596105, -0.67812588});
+  std::vector<uint8_t> quantized_bits(kTestNumBits / CHAR_BIT, 0b11111111);
+
+  ASSERT_TRUE(
+      quantizer_->QuantizeToBits(features, absl::MakeSpan(quantized_bits)));
+
+  std::vector<uint8_t> expected(kTestNumBits / CHAR_BIT, 0);
+  expected[0] = 0b00100000;
+  EXPECT_EQ(quantized_bits, expected);
+  EXPECT_FALSE(quantizer_->QuantizeToBits(
+      features, absl::MakeSpan(quantized_bits).subspan(1)));
+}
+
+TEST_F(VectorQuantizerImplTest, DecodeBitsToLossyFeaturesMatchesString) {
+  // As in DecodeToLossyFeaturesValidNumFeatures, for the bit pattern 0b110.
+  std::vector<uint8_t> quantized_bits(kTestNumBits / CHAR_BIT, 0);
+  quantized_bits[0] = 0b11000000;
+  const std::vector<float> expected_features(
+      {0.18114592, 1.51749929, 0.47358171, 0.59523003});
+  std::vector<float> features(kTestNumFeatures);
+
+  ASSERT_TRUE(quantizer_->DecodeBitsToLossyFeatures(
+      quantized_bits, absl::MakeSpan(features)));
+
+  EXPECT_THAT(features,
+              testing::Pointwise(testing::FloatEq(), expected_features));
+  EXPECT_FALSE(quantizer_->DecodeBitsToLossyFeatures(
+      quantized_bits, absl::MakeSpan(features).subspan(1)));
+}
+
 TEST_F(VectorQuantizerImplTest, DefaultCreateSucceedsWithProdNumFeatures) {
   auto quantizer = VectorQuantizerImpl::Create(
       kNumFramesPerPacket * kNumFeatures, 120, model_path_);
@@ -237,6 +359,30 @@ TEST_F(VectorQuantizerImplTest, DefaultCreateSucceedsWithProdNumFeatures) {
   EXPECT_NE(quantizer, nullptr);
 }
 
+// Lossy features are a code vector of each codebook in the klt domain, so
+// quantizing them must find those same code vectors again.
+TEST_F(VectorQuantizerImplTest, QuantizeFindsDecodedCodeVectors) {
+  auto quantizer = VectorQuantizerImpl::Create(
+      kNumFramesPerPacket * kNumFeatures, kTestNumBits, model_path_);
+  ASSERT_NE(quantizer, nullptr);
+
+  std::vector<std::string> quantized_features;
+  for (const float value : {-1.f, 0.f, 0.5f, 2.f}) {
+    auto quantized_or = quantizer->Quantize(
+        std::vector<float>(kNumFramesPerPacket * kNumFeatures, value));
+    ASSERT_TRUE(quantized_or.has_value());
+    quantized_features.push_back(quantized_or.value());
+  }
+  std::vector<std::vector<float>> lossy_features;
+  for (const std::string& quantized : quantized_features) {
+    lossy_features.push_back(quantizer->DecodeToLossyFeatures(quantized));
+  }
+
+  auto requantized_or = quantizer->QuantizeBatch(lossy_features);
+  ASSERT_TRUE(requantized_or.has_value());
+  EXPECT_EQ(requantized_or.value(), quantized_features);
+}
+
 TEST_F(VectorQuantizerImplTest, TooManyBits) {
   // kMaxNumQuantizedBits is 200; try 201.
   auto quantizer = VectorQuantizerImpl::Create(
@@ -17,10 +17,15 @@
 #ifndef LYRA_CODEC_VECTOR_QUANTIZER_INTERFACE_H_
 #define LYRA_CODEC_VECTOR_QUANTIZER_INTERFACE_H_
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #include "absl/types/optional.h"  // IWYU pragma: keep
+#include "absl/types/span.h"
+#include "packed_bits.h"
 
 namespace chromemedia {
 namespace codec {
@@ -39,6 +44,69 @@ class VectorQuantizerInterface {
   // spectrogram domain.
   virtual std::vector<float> DecodeToLossyFeatures(
       const std::string& quantized_features) const = 0;
+
+  // As Quantize(), but packs the bits into |quantized_bits| as described in
+  // packed_bits.h, zeroing its unused bits. Returns false on failure or if
+  // |quantized_bits| is too short. Implementations override this to avoid the
+  // string which this default goes through.
+  virtual bool QuantizeToBits(const std::vector<float>& features,
+                              absl::Span<uint8_t> quantized_bits) const {
+    const absl::optional<std::string> quantized_or = Quantize(features);
+    if (!quantized_or.has_value() ||
+        quantized_or.value().size() > CHAR_BIT * quantized_bits.size()) {
+      return false;
+    }
+    std::fill(quantized_bits.begin(), quantized_bits.end(), 0);
+    StringToPackedBits(quantized_or.value(), quantized_or.value().size(),
+                       quantized_bits);
+    return true;
+  }
+
+  // As QuantizeToBits() for each of |num_frames| frames, whose features follow
+  // each other in |features| and whose bits are packed into consecutive parts
+  // of |quantized_bits| of equal size. Returns false on failure or if the
+  // sizes are not multiples of |num_frames|. Implementations override this to
+  // search the codebooks for all frames at once.
+  virtual bool QuantizeBatchToBits(absl::Span<const float> features,
+                                   int num_frames,
+                                   absl::Span<uint8_t> quantized_bits) const {
+    if (num_frames <= 0 || features.size() % num_frames != 0 ||
+        quantized_bits.size() % num_frames != 0) {
+      return false;
+    }
+    const int num_features = features.size() / num_frames;
+    const int num_bytes = quantized_bits.size() / num_frames;
+    std::vector<float> frame_features(num_features);
+    for (int frame = 0; frame < num_frames; ++frame) {
+      const auto frame_begin = features.begin() + frame * num_features;
+      std::copy(frame_begin, frame_begin + num_features,
+                frame_features.begin());
+      if (!QuantizeToBits(frame_features,
+                          quantized_bits.subspan(frame * num_bytes,
+                                                 num_bytes))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // As DecodeToLossyFeatures(), but from bits packed as by QuantizeToBits()
+  // and into |features|. Returns false if |features| is not of the size of
+  // the decoded features. Implementations override this to avoid the string
+  // and vector which this default goes through, passing all the bits of
+  // |quantized_bits|.
+  virtual bool DecodeBitsToLossyFeatures(
+      absl::Span<const uint8_t> quantized_bits,
+      absl::Span<float> features) const {
+    const std::vector<float> decoded_features = DecodeToLossyFeatures(
+        PackedBitsToString(quantized_bits, CHAR_BIT * quantized_bits.size()));
+    if (decoded_features.size() != features.size()) {
+      return false;
+    }
+    std::copy(decoded_features.begin(), decoded_features.end(),
+              features.begin());
+    return true;
+  }
 };
 
 }  // namespace codec
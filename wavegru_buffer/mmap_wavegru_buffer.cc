@@ -0,0 +1,114 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wavegru_buffer/mmap_wavegru_buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<MmapWavegruBuffer> MmapWavegruBuffer::Create(
+    const ghc::filesystem::path& path) {
+  // WrapUnique is used because of private c'tor.
+  auto buffer = absl::WrapUnique(new MmapWavegruBuffer());
+  std::error_code error_code;
+  if (ghc::filesystem::is_directory(path, error_code)) {
+    for (const auto& entry :
+         ghc::filesystem::directory_iterator(path, error_code)) {
+      if (entry.is_regular_file() && !buffer->MapFile(entry.path())) {
+        return nullptr;
+      }
+    }
+    if (error_code) {
+      std::cerr << "Could not list " << path << ": " << error_code.message()
+                << std::endl;
+      return nullptr;
+    }
+  } else if (!buffer->MapFile(path)) {
+    return nullptr;
+  }
+  return buffer;
+}
+
+MmapWavegruBuffer::~MmapWavegruBuffer() {
+  for (const auto& mapping : mappings_) {
+    if (mapping.second.second > 0) {
+      munmap(const_cast<char*>(mapping.second.first), mapping.second.second);
+    }
+  }
+}
+
+uint64_t MmapWavegruBuffer::GetBufferSize(const std::string& model_name) const {
+  const auto it = mappings_.find(model_name);
+  return it == mappings_.end() ? 0 : it->second.second;
+}
+
+const char* MmapWavegruBuffer::GetBuffer(const std::string& model_name) const {
+  const auto it = mappings_.find(model_name);
+  return it == mappings_.end() ? nullptr : it->second.first;
+}
+
+bool MmapWavegruBuffer::MapFile(const ghc::filesystem::path& file) {
+  const int fd = open(file.string().c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Could not open " << file << ": " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    std::cerr << "Could not stat " << file << ": " << std::strerror(errno)
+              << std::endl;
+    close(fd);
+    return false;
+  }
+  const uint64_t size = file_stat.st_size;
+  // mmap() does not accept empty mappings, empty files get a null buffer.
+  const char* data = nullptr;
+  if (size > 0) {
+    void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+      std::cerr << "Could not map " << file << ": " << std::strerror(errno)
+                << std::endl;
+      close(fd);
+      return false;
+    }
+    data = static_cast<const char*>(address);
+  }
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  mappings_[file.filename().string()] = std::make_pair(data, size);
+  return true;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
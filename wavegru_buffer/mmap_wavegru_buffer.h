@@ -0,0 +1,70 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_WAVEGRU_BUFFER_MMAP_WAVEGRU_BUFFER_H_
+#define LYRA_CODEC_WAVEGRU_BUFFER_MMAP_WAVEGRU_BUFFER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "include/ghc/filesystem.hpp"
+#include "wavegru_buffer/wavegru_buffer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A WavegruBufferInterface whose buffers are read-only shared memory mappings
+// of model files. The pages are backed by the page cache, so processes mapping
+// the same files share a single physical copy, and nothing is read from disk
+// until it is touched. Every buffer starts on a page boundary.
+class MmapWavegruBuffer : public WavegruBufferInterface {
+ public:
+  // Maps |path| if it is a regular file, or every regular file directly in
+  // |path| if it is a directory. Buffers are named by file name, without the
+  // directory. Returns nullptr if any of the files cannot be mapped.
+  static std::unique_ptr<MmapWavegruBuffer> Create(
+      const ghc::filesystem::path& path);
+
+  ~MmapWavegruBuffer();
+
+  MmapWavegruBuffer(const MmapWavegruBuffer&) = delete;
+  MmapWavegruBuffer& operator=(const MmapWavegruBuffer&) = delete;
+
+  // Returns 0 for unknown names.
+  uint64_t GetBufferSize(const std::string& model_name) const override;
+
+  // Returns nullptr for unknown names.
+  const char* GetBuffer(const std::string& model_name) const override;
+
+  int num_buffers() const { return mappings_.size(); }
+
+ private:
+  MmapWavegruBuffer() {}
+
+  // Maps |file| and adds it under its file name. Returns false on failure.
+  bool MapFile(const ghc::filesystem::path& file);
+
+  // Address and size of every mapping, by file name.
+  std::unordered_map<std::string, std::pair<const char*, uint64_t>> mappings_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_WAVEGRU_BUFFER_MMAP_WAVEGRU_BUFFER_H_
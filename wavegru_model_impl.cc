@@ -26,6 +26,7 @@
 #include "causal_convolutional_conditioning.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_wavegru.h"
+#include "model_store.h"
 #include "sparse_matmul/sparse_matmul.h"
 // IWYU pragma: no_include "speech/greco3/core/thread.h"
 #include "absl/memory/memory.h"
@@ -39,112 +40,112 @@
 namespace chromemedia {
 namespace codec {
 
- std::unique_ptr<WavegruModelImpl> WavegruModelImpl::Create(
-     int num_samples_per_hop, int num_features, int num_frames_per_packet,
-     float silence_value, const WavegruBufferInterface& wavegru_buffer) {
-   const int kNumThreads = 1;
-   const int kNumCondHiddens = 512;
-   const std::string kModelPrefix = "lyra_16khz";
-
-   auto wavegru = LyraWavegru<ComputeType>::Create(
-       kNumThreads, wavegru_buffer, kModelPrefix);
-   if (wavegru == nullptr) {
-     fprintf(stderr, "Could not create wavegru model.\n");
-     return nullptr;
-   }
-
-   auto merge_filter = BufferMerger::Create(wavegru->num_split_bands());
-   if (merge_filter == nullptr) {
-     fprintf(stderr, "Could not create merge filter.\n");
-     return nullptr;
-   }
-   // WrapUnique is used because of private c'tor.
-   return absl::WrapUnique(new WavegruModelImpl(
-       wavegru_buffer, kModelPrefix, kNumThreads, num_features,
-       kNumCondHiddens, num_samples_per_hop, num_frames_per_packet,
-       silence_value, std::move(wavegru), std::move(merge_filter)));
- }
+std::unique_ptr<WavegruModelImpl> WavegruModelImpl::Create(
+    int num_samples_per_hop, int num_features, int num_frames_per_packet,
+    float silence_value, const WavegruBufferInterface& wavegru_buffer) {
+  auto model_store = ModelStore::Create(wavegru_buffer);
+  auto model = Create(num_samples_per_hop, num_features, num_frames_per_packet,
+                      silence_value, model_store);
+  model_store->ReleaseWavegruBuffer();
+  return model;
+}
 
 std::unique_ptr<WavegruModelImpl> WavegruModelImpl::Create(
     int num_samples_per_hop, int num_features, int num_frames_per_packet,
     float silence_value, const ghc::filesystem::path& model_path) {
-  const int kNumThreads = 1;
+  return Create(num_samples_per_hop, num_features, num_frames_per_packet,
+                silence_value, ModelStore::Create(model_path));
+}
+
+std::unique_ptr<WavegruModelImpl> WavegruModelImpl::Create(
+    int num_samples_per_hop, int num_features, int num_frames_per_packet,
+    float silence_value, std::shared_ptr<ModelStore> model_store,
+    const LyraDecoderOptions& options, bool pipeline_conditioning) {
   const int kNumCondHiddens = 512;
   const std::string kModelPrefix = "lyra_16khz";
 
-  auto wavegru = LyraWavegru<ComputeType>::Create(
-      kNumThreads, std::string(model_path), kModelPrefix);
+  if (options.num_threads < 1 || options.num_threads > MaxNumThreads()) {
+    fprintf(stderr, "Number of threads must be in [1, %d], got %d.\n",
+            MaxNumThreads(), options.num_threads);
+    return nullptr;
+  }
+  if (options.num_conditioning_threads < 1 ||
+      options.num_conditioning_threads > kNumCondHiddens) {
+    fprintf(stderr,
+            "Number of conditioning threads must be in [1, %d], got %d.\n",
+            kNumCondHiddens, options.num_conditioning_threads);
+    return nullptr;
+  }
+  auto wavegru = LyraWavegru<ComputeType>::Create(options.num_threads,
+                                                  model_store, kModelPrefix);
   if (wavegru == nullptr) {
     fprintf(stderr, "Could not create wavegru model.\n");
     return nullptr;
   }
 
-  auto merge_filter = BufferMerger::Create(wavegru->num_split_bands());
+  auto merge_filter = BufferMerger::Create(
+      wavegru->num_split_bands(), num_samples_per_hop * num_frames_per_packet);
   if (merge_filter == nullptr) {
     fprintf(stderr, "Could not create merge filter.\n");
     return nullptr;
   }
   // WrapUnique is used because of private c'tor.
   return absl::WrapUnique(new WavegruModelImpl(
-      std::string(model_path), kModelPrefix, kNumThreads, num_features,
+      std::move(model_store), kModelPrefix, options, pipeline_conditioning,
+      num_features,
       kNumCondHiddens, num_samples_per_hop, num_frames_per_packet,
       silence_value, std::move(wavegru), std::move(merge_filter)));
 }
 
 WavegruModelImpl::WavegruModelImpl(
-    const std::string& model_path, const std::string& model_prefix,
-    int num_threads, int num_features, int num_cond_hiddens,
+    std::shared_ptr<ModelStore> model_store, const std::string& model_prefix,
+    const LyraDecoderOptions& options, bool pipeline_conditioning,
+    int num_features, int num_cond_hiddens,
     int num_samples_per_hop, int num_frames_per_packet, float silence_value,
     std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
     std::unique_ptr<BufferMerger> buffer_merger)
-    : num_threads_(num_threads),
+    : num_threads_(options.num_threads),
+      num_conditioning_threads_(options.num_conditioning_threads),
+      pipeline_conditioning_(pipeline_conditioning),
       num_samples_per_hop_(num_samples_per_hop),
       model_split_samples_(wavegru->num_split_bands()),
       wavegru_(std::move(wavegru)),
-      buffer_merger_(std::move(buffer_merger)) {
+      buffer_merger_(std::move(buffer_merger)),
+      features_(num_features, 1),
+      pending_features_(num_features, 1) {
   // The number of samples generated per band is based on the model, not
   // requested sampling rate. If the requested sample rate is less than the
-  // model sample rate we just merge less bands.
+  // model sample rate we just merge less bands. At most a packet is generated
+  // at once, plus the samples the merger buffers.
   for (auto& band : model_split_samples_) {
-    band.reserve(num_samples_per_hop_ / wavegru_->num_split_bands());
+    band.reserve(num_samples_per_hop_ * num_frames_per_packet /
+                     wavegru_->num_split_bands() +
+                 1);
   }
-  background_threads_.reserve(num_threads - 1);
+  background_threads_.reserve(num_threads_ - 1);
   fprintf(stdout, "Feature size: %d\n", num_features);
   fprintf(stdout, "Number of samples per hop: %d\n", num_samples_per_hop_);
 
   conditioning_ = absl::make_unique<ConditioningType>(
       num_features, num_cond_hiddens, wavegru_->num_gru_hiddens(),
       num_samples_per_hop_, num_frames_per_packet,
-      /*num_threads=*/1, silence_value, model_path, model_prefix);
-}
-
-WavegruModelImpl::WavegruModelImpl(
-    const WavegruBufferInterface& wavegru_buffer,
-    const std::string& model_prefix, int num_threads, int num_features,
-    int num_cond_hiddens, int num_samples_per_hop, int num_frames_per_packet,
-    float silence_value, std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
-    std::unique_ptr<BufferMerger> buffer_merger) :
-        num_threads_(num_threads),
-        num_samples_per_hop_(num_samples_per_hop),
-        model_split_samples_(wavegru->num_split_bands()),
-        wavegru_(std::move(wavegru)),
-        buffer_merger_(std::move(buffer_merger)) {
-
-
-  for (auto& band : model_split_samples_) {
-    band.reserve(num_samples_per_hop_ / wavegru_->num_split_bands());
+      num_conditioning_threads_, silence_value, std::move(model_store),
+      model_prefix);
+  if (pipeline_conditioning_) {
+    conditioning_thread_ =
+        absl::make_unique<std::thread>([this]() { ConditioningLoop(); });
   }
-  background_threads_.reserve(num_threads - 1);
-  fprintf(stdout, "Feature size: %d\n", num_features);
-  fprintf(stdout, "Number of samples per hop: %d\n", num_samples_per_hop_);
-
-  conditioning_ = absl::make_unique<ConditioningType>(
-      num_features, num_cond_hiddens, wavegru_->num_gru_hiddens(),
-      num_samples_per_hop_, num_frames_per_packet,
-      /*num_threads=*/1, silence_value, wavegru_buffer, model_prefix);
 }
 
 WavegruModelImpl::~WavegruModelImpl() {
+  if (conditioning_thread_ != nullptr) {
+    {
+      std::lock_guard<std::mutex> lock(conditioning_mutex_);
+      stop_conditioning_ = true;
+    }
+    conditioning_changed_.notify_all();
+    conditioning_thread_->join();
+  }
   wavegru_->TerminateThreads();
   for (const auto& thread : background_threads_) {
     thread->join();
@@ -153,24 +154,109 @@ WavegruModelImpl::~WavegruModelImpl() {
 
 void WavegruModelImpl::AddFeatures(const std::vector<float>& features) {
   const int kNumFrames = 1;
-  csrblocksparse::FatCacheAlignedVector<float> input(features.size(),
-                                                     kNumFrames);
-  std::copy(features.begin(), features.end(), input.data());
-  wavegru_->ResetConditioningStart();
+  if (pipeline_conditioning_) {
+    // Features added before the pending ones were used replace the current
+    // ones, as they would without pipelining.
+    if (conditioning_pending_) {
+      UsePendingConditioning();
+    }
+    {
+      std::lock_guard<std::mutex> lock(conditioning_mutex_);
+      if (pending_features_.rows() != static_cast<int>(features.size())) {
+        pending_features_ =
+            csrblocksparse::FatCacheAlignedVector<float>(features.size(),
+                                                         kNumFrames);
+      }
+      std::copy(features.begin(), features.end(), pending_features_.data());
+      features_pending_ = true;
+      conditioning_done_ = false;
+    }
+    conditioning_changed_.notify_all();
+    conditioning_pending_ = true;
+    return;
+  }
+
+  if (features_.rows() != static_cast<int>(features.size())) {
+    features_ = csrblocksparse::FatCacheAlignedVector<float>(features.size(),
+                                                             kNumFrames);
+  }
+  std::copy(features.begin(), features.end(), features_.data());
 
 #ifdef BENCHMARK
   const int64_t conditioning_start_microsecs = absl::ToUnixMicros(absl::Now());
 #endif  // BENCHMARK
-  buffer_merger_->Reset();
-  conditioning_->Precompute(input, /*num_threads=*/1);
+  conditioning_->Precompute(features_, num_conditioning_threads_);
 #ifdef BENCHMARK
   conditioning_timings_microsecs_.push_back(absl::ToUnixMicros(absl::Now()) -
                                             conditioning_start_microsecs);
 #endif  // BENCHMARK
+  UseNewConditioning();
+}
+
+void WavegruModelImpl::UseNewConditioning() {
+  wavegru_->ResetConditioningStart();
+  buffer_merger_->Reset();
+}
+
+void WavegruModelImpl::ConditioningLoop() {
+  std::unique_lock<std::mutex> lock(conditioning_mutex_);
+  while (true) {
+    conditioning_changed_.wait(
+        lock, [this]() { return features_pending_ || stop_conditioning_; });
+    if (stop_conditioning_) {
+      return;
+    }
+    features_pending_ = false;
+    // |pending_features_| is not written again before the conditioning is
+    // done, and the conditioning only writes the buffer AtStep() does not
+    // read, so the samples of the current features may be generated
+    // meanwhile.
+    lock.unlock();
+#ifdef BENCHMARK
+    const int64_t conditioning_start_microsecs =
+        absl::ToUnixMicros(absl::Now());
+#endif  // BENCHMARK
+    conditioning_->PrecomputeNext(pending_features_,
+                                  num_conditioning_threads_);
+    lock.lock();
+#ifdef BENCHMARK
+    pending_conditioning_microsecs_ =
+        absl::ToUnixMicros(absl::Now()) - conditioning_start_microsecs;
+#endif  // BENCHMARK
+    conditioning_done_ = true;
+    conditioning_changed_.notify_all();
+  }
+}
+
+void WavegruModelImpl::UsePendingConditioning() {
+  {
+    std::unique_lock<std::mutex> lock(conditioning_mutex_);
+    conditioning_changed_.wait(lock, [this]() { return conditioning_done_; });
+#ifdef BENCHMARK
+    conditioning_timings_microsecs_.push_back(pending_conditioning_microsecs_);
+#endif  // BENCHMARK
+  }
+  conditioning_->UseNext();
+  UseNewConditioning();
+  conditioning_pending_ = false;
 }
 
 absl::optional<std::vector<int16_t>> WavegruModelImpl::GenerateSamples(
     int num_samples) {
+  std::vector<int16_t> samples(num_samples);
+  if (GenerateSamples(absl::MakeSpan(samples)) < 0) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+int WavegruModelImpl::GenerateSamples(absl::Span<int16_t> samples) {
+  // Move on to the pending features once the current ones are used up.
+  if (conditioning_pending_ &&
+      wavegru_->conditioning_start() >= conditioning_->num_samples()) {
+    UsePendingConditioning();
+  }
+
   // Launch background threads on the first packet.
   if (background_threads_.empty() && num_threads_ > 1) {
     // |tid| = 0 is reserved for the main thread which will be returned to the
@@ -191,13 +277,9 @@ absl::optional<std::vector<int16_t>> WavegruModelImpl::GenerateSamples(
   const int64_t wavegru_start_microsecs = absl::ToUnixMicros(absl::Now());
 #endif  // BENCHMARK
 
-  // Without specifying the |-> const std::vector<std::vector<int16_t>>&| the
-  // return type of the lambda is inferred and will be a copy of
-  // |model_split_samples_|. The std::function will then incorrectly return a
-  // reference to this local variable which is destroyed as soon as the
-  // std::function call operator is returned.
-  std::function<const std::vector<std::vector<int16_t>>&(int)>
-      sample_generator = [&](int num_samples_to_generate)
+  // The |-> const std::vector<std::vector<int16_t>>&| keeps the lambda from
+  // returning a copy of |model_split_samples_|.
+  auto sample_generator = [&](int num_samples_to_generate)
       -> const std::vector<std::vector<int16_t>>& {
     const int num_samples_to_generate_per_band =
         num_samples_to_generate / wavegru_->num_split_bands();
@@ -221,12 +303,12 @@ absl::optional<std::vector<int16_t>> WavegruModelImpl::GenerateSamples(
   // Only ask the buffer merger for the min of the number of requested samples
   // and the number we actually generated, because the model may have run out of
   // conditioning but the BufferAndMerge retains state until Reset() is called.
-  auto samples = buffer_merger_->BufferAndMerge(sample_generator, num_samples);
+  buffer_merger_->BufferAndMerge(sample_generator, samples);
 #ifdef BENCHMARK
   model_timings_microsecs_.push_back(absl::ToUnixMicros(absl::Now()) -
                                      wavegru_start_microsecs);
 #endif  // BENCHMARK
-  return samples;
+  return samples.size();
 }
 
 }  // namespace codec
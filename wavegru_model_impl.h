@@ -17,19 +17,24 @@
 #ifndef LYRA_CODEC_WAVEGRU_MODEL_IMPL_H_
 #define LYRA_CODEC_WAVEGRU_MODEL_IMPL_H_
 
+#include <condition_variable>  // NOLINT
 #include <cstdint>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
 #include <thread>  // NOLINT
 #include <vector>
 
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "buffer_merger.h"
 #include "causal_convolutional_conditioning.h"
 #include "generative_model_interface.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_decoder_options.h"
 #include "lyra_types.h"
 #include "lyra_wavegru.h"
+#include "model_store.h"
 #include "sparse_matmul/sparse_matmul.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
 
@@ -48,13 +53,42 @@ class WavegruModelImpl : public GenerativeModelInterface {
       int num_samples_per_hop, int num_features, int num_frames_per_packet,
       float silence_value, const WavegruBufferInterface& wavegru_buffer);
 
+  // The weights and biases are shared with all other users of |model_store|.
+  // The sampling of each hop is split across |options.num_threads| threads,
+  // the calling one plus |options.num_threads| - 1 background threads.
+  // Returns a nullptr if |options| are out of range for this build.
+  // With |pipeline_conditioning| the conditioning of features is computed on
+  // a helper thread, see AddFeatures(). This only pays off for callers which
+  // add the features of a packet before generating the samples of the
+  // previous one, which LyraDecoder does not do, so it is not a decoder
+  // option.
+  static std::unique_ptr<WavegruModelImpl> Create(
+      int num_samples_per_hop, int num_features, int num_frames_per_packet,
+      float silence_value, std::shared_ptr<ModelStore> model_store,
+      const LyraDecoderOptions& options = LyraDecoderOptions(),
+      bool pipeline_conditioning = false);
+
+  // Largest |LyraDecoderOptions::num_threads| supported by this build.
+  static constexpr int MaxNumThreads() {
+    return LyraWavegru<ComputeType>::MaxNumThreads();
+  }
+
   ~WavegruModelImpl() override;
 
+  // With |pipeline_conditioning| given at creation, the conditioning of
+  // |features| is computed on a helper thread and the call returns right
+  // away. The features take effect once the samples of the current ones have
+  // all been generated, or when more features are added, whichever comes
+  // first. Adding the features of packet N + 1 before generating the samples
+  // of packet N thus overlaps the two.
   void AddFeatures(const std::vector<float>& features) override;
 
   absl::optional<std::vector<int16_t>> GenerateSamples(
       int num_samples) override;
 
+  // Does not allocate, the buffers being sized for a packet at creation.
+  int GenerateSamples(absl::Span<int16_t> samples) override;
+
  private:
 #ifdef USE_FIXED16
   using ComputeType = csrblocksparse::fixed16_type;
@@ -67,24 +101,31 @@ class WavegruModelImpl : public GenerativeModelInterface {
       CausalConvolutionalConditioning<ConditioningTypes<ComputeType>>;
 
   WavegruModelImpl() = delete;
-  WavegruModelImpl(const std::string& model_path,
-                   const std::string& model_prefix, int num_threads,
-                   int num_features, int num_cond_hiddens,
+  WavegruModelImpl(std::shared_ptr<ModelStore> model_store,
+                   const std::string& model_prefix,
+                   const LyraDecoderOptions& options,
+                   bool pipeline_conditioning, int num_features,
+                   int num_cond_hiddens,
                    int num_samples_per_hop, int num_frames_per_packet,
                    float silence_value,
                    std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
                    std::unique_ptr<BufferMerger> buffer_merger);
 
-  WavegruModelImpl(const WavegruBufferInterface& wavegru_buffer,
-                   const std::string& model_prefix, int num_threads,
-                   int num_features, int num_cond_hiddens,
-                   int num_samples_per_hop, int num_frames_per_packet,
-                   float silence_value,
-                   std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
-                   std::unique_ptr<BufferMerger> buffer_merger);
+  // Starts generating samples from the conditioning computed last.
+  void UseNewConditioning();
 
+  // Waits for the features handed over by AddFeatures() and computes their
+  // conditioning, until |stop_conditioning_| is set. Runs on
+  // |conditioning_thread_| in pipelined mode.
+  void ConditioningLoop();
+
+  // Waits for the conditioning of the pending features and starts generating
+  // samples from it.
+  void UsePendingConditioning();
 
   const int num_threads_;
+  const int num_conditioning_threads_;
+  const bool pipeline_conditioning_;
   const int num_samples_per_hop_;
 
   // The direct output samples from the model in the split domain.
@@ -94,6 +135,26 @@ class WavegruModelImpl : public GenerativeModelInterface {
   std::unique_ptr<LyraWavegru<ComputeType>> wavegru_;
   std::unique_ptr<ConditioningType> conditioning_;
   std::unique_ptr<BufferMerger> buffer_merger_;
+
+  // The features handed to |conditioning_| without pipelining.
+  csrblocksparse::FatCacheAlignedVector<float> features_;
+
+  // Whether AddFeatures() handed over features which are not used yet.
+  bool conditioning_pending_ = false;
+
+  // The features handed over to |conditioning_thread_| in pipelined mode, and
+  // whether they are waiting for it or their conditioning is done. Guarded by
+  // |conditioning_mutex_|.
+  std::mutex conditioning_mutex_;
+  std::condition_variable conditioning_changed_;
+  csrblocksparse::FatCacheAlignedVector<float> pending_features_;
+  bool features_pending_ = false;
+  bool conditioning_done_ = false;
+  bool stop_conditioning_ = false;
+#ifdef BENCHMARK
+  int64_t pending_conditioning_microsecs_ = 0;
+#endif  // BENCHMARK
+  std::unique_ptr<std::thread> conditioning_thread_;
 };
 
 }  // namespace codec
@@ -23,6 +23,8 @@
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
+#include "lyra_decoder_options.h"
+#include "model_store.h"
 
 namespace chromemedia {
 namespace codec {
@@ -79,6 +81,166 @@ TEST_F(WavegruModelImplTest, GenerateMoreThanNumSamplesPerHopExpectDeath) {
   }
 }
 
+TEST(WavegruModelImplThreadsTest, MultipleThreadsGenerateExpectedOutputSize) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  LyraDecoderOptions options;
+  options.num_threads = 2;
+  auto model = WavegruModelImpl::Create(
+      num_samples_per_hop, kNumFeatures, kNumFramesPerPacket, 0.0f,
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru"),
+      options);
+  ASSERT_NE(model, nullptr);
+
+  // The background threads are started by the first call and reused by the
+  // following ones.
+  for (int i = 0; i < 3; ++i) {
+    model->AddFeatures(std::vector<float>(kNumFeatures));
+    auto samples_or = model->GenerateSamples(num_samples_per_hop);
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(samples_or.value().size(), num_samples_per_hop);
+  }
+}
+
+TEST(WavegruModelImplThreadsTest, SamplingThreadsMatchSingleThread) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  auto model_store =
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru");
+  LyraDecoderOptions options;
+  // Gives the threads slices of the GRU state of unequal size.
+  options.num_threads = 3;
+  auto threaded_model =
+      WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                               kNumFramesPerPacket, 0.0f, model_store, options);
+  ASSERT_NE(threaded_model, nullptr);
+  auto model = WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                                        kNumFramesPerPacket, 0.0f, model_store);
+  ASSERT_NE(model, nullptr);
+
+  for (int i = 0; i < 3; ++i) {
+    const std::vector<float> features(kNumFeatures, 0.1f * i);
+    threaded_model->AddFeatures(features);
+    model->AddFeatures(features);
+    auto threaded_samples_or =
+        threaded_model->GenerateSamples(num_samples_per_hop);
+    auto samples_or = model->GenerateSamples(num_samples_per_hop);
+    ASSERT_TRUE(threaded_samples_or.has_value());
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(threaded_samples_or.value(), samples_or.value());
+  }
+}
+
+TEST(WavegruModelImplThreadsTest, ConditioningThreadsMatchSingleThread) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  auto model_store =
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru");
+  LyraDecoderOptions options;
+  options.num_conditioning_threads = 4;
+  auto threaded_model =
+      WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                               kNumFramesPerPacket, 0.0f, model_store, options);
+  ASSERT_NE(threaded_model, nullptr);
+  auto model = WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                                        kNumFramesPerPacket, 0.0f, model_store);
+  ASSERT_NE(model, nullptr);
+
+  for (int i = 0; i < 3; ++i) {
+    const std::vector<float> features(kNumFeatures, 0.1f * i);
+    threaded_model->AddFeatures(features);
+    model->AddFeatures(features);
+    auto threaded_samples_or =
+        threaded_model->GenerateSamples(num_samples_per_hop);
+    auto samples_or = model->GenerateSamples(num_samples_per_hop);
+    ASSERT_TRUE(threaded_samples_or.has_value());
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(threaded_samples_or.value(), samples_or.value());
+  }
+}
+
+TEST(WavegruModelImplThreadsTest, PipelinedConditioningMatchesSequential) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  const int kNumPackets = 3;
+  auto model_store =
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru");
+  auto pipelined_model = WavegruModelImpl::Create(
+      num_samples_per_hop, kNumFeatures, kNumFramesPerPacket, 0.0f,
+      model_store, LyraDecoderOptions(), /*pipeline_conditioning=*/true);
+  ASSERT_NE(pipelined_model, nullptr);
+  auto model = WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                                        kNumFramesPerPacket, 0.0f, model_store);
+  ASSERT_NE(model, nullptr);
+  auto features = [](int packet) {
+    return std::vector<float>(kNumFeatures, 0.1f * packet);
+  };
+
+  // The features of each packet are added before the samples of the previous
+  // one are generated, so that the two overlap. The samples are generated in
+  // two calls, the first of which does not use up the current features.
+  pipelined_model->AddFeatures(features(0));
+  for (int packet = 0; packet < kNumPackets; ++packet) {
+    if (packet + 1 < kNumPackets) {
+      pipelined_model->AddFeatures(features(packet + 1));
+    }
+    model->AddFeatures(features(packet));
+    for (const int num_samples :
+         {num_samples_per_hop / 2, num_samples_per_hop / 2}) {
+      auto pipelined_samples_or = pipelined_model->GenerateSamples(num_samples);
+      auto samples_or = model->GenerateSamples(num_samples);
+      ASSERT_TRUE(pipelined_samples_or.has_value());
+      ASSERT_TRUE(samples_or.has_value());
+      EXPECT_EQ(pipelined_samples_or.value(), samples_or.value());
+    }
+  }
+}
+
+TEST(WavegruModelImplThreadsTest, PipelinedConditioningInSequentialCalls) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  auto model_store =
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru");
+  auto pipelined_model = WavegruModelImpl::Create(
+      num_samples_per_hop, kNumFeatures, kNumFramesPerPacket, 0.0f,
+      model_store, LyraDecoderOptions(), /*pipeline_conditioning=*/true);
+  ASSERT_NE(pipelined_model, nullptr);
+  auto model = WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                                        kNumFramesPerPacket, 0.0f, model_store);
+  ASSERT_NE(model, nullptr);
+
+  // Each packet is added and then fully generated, as LyraDecoder does, so
+  // nothing overlaps but the samples are the same.
+  for (int i = 0; i < 3; ++i) {
+    const std::vector<float> features(kNumFeatures, 0.1f * i);
+    pipelined_model->AddFeatures(features);
+    model->AddFeatures(features);
+    auto pipelined_samples_or =
+        pipelined_model->GenerateSamples(num_samples_per_hop);
+    auto samples_or = model->GenerateSamples(num_samples_per_hop);
+    ASSERT_TRUE(pipelined_samples_or.has_value());
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(pipelined_samples_or.value(), samples_or.value());
+  }
+}
+
+TEST(WavegruModelImplThreadsTest, OutOfRangeThreadsFail) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  auto model_store =
+      ModelStore::Create(ghc::filesystem::current_path() / "wavegru");
+  for (const int num_threads : {0, WavegruModelImpl::MaxNumThreads() + 1}) {
+    LyraDecoderOptions options;
+    options.num_threads = num_threads;
+    EXPECT_EQ(WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                                       kNumFramesPerPacket, 0.0f, model_store,
+                                       options),
+              nullptr);
+  }
+  for (const int num_conditioning_threads : {0, 513}) {
+    LyraDecoderOptions options;
+    options.num_conditioning_threads = num_conditioning_threads;
+    EXPECT_EQ(WavegruModelImpl::Create(num_samples_per_hop, kNumFeatures,
+                                       kNumFramesPerPacket, 0.0f, model_store,
+                                       options),
+              nullptr);
+  }
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
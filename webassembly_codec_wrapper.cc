@@ -1,36 +1,45 @@
 #include <emscripten/bind.h>
+#include <emscripten/em_asm.h>
 #include <emscripten/fetch.h>
 
+#include <algorithm>
+#include <memory>
 #include <unordered_map>
 
 #include "encode_and_decode_lib.h"
 #include "lyra_decoder.h"
 #include "lyra_encoder.h"
+#include "model_store.h"
+#include "webassembly_codec_wrapper.h"
 #include "wavegru_buffer/wavegru_buffer_interface.h"
 
-// Encoder and Decoder.
-std::unique_ptr<chromemedia::codec::LyraEncoder> encoder;
-std::unique_ptr<chromemedia::codec::LyraDecoder> decoder;
-
-std::unique_ptr<chromemedia::codec::LyraEncoder> encoder_32khz;
-std::unique_ptr<chromemedia::codec::LyraDecoder> decoder_32khz;
-
-std::unique_ptr<chromemedia::codec::LyraEncoder> encoder_16khz;
-std::unique_ptr<chromemedia::codec::LyraDecoder> decoder_16khz;
-
-std::unique_ptr<chromemedia::codec::LyraEncoder> encoder_8khz;
-std::unique_ptr<chromemedia::codec::LyraDecoder> decoder_8khz;
+// Encoders and decoders of all sample rates, sharing a single model. Those of
+// a sample rate other than the internal one are created on first use.
+std::unique_ptr<chromemedia::codec::SampleRateCodecs> codecs;
 
 std::atomic<int8_t> FETCHED_MODEL_COUNT(0);
 
-// Forward declaration of encoder and decoder creator fucntions.
-void CreateEncoder();
-void CreateDecoder();
-bool encoders_initialized = false;
-bool decoders_initialized = false;
+// Forward declaration of the model loading function.
+void LoadModel();
+bool model_loaded = false;
 
 void asyncDownload(const std::string& url, const std::string& model_name);
 
+// Upper bound of the decoder threads, including the main thread.
+constexpr int kMaxNumThreads = 8;
+
+// Returns the number of decoder threads the page asked for through the
+// |numThreads| option of the module factory. The single-threaded build ignores
+// it.
+int RequestedNumThreads() {
+#ifdef __EMSCRIPTEN_PTHREADS__
+  const int num_threads = EM_ASM_INT({ return Module['numThreads'] || 1; });
+  return std::clamp(num_threads, 1, kMaxNumThreads);
+#else
+  return 1;
+#endif
+}
+
 class WebassemblyWavegruBuffer
     : public chromemedia::codec::WavegruBufferInterface {
  public:
@@ -145,11 +154,7 @@ void downloadSucceeded(emscripten_fetch_t* fetch) {
   wavegru_buffer.SetFetch(model_name, fetch);
   FETCHED_MODEL_COUNT++;
   if (FETCHED_MODEL_COUNT == 49) {
-    CreateEncoder();
-    if (encoder == nullptr) {
-      printf("Failed to create encoder.\n");
-    }
-    CreateDecoder();
+    LoadModel();
   }
 }
 
@@ -173,95 +178,47 @@ void asyncDownload(const std::string& url, const std::string& model_name) {
 
 void InitializeCodec() { wavegru_buffer.DownloadModels(); }
 
-void CreateEncoder() {
-  encoder = chromemedia::codec::LyraEncoder::Create(
-      /*sample_rate_hz=*/48000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000,
-      /*enable_dtx=*/false, wavegru_buffer);
-
-  // Create encoders at different sample rates because the input audio sample
-  // rate is not know at this time.
-  encoder_16khz = chromemedia::codec::LyraEncoder::Create(
-      /*sample_rate_hz=*/16000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000,
-      /*enable_dtx=*/false, wavegru_buffer);
-
-  encoder_32khz = chromemedia::codec::LyraEncoder::Create(
-      /*sample_rate_hz=*/32000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000,
-      /*enable_dtx=*/false, wavegru_buffer);
-
-  encoder_8khz = chromemedia::codec::LyraEncoder::Create(
-      /*sample_rate_hz=*/8000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000,
-      /*enable_dtx=*/false, wavegru_buffer);
-
-  if (encoder == nullptr || encoder_32khz == nullptr ||
-      encoder_16khz == nullptr || encoder_8khz == nullptr) {
-    fprintf(stderr, "Failed to create encoders.\n");
+void LoadModel() {
+  codecs = std::make_unique<chromemedia::codec::SampleRateCodecs>(
+      chromemedia::codec::ModelStore::Create(wavegru_buffer),
+      /*num_channels=*/1, /*bitrate=*/3000, RequestedNumThreads());
+  if (!codecs->LoadModel()) {
+    fprintf(stderr, "Failed to load the model.\n");
   } else {
-    fprintf(stdout, "Successfully created encoders!\n");
-    encoders_initialized = true;
+    fprintf(stdout, "Successfully loaded the model with %d threads!\n",
+            codecs->num_threads());
+    model_loaded = true;
   }
 }
 
-void CreateDecoder() {
-  decoder = chromemedia::codec::LyraDecoder::Create(
-      /*sample_rate_hz=*/48000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000, wavegru_buffer);
-
-  decoder_16khz = chromemedia::codec::LyraDecoder::Create(
-      /*sample_rate_hz=*/16000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000, wavegru_buffer);
-
-  decoder_32khz = chromemedia::codec::LyraDecoder::Create(
-      /*sample_rate_hz=*/32000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000, wavegru_buffer);
-
-  decoder_8khz = chromemedia::codec::LyraDecoder::Create(
-      /*sample_rate_hz=*/8000,
-      /*num_channels=*/1,
-      /*bitrate=*/3000, wavegru_buffer);
-
-  if (decoder == nullptr || decoder_32khz == nullptr ||
-      decoder_16khz == nullptr || decoder_8khz == nullptr) {
-    fprintf(stderr, "Failed to create decoders.\n");
-  } else {
-    fprintf(stdout, "Successfully created decoders!\n");
-    decoders_initialized = true;
+// Prints an error for rates which have no codec.
+bool CheckSampleRate(uint32_t sample_rate_hz) {
+  if (!chromemedia::codec::IsSampleRateSupported(sample_rate_hz)) {
+    fprintf(stderr,
+            "Unsupported sample rate: %d. Only %d, %d, %d and %d khz sample "
+            "rates are supported.\n",
+            sample_rate_hz, 48000, 16000, 32000, 8000);
+    return false;
+  }
+  if (!model_loaded) {
+    fprintf(stderr, "The model is not loaded yet.\n");
+    return false;
   }
+  return true;
 }
 
 bool EncodeAndDecodeWithLyra(uintptr_t data, uint32_t num_samples,
                              uint32_t sample_rate_hz, uintptr_t out_data) {
   fprintf(stdout, "EncodeAndDecode called with %d samples.\n", num_samples);
 
-  chromemedia::codec::LyraEncoder* encoder_to_use = nullptr;
-  chromemedia::codec::LyraDecoder* decoder_to_use = nullptr;
-  if (sample_rate_hz == 48000) {
-    encoder_to_use = encoder.get();
-    decoder_to_use = decoder.get();
-  } else if (sample_rate_hz == 16000) {
-    encoder_to_use = encoder_16khz.get();
-    decoder_to_use = decoder_16khz.get();
-  } else if (sample_rate_hz == 32000) {
-    encoder_to_use = encoder_32khz.get();
-    decoder_to_use = decoder_32khz.get();
-  } else if (sample_rate_hz == 8000) {
-    encoder_to_use = encoder_8khz.get();
-    decoder_to_use = decoder_8khz.get();
-  } else {
-    fprintf(stderr,
-            "Unsupported sample rate: %d. Only %d, %d, %d and %d khz sample "
-            "rates are supported.\n",
-            sample_rate_hz, 48000, 16000, 32000, 8000);
+  if (!CheckSampleRate(sample_rate_hz)) {
+    return false;
+  }
+  chromemedia::codec::LyraEncoder* encoder_to_use =
+      codecs->GetEncoder(sample_rate_hz);
+  chromemedia::codec::LyraDecoder* decoder_to_use =
+      codecs->GetDecoder(sample_rate_hz);
+  if (encoder_to_use == nullptr || decoder_to_use == nullptr) {
     return false;
   }
 
@@ -289,8 +246,10 @@ bool EncodeAndDecodeWithLyra(uintptr_t data, uint32_t num_samples,
     return false;
   }
 
-  // Convert the decoded output to float.
-  const int num_decoded_samples = maybe_decoded_output.value().size();
+  // Convert the decoded output to float. The encoder pads the last packet, so
+  // it may decode to more samples than there is room for.
+  const int num_decoded_samples = std::min<int>(
+      maybe_decoded_output.value().size(), num_samples);
   float* out_data_ptr = reinterpret_cast<float*>(out_data);
   const std::vector<int16_t>& decoded_output = maybe_decoded_output.value();
   for (int i = 0; i < num_decoded_samples; i++) {
@@ -306,21 +265,12 @@ std::vector<uint8_t> EncodeWithLyra(uintptr_t data, uint32_t num_samples,
                              uint32_t sample_rate_hz) {
   fprintf(stdout, "Encode called with %d samples.\n", num_samples);
 
-  chromemedia::codec::LyraEncoder* encoder_to_use = nullptr;
-  if (sample_rate_hz == 48000) {
-    encoder_to_use = encoder.get();
-  } else if (sample_rate_hz == 16000) {
-    encoder_to_use = encoder_16khz.get();
-  } else if (sample_rate_hz == 32000) {
-    encoder_to_use = encoder_32khz.get();
-  } else if (sample_rate_hz == 8000) {
-    encoder_to_use = encoder_8khz.get();
+  if (!CheckSampleRate(sample_rate_hz)) {
+    return std::vector<uint8_t>();
   }
-  else {
-    fprintf(stderr,
-            "Unsupported sample rate: %d. Only %d, %d, %d and %d khz sample "
-            "rates are supported.\n",
-            sample_rate_hz, 48000, 16000, 32000, 8000);
+  chromemedia::codec::LyraEncoder* encoder_to_use =
+      codecs->GetEncoder(sample_rate_hz);
+  if (encoder_to_use == nullptr) {
     return std::vector<uint8_t>();
   }
 
@@ -345,21 +295,12 @@ bool DecodeWithLyra(emscripten::val encoded_data, uint32_t num_samples,
                              uint32_t sample_rate_hz, uintptr_t out_data) {
   fprintf(stdout, "Decode called with %d samples.\n", num_samples);
 
-  chromemedia::codec::LyraDecoder* decoder_to_use = nullptr;
-  if (sample_rate_hz == 48000) {
-    decoder_to_use = decoder.get();
-  } else if (sample_rate_hz == 16000) {
-    decoder_to_use = decoder_16khz.get();
-  } else if (sample_rate_hz == 32000) {
-    decoder_to_use = decoder_32khz.get();
-  } else if (sample_rate_hz == 8000) {
-    decoder_to_use = decoder_8khz.get();
+  if (!CheckSampleRate(sample_rate_hz)) {
+    return false;
   }
-  else {
-    fprintf(stderr,
-            "Unsupported sample rate: %d. Only %d, %d, %d and %d khz sample "
-            "rates are supported.\n",
-            sample_rate_hz, 48000, 16000, 32000, 8000);
+  chromemedia::codec::LyraDecoder* decoder_to_use =
+      codecs->GetDecoder(sample_rate_hz);
+  if (decoder_to_use == nullptr) {
     return false;
   }
 
@@ -382,8 +323,10 @@ bool DecodeWithLyra(emscripten::val encoded_data, uint32_t num_samples,
     return false;
   }
 
-  // Convert the decoded output to float.
-  const int num_decoded_samples = maybe_decoded_output.value().size();
+  // Convert the decoded output to float. The encoder pads the last packet, so
+  // it may decode to more samples than there is room for.
+  const int num_decoded_samples = std::min<int>(
+      maybe_decoded_output.value().size(), num_samples);
   float* out_data_ptr = reinterpret_cast<float*>(out_data);
   const std::vector<int16_t>& decoded_output = maybe_decoded_output.value();
   for (int i = 0; i < num_decoded_samples; i++) {
@@ -395,7 +338,9 @@ bool DecodeWithLyra(emscripten::val encoded_data, uint32_t num_samples,
   return true;
 }
 
-bool IsCodecReady() { return encoders_initialized && decoders_initialized; }
+bool IsCodecReady() { return model_loaded; }
+
+int NumThreads() { return model_loaded ? codecs->num_threads() : 0; }
 
 int main(int argc, char* argv[]) {
   InitializeCodec();
@@ -404,6 +349,7 @@ int main(int argc, char* argv[]) {
 
 EMSCRIPTEN_BINDINGS(module) {
   emscripten::function("isCodecReady", IsCodecReady);
+  emscripten::function("numThreads", NumThreads);
   emscripten::function("encodeAndDecode", EncodeAndDecodeWithLyra,
                        emscripten::allow_raw_pointers());
   emscripten::function("EncodeWithLyra", EncodeWithLyra,
@@ -1,15 +1,108 @@
 #ifndef LYRA_CODEC_WEBASSEMBLY_CODEC_WRAPPER_H_
 #define LYRA_CODEC_WEBASSEMBLY_CODEC_WRAPPER_H_
 
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
 #include <vector>
 
 #include "encode_and_decode_lib.h"
+#include "lyra_config.h"
 #include "lyra_decoder.h"
+#include "lyra_decoder_options.h"
 #include "lyra_encoder.h"
+#include "model_store.h"
 
 namespace chromemedia {
 namespace codec {
 
+// The encoders and decoders of the wasm wrapper, one pair per sample rate.
+// The model always runs at |kInternalSampleRateHz|, so all of them share a
+// single copy of the parameters through |model_store|, and each only owns its
+// resampler and per-stream state. A pair is created on the first request for
+// its sample rate, so a page only pays for the rates it uses.
+// The decoders split the sampling across |num_threads| threads, which in the
+// threaded wasm build run as web workers.
+class SampleRateCodecs {
+ public:
+  SampleRateCodecs(std::shared_ptr<ModelStore> model_store, int num_channels,
+                   int bitrate, int num_threads = 1)
+      : model_store_(std::move(model_store)),
+        num_channels_(num_channels),
+        bitrate_(bitrate),
+        num_threads_(num_threads) {}
+
+  // Loads the shared parameters by creating the codecs of the internal sample
+  // rate. Returns false on failure.
+  bool LoadModel() {
+    return GetEncoder(kInternalSampleRateHz) != nullptr &&
+           GetDecoder(kInternalSampleRateHz) != nullptr;
+  }
+
+  // Returns nullptr if |sample_rate_hz| is not supported or the encoder could
+  // not be created.
+  LyraEncoder* GetEncoder(int sample_rate_hz) {
+    if (!IsSampleRateSupported(sample_rate_hz)) {
+      return nullptr;
+    }
+    auto& encoder = encoders_[sample_rate_hz];
+    if (encoder == nullptr) {
+      encoder = LyraEncoder::Create(sample_rate_hz, num_channels_, bitrate_,
+                                    /*enable_dtx=*/false, model_store_);
+      if (encoder == nullptr) {
+        fprintf(stderr, "Failed to create encoder for %d Hz.\n",
+                sample_rate_hz);
+      }
+    }
+    return encoder.get();
+  }
+
+  // Returns nullptr if |sample_rate_hz| is not supported or the decoder could
+  // not be created.
+  LyraDecoder* GetDecoder(int sample_rate_hz) {
+    if (!IsSampleRateSupported(sample_rate_hz)) {
+      return nullptr;
+    }
+    auto& decoder = decoders_[sample_rate_hz];
+    if (decoder == nullptr) {
+      LyraDecoderOptions options;
+      options.num_threads = num_threads_;
+      decoder = LyraDecoder::Create(sample_rate_hz, num_channels_, bitrate_,
+                                    model_store_, options);
+      if (decoder == nullptr) {
+        fprintf(stderr, "Failed to create decoder for %d Hz.\n",
+                sample_rate_hz);
+      }
+    }
+    return decoder.get();
+  }
+
+  // The number of sample rates with an encoder or decoder.
+  int num_sample_rates() const {
+    std::set<int> rates;
+    for (const auto& encoder : encoders_) {
+      if (encoder.second != nullptr) rates.insert(encoder.first);
+    }
+    for (const auto& decoder : decoders_) {
+      if (decoder.second != nullptr) rates.insert(decoder.first);
+    }
+    return rates.size();
+  }
+
+  int num_threads() const { return num_threads_; }
+
+ private:
+  const std::shared_ptr<ModelStore> model_store_;
+  const int num_channels_;
+  const int bitrate_;
+  const int num_threads_;
+  std::map<int, std::unique_ptr<LyraEncoder>> encoders_;
+  std::map<int, std::unique_ptr<LyraDecoder>> decoders_;
+};
+
 // Clone of the method exposed to wasm in webassembly_codec_wrapper.cc. Cloned
 // here for unit testing.
 bool EncodeAndDecodeWithLyra(uintptr_t data, uint32_t num_samples,
@@ -41,8 +134,10 @@ bool EncodeAndDecodeWithLyra(uintptr_t data, uint32_t num_samples,
     return false;
   }
 
-  // Convert the decoded output to float.
-  const int num_decoded_samples = maybe_decoded_output.value().size();
+  // Convert the decoded output to float. The encoder pads the last packet, so
+  // it may decode to more samples than there is room for.
+  const int num_decoded_samples = std::min<int>(
+      maybe_decoded_output.value().size(), num_samples);
   float* out_data_ptr = reinterpret_cast<float*>(out_data);
   const std::vector<int16_t>& decoded_output = maybe_decoded_output.value();
   for (int i = 0; i < num_decoded_samples; i++) {
@@ -1,9 +1,12 @@
 #include "webassembly_codec_wrapper.h"
 
+#include <iterator>
+
 #include "gmock/gmock.h"
 #include "lyra_config.h"
 #include "lyra_decoder.h"
 #include "lyra_encoder.h"
+#include "model_store.h"
 #include "runfiles_util.h"
 #include "wav_util.h"
 
@@ -74,6 +77,56 @@ TEST_F(WebassemblyCodecWrapperTest, Basic) {
   }
 }
 
+TEST(SampleRateCodecsTest, RatesShareOneModelAndAreCreatedOnUse) {
+  auto model_store = ModelStore::Create(GetModelRunfilesPathForTest());
+  SampleRateCodecs codecs(model_store, /*num_channels=*/1, /*bitrate=*/3000);
+  EXPECT_EQ(codecs.num_sample_rates(), 0);
+  EXPECT_EQ(model_store->size(), 0);
+
+  ASSERT_TRUE(codecs.LoadModel());
+  EXPECT_EQ(codecs.num_sample_rates(), 1);
+  const int model_size = model_store->size();
+  EXPECT_GT(model_size, 0);
+
+  // Further rates only add their own front end, no parameters.
+  for (int sample_rate_hz : kSupportedSampleRates) {
+    EXPECT_NE(codecs.GetEncoder(sample_rate_hz), nullptr);
+    EXPECT_NE(codecs.GetDecoder(sample_rate_hz), nullptr);
+  }
+  EXPECT_EQ(codecs.num_sample_rates(), std::size(kSupportedSampleRates));
+  EXPECT_EQ(model_store->size(), model_size);
+
+  // Repeated requests return the same instance.
+  EXPECT_EQ(codecs.GetEncoder(48000), codecs.GetEncoder(48000));
+  EXPECT_EQ(codecs.GetDecoder(48000), codecs.GetDecoder(48000));
+}
+
+TEST(SampleRateCodecsTest, UnsupportedRateHasNoCodec) {
+  SampleRateCodecs codecs(ModelStore::Create(GetModelRunfilesPathForTest()),
+                          /*num_channels=*/1, /*bitrate=*/3000);
+  EXPECT_EQ(codecs.GetEncoder(44100), nullptr);
+  EXPECT_EQ(codecs.GetDecoder(44100), nullptr);
+  EXPECT_EQ(codecs.num_sample_rates(), 0);
+}
+
+TEST(SampleRateCodecsTest, ThreadedDecoderDecodes) {
+  SampleRateCodecs codecs(ModelStore::Create(GetModelRunfilesPathForTest()),
+                          /*num_channels=*/1, /*bitrate=*/3000,
+                          /*num_threads=*/2);
+  ASSERT_TRUE(codecs.LoadModel());
+  EXPECT_EQ(codecs.num_threads(), 2);
+
+  const int num_samples = 2 * GetNumSamplesPerFrame(kInternalSampleRateHz) *
+                          kNumFramesPerPacket;
+  std::vector<float> data_to_encode(num_samples, 0.25f);
+  std::vector<float> decoded_data(num_samples, 0.0f);
+  EXPECT_TRUE(EncodeAndDecodeWithLyra(
+      reinterpret_cast<uintptr_t>(data_to_encode.data()), num_samples,
+      kInternalSampleRateHz, reinterpret_cast<uintptr_t>(decoded_data.data()),
+      codecs.GetEncoder(kInternalSampleRateHz),
+      codecs.GetDecoder(kInternalSampleRateHz)));
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
\ No newline at end of file